@@ -54,6 +54,13 @@ if(USE_LEVELDB)
   list(APPEND Caffe_LINKER_LIBS ${Snappy_LIBRARIES})
 endif()
 
+# ---[ OpenMP
+if(USE_OPENMP)
+  find_package(OpenMP REQUIRED)
+  set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} ${OpenMP_C_FLAGS}")
+  set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} ${OpenMP_CXX_FLAGS}")
+endif()
+
 # ---[ CUDA
 include(cmake/Cuda.cmake)
 if(NOT HAVE_CUDA)
@@ -92,6 +99,7 @@ if(NOT APPLE)
     find_package(OpenBLAS REQUIRED)
     include_directories(SYSTEM ${OpenBLAS_INCLUDE_DIR})
     list(APPEND Caffe_LINKER_LIBS ${OpenBLAS_LIB})
+    add_definitions(-DUSE_OPENBLAS)
   elseif(BLAS STREQUAL "MKL" OR BLAS STREQUAL "mkl")
     find_package(MKL REQUIRED)
     include_directories(SYSTEM ${MKL_INCLUDE_DIR})
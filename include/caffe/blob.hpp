@@ -217,6 +217,13 @@ class Blob {
     return diff_;
   }
 
+  /**
+   * @brief Returns the version of the data, which changes whenever it may
+   *        have been written; together with data(), it tells whether a copy
+   *        derived from the data, e.g. packed weights, is stale.
+   */
+  inline size_t data_version() const { return data()->version(); }
+
   const Dtype* cpu_data() const;
   void set_cpu_data(Dtype* data);
   const int* gpu_shape() const;
@@ -263,6 +270,36 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Make data_ a view of the count() values of the data_ of Blob
+   *        other that start at offset, so that writing this Blob writes that
+   *        part of other -- useful to have a Layer produce its top directly
+   *        in a larger Blob.
+   *
+   * The view does not keep the memory of other alive. It lasts until this
+   * Blob grows, which allocates it memory of its own again. (CPU only.)
+   */
+  void ShareDataView(const Blob& other, const int offset);
+  /// @brief As ShareDataView, for the diff_.
+  void ShareDiffView(const Blob& other, const int offset);
+  /**
+   * @brief Give the Blob fresh memory of its own for its count() values,
+   *        ending any views set by ShareDataView and ShareDiffView. The
+   *        values are not kept.
+   */
+  void ReleaseViews();
+  /**
+   * @brief Make data_ the SyncedMemory data, such as one holding a buffer
+   *        the caller owns that its deleter releases, and reshape the Blob to
+   *        shape, which must fit in it -- useful to run a Net directly on
+   *        the caller's inputs, or into the caller's outputs.
+   *
+   * Layers write tops through the data in place, so the Blob keeps it until
+   * it grows past it, or is given other data. Blobs sharing the previous
+   * data keep that.
+   */
+  void set_data(const shared_ptr<SyncedMemory>& data,
+      const vector<int>& shape);
 
   bool ShapeEquals(const BlobProto& other);
 
@@ -45,6 +45,9 @@ class DataTransformer {
    * @brief Applies the transformation defined in the data layer's
    * transform_param block to a vector of Datum.
    *
+   * The datums are transformed in parallel when the transformation makes no
+   * random choices, as in the TEST phase without mirroring.
+   *
    * @param datum_vector
    *    A vector of Datum containing the data to be transformed.
    * @param transformed_blob
@@ -135,6 +138,9 @@ class DataTransformer {
    * @brief Applies the transformation defined in the data layer's
    * transform_param block to a vector of Mat.
    *
+   * The images are transformed in parallel when the transformation makes no
+   * random choices, as in the TEST phase without noise or mirroring.
+   *
    * @param mat_vector
    *    A vector of Mat containing the data to be transformed.
    * @param transformed_blob
@@ -248,6 +254,29 @@ class DataTransformer {
   void Transform(const Datum& datum, Blob<Dtype>* transformed_blob,
                  NormalizedBBox* crop_bbox, bool* do_mirror);
 
+  /**
+   * @brief Checks that there is one mean value, or one per channel, and
+   *    replicates a single mean value across the channels.
+   */
+  void ReplicateMeanValues(const int channels);
+  /// @brief Returns the input channel each of the channels is taken from.
+  vector<int> ChannelSources(const int channels) const;
+  /// @brief Whether transforming an input may draw from the generator.
+  bool MakesRandomChoices() const;
+  // Transforms the datums [begin, end) of datum_vector into their channels x
+  // height x width items of transformed_data.
+  void TransformDatumRange(const vector<Datum>* datum_vector,
+                           Dtype* transformed_data, int channels,
+                           int height, int width, int begin, int end);
+
+#ifdef USE_OPENCV
+  // Transforms the Mats [begin, end) of mat_vector into their channels x
+  // height x width items of transformed_data.
+  void TransformRange(const vector<cv::Mat>* mat_vector,
+                      Dtype* transformed_data, int channels, int height,
+                      int width, int begin, int end);
+#endif  // USE_OPENCV
+
   // Tranformation parameters
   TransformationParameter param_;
 
@@ -0,0 +1,127 @@
+#ifndef CAFFE_INFERENCE_POOL_HPP_
+#define CAFFE_INFERENCE_POOL_HPP_
+
+#include <deque>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class InferencePool;
+
+/**
+ * @brief A forward pass queued on an InferencePool: the values of the net
+ *        inputs, and once it is done, copies of the net outputs.
+ */
+template <typename Dtype>
+class InferenceRequest {
+ public:
+  /**
+   * @brief Takes the values of the net inputs, in the order of
+   *        Net::input_blobs. Their first axis is the batch, which need not
+   *        be the batch of the net. They must not change until the request
+   *        is done.
+   */
+  explicit InferenceRequest(const vector<shared_ptr<Blob<Dtype> > >& inputs);
+
+  /// @brief Returns whether the outputs are ready, without blocking.
+  bool done() const;
+  /// @brief Blocks until the outputs are ready.
+  void Wait() const;
+
+  inline const vector<shared_ptr<Blob<Dtype> > >& inputs() const {
+    return inputs_;
+  }
+  /// @brief The net outputs, in the order of Net::output_blobs, once done.
+  inline const vector<shared_ptr<Blob<Dtype> > >& outputs() const {
+    return outputs_;
+  }
+  /// @brief The batch size, the first axis of the inputs.
+  inline int num() const { return inputs_[0]->shape(0); }
+
+ protected:
+  friend class InferencePool<Dtype>;
+  // Marks the outputs ready and wakes up the waiters.
+  void Finish();
+
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+
+  vector<shared_ptr<Blob<Dtype> > > inputs_;
+  vector<shared_ptr<Blob<Dtype> > > outputs_;
+  bool done_;
+  shared_ptr<sync> sync_;
+
+  DISABLE_COPY_AND_ASSIGN(InferenceRequest);
+};
+
+/**
+ * @brief Runs forward passes submitted from any thread on worker threads,
+ *        each with its own replica of a TEST phase net (see
+ *        Net::CreateReplica), so that callers overlap their own work with
+ *        inference, and requests run concurrently.
+ *
+ * A worker takes the oldest request and, if max_batch_size > 1, the requests
+ * queued right behind it whose inputs have the same shape past the first
+ * axis, as long as their batches add up to at most max_batch_size, and runs
+ * them as one batch. The net outputs must then be batched along their first
+ * axis too. The workers run in the Caffe mode, and on the device, current
+ * when the pool is created. The net must not be changed while the pool is
+ * alive.
+ */
+template <typename Dtype>
+class InferencePool {
+ public:
+  InferencePool(const shared_ptr<Net<Dtype> >& net, const int num_workers,
+      const int max_batch_size);
+  ~InferencePool();
+
+  /// @brief Queues request, and returns at once.
+  void Submit(const shared_ptr<InferenceRequest<Dtype> >& request);
+  /// @brief Queues a forward pass of inputs, and returns at once.
+  shared_ptr<InferenceRequest<Dtype> > Submit(
+      const vector<shared_ptr<Blob<Dtype> > >& inputs);
+  /**
+   * @brief Finishes the queued requests and stops the workers; nothing may
+   *        be submitted afterwards. The destructor calls it.
+   */
+  void Stop();
+
+  inline const shared_ptr<Net<Dtype> >& net() const { return net_; }
+  inline int num_workers() const { return replicas_.size(); }
+  inline int max_batch_size() const { return max_batch_size_; }
+
+ protected:
+  /**
+   * @brief Takes the next batch of requests off the queue into batch,
+   *        blocking until there is one. Returns false once the pool stops
+   *        and the queue is empty.
+   */
+  bool Next(vector<shared_ptr<InferenceRequest<Dtype> > >* batch);
+  /// @brief Runs a batch of requests on replica and fills their outputs.
+  void Run(Net<Dtype>* replica,
+      const vector<shared_ptr<InferenceRequest<Dtype> > >& batch);
+  void WorkerEntry(Net<Dtype>* replica, Caffe::Brew mode, int device);
+
+  class sync;
+
+  shared_ptr<Net<Dtype> > net_;
+  vector<shared_ptr<Net<Dtype> > > replicas_;
+  const int max_batch_size_;
+  std::deque<shared_ptr<InferenceRequest<Dtype> > > queue_;
+  bool stopping_;
+  shared_ptr<sync> sync_;
+
+  DISABLE_COPY_AND_ASSIGN(InferencePool);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_INFERENCE_POOL_HPP_
@@ -38,7 +38,7 @@ class Layer {
    * layer.
    */
   explicit Layer(const LayerParameter& param)
-    : layer_param_(param), is_shared_(false) {
+    : layer_param_(param), channels_last_(false), is_shared_(false) {
       // Set phase and copy blobs (if there are any).
       phase_ = param.phase();
       if (layer_param_.blobs_size() > 0) {
@@ -316,6 +316,43 @@ class Layer {
     param_propagate_down_[param_id] = value;
   }
 
+  /**
+   * @brief Returns whether Forward_cpu can run on bottom and top blobs that
+   *        hold their N x C x H x W values channels-last, as N x H x W x C.
+   *
+   * The blob shapes stay N x C x H x W; only the order of the values in
+   * memory changes. Layers that are indifferent to the order of their
+   * values, like element-wise ones, can simply return true.
+   */
+  virtual inline bool SupportsChannelsLast() const { return false; }
+  /**
+   * @brief Returns whether the layer is faster channels-last, so that a
+   *        chain of channels-last layers may start with it.
+   */
+  virtual inline bool PrefersChannelsLast() const { return false; }
+  /**
+   * @brief Shares the copies the layer derives from its weights, such as its
+   *        packed weights, with other, a layer of the same type and
+   *        parameters whose weights this one shares, so that they are built
+   *        once for both. Only called by Net::CreateReplica.
+   */
+  virtual void ShareDerivedWeights(Layer* other) {}
+  /**
+   * @brief Returns whether the top is only a view of the bottom: it shares
+   *        the bottom's data and diff, from Reshape, Forward or Backward on,
+   *        and the layer itself never writes them.
+   */
+  virtual inline bool ViewsBottom() const { return false; }
+  /**
+   * @brief Sets whether Forward_cpu runs channels-last; only called by
+   *        Net, for layers that return true from SupportsChannelsLast().
+   */
+  inline void set_channels_last(const bool value) {
+    CHECK(!value || SupportsChannelsLast())
+        << type() << " layer does not support channels-last blobs.";
+    channels_last_ = value;
+  }
+  inline bool channels_last() const { return channels_last_; }
 
  protected:
   /** The protobuf that stores the layer parameters */
@@ -330,6 +367,8 @@ class Layer {
   /** The vector that indicates whether each top blob has a non-zero weight in
    *  the objective function. */
   vector<Dtype> loss_;
+  /** Whether Forward_cpu runs on channels-last blobs. */
+  bool channels_last_;
 
   /** @brief Using the CPU device, compute the layer output. */
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -1,12 +1,15 @@
 #ifndef CAFFE_BASE_CONVOLUTION_LAYER_HPP_
 #define CAFFE_BASE_CONVOLUTION_LAYER_HPP_
 
+#include <stdint.h>
+
 #include <vector>
 
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/im2col.hpp"
+#include "caffe/util/packed_gemm.hpp"
 
 namespace caffe {
 
@@ -27,11 +30,13 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   virtual inline int MinBottomBlobs() const { return 1; }
   virtual inline int MinTopBlobs() const { return 1; }
   virtual inline bool EqualNumBottomTopBlobs() const { return true; }
+  virtual void ShareDerivedWeights(Layer<Dtype>* other);
 
  protected:
   // Helper functions that abstract away the column buffer and gemm arguments.
   // The last argument in forward_cpu_gemm is so that we can skip the im2col if
-  // we just called weight_cpu_gemm with the same input.
+  // we just called weight_cpu_gemm with the same input. With packed or int8
+  // weights, forward_cpu_gemm multiplies by those, made from blobs_[0].
   void forward_cpu_gemm(const Dtype* input, const Dtype* weights,
       Dtype* output, bool skip_im2col = false);
   void forward_cpu_bias(Dtype* output, const Dtype* bias);
@@ -40,6 +45,12 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
       weights);
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
+  // Adds the bias, unless NULL, to one output image, and applies the fused
+  // activation, if any, in the same pass.
+  void forward_cpu_bias_activation(Dtype* output, const Dtype* bias);
+  // Convolves one channels-last image into a channels-last output, with the
+  // bias and activation; 2D, with a single group, only.
+  void forward_cpu_channels_last(const Dtype* input, Dtype* output);
 
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -50,6 +61,7 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   void weight_gpu_gemm(const Dtype* col_input, const Dtype* output, Dtype*
       weights);
   void backward_gpu_bias(Dtype* bias, const Dtype* input);
+  void forward_gpu_activation(Dtype* output);
 #endif
 
   /// @brief The spatial dimensions of the input.
@@ -90,8 +102,38 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   int weight_offset_;
   int num_output_;
   bool bias_term_;
+  /// @brief The activation applied to the output; its PReLU slopes, if any,
+  ///        are the last blob.
+  FusedActivationParameter fused_activation_;
+  bool fuse_activation_;
+  /// @brief Whether Forward runs in int8.
+  bool quantize_;
+  /// @brief Whether forward_cpu_gemm multiplies by weights packed once for
+  ///        the packed GEMM, rather than passing them to caffe_cpu_gemm.
+  bool use_packed_weights_;
+  /// @brief How many output rows the CPU column buffer holds at a time, or
+  ///        0 if it holds whole images.
+  int col_strip_rows_;
   bool is_1x1_;
   bool force_nd_im2col_;
+  // The copies derived from the weights, each with the data it was made
+  // from, shared with the replicas of the layer (see ShareDerivedWeights):
+  // the weights packed for the fp32 GEMM, each group apart, or quantized to
+  // int8 with their per output channel scales; the weights reordered to
+  // num_output x kernel_h x kernel_w x channels, to match the channels-last
+  // column buffer; and the Winograd-transformed filters of ConvolutionLayer.
+  struct DerivedWeights {
+    WeightMutex mutex;
+    BlobDataVersion version;
+    vector<Dtype> packed;
+    vector<int8_t> int8;
+    vector<Dtype> scales;
+    BlobDataVersion channels_last_version;
+    vector<Dtype> channels_last;
+    BlobDataVersion winograd_version;
+    vector<Dtype> winograd;
+  };
+  shared_ptr<DerivedWeights> derived_weights_;
 
  private:
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
@@ -123,6 +165,27 @@ class BaseConvolutionLayer : public Layer<Dtype> {
           pad_.cpu_data(), stride_.cpu_data(), dilation_.cpu_data(), data);
     }
   }
+  // Expand and roll up only the output rows [first_row, first_row + rows).
+  inline void conv_im2col_rows_cpu(const Dtype* data, const int first_row,
+      const int rows, Dtype* col_buff) {
+    im2col_rows_cpu(data, conv_in_channels_,
+        conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
+        kernel_shape_.cpu_data()[0], kernel_shape_.cpu_data()[1],
+        pad_.cpu_data()[0], pad_.cpu_data()[1],
+        stride_.cpu_data()[0], stride_.cpu_data()[1],
+        dilation_.cpu_data()[0], dilation_.cpu_data()[1], first_row, rows,
+        col_buff);
+  }
+  inline void conv_col2im_rows_cpu(const Dtype* col_buff, const int first_row,
+      const int rows, Dtype* data) {
+    col2im_rows_cpu(col_buff, conv_in_channels_,
+        conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
+        kernel_shape_.cpu_data()[0], kernel_shape_.cpu_data()[1],
+        pad_.cpu_data()[0], pad_.cpu_data()[1],
+        stride_.cpu_data()[0], stride_.cpu_data()[1],
+        dilation_.cpu_data()[0], dilation_.cpu_data()[1], first_row, rows,
+        data);
+  }
 #ifndef CPU_ONLY
   inline void conv_im2col_gpu(const Dtype* data, Dtype* col_buff) {
     if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
@@ -167,6 +230,24 @@ class BaseConvolutionLayer : public Layer<Dtype> {
 
   Blob<Dtype> col_buffer_;
   Blob<Dtype> bias_multiplier_;
+
+  // The CPU GEMM helpers for a column buffer of col_strip_rows_ rows.
+  void forward_cpu_gemm_strips(const Dtype* input, const Dtype* weights,
+      Dtype* output);
+  void backward_cpu_gemm_strips(const Dtype* output, const Dtype* weights,
+      Dtype* input);
+  void weight_cpu_gemm_strips(const Dtype* input, const Dtype* output,
+      Dtype* weights);
+
+  // Packs the weights, or quantizes them for int8 inference, if they have
+  // changed since they were last packed.
+  void pack_weights();
+  void forward_cpu_gemm_int8(const Dtype* input, const Dtype* col_buff,
+      Dtype* output);
+  // Buffers for the packed int8 column buffer and the int32 output of one
+  // group.
+  vector<uint8_t> col_packed_;
+  vector<int32_t> output_int32_;
 };
 
 }  // namespace caffe
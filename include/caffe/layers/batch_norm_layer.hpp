@@ -49,6 +49,10 @@ class BatchNormLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "BatchNorm"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  // Only with the stored statistics, which do not reduce over the batch.
+  virtual inline bool SupportsChannelsLast() const {
+    return use_global_stats_;
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -59,6 +63,7 @@ class BatchNormLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  void forward_cpu_channels_last(const int pixels, Dtype* top_data);
 
   Blob<Dtype> mean_, variance_, temp_, x_norm_;
   bool use_global_stats_;
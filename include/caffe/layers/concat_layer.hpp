@@ -26,6 +26,24 @@ class ConcatLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "Concat"; }
   virtual inline int MinBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  // Images concatenate the same either way; channels interleave per pixel.
+  virtual inline bool SupportsChannelsLast() const {
+    return concat_axis_ <= 1;
+  }
+  /**
+   * @brief Places the data of the bottoms flagged in data, and the diffs of
+   *        those flagged in diff, in the top, where the concatenation is
+   *        contiguous, so that their producers write it directly and Forward
+   *        and Backward copy nothing for them. Only called by Net, which
+   *        knows that nothing else shares or modifies those bottoms; see
+   *        NetParameter.zero_copy_concat. (CPU only.)
+   *
+   * A bottom that is only a view of another blob, like a Flatten top, lists
+   * in sources the blobs it views, in turn, down to the one its producer
+   * writes, which is placed instead; the bottom and the others share it.
+   */
+  void set_bottom_views(const vector<bool>& data, const vector<bool>& diff,
+      const vector<vector<Blob<Dtype>*> >& sources);
 
  protected:
   /**
@@ -76,10 +94,27 @@ class ConcatLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  /// @brief Points the flagged bottoms at their place in the top, moving
+  ///        their values there, or back to memory of their own where the
+  ///        concatenation stopped being contiguous.
+  void ViewBottoms(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
   int count_;
   int num_concats_;
   int concat_input_size_;
   int concat_axis_;
+  /// Which bottoms to place in the top, and the memory of those placed,
+  /// to tell whether they still are.
+  vector<bool> view_data_;
+  vector<bool> view_diff_;
+  vector<vector<Blob<Dtype>*> > sources_;
+  vector<shared_ptr<SyncedMemory> > data_views_;
+  vector<shared_ptr<SyncedMemory> > diff_views_;
+  /// The top memory the views point into, kept alive until they are moved,
+  /// should the top be reallocated.
+  shared_ptr<SyncedMemory> viewed_data_;
+  shared_ptr<SyncedMemory> viewed_diff_;
 };
 
 }  // namespace caffe
@@ -59,12 +59,27 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
    *  group.
    *  - bias_term (\b optional, default true). Whether to have a bias.
    *  - engine: convolution has CAFFE (matrix multiplication) and CUDNN (library
-   *    kernels + stream parallelism) engines.
+   *    kernels + stream parallelism) engines, and WINOGRAD (Winograd minimal
+   *    filtering, for CPU Forward of 3x3 convolutions with stride 1).
+   *  - winograd_tile (\b optional, default 0). The output tile size of the
+   *    WINOGRAD engine, 2 or 4; 0 picks one by the output size.
    */
   explicit ConvolutionLayer(const LayerParameter& param)
       : BaseConvolutionLayer<Dtype>(param) {}
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Convolution"; }
+  // Channels-last, the column buffer copies whole runs of channels and the
+  // output comes straight out of the GEMM, pixel by pixel; Winograd stays
+  // channels-first.
+  virtual inline bool SupportsChannelsLast() const {
+    return this->num_spatial_axes_ == 2 && this->group_ == 1 &&
+        !this->quantize_ && !this->force_nd_im2col_ && !use_winograd_;
+  }
+  virtual inline bool PrefersChannelsLast() const {
+    return SupportsChannelsLast();
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -77,6 +92,22 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual inline bool reverse_dimensions() { return false; }
   virtual void compute_output_shape();
+
+  // Whether Winograd minimal filtering can compute this convolution.
+  bool winograd_eligible();
+  void forward_cpu_winograd(const Dtype* input, Dtype* output);
+
+  /// @brief Whether Forward_cpu uses Winograd minimal filtering.
+  bool use_winograd_;
+  int winograd_tile_;
+  int winograd_tiles_h_;
+  int winograd_tiles_w_;
+  // How many tiles, over all images of the batch, each GEMM covers.
+  int winograd_chunk_;
+  // The transformed input tiles and their products with the transformed
+  // filters (see DerivedWeights), for one chunk of tiles.
+  vector<Dtype> winograd_V_;
+  vector<Dtype> winograd_M_;
 };
 
 }  // namespace caffe
@@ -28,6 +28,7 @@ class EltwiseLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "Eltwise"; }
   virtual inline int MinBottomBlobs() const { return 2; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual inline bool SupportsChannelsLast() const { return true; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -38,6 +39,8 @@ class EltwiseLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  void forward_cpu_range(const vector<const Dtype*>& bottom_data,
+      Dtype* top_data, int* mask, const int begin, const int end);
 
   EltwiseParameter_EltwiseOp op_;
   vector<Dtype> coeffs_;
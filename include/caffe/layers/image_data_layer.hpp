@@ -14,6 +14,8 @@
 
 namespace caffe {
 
+class ImageCache;
+
 /**
  * @brief Provides data to the Net from image files.
  *
@@ -39,6 +41,8 @@ class ImageDataLayer : public BasePrefetchingDataLayer<Dtype> {
 
   vector<std::pair<std::string, int> > lines_;
   int lines_id_;
+  // Set when image_data_param.cache_mb is.
+  shared_ptr<ImageCache> image_cache_;
 };
 
 
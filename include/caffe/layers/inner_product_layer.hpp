@@ -1,11 +1,14 @@
 #ifndef CAFFE_INNER_PRODUCT_LAYER_HPP_
 #define CAFFE_INNER_PRODUCT_LAYER_HPP_
 
+#include <stdint.h>
+
 #include <vector>
 
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/packed_gemm.hpp"
 
 namespace caffe {
 
@@ -28,6 +31,7 @@ class InnerProductLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "InnerProduct"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual void ShareDerivedWeights(Layer<Dtype>* other);
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -38,6 +42,11 @@ class InnerProductLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  // Packs the weights, or quantizes them for int8 inference, if they have
+  // changed since they were last packed.
+  void pack_weights();
+  // Computes the inner product with int8 products (see QuantizationParameter).
+  void Forward_cpu_int8(const Dtype* bottom_data, Dtype* top_data);
 
   int M_;
   int K_;
@@ -45,6 +54,29 @@ class InnerProductLayer : public Layer<Dtype> {
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
   bool transpose_;  ///< if true, assume transposed weights
+  /// The activation applied to the output; its PReLU slopes, if any, are the
+  /// last blob.
+  FusedActivationParameter fused_activation_;
+  bool fuse_activation_;
+  /// Whether Forward multiplies by weights packed once for the packed GEMM.
+  bool use_packed_weights_;
+  /// Whether Forward runs in int8, and buffers for the quantized input and
+  /// int32 output.
+  bool quantize_;
+  vector<int8_t> bottom_int8_;
+  vector<Dtype> bottom_scales_;
+  vector<int32_t> top_int32_;
+  /// The weights packed for the packed GEMM, or quantized and packed for the
+  /// int8 GEMM with their per output scales, and the data they were made
+  /// from; shared with the replicas of the layer (see ShareDerivedWeights).
+  struct DerivedWeights {
+    WeightMutex mutex;
+    BlobDataVersion version;
+    vector<Dtype> packed;
+    vector<uint8_t> int8_packed;
+    vector<Dtype> scales;
+  };
+  shared_ptr<DerivedWeights> derived_weights_;
 };
 
 }  // namespace caffe
@@ -47,6 +47,8 @@ class LRNLayer : public Layer<Dtype> {
       const vector<Blob<Dtype>*>& top);
   virtual void CrossChannelForward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
+  void CrossChannelForward_cpu_rows(const Dtype* bottom_data,
+      Dtype* top_data, Dtype* scale_data, const int begin, const int end);
   virtual void WithinChannelForward(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void CrossChannelBackward_cpu(const vector<Blob<Dtype>*>& top,
@@ -33,6 +33,13 @@ class PoolingLayer : public Layer<Dtype> {
     return (this->layer_param_.pooling_param().pool() ==
             PoolingParameter_PoolMethod_MAX) ? 2 : 1;
   }
+  // MAX and AVE pooling without a mask top run channels-last, vectorized
+  // over the channels of each pixel.
+  virtual inline bool SupportsChannelsLast() const {
+    return this->layer_param_.top_size() == 1 &&
+        this->layer_param_.pooling_param().pool() !=
+        PoolingParameter_PoolMethod_STOCHASTIC;
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -43,6 +50,16 @@ class PoolingLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  void forward_cpu_channels_last(const Dtype* bottom_data, Dtype* top_data,
+      const int begin, const int end);
+  void forward_cpu_max(const Dtype* bottom_data, Dtype* top_data, int* mask,
+      Dtype* top_mask, const int begin, const int end);
+  void forward_cpu_unmasked(const Dtype* bottom_data, Dtype* top_data,
+      const int begin, const int end);
+  void forward_cpu_stochastic(const Dtype* bottom_data, Dtype* top_data,
+      Dtype* rand_idx, const int begin, const int end);
+  Dtype pool_window(const Dtype* bottom, const int ph, const int pw,
+      const bool max_pool) const;
 
   int kernel_h_, kernel_w_;
   int stride_h_, stride_w_;
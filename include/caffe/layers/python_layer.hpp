@@ -10,6 +10,22 @@ namespace bp = boost::python;
 
 namespace caffe {
 
+/**
+ * @brief Holds the GIL for its scope. Nets may run on threads that released
+ *        it, as pycaffe's forward and backward and the InferencePool workers
+ *        do, so every call into Python takes it first.
+ */
+class PyGILLock {
+ public:
+  PyGILLock() : state_(PyGILState_Ensure()) {}
+  ~PyGILLock() { PyGILState_Release(state_); }
+
+ private:
+  PyGILState_STATE state_;
+
+  DISABLE_COPY_AND_ASSIGN(PyGILLock);
+};
+
 template <typename Dtype>
 class PythonLayer : public Layer<Dtype> {
  public:
@@ -24,6 +40,7 @@ class PythonLayer : public Layer<Dtype> {
         && !ShareInParallel()) {
       LOG(FATAL) << "PythonLayer is not implemented in Multi-GPU training";
     }
+    PyGILLock lock;
     self_.attr("param_str") = bp::str(
         this->layer_param_.python_param().param_str());
     self_.attr("phase") = static_cast<int>(this->phase_);
@@ -31,6 +48,7 @@ class PythonLayer : public Layer<Dtype> {
   }
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+    PyGILLock lock;
     self_.attr("reshape")(bottom, top);
   }
 
@@ -43,10 +61,12 @@ class PythonLayer : public Layer<Dtype> {
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+    PyGILLock lock;
     self_.attr("forward")(bottom, top);
   }
   virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+    PyGILLock lock;
     self_.attr("backward")(top, propagate_down, bottom);
   }
 
@@ -104,6 +104,8 @@ class SoftmaxWithLossLayer : public LossLayer<Dtype> {
   shared_ptr<Layer<Dtype> > softmax_layer_;
   /// prob stores the output probability predictions from the SoftmaxLayer.
   Blob<Dtype> prob_;
+  /// log_norm holds the log of the softmax normalizer of each prediction.
+  Blob<Dtype> log_norm_;
   /// bottom vector holder used in call to the underlying SoftmaxLayer::Forward
   vector<Blob<Dtype>*> softmax_bottom_vec_;
   /// top vector holder used in call to the underlying SoftmaxLayer::Forward
@@ -0,0 +1,135 @@
+#ifndef CAFFE_STREAM_DATA_LAYER_HPP_
+#define CAFFE_STREAM_DATA_LAYER_HPP_
+
+#include <deque>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/base_data_layer.hpp"
+
+namespace caffe {
+
+template <typename Dtype> class StreamDataLayer;
+
+/**
+ * @brief A sample queued on a StreamDataLayer, and the slot its results come
+ *        back in.
+ */
+template <typename Dtype>
+class StreamDataRequest {
+ public:
+  /// @brief Blocks until the results are in.
+  void Wait();
+  /// @brief Blocks up to timeout_us for the results; returns whether they
+  ///        are in.
+  bool TimedWait(const int timeout_us);
+  bool done() const;
+  /**
+   * @brief The results, once done(): the request's item of each of the
+   *        blobs the serving loop passed to StreamDataLayer::CompleteBatch.
+   */
+  inline const vector<vector<Dtype> >& results() const { return results_; }
+
+ private:
+  friend class StreamDataLayer<Dtype>;
+  explicit StreamDataRequest(Datum* datum);
+
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+
+  // Swapped out into the batch that takes the request.
+  Datum datum_;
+  vector<vector<Dtype> > results_;
+  shared_ptr<sync> sync_;
+
+  DISABLE_COPY_AND_ASSIGN(StreamDataRequest);
+};
+
+/**
+ * @brief Provides data to the Net from samples that client threads queue one
+ *        at a time, for online serving.
+ *
+ * Each Forward takes a micro-batch off the queue: it waits for a sample, then
+ * for the batch to fill up to batch_size until the oldest sample has waited
+ * max_latency_us, and transforms the samples of the batch in parallel. The
+ * batch, and so the net's blobs, holds as many samples as were taken. The
+ * serving loop then calls CompleteBatch with the net's outputs, which hands
+ * each request its results and wakes its client:
+ *
+ *     while (serving) {
+ *       if (layer->WaitForRequest(100000)) {
+ *         net->Forward();
+ *         layer->CompleteBatch(net->output_blobs());
+ *       }
+ *     }
+ */
+template <typename Dtype>
+class StreamDataLayer : public BaseDataLayer<Dtype> {
+ public:
+  explicit StreamDataLayer(const LayerParameter& param);
+  virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  virtual inline const char* type() const { return "StreamData"; }
+  virtual inline int ExactNumBottomBlobs() const { return 0; }
+  virtual inline int ExactNumTopBlobs() const { return 2; }
+
+  /**
+   * @brief Queues datum, blocking while the queue is full, and returns the
+   *        request to wait on for its results. Safe to call from any thread.
+   *        Swaps the contents out of datum rather than copying them.
+   */
+  shared_ptr<StreamDataRequest<Dtype> > Enqueue(Datum* datum);
+#ifdef USE_OPENCV
+  /// @brief Queues an 8-bit image, as a Datum, with its label.
+  shared_ptr<StreamDataRequest<Dtype> > Enqueue(const cv::Mat& cv_img,
+      const int label);
+#endif  // USE_OPENCV
+
+  /**
+   * @brief Blocks up to timeout_us for a request to be queued; returns
+   *        whether one is, so that a serving loop can also stop.
+   */
+  bool WaitForRequest(const int timeout_us);
+  /**
+   * @brief Hands each request of the batch of the last Forward its item of
+   *        each of outputs, whose first axis runs over the batch, and wakes
+   *        its client.
+   */
+  void CompleteBatch(const vector<Blob<Dtype>*>& outputs);
+
+  /// @brief The requests of the batch of the last Forward, until completed.
+  inline const vector<shared_ptr<StreamDataRequest<Dtype> > >& batch() const {
+    return batch_;
+  }
+  /// @brief The number of requests waiting in the queue.
+  int queued() const;
+
+  int batch_size() { return batch_size_; }
+  int channels() { return channels_; }
+  int height() { return height_; }
+  int width() { return width_; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  class sync;
+
+  int batch_size_, channels_, height_, width_;
+  int max_latency_us_, queue_size_;
+  std::deque<shared_ptr<StreamDataRequest<Dtype> > > queue_;
+  shared_ptr<sync> sync_;
+  vector<shared_ptr<StreamDataRequest<Dtype> > > batch_;
+  vector<Datum> batch_datums_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_STREAM_DATA_LAYER_HPP_
@@ -14,6 +14,8 @@
 
 namespace caffe {
 
+class ImageCache;
+
 /**
  * @brief Provides data to the Net from windows of images files, specified
  *        by a window data file.
@@ -36,6 +38,17 @@ class WindowDataLayer : public BasePrefetchingDataLayer<Dtype> {
  protected:
   virtual unsigned int PrefetchRand();
   virtual void load_batch(Batch<Dtype>* batch);
+#ifdef USE_OPENCV
+  // Loads the images of image_database_ at image_ids [begin, end) into
+  // images, leaving the ones it fails to load empty.
+  void LoadImages(const vector<int>* image_ids, vector<cv::Mat>* images,
+      int begin, int end);
+  // Crops the windows of items [begin, end) out of their images, warps them
+  // and writes them into top_data.
+  void WarpWindows(const vector<vector<float> >* windows,
+      const vector<int>* mirrors, const vector<cv::Mat>* images,
+      Dtype* top_data, int begin, int end);
+#endif  // USE_OPENCV
 
   shared_ptr<Caffe::RNG> prefetch_rng_;
   vector<std::pair<std::string, vector<int> > > image_database_;
@@ -48,6 +61,8 @@ class WindowDataLayer : public BasePrefetchingDataLayer<Dtype> {
   bool has_mean_values_;
   bool cache_images_;
   vector<std::pair<std::string, Datum > > image_database_cache_;
+  // Set when window_data_param.cache_mb is.
+  shared_ptr<ImageCache> image_cache_;
 };
 
 }  // namespace caffe
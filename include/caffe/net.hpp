@@ -11,6 +11,7 @@
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/mapped_weights.hpp"
 
 namespace caffe {
 
@@ -100,11 +101,56 @@ class Net {
    */
   void ShareWeights();
 
+  /**
+   * @brief Moves the data and diff of all learnable params into two
+   *        contiguous, cache-line aligned host arenas and leaves the param
+   *        blobs as views into them. Values are preserved.
+   *
+   * In CPU mode Update, ClearParamDiffs and the solvers then stream over each
+   * arena in one pass instead of visiting every blob. Reshaping a learnable
+   * param to a larger size detaches it from the arena; call this again then.
+   */
+  void MakeLearnableParamsContiguous();
+  /// @brief Whether every learnable param is still a view into the arena.
+  bool learnable_params_contiguous() const;
+  /**
+   * @brief Host pointers to the start of the param data/diff arenas. Every
+   *        learnable param is synced to the host first (and marked as
+   *        modified there by the mutable versions), so the whole arena may be
+   *        read or written directly. Requires learnable_params_contiguous().
+   */
+  const Dtype* learnable_params_cpu_data();
+  Dtype* mutable_learnable_params_cpu_data();
+  const Dtype* learnable_params_cpu_diff();
+  Dtype* mutable_learnable_params_cpu_diff();
+  /// @brief Arena offset of each learnable param, in elements.
+  inline const vector<size_t>& learnable_params_offsets() const {
+    return learnable_params_offsets_;
+  }
+  /// @brief Number of elements in each arena, including alignment padding.
+  inline size_t learnable_params_arena_count() const {
+    return learnable_params_arena_count_;
+  }
+
   /**
    * @brief For an already initialized net, implicitly copies (i.e., using no
    *        additional memory) the pre-trained layers from another Net.
    */
   void ShareTrainedLayersWith(const Net* other);
+  /**
+   * @brief Creates a net with the same definition whose layers share this
+   *        net's weights, but which has its own activations.
+   *
+   * Replicas may run Forward concurrently, one thread each (set the Caffe
+   * mode and device in every thread), as long as nothing writes to the
+   * weights meanwhile. The weights are synced up front, so that reading
+   * them never writes to the shared SyncedMemory. The copies layers derive
+   * from the weights, such as packed or int8 weights, are shared too, and
+   * built once, by the first replica to need them. Only TEST phase nets can
+   * be replicated, since training writes to the weights. This net, which
+   * owns the weight storage, must outlive its replicas.
+   */
+  shared_ptr<Net> CreateReplica() const;
   // For an already initialized net, CopyTrainedLayersFrom() copies the already
   // trained layers from another net parameter instance.
   /**
@@ -115,6 +161,13 @@ class Net {
   void CopyTrainedLayersFrom(const string trained_filename);
   void CopyTrainedLayersFromBinaryProto(const string trained_filename);
   void CopyTrainedLayersFromHDF5(const string trained_filename);
+  /**
+   * @brief Maps a weight file written by WriteMappedWeights and points the
+   *        layer blobs directly at the mapping where the types allow it, so
+   *        that no copy of the weights is made. Blobs of contiguous nets, and
+   *        blobs stored with the other floating point type, are copied.
+   */
+  void CopyTrainedLayersFromMapped(const string trained_filename);
   /// @brief Writes the net to a proto.
   void ToProto(NetParameter* param, bool write_diff = false) const;
   /// @brief Writes the net to an HDF5 file.
@@ -211,7 +264,18 @@ class Net {
     return net_output_blob_indices_;
   }
   bool has_blob(const string& blob_name) const;
+  /**
+   * @brief Returns the blob named blob_name, reordered channels-first if the
+   *        last Forward left it channels-last; see NetParameter.channels_last.
+   */
   const shared_ptr<Blob<Dtype> > blob_by_name(const string& blob_name) const;
+  /**
+   * @brief Reorders every blob that the last Forward left channels-last back
+   *        to channels-first, for callers that read blobs() directly, such as
+   *        pycaffe. Forward only hands back its inputs, its outputs and the
+   *        tops of the last layer it runs channels-first.
+   */
+  void RestoreChannelsFirst() const;
   bool has_layer(const string& layer_name) const;
   const shared_ptr<Layer<Dtype> > layer_by_name(const string& layer_name) const;
 
@@ -248,9 +312,20 @@ class Net {
   void BackwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Update.
   void UpdateDebugInfo(const int param_id);
+  /// @brief Decides which layers run channels-last in CPU Forward; see
+  ///        NetParameter.channels_last.
+  void PlanChannelsLast();
+  /// @brief Reorders the values of blob in place to the given layout, unless
+  ///        they are in it already.
+  void ConvertLayout(Blob<Dtype>* blob, const bool channels_last) const;
+  /// @brief Decides which Concat bottoms are produced in place in the
+  ///        Concat top; see NetParameter.zero_copy_concat.
+  void PlanZeroCopyConcat();
 
   /// @brief The network name
   string name_;
+  /// @brief The definition the net was initialized from, without weights
+  NetParameter param_;
   /// @brief The phase: TRAIN or TEST
   Phase phase_;
   /// @brief Individual layers in the net
@@ -302,10 +377,31 @@ class Net {
   /// the weight decay multipliers for learnable_params_
   vector<float> params_weight_decay_;
   vector<bool> has_params_decay_;
+  /// Contiguous host storage for learnable_params_ data and diff, and the
+  /// offset of each param in it; see MakeLearnableParamsContiguous.
+  shared_ptr<SyncedMemory> params_data_arena_;
+  shared_ptr<SyncedMemory> params_diff_arena_;
+  vector<size_t> learnable_params_offsets_;
+  size_t learnable_params_arena_count_;
+  /// The SyncedMemory views handed out to learnable_params_, used to detect
+  /// params that were reallocated since.
+  vector<SyncedMemory*> params_data_views_;
+  vector<SyncedMemory*> params_diff_views_;
+  /// Weight files some layer blobs may point into; see
+  /// CopyTrainedLayersFromMapped.
+  vector<shared_ptr<MappedWeights> > mapped_weights_;
   /// The bytes of memory used by this net
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
+  /// Whether to run layers channels-last in CPU Forward, the memory of the
+  /// blobs that currently hold channels-last values, and a buffer for
+  /// reordering them; mutable, as reading a blob reorders it.
+  bool channels_last_;
+  mutable set<const SyncedMemory*> channels_last_data_;
+  mutable vector<Dtype> channels_last_buffer_;
+  /// Whether to produce Concat bottoms in place in the Concat top.
+  bool zero_copy_concat_;
   /// The root net that actually holds the shared layers in data parallelism
   const Net* const root_net_;
   DISABLE_COPY_AND_ASSIGN(Net);
@@ -8,6 +8,28 @@
 
 namespace caffe {
 
+/**
+ * @brief The gradient preprocessing folded into the fused CPU updates:
+ *        g <- scale * g + l2_decay * w + l1_decay * sign(w), where scale
+ *        combines gradient clipping and iter_size normalization.
+ *
+ * Only one of the decays is non-zero; keeping both terms keeps the inner
+ * loops of the fused kernels branch-free.
+ */
+template <typename Dtype>
+struct FusedGradient {
+  FusedGradient(Dtype scale, Dtype l2_decay, Dtype l1_decay)
+      : scale_(scale), l2_decay_(l2_decay), l1_decay_(l1_decay) {}
+  inline Dtype operator()(Dtype w, Dtype g) const {
+    const Dtype sign_w = (Dtype(0) < w) - (w < Dtype(0));
+    return scale_ * g + l2_decay_ * w + l1_decay_ * sign_w;
+  }
+  Dtype scale_, l2_decay_, l1_decay_;
+};
+
+// Parameters smaller than this are updated on the calling thread only.
+const int kFusedUpdateParallelThreshold = 32768;
+
 /**
  * @brief Optimizes the parameters of a Net using
  *        stochastic gradient descent (SGD) with momentum.
@@ -25,12 +47,40 @@ class SGDSolver : public Solver<Dtype> {
 
  protected:
   void PreSolve();
+  /**
+   * @brief If the net's learnable params are contiguous, moves history_ into
+   *        one arena laid out like the param arena, one set per
+   *        learnable_params() pass. Called again whenever history_ grows.
+   */
+  void MakeHistoryContiguous();
   Dtype GetLearningRate();
   virtual void ApplyUpdate();
   virtual void Normalize(int param_id);
   virtual void Regularize(int param_id);
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  /**
+   * @brief Single pass CPU replacement for Normalize, Regularize,
+   *        ComputeUpdateValue and Blob::Update over learnable params
+   *        [begin, end), used when solver_param.fused_update is set. The
+   *        params share their lr and decay multipliers. Leaves the update
+   *        value in the param diff, as the unfused path does.
+   */
+  virtual void ComputeFusedUpdate(int begin, int end, Dtype rate,
+      const FusedGradient<Dtype>& gradient);
+  FusedGradient<Dtype> GetFusedGradient(int param_id, Dtype clip_scale);
+  /**
+   * @brief Points data, diff and history (one pointer per history set) at
+   *        learnable params [begin, end) and returns their count. More than
+   *        one param requires history_contiguous(); the span then covers
+   *        them and the arena padding between them.
+   */
+  int GetFusedUpdateSpan(int begin, int end, Dtype** data, Dtype** diff,
+      vector<Dtype*>* history);
+  /// @brief Whether history_ is still laid out like the param arena.
+  bool history_contiguous() const;
   virtual void ClipGradients();
+  /// @brief The factor ClipGradients scales the diffs by (1 if not clipping).
+  Dtype GetClipGradientsScale();
   virtual void SnapshotSolverState(const string& model_filename);
   virtual void SnapshotSolverStateToBinaryProto(const string& model_filename);
   virtual void SnapshotSolverStateToHDF5(const string& model_filename);
@@ -41,6 +91,8 @@ class SGDSolver : public Solver<Dtype> {
   // temp maintains other information that might be needed in computation
   //   of gradients/updates and is not needed in snapshots
   vector<shared_ptr<Blob<Dtype> > > history_, update_, temp_;
+  // Backing storage for history_ when it is contiguous.
+  shared_ptr<SyncedMemory> history_arena_;
 
   // loss history for 'plateau' LR policy (should be stored in snapshots)
   Dtype minimum_loss_;
@@ -60,6 +112,8 @@ class NesterovSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeFusedUpdate(int begin, int end, Dtype rate,
+      const FusedGradient<Dtype>& gradient);
 
   DISABLE_COPY_AND_ASSIGN(NesterovSolver);
 };
@@ -75,6 +129,8 @@ class AdaGradSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeFusedUpdate(int begin, int end, Dtype rate,
+      const FusedGradient<Dtype>& gradient);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with AdaGrad.";
@@ -95,6 +151,8 @@ class RMSPropSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeFusedUpdate(int begin, int end, Dtype rate,
+      const FusedGradient<Dtype>& gradient);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with RMSProp.";
@@ -119,6 +177,8 @@ class AdaDeltaSolver : public SGDSolver<Dtype> {
  protected:
   void AdaDeltaPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeFusedUpdate(int begin, int end, Dtype rate,
+      const FusedGradient<Dtype>& gradient);
 
   DISABLE_COPY_AND_ASSIGN(AdaDeltaSolver);
 };
@@ -143,6 +203,8 @@ class AdamSolver : public SGDSolver<Dtype> {
  protected:
   void AdamPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeFusedUpdate(int begin, int end, Dtype rate,
+      const FusedGradient<Dtype>& gradient);
 
   DISABLE_COPY_AND_ASSIGN(AdamSolver);
 };
@@ -0,0 +1,137 @@
+#ifndef CAFFE_SNAPSHOT_WRITER_HPP_
+#define CAFFE_SNAPSHOT_WRITER_HPP_
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
+
+namespace google { namespace protobuf { namespace io {
+class CodedOutputStream;
+} } }
+
+namespace caffe {
+
+/**
+ * @brief A snapshot file whose contents have been staged in host memory, so
+ *        that it can be serialized later, possibly on another thread, while
+ *        the staged-from blobs keep changing.
+ *
+ * The file is a binary protobuf message streamed one repeated entry at a time
+ * (a layer, or a history blob), so that the whole message is never built in
+ * memory. It is written under a temporary name and renamed into place once
+ * complete, so readers never see a partial snapshot.
+ */
+class Snapshot {
+ public:
+  explicit Snapshot(const string& filename) : filename_(filename) {}
+  virtual ~Snapshot() {}
+
+  /// @brief Writes the snapshot to filename(), replacing it atomically.
+  void Write();
+  inline const string& filename() const { return filename_; }
+
+ protected:
+  /// @brief Serializes the staged message to output.
+  virtual void Serialize(google::protobuf::io::CodedOutputStream* output) = 0;
+
+  /**
+   * @brief Copies the data (or diff) of blobs into one host buffer and returns
+   *        blobs viewing the copies. Blobs sharing memory are staged once.
+   */
+  template <typename Dtype>
+  static vector<shared_ptr<Blob<Dtype> > > StageBlobs(
+      const vector<Blob<Dtype>*>& blobs, bool diff,
+      shared_ptr<SyncedMemory>* buffer);
+
+  const string filename_;
+
+  DISABLE_COPY_AND_ASSIGN(Snapshot);
+};
+
+/**
+ * @brief Stages the weights of a Net as Net::ToProto would write them. When
+ *        the net's learnable params are contiguous, the data is staged with a
+ *        single copy of the param arena.
+ */
+template <typename Dtype>
+class NetSnapshot : public Snapshot {
+ public:
+  NetSnapshot(Net<Dtype>* net, const string& filename, bool write_diff);
+
+ protected:
+  virtual void Serialize(google::protobuf::io::CodedOutputStream* output);
+
+  NetParameter header_;
+  vector<LayerParameter> layer_params_;
+  // The staged blobs of each layer, viewing data_buffer_ and diff_buffer_.
+  vector<vector<shared_ptr<Blob<Dtype> > > > layer_blobs_;
+  bool write_diff_;
+  shared_ptr<SyncedMemory> data_buffer_, diff_buffer_;
+};
+
+/// @brief Stages a SolverState together with the solver history blobs.
+template <typename Dtype>
+class SolverStateSnapshot : public Snapshot {
+ public:
+  SolverStateSnapshot(const SolverState& state,
+      const vector<shared_ptr<Blob<Dtype> > >& history,
+      const string& filename);
+
+ protected:
+  virtual void Serialize(google::protobuf::io::CodedOutputStream* output);
+
+  SolverState header_;
+  vector<shared_ptr<Blob<Dtype> > > history_;
+  shared_ptr<SyncedMemory> buffer_;
+};
+
+/**
+ * @brief Writes Snapshot%s on a background thread, in the order they are
+ *        pushed. Snapshots are pushed in units, such as a model with its
+ *        solver state: BeginUnit blocks until fewer than max_in_flight units
+ *        are staged or being written, so it must come before staging the
+ *        unit's snapshots. This bounds the host memory held by staging
+ *        buffers to max_in_flight units, and pushing the snapshots of a unit
+ *        never blocks.
+ *
+ * BeginUnit, Push and Wait must be called from the same (training) thread.
+ */
+class SnapshotWriter : public InternalThread {
+ public:
+  explicit SnapshotWriter(int max_in_flight);
+  virtual ~SnapshotWriter();
+
+  /// @brief Starts a unit of snapshots, once one is free to stage.
+  void BeginUnit();
+  /**
+   * @brief Queues a snapshot of the current unit for writing and takes
+   *        ownership of it.
+   */
+  void Push(Snapshot* snapshot);
+  /// @brief Blocks until every pushed snapshot is on disk.
+  void Wait();
+
+ protected:
+  virtual void InternalThreadEntry();
+  // Releases the snapshots of the oldest unit, waiting for them if needed.
+  void ReleaseUnit();
+
+  const int max_in_flight_;
+  // The number of snapshots of each unit in flight, oldest first.
+  std::deque<int> units_;
+  BlockingQueue<Snapshot*> queue_;
+  BlockingQueue<Snapshot*> written_;
+
+  DISABLE_COPY_AND_ASSIGN(SnapshotWriter);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_SNAPSHOT_WRITER_HPP_
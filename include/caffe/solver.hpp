@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "caffe/net.hpp"
+#include "caffe/snapshot_writer.hpp"
 #include "caffe/solver_factory.hpp"
 
 namespace caffe {
@@ -66,6 +67,8 @@ class Solver {
   // function that produces a SolverState protocol buffer that needs to be
   // written to disk together with the learned net.
   void Snapshot();
+  /// @brief Blocks until every asynchronous snapshot has been written.
+  void WaitForSnapshots();
   virtual ~Solver() {}
   inline const SolverParameter& param() const { return param_; }
   inline shared_ptr<Net<Dtype> > net() { return net_; }
@@ -100,6 +103,13 @@ class Solver {
   string SnapshotFilename(const string extension);
   string SnapshotToBinaryProto();
   string SnapshotToHDF5();
+  /**
+   * @brief Writes a staged snapshot, on the background writer if
+   *        async_snapshot is set and immediately otherwise. Takes ownership.
+   */
+  void WriteSnapshot(caffe::Snapshot* snapshot);
+  /// @brief Whether BINARYPROTO snapshots are written as staged Snapshot%s.
+  bool StagedSnapshots() const;
   // The test routine
   void TestAll();
   void TestClassification(const int test_net_id = 0);
@@ -132,6 +142,9 @@ class Solver {
   // True iff a request to stop early was received.
   bool requested_early_exit_;
 
+  // Writes snapshots in the background when async_snapshot is set.
+  shared_ptr<SnapshotWriter> snapshot_writer_;
+
   DISABLE_COPY_AND_ASSIGN(Solver);
 };
 
@@ -35,6 +35,18 @@ inline void CaffeFreeHost(void* ptr, bool use_cuda) {
   free(ptr);
 }
 
+// Alignment, in bytes, of the param and history arenas carved out of a single
+// SyncedMemory (see Net::MakeLearnableParamsContiguous). One cache line, which
+// also satisfies every SIMD load/store width in use.
+const size_t kArenaAlignment = 64;
+
+// Rounds a host pointer up to the next multiple of kArenaAlignment. Arenas
+// are allocated kArenaAlignment bytes larger than needed to leave room for it.
+inline void* AlignArenaPointer(void* ptr) {
+  const size_t address = reinterpret_cast<size_t>(ptr);
+  return reinterpret_cast<void*>(
+      (address + kArenaAlignment - 1) & ~(kArenaAlignment - 1));
+}
 
 /**
  * @brief Manages memory allocation and synchronization between the host (CPU)
@@ -47,11 +59,11 @@ class SyncedMemory {
   SyncedMemory()
       : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(0), head_(UNINITIALIZED),
         own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
-        gpu_device_(-1) {}
+        gpu_device_(-1), version_(0) {}
   explicit SyncedMemory(size_t size)
       : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
         own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
-        gpu_device_(-1) {}
+        gpu_device_(-1), version_(0) {}
   ~SyncedMemory();
   const void* cpu_data();
   void set_cpu_data(void* data);
@@ -62,6 +74,9 @@ class SyncedMemory {
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED };
   SyncedHead head() { return head_; }
   size_t size() { return size_; }
+  // Changes whenever the data may have been written: on every call to the
+  // mutable_*_data and set_*_data methods.
+  size_t version() const { return version_; }
 
 #ifndef CPU_ONLY
   void async_gpu_push(const cudaStream_t& stream);
@@ -78,6 +93,7 @@ class SyncedMemory {
   bool cpu_malloc_use_cuda_;
   bool own_gpu_data_;
   int gpu_device_;
+  size_t version_;
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
 };  // class SyncedMemory
@@ -0,0 +1,31 @@
+#ifndef CAFFE_UTIL_CHANNELS_LAST_HPP_
+#define CAFFE_UTIL_CHANNELS_LAST_HPP_
+
+namespace caffe {
+
+// Blobs are N x C x H x W; channels-last, their values are stored in the
+// order N x H x W x C instead, so that the channels of one pixel are
+// contiguous. spatial below is H x W.
+
+// Transposes each of num rows x cols matrices of src into dst.
+template <typename Dtype>
+void caffe_cpu_batched_transpose(const int num, const int rows,
+    const int cols, const Dtype* src, Dtype* dst);
+
+// Reorders num images from channels-first to channels-last.
+template <typename Dtype>
+inline void caffe_cpu_to_channels_last(const int num, const int channels,
+    const int spatial, const Dtype* src, Dtype* dst) {
+  caffe_cpu_batched_transpose(num, channels, spatial, src, dst);
+}
+
+// Reorders num images from channels-last to channels-first.
+template <typename Dtype>
+inline void caffe_cpu_to_channels_first(const int num, const int channels,
+    const int spatial, const Dtype* src, Dtype* dst) {
+  caffe_cpu_batched_transpose(num, spatial, channels, src, dst);
+}
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_CHANNELS_LAST_HPP_
@@ -0,0 +1,63 @@
+#ifndef CAFFE_UTIL_DB_WRITER_HPP
+#define CAFFE_UTIL_DB_WRITER_HPP
+
+#include <stdint.h>
+
+#include <string>
+
+#include "boost/function.hpp"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/db.hpp"
+
+/**
+ Forward declare boost::mutex instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class mutex; }
+
+namespace caffe { namespace db {
+
+/**
+ * @brief Makes the record of an item: sets its key and value and returns
+ *        true, or returns false to leave the item out. It is called from
+ *        several threads at once.
+ */
+typedef boost::function<bool(int, string*, string*)> RecordMaker;  // NOLINT
+
+/**
+ * @brief Writes the records of items [0, num_items) to db in item order,
+ *        while num_workers threads make them, so that the db comes out the
+ *        same for any number of workers. Returns the number of records
+ *        written.
+ *
+ * The calling thread writes, committing a transaction once its records add
+ * up to commit_bytes, and logs the records/s and MB/s every log_every
+ * records. The workers stay a bounded number of items ahead of the writer,
+ * which bounds the memory held in made records.
+ */
+int WriteRecords(DB* db, const int num_items, const RecordMaker& make_record,
+    const int num_workers, const int64_t commit_bytes,
+    const int log_every = 1000);
+
+/**
+ * @brief Checks that every Datum has the data size of the first one, for
+ *        record makers on several threads.
+ */
+class SizeCheck {
+ public:
+  SizeCheck();
+  void Check(const Datum& datum);
+
+ private:
+  shared_ptr<boost::mutex> mutex_;
+  int data_size_;
+
+  DISABLE_COPY_AND_ASSIGN(SizeCheck);
+};
+
+}  // namespace db
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DB_WRITER_HPP
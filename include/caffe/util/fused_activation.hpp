@@ -0,0 +1,28 @@
+#ifndef CAFFE_UTIL_FUSED_ACTIVATION_HPP_
+#define CAFFE_UTIL_FUSED_ACTIVATION_HPP_
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Adds bias, one value per channel, to data, laid out as outer_num x
+ *        channels x inner_num, and applies the activation described by param
+ *        in the same pass, with the same results as the bias followed by the
+ *        ReLU or PReLU layer it replaces. bias may be NULL, for none; slopes
+ *        holds the PReLU slopes, and may be NULL otherwise.
+ */
+template <typename Dtype>
+void fused_activation_cpu(const FusedActivationParameter& param,
+    const int outer_num, const int channels, const int inner_num,
+    const Dtype* bias, const Dtype* slopes, Dtype* data);
+
+/// @brief Applies the activation alone; the bias is added beforehand.
+template <typename Dtype>
+void fused_activation_gpu(const FusedActivationParameter& param,
+    const int outer_num, const int channels, const int inner_num,
+    const Dtype* slopes, Dtype* data);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FUSED_ACTIVATION_HPP_
@@ -16,6 +16,25 @@ void im2col_cpu(const Dtype* data_im, const int channels,
     const int stride_w, const int dilation_h, const int dilation_w,
     Dtype* data_col);
 
+// im2col_cpu for the output rows [first_row, first_row + num_rows) only:
+// data_col holds their columns, kernel_dim x (num_rows * output width).
+template <typename Dtype>
+void im2col_rows_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    const int first_row, const int num_rows, Dtype* data_col);
+
+// im2col_rows_cpu for a channels-last image, height x width x channels:
+// data_col holds a row of kernel_h x kernel_w x channels values for each of
+// the num_rows * output width outputs.
+template <typename Dtype>
+void im2col_nhwc_rows_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    const int first_row, const int num_rows, Dtype* data_col);
+
 template <typename Dtype>
 void col2im_nd_cpu(const Dtype* data_col, const int num_spatial_axes,
     const int* im_shape, const int* col_shape,
@@ -29,6 +48,16 @@ void col2im_cpu(const Dtype* data_col, const int channels,
     const int stride_w, const int dilation_h, const int dilation_w,
     Dtype* data_im);
 
+// The inverse of im2col_rows_cpu: adds the columns of the output rows
+// [first_row, first_row + num_rows) into data_im, which, unlike col2im_cpu,
+// it does not zero first.
+template <typename Dtype>
+void col2im_rows_cpu(const Dtype* data_col, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    const int first_row, const int num_rows, Dtype* data_im);
+
 template <typename Dtype>
 void im2col_nd_gpu(const Dtype* data_im, const int num_spatial_axes,
     const int col_size, const int* im_shape, const int* col_shape,
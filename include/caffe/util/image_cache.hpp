@@ -0,0 +1,82 @@
+#ifndef CAFFE_UTIL_IMAGE_CACHE_HPP_
+#define CAFFE_UTIL_IMAGE_CACHE_HPP_
+
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#include <stdint.h>
+
+#include <list>
+#include <map>
+#include <string>
+
+#include "caffe/common.hpp"
+
+/**
+ Forward declare boost::mutex instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class mutex; }
+
+namespace caffe {
+
+/**
+ * @brief A cache of decoded images, keyed by their file name, that holds up
+ *        to capacity bytes of pixels and evicts the least recently used
+ *        images to make room.
+ *
+ * Data layers that come back to the same images, epoch after epoch or, for
+ * windows, many times in one epoch, decode each of them once for as long as
+ * it stays in the cache. The cache is safe to use from several threads at
+ * once. The images it hands out share their pixels with it: callers must
+ * not write into them, nor into the images they Insert.
+ */
+class ImageCache {
+ public:
+  explicit ImageCache(const size_t capacity);
+
+  /**
+   * @brief Sets image to the image cached under key and returns true, or
+   *        returns false if it is not cached.
+   */
+  bool Lookup(const string& key, cv::Mat* image);
+  /**
+   * @brief Caches image under key, evicting the least recently used images
+   *        until it fits. Images larger than the whole cache are not cached.
+   */
+  void Insert(const string& key, const cv::Mat& image);
+
+  inline size_t capacity() const { return capacity_; }
+  /// @brief The bytes of pixels of the cached images.
+  size_t bytes() const;
+  /// @brief The number of cached images.
+  size_t size() const;
+  int64_t hits() const;
+  int64_t misses() const;
+  /// @brief The fraction of the lookups so far that were hits.
+  float hit_rate() const;
+  /// @brief A line reporting the images, bytes and hit rate of the cache.
+  string Summary() const;
+
+ private:
+  struct Entry {
+    cv::Mat image;
+    size_t bytes;
+    std::list<string>::iterator recency;
+  };
+
+  const size_t capacity_;
+  size_t bytes_;
+  int64_t hits_;
+  int64_t misses_;
+  // The keys, from the most to the least recently used.
+  std::list<string> recency_;
+  std::map<string, Entry> entries_;
+  shared_ptr<boost::mutex> mutex_;
+
+  DISABLE_COPY_AND_ASSIGN(ImageCache);
+};
+
+}  // namespace caffe
+
+#endif  // USE_OPENCV
+#endif  // CAFFE_UTIL_IMAGE_CACHE_HPP_
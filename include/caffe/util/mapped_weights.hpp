@@ -0,0 +1,62 @@
+#ifndef CAFFE_UTIL_MAPPED_WEIGHTS_HPP_
+#define CAFFE_UTIL_MAPPED_WEIGHTS_HPP_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/syncedmem.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A weight file laid out to be memory-mapped and used in place.
+ *
+ * The file starts with a fixed-size header: the 8-byte magic "CAFFEMAP", a
+ * uint32 version and a uint32 reserved word, then the uint64 offset and size
+ * of a serialized MappedWeightsIndex, in host byte order. The raw data of each
+ * blob follows, starting at a multiple of kArenaAlignment so that it can back
+ * a Blob directly; the index, listing each layer's blobs with their shape and
+ * offset, comes last.
+ *
+ * The file is mapped copy-on-write: processes loading the same file share its
+ * pages through the page cache, and writes to the weights (e.g. fine-tuning)
+ * go to private copies of the touched pages, never to the file.
+ */
+class MappedWeights {
+ public:
+  /// @brief Maps filename; dies if it is not a valid mapped weight file.
+  explicit MappedWeights(const string& filename);
+  ~MappedWeights();
+
+  /// @brief Whether filename starts with the mapped weight file magic.
+  static bool IsMappedWeightsFile(const string& filename);
+
+  inline const MappedWeightsIndex& index() const { return index_; }
+  /// @brief The mapped data of a blob listed in index().
+  inline void* data(const MappedBlob& blob) const {
+    return static_cast<char*>(map_) + blob.offset();
+  }
+
+ protected:
+  string filename_;
+  void* map_;
+  size_t size_;
+  MappedWeightsIndex index_;
+
+  DISABLE_COPY_AND_ASSIGN(MappedWeights);
+};
+
+/**
+ * @brief Writes the weights in param to filename as a mapped weight file.
+ *        Blobs stored as double_data are written as doubles, others as floats.
+ *        Legacy 4D blob dimensions are kept as such, and loaded with the
+ *        rules of Blob::ShapeEquals.
+ */
+void WriteMappedWeights(const NetParameter& param, const string& filename);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_MAPPED_WEIGHTS_HPP_
@@ -20,6 +20,14 @@ void caffe_cpu_gemm(const CBLAS_TRANSPOSE TransA,
     const Dtype alpha, const Dtype* A, const Dtype* B, const Dtype beta,
     Dtype* C);
 
+// caffe_cpu_gemm for matrices that are parts of larger ones: lda, ldb and
+// ldc are the distances between the rows of A, B and C as stored.
+template <typename Dtype>
+void caffe_cpu_gemm(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const Dtype alpha, const Dtype* A, const int lda, const Dtype* B,
+    const int ldb, const Dtype beta, Dtype* C, const int ldc);
+
 template <typename Dtype>
 void caffe_cpu_gemv(const CBLAS_TRANSPOSE TransA, const int M, const int N,
     const Dtype alpha, const Dtype* A, const Dtype* x, const Dtype beta,
@@ -91,6 +99,13 @@ void caffe_exp(const int n, const Dtype* a, Dtype* y);
 template <typename Dtype>
 void caffe_log(const int n, const Dtype* a, Dtype* y);
 
+template <typename Dtype>
+void caffe_tanh(const int n, const Dtype* a, Dtype* y);
+
+// y[i] = 1 / (1 + exp(-a[i])).
+template <typename Dtype>
+void caffe_sigmoid(const int n, const Dtype* a, Dtype* y);
+
 template <typename Dtype>
 void caffe_abs(const int n, const Dtype* a, Dtype* y);
 
@@ -0,0 +1,29 @@
+#ifndef CAFFE_UTIL_OPTIMIZE_NET_HPP_
+#define CAFFE_UTIL_OPTIMIZE_NET_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Rewrites a TEST phase net for faster inference. param must carry
+ *        the trained weights of its layers as blobs.
+ *
+ * Chains of BatchNorm (using global statistics), Scale and Bias layers that
+ * follow a Convolution or InnerProduct layer are folded into its weights and
+ * bias, and a ReLU or PReLU layer ending such a chain becomes the layer's
+ * fused activation (see FusedActivationParameter). A layer is only folded
+ * when it is the next one to read the output, and, unless it computes in
+ * place, the only one, so the outputs of the net are unchanged up to
+ * rounding. The names of the layers removed are appended to removed_layers.
+ */
+void OptimizeNetForInference(const NetParameter& param,
+    NetParameter* param_optimized, vector<string>* removed_layers);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_OPTIMIZE_NET_HPP_
@@ -0,0 +1,93 @@
+#ifndef CAFFE_UTIL_PACKED_GEMM_HPP_
+#define CAFFE_UTIL_PACKED_GEMM_HPP_
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/mkl_alternate.hpp"
+
+namespace caffe {
+
+// GEMMs with one operand, typically the weights of a layer, packed once into
+// the panels the kernel reads, so that it is not packed again on every call
+// as caffe_cpu_gemm does. C is always overwritten (alpha = 1, beta = 0).
+
+// Whether the packed GEMMs have a fast path for Dtype on this CPU (AVX-512
+// for float). Where they don't, they are correct but slow, and callers
+// should keep using caffe_cpu_gemm.
+template <typename Dtype>
+bool caffe_cpu_packed_gemm_supported();
+template <> bool caffe_cpu_packed_gemm_supported<float>();
+template <> bool caffe_cpu_packed_gemm_supported<double>();
+
+// Packs the M x K matrix A, row major, for caffe_cpu_gemm_packed_a. packed
+// holds M * K values.
+template <typename Dtype>
+void caffe_cpu_pack_a(const int M, const int K, const Dtype* A,
+    Dtype* packed);
+
+// Computes C = A * B, where A is M x K, packed, and B is K x N and C is
+// M x N, both row major; the rows of C are ldc apart.
+template <typename Dtype>
+void caffe_cpu_gemm_packed_a(const int M, const int N, const int K,
+    const Dtype* packed_a, const Dtype* B, Dtype* C, const int ldc);
+
+// The number of values caffe_cpu_pack_b packs a K x N matrix into.
+int caffe_cpu_packed_b_size(const int K, const int N);
+
+// Packs the K x N matrix B, row major, or its transpose if TransB, for
+// caffe_cpu_gemm_packed_b.
+template <typename Dtype>
+void caffe_cpu_pack_b(const CBLAS_TRANSPOSE TransB, const int K, const int N,
+    const Dtype* B, Dtype* packed);
+
+// Computes C = A * B, where A is M x K and C is M x N, both row major, and B
+// is K x N, packed.
+template <typename Dtype>
+void caffe_cpu_gemm_packed_b(const int M, const int N, const int K,
+    const Dtype* A, const Dtype* packed_b, Dtype* C);
+
+// Remembers which data of a Blob a copy derived from it, such as its packed
+// weights, was made from, to tell when the copy is stale.
+class BlobDataVersion {
+ public:
+  BlobDataVersion() : version_(0) {}
+  template <typename Dtype>
+  bool Matches(const Blob<Dtype>& blob) const {
+    return data_ == blob.data() && version_ == blob.data_version();
+  }
+  template <typename Dtype>
+  void Set(const Blob<Dtype>& blob) {
+    data_ = blob.data();
+    version_ = blob.data_version();
+  }
+
+ private:
+  shared_ptr<SyncedMemory> data_;
+  size_t version_;
+};
+
+// The lock that layers sharing copies derived from their weights, like the
+// replicas of a net (see Layer::ShareDerivedWeights), hold while they check
+// and rebuild them, so that each copy is built once, by the first replica
+// to need it.
+class WeightMutex {
+ public:
+  WeightMutex();
+  void lock();
+  void unlock();
+
+ private:
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+  shared_ptr<sync> sync_;
+
+  DISABLE_COPY_AND_ASSIGN(WeightMutex);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PACKED_GEMM_HPP_
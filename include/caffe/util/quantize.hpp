@@ -0,0 +1,97 @@
+#ifndef CAFFE_UTIL_QUANTIZE_HPP_
+#define CAFFE_UTIL_QUANTIZE_HPP_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Symmetric int8 quantization: a value x with scale s is stored as
+// q = round(x / s), saturated to [-kInt8Max, kInt8Max], so that x ~ q * s.
+// Ties round as the current rounding mode has it, to even by default, on
+// every CPU.
+const int kInt8Max = 127;
+
+// Returns the largest magnitude of the n values of x.
+template <typename Dtype>
+Dtype caffe_cpu_amax(const int n, const Dtype* x);
+
+// Returns the scale that maps a largest magnitude of max_abs to kInt8Max.
+template <typename Dtype>
+inline Dtype int8_scale(const Dtype max_abs) {
+  return max_abs > 0 ? max_abs / kInt8Max : Dtype(1);
+}
+
+// The int8 GEMM works on groups of 4 along K: it returns the length of the
+// rows of A, and of the columns of packed B, for K.
+inline int int8_gemm_k(const int K) { return (K + 3) / 4 * 4; }
+
+// Quantizes x, laid out as rows x cols, with the given scale into the rows
+// of q, which are int8_gemm_k(cols) long and zero-padded.
+template <typename Dtype>
+void caffe_cpu_quantize(const int rows, const int cols, const Dtype scale,
+    const Dtype* x, int8_t* q);
+
+// As caffe_cpu_quantize, but with a scale for each row, stored in scales.
+template <typename Dtype>
+void caffe_cpu_quantize_rows(const int rows, const int cols, const Dtype* x,
+    int8_t* q, Dtype* scales);
+
+// Quantizes x, laid out as K x N, with the given scale into the packed
+// layout caffe_cpu_gemm_s8 reads B in: for every 4 rows, the 4 values of
+// each column are consecutive, offset by 128 to be unsigned. q holds
+// int8_gemm_k(K) * N values.
+template <typename Dtype>
+void caffe_cpu_quantize_pack(const int K, const int N, const Dtype scale,
+    const Dtype* x, uint8_t* q);
+
+// Packs the transpose of x, quantized as N rows of int8_gemm_k(K) values,
+// as caffe_cpu_quantize_pack would.
+void caffe_cpu_pack_s8(const int N, const int K, const int8_t* x,
+    uint8_t* q);
+
+// The kernels of caffe_cpu_gemm_s8, slowest first.
+enum Int8GemmKernel { INT8_GEMM_SCALAR, INT8_GEMM_AVX2, INT8_GEMM_VNNI };
+
+// Returns the kernel caffe_cpu_gemm_s8 uses: AVX-512 VNNI dot products, or
+// else AVX2 int16 multiply-adds, if the CPU has them, but no faster than the
+// limit set by caffe_cpu_limit_gemm_s8_kernel.
+Int8GemmKernel caffe_cpu_gemm_s8_kernel();
+
+// Limits caffe_cpu_gemm_s8 to kernels up to max_kernel, e.g. to test the
+// slower ones. Not thread-safe.
+void caffe_cpu_limit_gemm_s8_kernel(const Int8GemmKernel max_kernel);
+
+// Whether caffe_cpu_gemm_s8 has a vectorized kernel on this CPU. Where it
+// doesn't, it is correct but slower than the float GEMM, so layers with a
+// quantization_param warn and stay in float.
+inline bool caffe_cpu_gemm_s8_supported() {
+  return caffe_cpu_gemm_s8_kernel() != INT8_GEMM_SCALAR;
+}
+
+// Computes C = A * B with int32 accumulation, where A is M x K, quantized
+// into rows of int8_gemm_k(K) values, B is K x N, packed, and C is M x N.
+void caffe_cpu_gemm_s8(const int M, const int N, const int K,
+    const int8_t* A, const uint8_t* B, int32_t* C);
+
+// Computes y = C * scale, scaling row i by row_scales[i] and column j by
+// col_scales[j] as well, where either may be NULL. C and y are M x N.
+template <typename Dtype>
+void caffe_cpu_dequantize(const int M, const int N, const int32_t* C,
+    const Dtype scale, const Dtype* row_scales, const Dtype* col_scales,
+    Dtype* y);
+
+// Sets the quantization_param of the layers of param listed in table.
+void ApplyQuantizationTable(const QuantizationTable& table,
+    NetParameter* param);
+
+// Reads a quantization table, in text format, and applies it to param.
+void ApplyQuantizationTableOrDie(const string& filename, NetParameter* param);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_QUANTIZE_HPP_
@@ -0,0 +1,155 @@
+#ifndef CAFFE_UTIL_SIMD_MATH_HPP_
+#define CAFFE_UTIL_SIMD_MATH_HPP_
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <emmintrin.h>
+#define USE_SSE_MATH
+#endif
+
+namespace caffe {
+
+#ifdef USE_SSE_MATH
+
+// Vectorized float transcendentals for x86-64, which need only its baseline
+// SSE2. They follow the Cephes single precision polynomials, reducing the
+// argument by powers of two. Against the correctly rounded results, log and
+// exp stay within 1 ulp over their domains, and pow within 3.5 ulp for
+// |p| <= 4, its error growing in proportion to |p| beyond.
+
+/**
+ * @brief Splits each lane of x, which must be positive and normal, into
+ *        2^e * (1 + r), with 1 + r in [sqrt(1/2), sqrt(2)), and returns
+ *        log(1 + r) - r + r^2 / 2, for r^2 in z.
+ */
+inline __m128 caffe_sse_log_parts(const __m128 x, __m128* e, __m128* r,
+    __m128* z) {
+  const __m128 one = _mm_set1_ps(1.f);
+  const __m128i bits = _mm_castps_si128(x);
+  *e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23),
+      _mm_set1_epi32(126)));
+  const __m128 m = _mm_or_ps(_mm_castsi128_ps(_mm_and_si128(bits,
+      _mm_set1_epi32(0x007fffff))), _mm_set1_ps(0.5f));
+  const __m128 small = _mm_cmplt_ps(m, _mm_set1_ps(0.707106781186547524f));
+  *e = _mm_sub_ps(*e, _mm_and_ps(one, small));
+  *r = _mm_add_ps(_mm_sub_ps(m, one), _mm_and_ps(m, small));
+  *z = _mm_mul_ps(*r, *r);
+  __m128 y = _mm_set1_ps(7.0376836292e-2f);
+  y = _mm_add_ps(_mm_mul_ps(y, *r), _mm_set1_ps(-1.1514610310e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, *r), _mm_set1_ps(1.1676998740e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, *r), _mm_set1_ps(-1.2420140846e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, *r), _mm_set1_ps(1.4249322787e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, *r), _mm_set1_ps(-1.6668057665e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, *r), _mm_set1_ps(2.0000714765e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, *r), _mm_set1_ps(-2.4999993993e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, *r), _mm_set1_ps(3.3333331174e-1f));
+  return _mm_mul_ps(_mm_mul_ps(y, *r), *z);
+}
+
+/**
+ * @brief Returns the natural logarithm of each lane of x, which must be
+ *        positive and normal.
+ */
+inline __m128 caffe_sse_log(const __m128 x) {
+  __m128 e, r, z;
+  __m128 y = caffe_sse_log_parts(x, &e, &r, &z);
+  // Add e * log(2), split in two for precision.
+  y = _mm_add_ps(y, _mm_mul_ps(e, _mm_set1_ps(-2.12194440e-4f)));
+  y = _mm_sub_ps(y, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+  return _mm_add_ps(_mm_add_ps(r, y),
+      _mm_mul_ps(e, _mm_set1_ps(0.693359375f)));
+}
+
+/**
+ * @brief Returns e raised to each lane of x, clamped to [-87.3, 88.3] so
+ *        that the result stays normal.
+ */
+inline __m128 caffe_sse_exp(__m128 x) {
+  x = _mm_min_ps(x, _mm_set1_ps(88.3762626647949f));
+  x = _mm_max_ps(x, _mm_set1_ps(-87.3365447f));
+  // x = n * log(2) + r, with n = round(x / log(2)) and |r| <= log(2) / 2.
+  __m128 n = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)),
+      _mm_set1_ps(0.5f));
+  const __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(n));
+  n = _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, n),
+      _mm_set1_ps(1.f)));
+  x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(0.693359375f)));
+  x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(-2.12194440e-4f)));
+  // exp(r) - 1 - r.
+  const __m128 z = _mm_mul_ps(x, x);
+  __m128 y = _mm_set1_ps(1.9875691500e-4f);
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.3981999507e-3f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(8.3334519073e-3f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(4.1665795894e-2f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.6666665459e-1f));
+  y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(5.0000001201e-1f));
+  y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, z), x), _mm_set1_ps(1.f));
+  // Scale by 2^n, built in the exponent bits.
+  const __m128i pow2n = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n),
+      _mm_set1_epi32(127)), 23);
+  return _mm_mul_ps(y, _mm_castsi128_ps(pow2n));
+}
+
+/// @brief Returns 2^n for each lane of n, in [-126, 127].
+inline __m128 caffe_sse_pow2(const __m128i n) {
+  return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n,
+      _mm_set1_epi32(127)), 23));
+}
+
+/**
+ * @brief Returns each lane of x, which must be positive and normal, raised
+ *        to the power p, for |p| <= 64 and normal results.
+ */
+inline __m128 caffe_sse_pow(const __m128 x, const float p) {
+  // x^p = 2^(p e) (1 + r)^p. Take the integer n nearest to p e out as a
+  // power of two, so that exp only sees the small rest, and its rounding
+  // error does not grow with |p log(x)|. p is split in two halves of 12
+  // bits, whose products with e are exact.
+  const __m128 p_hi = _mm_and_ps(_mm_set1_ps(p),
+      _mm_castsi128_ps(_mm_set1_epi32(0xfffff000)));
+  const __m128 p_lo = _mm_sub_ps(_mm_set1_ps(p), p_hi);
+  __m128 e, r, z;
+  const __m128 y = caffe_sse_log_parts(x, &e, &r, &z);
+  const __m128 log_m = _mm_add_ps(r,
+      _mm_sub_ps(y, _mm_mul_ps(z, _mm_set1_ps(0.5f))));
+  const __m128 pe = _mm_mul_ps(e, p_hi);
+  const __m128i n = _mm_cvtps_epi32(pe);
+  const __m128 f = _mm_add_ps(_mm_sub_ps(pe, _mm_cvtepi32_ps(n)),
+      _mm_mul_ps(e, p_lo));
+  const __m128 u = _mm_add_ps(_mm_mul_ps(f, _mm_set1_ps(0.693147180559945f)),
+      _mm_mul_ps(log_m, _mm_set1_ps(p)));
+  // Scale in two steps, as 2^n itself may not be normal.
+  const __m128i n_half = _mm_srai_epi32(n, 1);
+  return _mm_mul_ps(_mm_mul_ps(caffe_sse_exp(u), caffe_sse_pow2(n_half)),
+      caffe_sse_pow2(_mm_sub_epi32(n, n_half)));
+}
+
+#endif  // USE_SSE_MATH
+
+// Array versions for float, which run the same polynomials with the widest
+// of AVX-512, AVX2 with FMA and SSE2 that the CPU supports, and libm on other
+// architectures. Blocks holding a value outside the polynomials' domain, such
+// as a NaN, an infinity or a result that would be denormal, fall back to libm
+// for the block, so that the functions agree with it everywhere else. Against
+// the correctly rounded results, checked over every float, exp and log stay
+// within 1.1 ulp, tanh within 1.5 ulp and sigmoid within 2.5 ulp. powx is
+// correctly rounded for p = 0, 1, 2 and 0.5, and otherwise within the bounds
+// of caffe_sse_pow. x and y may be the same array.
+
+/// @brief y[i] = exp(x[i]).
+void caffe_simd_exp(const int n, const float* x, float* y);
+/// @brief y[i] = log(x[i]).
+void caffe_simd_log(const int n, const float* x, float* y);
+/// @brief y[i] = pow(x[i], p).
+void caffe_simd_powx(const int n, const float* x, const float p, float* y);
+/// @brief y[i] = tanh(x[i]).
+void caffe_simd_tanh(const int n, const float* x, float* y);
+/// @brief y[i] = 1 / (1 + exp(-x[i])).
+void caffe_simd_sigmoid(const int n, const float* x, float* y);
+
+/// @brief The instruction set the array versions run with: "avx512f",
+///        "avx2", "sse2" or "scalar".
+const char* caffe_simd_math_isa();
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SIMD_MATH_HPP_
@@ -0,0 +1,42 @@
+#ifndef CAFFE_UTIL_SOFTMAX_HPP_
+#define CAFFE_UTIL_SOFTMAX_HPP_
+
+namespace caffe {
+
+// Softmax kernels for blobs laid out as outer_num x channels x inner_num,
+// which normalize each column -- the channels at one outer and inner index.
+// They work through blocks of columns small enough to stay in cache between
+// their passes, and split the columns among the threads of the pool.
+
+/**
+ * @brief Computes y = softmax(x) over the channels, y may be x. If log_norm
+ *        is not NULL, it receives the log of the normalizer of each column,
+ *        so that the log-probability of channel c is x[c] - log_norm.
+ */
+template <typename Dtype>
+void caffe_cpu_softmax(const int outer_num, const int channels,
+    const int inner_num, const Dtype* x, Dtype* y, Dtype* log_norm);
+
+/**
+ * @brief Backpropagates dy through y = softmax(x) into
+ *        dx = y * (dy - dot(dy, y)); dx may be dy.
+ */
+template <typename Dtype>
+void caffe_cpu_softmax_backward(const int outer_num, const int channels,
+    const int inner_num, const Dtype* y, const Dtype* dy, Dtype* dx);
+
+/**
+ * @brief Computes the gradient of the multinomial logistic loss of the
+ *        probabilities prob, scale * (prob - 1 at the label), into diff,
+ *        leaving zero in the columns whose label is ignore_label if
+ *        has_ignore_label.
+ */
+template <typename Dtype>
+void caffe_cpu_softmax_loss_diff(const int outer_num, const int channels,
+    const int inner_num, const Dtype* prob, const Dtype* label,
+    const bool has_ignore_label, const int ignore_label, const Dtype scale,
+    Dtype* diff);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SOFTMAX_HPP_
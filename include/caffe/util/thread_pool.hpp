@@ -0,0 +1,90 @@
+#ifndef CAFFE_UTIL_THREAD_POOL_HPP_
+#define CAFFE_UTIL_THREAD_POOL_HPP_
+
+#include <stdint.h>
+
+#include <algorithm>
+
+#include "boost/function.hpp"
+
+namespace caffe {
+
+/**
+ * @brief The body of a parallel_for: runs the indices [begin, end).
+ */
+typedef boost::function<void(int, int)> RangeFunction;
+
+/**
+ * @brief Runs body over [0, n), split into ranges of at least grain indices,
+ *        on the threads of the process-wide ThreadPool, and returns once all
+ *        of them have run.
+ *
+ * Each thread starts on its own contiguous share of [0, n), so that repeated
+ * loops over the same data touch it from the same threads, and steals half
+ * of what another thread has left once it runs out. The body must tolerate
+ * any split of the indices into ranges. The calling thread runs the whole
+ * loop itself when n <= grain, when the pool has a single thread, or when
+ * the pool is busy, as it is for nested loops and for loops from other
+ * threads that run concurrently, such as replicas of a Net.
+ */
+void parallel_for(const int n, const int grain, const RangeFunction& body);
+
+/// @brief About how many elements of work a range should hold to amortize
+///        scheduling it.
+const int kParallelForGrainWork = 32768;
+
+/**
+ * @brief Returns the grain for indices that each cost about cost elements of
+ *        work.
+ */
+inline int parallel_grain(const int cost) {
+  return std::max(1, kParallelForGrainWork / std::max(1, cost));
+}
+
+/**
+ * @brief The process-wide pool of threads behind parallel_for.
+ *
+ * Its threads, the caller's included, default to the number of cores this
+ * process may run on, so that taskset and numactl budgets, and NUMA node
+ * bindings, carry over; on Linux, the workers are pinned to those cores in
+ * turn. The workers start with the first parallel loop.
+ */
+class ThreadPool {
+ public:
+  /// @brief Counters of the parallel loops run so far.
+  struct Stats {
+    Stats() : parallel_loops(0), inline_loops(0), ranges(0), steals(0),
+        busy_seconds(0), capacity_seconds(0) {}
+    /// Loops run on the pool, and loops the caller ran by itself.
+    int64_t parallel_loops;
+    int64_t inline_loops;
+    /// Ranges the pool ran, and how many of them were stolen.
+    int64_t ranges;
+    int64_t steals;
+    /// Time the threads spent in loop bodies, and the time they could have,
+    /// the wall time of each parallel loop times the number of threads.
+    double busy_seconds;
+    double capacity_seconds;
+    /// The fraction of the pool's capacity that parallel loops used.
+    double utilization() const {
+      return capacity_seconds > 0 ? busy_seconds / capacity_seconds : 0;
+    }
+  };
+
+  /// @brief Returns the number of threads, the caller's included.
+  static int num_threads();
+  /**
+   * @brief Sets the core budget: the number of threads parallel_for runs
+   *        on, and, with OpenBLAS, MKL or OpenMP, the number they use.
+   *
+   * The budget is shared rather than split, as layers either call BLAS or
+   * run a parallel loop at any one time. 0 restores the default.
+   */
+  static void set_num_threads(const int num_threads);
+  static Stats stats();
+  static void ResetStats();
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_THREAD_POOL_HPP_
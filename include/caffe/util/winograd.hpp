@@ -0,0 +1,54 @@
+#ifndef CAFFE_UTIL_WINOGRAD_HPP_
+#define CAFFE_UTIL_WINOGRAD_HPP_
+
+namespace caffe {
+
+// Winograd minimal filtering F(m x m, 3 x 3) (Lavin & Gray, 2016) computes a
+// 3 x 3 convolution, with stride and dilation 1, over m x m output tiles,
+// each from an alpha x alpha input tile where alpha = m + 2, with alpha^2
+// multiplications per tile instead of 9 m^2. m is 2 or 4.
+//
+// The filters are transformed into U, alpha^2 matrices of K x C, and the
+// input tiles into V, alpha^2 matrices of C x P, where P counts tiles. The
+// convolution is then one GEMM per position xi of a tile,
+//   M[xi] (K x P) = U[xi] (K x C) * V[xi] (C x P),
+// and the output transform turns M back into output tiles. Tiles are
+// numbered row by row across the images of a batch, so that one GEMM can
+// cover tiles from several images.
+
+inline int winograd_alpha(const int tile) { return tile + 2; }
+
+// Whether the input and output transforms have a SIMD path for Dtype on this
+// CPU (AVX-512 for float); where they don't, im2col and GEMM are faster.
+template <typename Dtype>
+bool caffe_cpu_winograd_supported();
+template <> bool caffe_cpu_winograd_supported<float>();
+template <> bool caffe_cpu_winograd_supported<double>();
+
+// Transforms the K x C x 3 x 3 filters into U.
+template <typename Dtype>
+void winograd_filter_transform_cpu(const int tile, const int K, const int C,
+    const Dtype* weights, Dtype* U);
+
+// Transforms num_tiles input tiles, from first_tile on, of a batch of images
+// of channels x height x width, padded with zeros, into V, which holds
+// alpha^2 x channels x num_tiles values. Each image has tiles_h x tiles_w
+// tiles.
+template <typename Dtype>
+void winograd_input_transform_cpu(const Dtype* data, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    const int tile, const int tiles_h, const int tiles_w,
+    const int first_tile, const int num_tiles, Dtype* V);
+
+// Transforms the num_tiles tiles of M, alpha^2 x channels x num_tiles
+// values, into the matching tiles of a batch of outputs of channels x
+// height x width, leaving out what lies past the bottom or right edges.
+template <typename Dtype>
+void winograd_output_transform_cpu(const Dtype* M, const int channels,
+    const int height, const int width, const int tile, const int tiles_h,
+    const int tiles_w, const int first_tile, const int num_tiles,
+    Dtype* output);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_WINOGRAD_HPP_
@@ -14,7 +14,15 @@
 #include <vector>  // NOLINT(build/include_order)
 #include <fstream>  // NOLINT
 
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#endif  // USE_OPENCV
+
+#include "google/protobuf/text_format.h"
+
 #include "caffe/caffe.hpp"
+#include "caffe/data_transformer.hpp"
+#include "caffe/inference_pool.hpp"
 #include "caffe/layers/memory_data_layer.hpp"
 #include "caffe/layers/python_layer.hpp"
 #include "caffe/sgd_solvers.hpp"
@@ -23,6 +31,8 @@
 // You're strongly advised to upgrade to >= 1.7.
 #ifndef NPY_ARRAY_C_CONTIGUOUS
 #define NPY_ARRAY_C_CONTIGUOUS NPY_C_CONTIGUOUS
+#define NPY_ARRAY_ALIGNED NPY_ALIGNED
+#define NPY_ARRAY_WRITEABLE NPY_WRITEABLE
 #define PyArray_SetBaseObject(arr, x) (PyArray_BASE(arr) = (x))
 #endif
 
@@ -53,6 +63,20 @@ void set_mode_gpu() { Caffe::set_mode(Caffe::GPU); }
 
 void set_random_seed(unsigned int seed) { Caffe::set_random_seed(seed); }
 
+// Releases the GIL for its scope, so that other Python threads run while
+// Caffe computes. Nothing in the scope may touch Python objects; Python
+// layers and solver callbacks take the GIL back with PyGILLock.
+class ScopedGILRelease {
+ public:
+  ScopedGILRelease() : state_(PyEval_SaveThread()) {}
+  ~ScopedGILRelease() { PyEval_RestoreThread(state_); }
+
+ private:
+  PyThreadState* state_;
+
+  DISABLE_COPY_AND_ASSIGN(ScopedGILRelease);
+};
+
 // For convenience, check that input files can be opened, and raise an
 // exception that boost will send to Python if not (caffe could still crash
 // later if the input files are disturbed before they are actually used, but
@@ -139,6 +163,16 @@ void Net_Save(const Net<Dtype>& net, string filename) {
   WriteProtoToBinaryFile(net_param, filename.c_str());
 }
 
+Dtype Net_ForwardFromTo(Net<Dtype>* net, int start, int end) {
+  ScopedGILRelease release;
+  return net->ForwardFromTo(start, end);
+}
+
+void Net_BackwardFromTo(Net<Dtype>* net, int start, int end) {
+  ScopedGILRelease release;
+  net->BackwardFromTo(start, end);
+}
+
 void Net_SaveHDF5(const Net<Dtype>& net, string filename) {
   net.ToHDF5(filename);
 }
@@ -179,6 +213,11 @@ void Net_SetInputArrays(Net<Dtype>* net, bp::object data_obj,
       PyArray_DIMS(data_arr)[0]);
 }
 
+void Solver_Step(Solver<Dtype>* solver, int iters) {
+  ScopedGILRelease release;
+  solver->Step(iters);
+}
+
 Solver<Dtype>* GetSolverFromFile(const string& filename) {
   SolverParameter param;
   ReadSolverParamsFromTextFileOrDie(filename, &param);
@@ -238,6 +277,58 @@ bp::object Blob_Reshape(bp::tuple args, bp::dict kwargs) {
   return bp::object();
 }
 
+// Drops the reference to the ndarray whose buffer a SyncedMemory holds,
+// once no blob uses it; the last blob may let go of it without the GIL.
+struct NdarrayDeleter {
+  explicit NdarrayDeleter(PyObject* array) : array_(array) {}
+  void operator()(SyncedMemory* memory) const {
+    delete memory;
+    PyGILLock lock;
+    Py_DECREF(array_);
+  }
+  PyObject* array_;
+};
+
+void Blob_BindData(Blob<Dtype>* self, bp::object array_obj) {
+  if (!PyArray_Check(array_obj.ptr())) {
+    throw std::runtime_error("Blob.bind_data takes an ndarray");
+  }
+  PyArrayObject* array = reinterpret_cast<PyArrayObject*>(array_obj.ptr());
+  const int flags =
+      NPY_ARRAY_C_CONTIGUOUS | NPY_ARRAY_ALIGNED | NPY_ARRAY_WRITEABLE;
+  if ((PyArray_FLAGS(array) & flags) != flags) {
+    throw std::runtime_error("bound arrays must be C contiguous, aligned"
+        " and writeable");
+  }
+  if (PyArray_TYPE(array) != NPY_DTYPE) {
+    throw std::runtime_error("bound arrays must be float32");
+  }
+  if (PyArray_SIZE(array) == 0) {
+    throw std::runtime_error("bound arrays must not be empty");
+  }
+  vector<int> shape(PyArray_DIMS(array),
+      PyArray_DIMS(array) + PyArray_NDIM(array));
+  // The memory holds a reference to the array, so that the array outlives
+  // every blob using its buffer.
+  Py_INCREF(array_obj.ptr());
+  shared_ptr<SyncedMemory> memory(new SyncedMemory(PyArray_NBYTES(array)),
+      NdarrayDeleter(array_obj.ptr()));
+  memory->set_cpu_data(PyArray_DATA(array));
+  self->set_data(memory, shape);
+}
+
+void Blob_UnbindData(Blob<Dtype>* self) {
+  if (self->count() == 0 ||
+      !boost::get_deleter<NdarrayDeleter>(self->data())) {
+    return;
+  }
+  shared_ptr<SyncedMemory> memory(
+      new SyncedMemory(self->count() * sizeof(Dtype)));
+  caffe_copy(self->count(), self->cpu_data(),
+      static_cast<Dtype*>(memory->mutable_cpu_data()));
+  self->set_data(memory, self->shape());
+}
+
 bp::object BlobVec_add_blob(bp::tuple args, bp::dict kwargs) {
   if (bp::len(kwargs) > 0) {
     throw std::runtime_error("BlobVec.add_blob takes no kwargs");
@@ -262,9 +353,11 @@ class PythonCallback: public Solver<Dtype>::Callback {
   PythonCallback(bp::object on_start, bp::object on_gradients_ready)
     : on_start_(on_start), on_gradients_ready_(on_gradients_ready) { }
   virtual void on_gradients_ready() {
+    PyGILLock lock;
     on_gradients_ready_();
   }
   virtual void on_start() {
+    PyGILLock lock;
     on_start_();
   }
 };
@@ -274,6 +367,134 @@ void Solver_add_callback(Solver<Dtype> * solver, bp::object on_start,
   solver->add_callback(new PythonCallback<Dtype>(on_start, on_gradients_ready));
 }
 
+// Lets the workers, which may run Python layers, finish without the GIL
+// before the pool goes.
+void InferencePool_Delete(InferencePool<Dtype>* pool) {
+  {
+    ScopedGILRelease release;
+    pool->Stop();
+  }
+  delete pool;
+}
+
+shared_ptr<InferencePool<Dtype> > InferencePool_Init(
+    shared_ptr<Net<Dtype> > net, int num_workers, int max_batch_size) {
+  if (net->phase() != TEST) {
+    throw std::runtime_error("InferencePool needs a TEST phase net");
+  }
+  if (net->num_inputs() == 0) {
+    throw std::runtime_error("InferencePool needs a net with inputs");
+  }
+  if (num_workers <= 0 || max_batch_size <= 0) {
+    throw std::runtime_error("num_workers and max_batch_size must be"
+        " positive");
+  }
+  return shared_ptr<InferencePool<Dtype> >(
+      new InferencePool<Dtype>(net, num_workers, max_batch_size),
+      &InferencePool_Delete);
+}
+
+shared_ptr<InferenceRequest<Dtype> > InferencePool_Submit(
+    InferencePool<Dtype>* pool, bp::object arrays) {
+  const vector<Blob<Dtype>*>& net_inputs = pool->net()->input_blobs();
+  if (bp::len(arrays) != net_inputs.size()) {
+    throw std::runtime_error("InferencePool needs an array for each net"
+        " input");
+  }
+  vector<shared_ptr<Blob<Dtype> > > inputs;
+  for (int i = 0; i < net_inputs.size(); ++i) {
+    // Copy the arrays, which may change while the request runs, casting
+    // them to the net's type as Net.forward does.
+    bp::object array = arrays[i];
+    PyObject* input_obj = PyArray_FROMANY(array.ptr(), NPY_DTYPE, 1, 0,
+        NPY_ARRAY_C_CONTIGUOUS | NPY_ARRAY_ALIGNED | NPY_ARRAY_FORCECAST);
+    if (input_obj == NULL) {
+      bp::throw_error_already_set();
+    }
+    bp::handle<> input_handle(input_obj);
+    PyArrayObject* input_arr = reinterpret_cast<PyArrayObject*>(input_obj);
+    if (PyArray_NDIM(input_arr) != net_inputs[i]->num_axes()) {
+      throw std::runtime_error("input arrays must have as many axes as the"
+          " net inputs");
+    }
+    vector<int> shape(PyArray_DIMS(input_arr),
+        PyArray_DIMS(input_arr) + PyArray_NDIM(input_arr));
+    inputs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
+    caffe_copy(inputs[i]->count(),
+        static_cast<const Dtype*>(PyArray_DATA(input_arr)),
+        inputs[i]->mutable_cpu_data());
+  }
+  return pool->Submit(inputs);
+}
+
+void InferenceRequest_Wait(const InferenceRequest<Dtype>& request) {
+  ScopedGILRelease release;
+  request.Wait();
+}
+
+#ifdef USE_OPENCV
+shared_ptr<DataTransformer<Dtype> > DataTransformer_Init(
+    const string& transform_param, int phase) {
+  TransformationParameter param;
+  if (!google::protobuf::TextFormat::ParseFromString(transform_param,
+      &param)) {
+    throw std::runtime_error("Could not parse the TransformationParameter");
+  }
+  shared_ptr<DataTransformer<Dtype> > transformer(
+      new DataTransformer<Dtype>(param, static_cast<Phase>(phase)));
+  transformer->InitRand();
+  return transformer;
+}
+
+// Transforms a list of 8-bit H x W x K (or H x W) images, in parallel when
+// the transformation allows, into blob, which is reshaped to hold them. The
+// images are wrapped rather than copied.
+void DataTransformer_Transform(DataTransformer<Dtype>* self,
+    bp::object images, Blob<Dtype>* blob) {
+  const int num = bp::len(images);
+  if (num == 0) {
+    throw std::runtime_error("DataTransformer.transform needs images");
+  }
+  // Hold the arrays while the GIL is released.
+  vector<bp::object> arrays;
+  vector<cv::Mat> mats;
+  for (int i = 0; i < num; ++i) {
+    bp::object image = images[i];
+    if (!PyArray_Check(image.ptr())) {
+      throw std::runtime_error("images must be ndarrays");
+    }
+    PyArrayObject* array = reinterpret_cast<PyArrayObject*>(image.ptr());
+    const int ndim = PyArray_NDIM(array);
+    if (PyArray_TYPE(array) != NPY_UINT8 || (ndim != 2 && ndim != 3)) {
+      throw std::runtime_error("images must be H x W x K or H x W uint8"
+          " arrays");
+    }
+    const npy_intp* dims = PyArray_DIMS(array);
+    const npy_intp* strides = PyArray_STRIDES(array);
+    const int channels = ndim == 3 ? dims[2] : 1;
+    if (dims[0] == 0 || dims[1] == 0 || channels == 0 ||
+        channels > CV_CN_MAX) {
+      throw std::runtime_error("images must not be empty, and have at most"
+          " 512 channels");
+    }
+    // Rows may be strided, as for crops, but their pixels must be packed.
+    if ((ndim == 3 && strides[2] != 1) || strides[1] != channels) {
+      throw std::runtime_error("image rows must be contiguous");
+    }
+    arrays.push_back(image);
+    mats.push_back(cv::Mat(dims[0], dims[1], CV_8UC(channels),
+        PyArray_DATA(array), strides[0]));
+    if (self->InferBlobShape(mats[i]) != self->InferBlobShape(mats[0])) {
+      throw std::runtime_error("images must transform to the same shape;"
+          " resize them with a resize_param");
+    }
+  }
+  blob->Reshape(self->InferBlobShape(mats));
+  ScopedGILRelease release;
+  self->Transform(mats, blob);
+}
+#endif  // USE_OPENCV
+
 BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(SolveOverloads, Solve, 0, 1);
 
 BOOST_PYTHON_MODULE(_caffe) {
@@ -299,8 +520,8 @@ BOOST_PYTHON_MODULE(_caffe) {
             bp::arg("weights")=bp::object())))
     // Legacy constructor
     .def("__init__", bp::make_constructor(&Net_Init_Load))
-    .def("_forward", &Net<Dtype>::ForwardFromTo)
-    .def("_backward", &Net<Dtype>::BackwardFromTo)
+    .def("_forward", &Net_ForwardFromTo)
+    .def("_backward", &Net_BackwardFromTo)
     .def("reshape", &Net<Dtype>::Reshape)
     .def("clear_param_diffs", &Net<Dtype>::ClearParamDiffs)
     // The cast is to select a particular overload.
@@ -315,6 +536,7 @@ BOOST_PYTHON_MODULE(_caffe) {
         bp::return_value_policy<bp::copy_const_reference>()))
     .add_property("_blobs", bp::make_function(&Net<Dtype>::blobs,
         bp::return_internal_reference<>()))
+    .def("_restore_channels_first", &Net<Dtype>::RestoreChannelsFirst)
     .add_property("layers", bp::make_function(&Net<Dtype>::layers,
         bp::return_internal_reference<>()))
     .add_property("_blob_names", bp::make_function(&Net<Dtype>::blob_names,
@@ -347,6 +569,11 @@ BOOST_PYTHON_MODULE(_caffe) {
     .add_property("count",    static_cast<int (Blob<Dtype>::*)() const>(
         &Blob<Dtype>::count))
     .def("reshape",           bp::raw_function(&Blob_Reshape))
+    .def("bind_data",         &Blob_BindData)
+    .def("unbind_data",       &Blob_UnbindData)
+    // Handing out .data bumps the data version, so caches derived from it
+    // (e.g. packed weights) are rebuilt on the next forward. An array kept
+    // across a forward and written later is not seen: fetch .data again.
     .add_property("data",     bp::make_function(&Blob<Dtype>::mutable_cpu_data,
           NdarrayCallPolicies()))
     .add_property("diff",     bp::make_function(&Blob<Dtype>::mutable_cpu_diff,
@@ -373,7 +600,7 @@ BOOST_PYTHON_MODULE(_caffe) {
     .def("add_callback", &Solver_add_callback<Dtype>)
     .def("solve", static_cast<void (Solver<Dtype>::*)(const char*)>(
           &Solver<Dtype>::Solve), SolveOverloads())
-    .def("step", &Solver<Dtype>::Step)
+    .def("step", &Solver_Step)
     .def("restore", &Solver<Dtype>::Restore)
     .def("snapshot", &Solver<Dtype>::Snapshot);
   BP_REGISTER_SHARED_PTR_TO_PYTHON(Solver<Dtype>);
@@ -397,6 +624,37 @@ BOOST_PYTHON_MODULE(_caffe) {
     shared_ptr<AdamSolver<Dtype> >, boost::noncopyable>(
         "AdamSolver", bp::init<string>());
 
+  bp::class_<InferencePool<Dtype>, shared_ptr<InferencePool<Dtype> >,
+    boost::noncopyable>("InferencePool", bp::no_init)
+    .def("__init__", bp::make_constructor(&InferencePool_Init,
+          bp::default_call_policies(), (bp::arg("net"),
+            bp::arg("num_workers")=1, bp::arg("max_batch_size")=1)))
+    .add_property("net", bp::make_function(&InferencePool<Dtype>::net,
+        bp::return_value_policy<bp::copy_const_reference>()))
+    .add_property("num_workers", &InferencePool<Dtype>::num_workers)
+    .add_property("max_batch_size", &InferencePool<Dtype>::max_batch_size)
+    .def("_submit", &InferencePool_Submit);
+  BP_REGISTER_SHARED_PTR_TO_PYTHON(InferencePool<Dtype>);
+
+  bp::class_<InferenceRequest<Dtype>, shared_ptr<InferenceRequest<Dtype> >,
+    boost::noncopyable>("InferenceRequest", bp::no_init)
+    .add_property("done", &InferenceRequest<Dtype>::done)
+    .def("wait", &InferenceRequest_Wait)
+    .add_property("outputs", bp::make_function(
+        &InferenceRequest<Dtype>::outputs,
+        bp::return_internal_reference<>()));
+  BP_REGISTER_SHARED_PTR_TO_PYTHON(InferenceRequest<Dtype>);
+
+#ifdef USE_OPENCV
+  bp::class_<DataTransformer<Dtype>, shared_ptr<DataTransformer<Dtype> >,
+    boost::noncopyable>("DataTransformer", bp::no_init)
+    .def("__init__", bp::make_constructor(&DataTransformer_Init,
+          bp::default_call_policies(), (bp::arg("transform_param"),
+            bp::arg("phase")=static_cast<int>(TEST))))
+    .def("transform", &DataTransformer_Transform);
+  BP_REGISTER_SHARED_PTR_TO_PYTHON(DataTransformer<Dtype>);
+#endif  // USE_OPENCV
+
   bp::def("get_solver", &GetSolverFromFile,
       bp::return_value_policy<bp::manage_new_object>());
 
@@ -419,6 +677,12 @@ BOOST_PYTHON_MODULE(_caffe) {
   bp::class_<vector<bool> >("BoolVec")
     .def(bp::vector_indexing_suite<vector<bool> >());
 
+#if PY_VERSION_HEX < 0x03070000
+  // Set up the GIL, which the bindings release, for Pythons that do not at
+  // startup.
+  PyEval_InitThreads();
+#endif
+
   // boost python expects a void (missing) return value, while import_array
   // returns NULL for python3. import_array1() forces a void return value.
   import_array1();
@@ -87,7 +87,7 @@ class Classifier(caffe.Net):
                             dtype=np.float32)
         for ix, in_ in enumerate(input_):
             caffe_in[ix] = self.transformer.preprocess(self.inputs[0], in_)
-        out = self.forward_all(**{self.inputs[0]: caffe_in})
+        out = self.forward_all(zero_copy=True, **{self.inputs[0]: caffe_in})
         predictions = out[self.outputs[0]]
 
         # For oversampling, average predictions across crops.
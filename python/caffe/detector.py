@@ -82,7 +82,7 @@ class Detector(caffe.Net):
                             dtype=np.float32)
         for ix, window_in in enumerate(window_inputs):
             caffe_in[ix] = self.transformer.preprocess(in_, window_in)
-        out = self.forward_all(**{in_: caffe_in})
+        out = self.forward_all(zero_copy=True, **{in_: caffe_in})
         predictions = out[self.outputs[0]]
 
         # Package predictions with images and windows.
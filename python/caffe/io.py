@@ -3,9 +3,12 @@ import skimage.io
 from scipy.ndimage import zoom
 from skimage.transform import resize
 
+from . import _caffe
+
 try:
     # Python3 will most likely not be able to load protobuf
     from caffe.proto import caffe_pb2
+    from google.protobuf import text_format
 except:
     import sys
     if sys.version_info >= (3, 0):
@@ -161,6 +164,60 @@ class Transformer:
             caffe_in *= input_scale
         return caffe_in
 
+    def preprocess_batch(self, in_, images, blob):
+        """
+        Format a batch of 8-bit images for Caffe as preprocess() does, in
+        C++ with the data layers' DataTransformer: each image is resized,
+        transposed, reordered, scaled and centered in one pass, in parallel
+        across images, straight into blob.
+
+        An 8-bit value v stands for v / 255, as skimage.img_as_float has it.
+        The transpose must be (2, 0, 1), if set, and the mean one value per
+        channel. Resizing is bilinear, without the smoothing skimage may do.
+
+        Parameters
+        ----------
+        in_ : name of input blob to preprocess for
+        images : list of (H' x W' x K) or (H' x W') uint8 ndarrays
+        blob : Blob to fill, reshaped to N x K x H x W, e.g. net.blobs[in_]
+
+        Returns
+        -------
+        caffe_in : (N x K x H x W) data of blob
+        """
+        self.__check_input(in_)
+        if not hasattr(_caffe, 'DataTransformer'):
+            raise Exception('preprocess_batch needs Caffe built with OpenCV')
+        transpose = self.transpose.get(in_)
+        channel_swap = self.channel_swap.get(in_)
+        mean = self.mean.get(in_)
+        if transpose is not None and tuple(transpose) != (2, 0, 1):
+            raise ValueError('preprocess_batch takes H x W x K images to '
+                             'K x H x W only.')
+        if mean is not None and mean.shape[1:] != (1, 1):
+            raise ValueError('preprocess_batch takes a mean per channel.')
+        if any((im.shape[2] if im.ndim == 3 else 1) != self.inputs[in_][1]
+               for im in images):
+            raise ValueError('Image channels incompatible with input.')
+        param = caffe_pb2.TransformationParameter()
+        # (v / 255 * raw_scale - mean) * input_scale is computed as
+        # (v - mean / k) * k * input_scale with k = raw_scale / 255.
+        k = self.raw_scale.get(in_, 1.) / 255.
+        param.scale = k * self.input_scale.get(in_, 1.)
+        if mean is not None:
+            param.mean_value.extend([float(m) for m in mean.ravel() / k])
+        if channel_swap is not None:
+            param.channel_swap.extend([int(c) for c in channel_swap])
+        in_dims = tuple(self.inputs[in_][2:])
+        if any(im.shape[:2] != in_dims for im in images):
+            param.resize_param.height, param.resize_param.width = in_dims
+            param.resize_param.interp_mode.append(
+                caffe_pb2.ResizeParameter.LINEAR)
+        transformer = _caffe.DataTransformer(
+            text_format.MessageToString(param))
+        transformer.transform(images, blob)
+        return blob.data
+
     def deprocess(self, in_, data):
         """
         Invert Caffe formatting; see preprocess().
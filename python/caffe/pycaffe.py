@@ -11,7 +11,7 @@ except:
 import numpy as np
 
 from ._caffe import Net, SGDSolver, NesterovSolver, AdaGradSolver, \
-        RMSPropSolver, AdaDeltaSolver, AdamSolver
+        RMSPropSolver, AdaDeltaSolver, AdamSolver, InferencePool
 import caffe.io
 
 import six
@@ -25,7 +25,18 @@ import six
 def _Net_blobs(self):
     """
     An OrderedDict (bottom to top, i.e., input to output) of network
-    blobs indexed by name
+    blobs indexed by name, all channels-first, even those the last forward
+    left channels-last (see NetParameter.channels_last)
+    """
+    self._restore_channels_first()
+    return self._blob_dict
+
+
+@property
+def _Net_blob_dict(self):
+    """
+    The blobs as they are; forward hands back the inputs and outputs, which
+    are all the methods below read, channels-first.
     """
     if not hasattr(self, '_blobs_dict'):
         self._blobs_dict = OrderedDict(zip(self._blob_names, self._blobs))
@@ -62,7 +73,7 @@ def _Net_params(self):
 @property
 def _Net_inputs(self):
     if not hasattr(self, '_input_list'):
-        keys = list(self.blobs.keys())
+        keys = list(self._blob_dict.keys())
         self._input_list = [keys[i] for i in self._inputs]
     return self._input_list
 
@@ -70,12 +81,27 @@ def _Net_inputs(self):
 @property
 def _Net_outputs(self):
     if not hasattr(self, '_output_list'):
-        keys = list(self.blobs.keys())
+        keys = list(self._blob_dict.keys())
         self._output_list = [keys[i] for i in self._outputs]
     return self._output_list
 
 
-def _Net_forward(self, blobs=None, start=None, end=None, **kwargs):
+def _can_bind(arr, shape):
+    """
+    Whether ndarray arr can be bound as the memory of a blob of the given
+    shape (see Blob.bind_data).
+    """
+    return (arr.dtype == np.float32 and arr.shape == shape and
+            arr.flags.c_contiguous and arr.flags.aligned and
+            arr.flags.writeable)
+
+
+def _data_address(arr):
+    return arr.__array_interface__['data'][0]
+
+
+def _Net_forward(self, blobs=None, start=None, end=None, zero_copy=False,
+                 **kwargs):
     """
     Forward pass: prepare inputs and run the net forward.
 
@@ -88,6 +114,11 @@ def _Net_forward(self, blobs=None, start=None, end=None, **kwargs):
     start : optional name of layer at which to begin the forward pass
     end : optional name of layer at which to finish the forward pass
           (inclusive)
+    zero_copy : bind input ndarrays that are float32, C-contiguous, aligned,
+                writeable and shaped like their blob as the blob memory
+                instead of copying them in (see Blob.bind_data). The net
+                then reads them, and in-place layers write them, until the
+                blobs are given other inputs.
 
     Returns
     -------
@@ -114,14 +145,18 @@ def _Net_forward(self, blobs=None, start=None, end=None, **kwargs):
         # Set input according to defined shapes and make arrays single and
         # C-contiguous as Caffe expects.
         for in_, blob in six.iteritems(kwargs):
-            if blob.shape[0] != self.blobs[in_].shape[0]:
+            if blob.shape[0] != self._blob_dict[in_].shape[0]:
                 raise Exception('Input is not batch sized')
-            self.blobs[in_].data[...] = blob
+            if zero_copy and _can_bind(blob, self._blob_dict[in_].data.shape):
+                self._blob_dict[in_].bind_data(blob)
+            else:
+                self._blob_dict[in_].unbind_data()
+                self._blob_dict[in_].data[...] = blob
 
     self._forward(start_ind, end_ind)
 
     # Unpack blobs to extract
-    return {out: self.blobs[out].data for out in outputs}
+    return {out: self._blob_dict[out].data for out in outputs}
 
 
 def _Net_backward(self, diffs=None, start=None, end=None, **kwargs):
@@ -162,17 +197,18 @@ def _Net_backward(self, diffs=None, start=None, end=None, **kwargs):
         # Set top diffs according to defined shapes and make arrays single and
         # C-contiguous as Caffe expects.
         for top, diff in six.iteritems(kwargs):
-            if diff.shape[0] != self.blobs[top].shape[0]:
+            if diff.shape[0] != self._blob_dict[top].shape[0]:
                 raise Exception('Diff is not batch sized')
-            self.blobs[top].diff[...] = diff
+            self._blob_dict[top].diff[...] = diff
 
     self._backward(start_ind, end_ind)
 
     # Unpack diffs to extract
-    return {out: self.blobs[out].diff for out in outputs}
+    return {out: self._blob_dict[out].diff for out in outputs}
 
 
-def _Net_forward_all(self, blobs=None, **kwargs):
+def _Net_forward_all(self, blobs=None, zero_copy=False, per_batch=None,
+                     **kwargs):
     """
     Run net forward in batches.
 
@@ -181,25 +217,65 @@ def _Net_forward_all(self, blobs=None, **kwargs):
     blobs : list of blobs to extract as in forward()
     kwargs : Keys are input blob names and values are blob ndarrays.
              Refer to forward().
+    zero_copy : bind the input batches as forward() does, and have the net
+                write each batch of outputs directly into the returned
+                arrays where it can. The blobs get memory of their own back
+                at the end.
+    per_batch : list of blobs to extract whose shape does not follow the
+                batch, such as detections, kept as a list of their ndarray
+                of each batch.
 
     Returns
     -------
-    all_outs : {blob name: list of blobs} dict.
+    all_outs : {blob name: blob ndarray} dict, with an item per input in
+               each ndarray, except for the per_batch blobs, which map to a
+               list. Any other output without an item per input raises.
     """
-    # Collect outputs from batches
-    all_outs = {out: [] for out in set(self.outputs + (blobs or []))}
-    for batch in self._batch(kwargs):
-        outs = self.forward(blobs=blobs, **batch)
-        for out, out_blob in six.iteritems(outs):
-            all_outs[out].extend(out_blob.copy())
-    # Package in ndarray.
-    for out in all_outs:
-        all_outs[out] = np.asarray(all_outs[out])
+    per_batch = set(per_batch or [])
+    blobs = list(set(blobs or []) | per_batch)
+    outputs = set(self.outputs + blobs)
+    num = len(six.next(six.itervalues(kwargs)))
+    batch_size = six.next(six.itervalues(self._blob_dict)).shape[0]
+    padded_num = -(-num // batch_size) * batch_size
+    # Collect the outputs into arrays allocated on the first batch, and
+    # copies of the per_batch outputs of each batch into lists.
+    all_outs = {out: [] for out in per_batch}
+    i = 0
+    try:
+        for batch in self._batch(kwargs):
+            if zero_copy:
+                for out in outputs - per_batch - set(kwargs):
+                    if out in all_outs:
+                        self._blob_dict[out].bind_data(
+                            all_outs[out][i:i + batch_size])
+            outs = self.forward(blobs=blobs, zero_copy=zero_copy, **batch)
+            for out, out_blob in six.iteritems(outs):
+                if out in per_batch:
+                    all_outs[out].append(out_blob.copy())
+                    continue
+                if out not in all_outs:
+                    if not out_blob.ndim or out_blob.shape[0] != batch_size:
+                        raise Exception('Output {} does not have an item per '
+                                        'input; pass it in per_batch.'
+                                        .format(out))
+                    all_outs[out] = np.empty(
+                        (padded_num,) + out_blob.shape[1:],
+                        dtype=out_blob.dtype)
+                elif out_blob.shape[1:] != all_outs[out].shape[1:]:
+                    raise Exception('Output {} changed shape between '
+                                    'batches; pass it in per_batch.'
+                                    .format(out))
+                dst = all_outs[out][i:i + batch_size]
+                if _data_address(out_blob) != _data_address(dst):
+                    dst[...] = out_blob
+            i += batch_size
+    finally:
+        if zero_copy:
+            for name in outputs | set(kwargs):
+                self._blob_dict[name].unbind_data()
     # Discard padding.
-    pad = len(six.next(six.itervalues(all_outs))) - len(six.next(six.itervalues(kwargs)))
-    if pad:
-        for out in all_outs:
-            all_outs[out] = all_outs[out][:-pad]
+    for out in set(all_outs) - per_batch:
+        all_outs[out] = all_outs[out][:num]
     return all_outs
 
 
@@ -273,7 +349,7 @@ def _Net_batch(self, blobs):
     batch: {blob name: list of blobs} dict for a single batch.
     """
     num = len(six.next(six.itervalues(blobs)))
-    batch_size = six.next(six.itervalues(self.blobs)).shape[0]
+    batch_size = six.next(six.itervalues(self._blob_dict)).shape[0]
     remainder = num % batch_size
     num_batches = num // batch_size
 
@@ -310,7 +386,7 @@ def _Net_get_id_name(func, field):
     @property
     def get_id_name(self):
         if not hasattr(self, field):
-            id_to_name = list(self.blobs)
+            id_to_name = list(self._blob_dict)
             res = OrderedDict([(self._layer_names[i],
                                 [id_to_name[j] for j in func(self, i)])
                                 for i in range(len(self.layers))])
@@ -318,8 +394,54 @@ def _Net_get_id_name(func, field):
         return getattr(self, field)
     return get_id_name
 
+
+class InferenceFuture(object):
+    """
+    The pending result of InferencePool.forward_async.
+    """
+    def __init__(self, request, outputs):
+        self._request = request
+        self._outputs = outputs
+
+    def done(self):
+        """Whether the forward pass has finished, without blocking."""
+        return self._request.done
+
+    def result(self):
+        """
+        Wait for the forward pass, with the GIL released, and return its
+        {output blob name: blob ndarray} dict.
+        """
+        self._request.wait()
+        return {out: blob.data
+                for out, blob in zip(self._outputs, self._request.outputs)}
+
+
+def _InferencePool_forward_async(self, **kwargs):
+    """
+    Queue a forward pass on the pool's workers, which run it on their own
+    replicas of the net without the GIL, and return at once.
+
+    Parameters
+    ----------
+    kwargs : Keys are input blob names and values are ndarrays, batched along
+             their first axis; the batch need not be the net's. The arrays
+             are copied, so they may change as soon as this returns.
+
+    Returns
+    -------
+    future : InferenceFuture whose result() is the {output blob name: blob
+             ndarray} dict of the pass.
+    """
+    net = self.net
+    if set(kwargs.keys()) != set(net.inputs):
+        raise Exception('Input blob arguments do not match net inputs.')
+    request = self._submit([kwargs[in_] for in_ in net.inputs])
+    return InferenceFuture(request, net.outputs)
+
 # Attach methods to Net.
 Net.blobs = _Net_blobs
+Net._blob_dict = _Net_blob_dict
 Net.blob_loss_weights = _Net_blob_loss_weights
 Net.params = _Net_params
 Net.forward = _Net_forward
@@ -332,3 +454,6 @@ Net.inputs = _Net_inputs
 Net.outputs = _Net_outputs
 Net.top_names = _Net_get_id_name(Net._top_ids, "_top_names")
 Net.bottom_names = _Net_get_id_name(Net._bottom_ids, "_bottom_names")
+
+# Attach methods to InferencePool.
+InferencePool.forward_async = _InferencePool_forward_async
@@ -0,0 +1,92 @@
+import unittest
+import tempfile
+import os
+import threading
+import numpy as np
+
+import caffe
+
+
+def conv_net_file():
+    """Make a fully convolutional net prototxt, which takes inputs of any
+    batch, returning the name of the (temporary) file."""
+
+    f = tempfile.NamedTemporaryFile(mode='w+', delete=False)
+    f.write("""name: 'convnet'
+    layer { type: 'Input' name: 'data' top: 'data'
+      input_param { shape { dim: 2 dim: 3 dim: 6 dim: 6 } } }
+    layer { type: 'Convolution' name: 'conv' bottom: 'data' top: 'conv'
+      convolution_param { num_output: 5 kernel_size: 3 pad: 1
+        weight_filler { type: 'gaussian' std: 1 }
+        bias_filler { type: 'gaussian' std: 1 } } }
+    layer { type: 'ReLU' name: 'relu' bottom: 'conv' top: 'conv' }
+    layer { type: 'Softmax' name: 'prob' bottom: 'conv' top: 'prob' }""")
+    f.close()
+    return f.name
+
+
+class TestInferencePool(unittest.TestCase):
+    def setUp(self):
+        caffe.set_mode_cpu()
+        net_file = conv_net_file()
+        self.net = caffe.Net(net_file, caffe.TEST)
+        os.remove(net_file)
+
+    def expected(self, data):
+        self.net.blobs['data'].reshape(*data.shape)
+        return self.net.forward(data=data)['prob'].copy()
+
+    def test_forward_async(self):
+        inputs = [np.random.randn(1 + i % 3, 3, 6, 6).astype(np.float32)
+                  for i in range(10)]
+        expected = [self.expected(data) for data in inputs]
+        pool = caffe.InferencePool(self.net, num_workers=3)
+        self.assertEqual(pool.num_workers, 3)
+        futures = [pool.forward_async(data=data) for data in inputs]
+        for future, prob in zip(futures, expected):
+            np.testing.assert_allclose(future.result()['prob'], prob,
+                                       rtol=1e-5, atol=1e-6)
+            self.assertTrue(future.done())
+
+    def test_batch_requests(self):
+        inputs = [np.random.randn(1, 3, 6, 6) for i in range(8)]
+        expected = [self.expected(data) for data in inputs]
+        pool = caffe.InferencePool(self.net, max_batch_size=4)
+        futures = [pool.forward_async(data=data) for data in inputs]
+        # The outputs outlive the pool.
+        del pool
+        for future, prob in zip(futures, expected):
+            self.assertTrue(future.done())
+            np.testing.assert_allclose(future.result()['prob'], prob,
+                                       rtol=1e-5, atol=1e-6)
+
+    def test_wrong_inputs(self):
+        pool = caffe.InferencePool(self.net)
+        with self.assertRaises(Exception):
+            pool.forward_async(label=np.zeros((1, 3, 6, 6)))
+        with self.assertRaises(Exception):
+            pool.forward_async(data=np.zeros((3, 6, 6)))
+
+    def test_forward_from_threads(self):
+        """Nets forward without the GIL, so threads can run them at once."""
+        nets = [self.net] + [caffe.Net(self.net_file(), caffe.TEST)
+                             for i in range(2)]
+        errors = []
+
+        def run(net):
+            try:
+                for i in range(5):
+                    net.forward()
+            except Exception as e:
+                errors.append(e)
+        threads = [threading.Thread(target=run, args=(net,)) for net in nets]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEqual(errors, [])
+
+    def net_file(self):
+        net_file = conv_net_file()
+        self.addCleanup(os.remove, net_file)
+        return net_file
@@ -54,3 +54,48 @@ class TestArrayToDatum(unittest.TestCase):
         self.assertGreater(
             len(d1.SerializeToString()),
             len(d2.SerializeToString()))
+
+
+
+@unittest.skipIf(not hasattr(caffe._caffe, 'DataTransformer'),
+                 'Caffe built without OpenCV')
+class TestPreprocessBatch(unittest.TestCase):
+
+    def setUp(self):
+        self.transformer = caffe.io.Transformer({'data': (4, 3, 5, 6)})
+        self.transformer.set_transpose('data', (2, 0, 1))
+        self.transformer.set_channel_swap('data', (2, 1, 0))
+        self.transformer.set_raw_scale('data', 255)
+        self.transformer.set_mean('data', np.array([10., 20., 30.]))
+        self.transformer.set_input_scale('data', 0.5)
+        blobs = caffe._caffe.BlobVec()
+        blobs.add_blob(1)
+        self.blob = blobs[0]
+
+    def test_matches_preprocess(self):
+        images = [np.random.randint(0, 256, (5, 6, 3)).astype(np.uint8)
+                  for i in range(4)]
+        # A crop, whose rows are strided.
+        images.append(np.random.randint(
+            0, 256, (7, 8, 3)).astype(np.uint8)[1:6, 2:8])
+        data = self.transformer.preprocess_batch('data', images, self.blob)
+        self.assertEqual(data.shape, (5, 3, 5, 6))
+        for im, caffe_in in zip(images, data):
+            expected = self.transformer.preprocess('data', im / 255.)
+            np.testing.assert_allclose(caffe_in, expected, rtol=1e-5,
+                                       atol=1e-3)
+
+    def test_resize(self):
+        images = [np.zeros((10, 12, 3), dtype=np.uint8),
+                  np.zeros((3, 4, 3), dtype=np.uint8)]
+        data = self.transformer.preprocess_batch('data', images, self.blob)
+        self.assertEqual(data.shape, (2, 3, 5, 6))
+        np.testing.assert_allclose(data[:, 0], -5, rtol=1e-5)
+
+    def test_wrong_images(self):
+        with self.assertRaises(ValueError):
+            self.transformer.preprocess_batch(
+                'data', [np.zeros((5, 6, 1), dtype=np.uint8)], self.blob)
+        with self.assertRaises(Exception):
+            self.transformer.preprocess_batch(
+                'data', [np.zeros((5, 6, 3))], self.blob)
@@ -343,3 +343,124 @@ layer {
         net = caffe.Net(self.f.name, caffe.TEST, stages=['deploy'])
         self.check_net(net, ['pred'])
 
+
+
+class TestZeroCopy(unittest.TestCase):
+
+    TEST_NET = """
+layer {
+  name: "data"
+  type: "Input"
+  top: "data"
+  input_param { shape { dim: 4 dim: 2 dim: 3 dim: 3 } }
+}
+layer {
+  name: "ip"
+  type: "InnerProduct"
+  bottom: "data"
+  top: "ip"
+  inner_product_param {
+    num_output: 5
+    weight_filler { type: "gaussian" std: 1 }
+  }
+}
+layer {
+  name: "pred"
+  type: "Softmax"
+  bottom: "ip"
+  top: "pred"
+}
+"""
+
+    def setUp(self):
+        f = tempfile.NamedTemporaryFile(mode='w+', delete=False)
+        f.write(self.TEST_NET)
+        f.close()
+        self.net = caffe.Net(f.name, caffe.TEST)
+        os.remove(f.name)
+
+    def test_bind_data(self):
+        data = np.random.randn(4, 2, 3, 3).astype(np.float32)
+        expected = self.net.forward(data=data)['pred'].copy()
+        bound = data.copy()
+        self.net.blobs['data'].bind_data(bound)
+        # The blob reads and writes the array.
+        self.net.blobs['data'].data[0, 0, 0, 0] = 7
+        self.assertEqual(bound[0, 0, 0, 0], 7)
+        bound[...] = data
+        del bound
+        self.assertTrue((self.net.forward()['pred'] == expected).all())
+        # Unbinding keeps the values.
+        self.net.blobs['data'].unbind_data()
+        self.assertTrue((self.net.blobs['data'].data == data).all())
+        with self.assertRaises(Exception):
+            self.net.blobs['data'].bind_data(data.astype(np.float64))
+        with self.assertRaises(Exception):
+            self.net.blobs['data'].bind_data(
+                np.asfortranarray(data.transpose()))
+
+    def test_write_params(self):
+        data = np.random.randn(4, 2, 3, 3).astype(np.float32)
+        self.net.forward(data=data)
+        # Writes through .data reach weights derived for inference.
+        self.net.params['ip'][0].data[...] = 0
+        pred = self.net.forward(data=data)['pred']
+        self.assertTrue(np.allclose(pred, 1. / 5))
+
+    def test_forward_zero_copy(self):
+        data = np.random.randn(4, 2, 3, 3).astype(np.float32)
+        expected = self.net.forward(data=data)['pred'].copy()
+        pred = self.net.forward(zero_copy=True, data=data)['pred']
+        self.assertTrue((pred == expected).all())
+        data[0] = 0
+        self.assertTrue((self.net.blobs['data'].data[0] == 0).all())
+        # Copying inputs in again does not write the bound array.
+        self.net.forward(data=np.ones_like(data))
+        self.assertTrue((data[1:] != 1).any())
+
+    def test_forward_all_zero_copy(self):
+        data = np.random.randn(10, 2, 3, 3).astype(np.float32)
+        expected = self.net.forward_all(data=data)['pred']
+        pred = self.net.forward_all(zero_copy=True, data=data)['pred']
+        self.assertEqual(pred.shape, (10, 5))
+        self.assertTrue((pred == expected).all())
+        # The blobs no longer use the arrays.
+        self.net.forward(data=np.zeros_like(data[:4]))
+        self.assertTrue((pred == expected).all())
+
+    def test_forward_all_unbatched_output(self):
+        # An output with one item per batch, shaped like detections.
+        f = tempfile.NamedTemporaryFile(mode='w+', delete=False)
+        f.write(self.TEST_NET + """
+layer {
+  name: "det"
+  type: "Reshape"
+  bottom: "ip"
+  top: "det"
+  reshape_param { shape { dim: 1 dim: 1 dim: -1 dim: 5 } }
+}
+""")
+        f.close()
+        net = caffe.Net(f.name, caffe.TEST)
+        os.remove(f.name)
+        data = np.random.randn(10, 2, 3, 3).astype(np.float32)
+        with self.assertRaises(Exception):
+            net.forward_all(data=data)
+        for zero_copy in (False, True):
+            outs = net.forward_all(blobs=['ip'], zero_copy=zero_copy,
+                                   per_batch=['det'], data=data)
+            self.assertEqual(outs['ip'].shape, (10, 5))
+            self.assertEqual(len(outs['det']), 3)
+            for b, det in enumerate(outs['det']):
+                self.assertEqual(det.shape, (1, 1, 4, 5))
+                ip = outs['ip'][b * 4:(b + 1) * 4]
+                self.assertTrue((det[0, 0, :len(ip)] == ip).all())
+
+    def test_forward_all_per_batch(self):
+        # Declared outputs are lists even when they have an item per input.
+        data = np.random.randn(10, 2, 3, 3).astype(np.float32)
+        outs = self.net.forward_all(per_batch=['ip'], data=data)
+        self.assertEqual(outs['pred'].shape, (10, 5))
+        self.assertEqual(len(outs['ip']), 3)
+        for ip in outs['ip']:
+            self.assertEqual(ip.shape, (4, 5))
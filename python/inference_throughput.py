@@ -0,0 +1,128 @@
+#!/usr/bin/env python
+"""
+inference_throughput.py benchmarks serving a model from Python: it measures
+the requests per second of Net.forward called in a loop, and of
+InferencePool.forward_async with growing numbers of workers.
+
+Requests are random inputs shaped like the net inputs, with --batch_size
+items each. The model must have input blobs.
+"""
+import argparse
+import sys
+import time
+
+import numpy as np
+
+import caffe
+
+
+def make_requests(net, num_requests, batch_size):
+    requests = []
+    for i in range(num_requests):
+        requests.append({in_: np.random.randn(
+            *((batch_size,) + net.blobs[in_].data.shape[1:])).astype(
+                np.float32) for in_ in net.inputs})
+    return requests
+
+
+def forward_rate(net, requests):
+    for in_ in net.inputs:
+        net.blobs[in_].reshape(*requests[0][in_].shape)
+    net.forward(**requests[0])
+    start = time.time()
+    for request in requests:
+        net.forward(**request)
+    return len(requests) / (time.time() - start)
+
+
+def pool_rate(net, requests, num_workers, max_batch_size, in_flight):
+    pool = caffe.InferencePool(net, num_workers=num_workers,
+                               max_batch_size=max_batch_size)
+    # Warm up every worker.
+    for future in [pool.forward_async(**requests[0])
+                   for i in range(num_workers)]:
+        future.result()
+    start = time.time()
+    futures = []
+    for request in requests:
+        futures.append(pool.forward_async(**request))
+        # Bound the requests in flight, as a server would.
+        if len(futures) >= in_flight:
+            futures.pop(0).result()
+    for future in futures:
+        future.result()
+    return len(requests) / (time.time() - start)
+
+
+def main(argv):
+    parser = argparse.ArgumentParser()
+    # Required arguments: the model.
+    parser.add_argument(
+        "model_def",
+        help="Model definition file."
+    )
+    # Optional arguments.
+    parser.add_argument(
+        "--weights",
+        help="Trained model weights file."
+    )
+    parser.add_argument(
+        "--gpu",
+        action='store_true',
+        help="Switch for gpu computation."
+    )
+    parser.add_argument(
+        "--requests",
+        type=int,
+        default=200,
+        help="Number of requests to time."
+    )
+    parser.add_argument(
+        "--batch_size",
+        type=int,
+        default=1,
+        help="Number of items in each request."
+    )
+    parser.add_argument(
+        "--max_workers",
+        type=int,
+        default=4,
+        help="Largest number of pool workers to time, doubling from 1."
+    )
+    parser.add_argument(
+        "--max_batch_size",
+        type=int,
+        default=1,
+        help="Largest batch the pool workers gather requests into."
+    )
+    parser.add_argument(
+        "--in_flight",
+        type=int,
+        default=32,
+        help="Number of requests queued on the pool at once."
+    )
+    args = parser.parse_args()
+
+    if args.gpu:
+        caffe.set_mode_gpu()
+        print("GPU mode")
+    else:
+        caffe.set_mode_cpu()
+        print("CPU mode")
+
+    net = caffe.Net(args.model_def, caffe.TEST, weights=args.weights)
+    requests = make_requests(net, args.requests, args.batch_size)
+
+    baseline = forward_rate(net, requests)
+    print("Net.forward: {:.1f} requests/s".format(baseline))
+    num_workers = 1
+    while num_workers <= args.max_workers:
+        rate = pool_rate(net, requests, num_workers, args.max_batch_size,
+                         args.in_flight)
+        print("InferencePool, {} workers: {:.1f} requests/s, {:.2f}x".format(
+            num_workers, rate, rate / baseline))
+        num_workers *= 2
+
+
+if __name__ == '__main__':
+    main(sys.argv)
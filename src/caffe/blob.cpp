@@ -146,6 +146,48 @@ void Blob<Dtype>::ShareDiff(const Blob& other) {
   diff_ = other.diff();
 }
 
+template <typename Dtype>
+void Blob<Dtype>::ShareDataView(const Blob& other, const int offset) {
+  CHECK_GE(offset, 0);
+  CHECK_LE(offset + count_, other.count());
+  data_.reset(new SyncedMemory(count_ * sizeof(Dtype)));
+  data_->set_cpu_data(
+      static_cast<Dtype*>(other.data()->mutable_cpu_data()) + offset);
+  // Growing must not write past the view.
+  capacity_ = count_;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShareDiffView(const Blob& other, const int offset) {
+  CHECK_GE(offset, 0);
+  CHECK_LE(offset + count_, other.count());
+  diff_.reset(new SyncedMemory(count_ * sizeof(Dtype)));
+  diff_->set_cpu_data(
+      static_cast<Dtype*>(other.diff()->mutable_cpu_data()) + offset);
+  capacity_ = count_;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ReleaseViews() {
+  capacity_ = count_;
+  data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+  diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+}
+
+template <typename Dtype>
+void Blob<Dtype>::set_data(const shared_ptr<SyncedMemory>& data,
+    const vector<int>& shape) {
+  CHECK(data);
+  data_ = data;
+  capacity_ = data->size() / sizeof(Dtype);
+  // Growing up to the new capacity must not write past the diff.
+  if (!diff_ || diff_->size() < capacity_ * sizeof(Dtype)) {
+    diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+  }
+  Reshape(shape);
+  CHECK(data_ == data) << "The shape does not fit in the data.";
+}
+
 // The "update" method is used for parameter blobs in a Net, which are stored
 // as Blob<float> or Blob<double> -- hence we do not define it for
 // Blob<int> or Blob<unsigned int>.
@@ -5,12 +5,15 @@
 #include <string>
 #include <vector>
 
+#include "boost/bind.hpp"
+
 #include "caffe/data_transformer.hpp"
 #include "caffe/util/bbox_util.hpp"
 #include "caffe/util/im_transforms.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -47,6 +50,47 @@ DataTransformer<Dtype>::DataTransformer(const TransformationParameter& param,
   }
 }
 
+template<typename Dtype>
+void DataTransformer<Dtype>::ReplicateMeanValues(const int channels) {
+  CHECK(mean_values_.size() == 1 || mean_values_.size() == channels) <<
+      "Specify either 1 mean_value or as many as channels: " << channels;
+  if (channels > 1 && mean_values_.size() == 1) {
+    // Replicate the mean_value for simplicity
+    for (int c = 1; c < channels; ++c) {
+      mean_values_.push_back(mean_values_[0]);
+    }
+  }
+}
+
+// Inputs can only be transformed concurrently when no random choices are
+// made, as they would draw from one generator.
+template<typename Dtype>
+bool DataTransformer<Dtype>::MakesRandomChoices() const {
+  const bool has_crop =
+      param_.crop_size() || (param_.crop_h() && param_.crop_w());
+  return param_.mirror() || (phase_ == TRAIN && has_crop) ||
+      param_.has_noise_param() || (param_.has_resize_param() &&
+      param_.resize_param().interp_mode_size() > 1);
+}
+
+template<typename Dtype>
+vector<int> DataTransformer<Dtype>::ChannelSources(const int channels) const {
+  vector<int> sources(channels);
+  if (param_.channel_swap_size() == 0) {
+    for (int c = 0; c < channels; ++c) {
+      sources[c] = c;
+    }
+    return sources;
+  }
+  CHECK_EQ(param_.channel_swap_size(), channels) <<
+      "Specify a channel_swap entry for each of the channels: " << channels;
+  for (int c = 0; c < channels; ++c) {
+    CHECK_LT(param_.channel_swap(c), channels) << "Invalid channel_swap.";
+    sources[c] = param_.channel_swap(c);
+  }
+  return sources;
+}
+
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const Datum& datum,
                                        Dtype* transformed_data,
@@ -68,23 +112,17 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   CHECK_GE(datum_height, crop_size);
   CHECK_GE(datum_width, crop_size);
 
-  Dtype* mean = NULL;
+  const Dtype* mean = NULL;
   if (has_mean_file) {
     CHECK_EQ(datum_channels, data_mean_.channels());
     CHECK_EQ(datum_height, data_mean_.height());
     CHECK_EQ(datum_width, data_mean_.width());
-    mean = data_mean_.mutable_cpu_data();
+    mean = data_mean_.cpu_data();
   }
   if (has_mean_values) {
-    CHECK(mean_values_.size() == 1 || mean_values_.size() == datum_channels) <<
-     "Specify either 1 mean_value or as many as channels: " << datum_channels;
-    if (datum_channels > 1 && mean_values_.size() == 1) {
-      // Replicate the mean_value for simplicity
-      for (int c = 1; c < datum_channels; ++c) {
-        mean_values_.push_back(mean_values_[0]);
-      }
-    }
+    ReplicateMeanValues(datum_channels);
   }
+  const vector<int> sources = ChannelSources(datum_channels);
 
   int height = datum_height;
   int width = datum_width;
@@ -111,11 +149,13 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   crop_bbox->set_ymax(Dtype(h_off + height) / datum_height);
 
   Dtype datum_element;
-  int top_index, data_index;
+  int top_index, data_index, source_index;
   for (int c = 0; c < datum_channels; ++c) {
     for (int h = 0; h < height; ++h) {
       for (int w = 0; w < width; ++w) {
         data_index = (c * datum_height + h_off + h) * datum_width + w_off + w;
+        source_index =
+            data_index + (sources[c] - c) * datum_height * datum_width;
         if (*do_mirror) {
           top_index = (c * height + h) * width + (width - 1 - w);
         } else {
@@ -123,9 +163,9 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
         }
         if (has_uint8) {
           datum_element =
-            static_cast<Dtype>(static_cast<uint8_t>(data[data_index]));
+            static_cast<Dtype>(static_cast<uint8_t>(data[source_index]));
         } else {
-          datum_element = datum.float_data(data_index);
+          datum_element = datum.float_data(source_index);
         }
         if (has_mean_file) {
           transformed_data[top_index] =
@@ -227,11 +267,28 @@ void DataTransformer<Dtype>::Transform(const vector<Datum> & datum_vector,
   CHECK_GT(datum_num, 0) << "There is no datum to add";
   CHECK_LE(datum_num, num) <<
     "The size of datum_vector must be no greater than transformed_blob->num()";
+  if (MakesRandomChoices()) {
+    TransformDatumRange(&datum_vector, transformed_blob->mutable_cpu_data(),
+        channels, height, width, 0, datum_num);
+    return;
+  }
+  if (mean_values_.size() > 0) {
+    ReplicateMeanValues(channels);
+  }
+  parallel_for(datum_num, parallel_grain(channels * height * width),
+      boost::bind(&DataTransformer<Dtype>::TransformDatumRange, this,
+          &datum_vector, transformed_blob->mutable_cpu_data(), channels,
+          height, width, _1, _2));
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformDatumRange(
+    const vector<Datum>* datum_vector, Dtype* transformed_data, int channels,
+    int height, int width, int begin, int end) {
   Blob<Dtype> uni_blob(1, channels, height, width);
-  for (int item_id = 0; item_id < datum_num; ++item_id) {
-    int offset = transformed_blob->offset(item_id);
-    uni_blob.set_cpu_data(transformed_blob->mutable_cpu_data() + offset);
-    Transform(datum_vector[item_id], &uni_blob);
+  for (int item_id = begin; item_id < end; ++item_id) {
+    uni_blob.set_cpu_data(transformed_data + uni_blob.count() * item_id);
+    Transform((*datum_vector)[item_id], &uni_blob);
   }
 }
 
@@ -581,11 +638,77 @@ void DataTransformer<Dtype>::Transform(const vector<cv::Mat> & mat_vector,
   CHECK_GT(mat_num, 0) << "There is no MAT to add";
   CHECK_EQ(mat_num, num) <<
     "The size of mat_vector must be equals to transformed_blob->num()";
+  if (MakesRandomChoices()) {
+    TransformRange(&mat_vector, transformed_blob->mutable_cpu_data(),
+        channels, height, width, 0, mat_num);
+    return;
+  }
+  if (mean_values_.size() > 0) {
+    ReplicateMeanValues(channels);
+  }
+  parallel_for(mat_num, parallel_grain(channels * height * width),
+      boost::bind(&DataTransformer<Dtype>::TransformRange, this, &mat_vector,
+          transformed_blob->mutable_cpu_data(), channels, height, width, _1,
+          _2));
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformRange(const vector<cv::Mat>* mat_vector,
+    Dtype* transformed_data, int channels, int height, int width, int begin,
+    int end) {
   Blob<Dtype> uni_blob(1, channels, height, width);
-  for (int item_id = 0; item_id < mat_num; ++item_id) {
-    int offset = transformed_blob->offset(item_id);
-    uni_blob.set_cpu_data(transformed_blob->mutable_cpu_data() + offset);
-    Transform(mat_vector[item_id], &uni_blob);
+  for (int item_id = begin; item_id < end; ++item_id) {
+    uni_blob.set_cpu_data(transformed_data + uni_blob.count() * item_id);
+    Transform((*mat_vector)[item_id], &uni_blob);
+  }
+}
+
+// Writes the height x width pixels of an 8-bit image, whose channels are
+// interleaved and whose rows are step bytes apart, into transformed_data as
+// channel planes of (pixel - mean) * scale, mirrored if do_mirror. Channel c
+// is taken from image channel sources[c]. The mean comes from mean, the
+// mean_file values in the output channel order, offset to the first pixel,
+// with rows mean_width apart and channels mean_width * mean_height apart; or,
+// when mean is NULL, from mean_values, one per channel, if any.
+template <typename Dtype>
+static void TransformPixels(const uchar* image, const int step,
+    const int channels, const int height, const int width,
+    const vector<int>& sources, const bool do_mirror, const Dtype scale,
+    const Dtype* mean, const int mean_height, const int mean_width,
+    const vector<Dtype>& mean_values, Dtype* transformed_data) {
+  // Without a mean_file, each channel maps the 256 pixel values through a
+  // table.
+  Dtype table[256];
+  for (int c = 0; c < channels; ++c) {
+    const uchar* channel = image + sources[c];
+    Dtype* top_channel = transformed_data + c * height * width;
+    if (!mean) {
+      const Dtype mean_value =
+          mean_values.size() > 0 ? mean_values[c] : Dtype(0);
+      for (int v = 0; v < 256; ++v) {
+        table[v] = (static_cast<Dtype>(v) - mean_value) * scale;
+      }
+    }
+    for (int h = 0; h < height; ++h) {
+      const uchar* ptr = channel + h * step;
+      Dtype* top_row = top_channel + h * width;
+      if (mean) {
+        const Dtype* mean_row = mean + (c * mean_height + h) * mean_width;
+        for (int w = 0; w < width; ++w) {
+          const int w_idx = do_mirror ? width - 1 - w : w;
+          top_row[w_idx] =
+              (static_cast<Dtype>(ptr[w * channels]) - mean_row[w_idx]) * scale;
+        }
+      } else if (do_mirror) {
+        for (int w = 0; w < width; ++w) {
+          top_row[width - 1 - w] = table[ptr[w * channels]];
+        }
+      } else {
+        for (int w = 0; w < width; ++w) {
+          top_row[w] = table[ptr[w * channels]];
+        }
+      }
+    }
   }
 }
 
@@ -612,20 +735,13 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
   const bool has_mean_file = param_.has_mean_file();
   const bool has_mean_values = mean_values_.size() > 0;
 
-  Dtype* mean = NULL;
+  const Dtype* mean = NULL;
   if (has_mean_file) {
     CHECK_EQ(img_channels, data_mean_.channels());
-    mean = data_mean_.mutable_cpu_data();
+    mean = data_mean_.cpu_data();
   }
   if (has_mean_values) {
-    CHECK(mean_values_.size() == 1 || mean_values_.size() == img_channels) <<
-        "Specify either 1 mean_value or as many as channels: " << img_channels;
-    if (img_channels > 1 && mean_values_.size() == 1) {
-      // Replicate the mean_value for simplicity
-      for (int c = 1; c < img_channels; ++c) {
-        mean_values_.push_back(mean_values_[0]);
-      }
-    }
+    ReplicateMeanValues(img_channels);
   }
 
   int crop_h = param_.crop_h();
@@ -682,38 +798,13 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
   }
   CHECK(cv_cropped_image.data);
 
-  Dtype* transformed_data = transformed_blob->mutable_cpu_data();
-  int top_index;
-  for (int h = 0; h < height; ++h) {
-    const uchar* ptr = cv_cropped_image.ptr<uchar>(h);
-    int img_index = 0;
-    int h_idx = h;
-    for (int w = 0; w < width; ++w) {
-      int w_idx = w;
-      if (*do_mirror) {
-        w_idx = (width - 1 - w);
-      }
-      int h_idx_real = h_idx;
-      int w_idx_real = w_idx;
-      for (int c = 0; c < img_channels; ++c) {
-        top_index = (c * height + h_idx_real) * width + w_idx_real;
-        Dtype pixel = static_cast<Dtype>(ptr[img_index++]);
-        if (has_mean_file) {
-          int mean_index = (c * img_height + h_off + h_idx_real) * img_width
-              + w_off + w_idx_real;
-          transformed_data[top_index] =
-              (pixel - mean[mean_index]) * scale;
-        } else {
-          if (has_mean_values) {
-            transformed_data[top_index] =
-                (pixel - mean_values_[c]) * scale;
-          } else {
-            transformed_data[top_index] = pixel * scale;
-          }
-        }
-      }
-    }
+  if (has_mean_file) {
+    mean += h_off * img_width + w_off;
   }
+  TransformPixels(cv_cropped_image.ptr<uchar>(0),
+      static_cast<int>(cv_cropped_image.step[0]), img_channels, height, width,
+      ChannelSources(img_channels), *do_mirror, scale, mean, img_height,
+      img_width, mean_values_, transformed_blob->mutable_cpu_data());
 }
 
 template<typename Dtype>
@@ -744,21 +835,23 @@ void DataTransformer<Dtype>::TransformInv(const Dtype* data, cv::Mat* cv_img,
 
   const int img_type = channels == 3 ? CV_8UC3 : CV_8UC1;
   cv::Mat orig_img(height, width, img_type, cv::Scalar(0, 0, 0));
+  // Channel c goes back to the image channel it was taken from.
+  const vector<int> sources = ChannelSources(channels);
 
   for (int h = 0; h < height; ++h) {
     uchar* ptr = orig_img.ptr<uchar>(h);
-    int img_idx = 0;
     for (int w = 0; w < width; ++w) {
       for (int c = 0; c < channels; ++c) {
         int idx = (c * height + h) * width + w;
+        int img_idx = w * channels + sources[c];
         if (has_mean_file && channels!=1) {
-          ptr[img_idx++] = static_cast<uchar>(data[idx] / scale + mean[idx]);
+          ptr[img_idx] = static_cast<uchar>(data[idx] / scale + mean[idx]);
         } else {
           if (has_mean_values && channels!=1) {
-            ptr[img_idx++] =
+            ptr[img_idx] =
                 static_cast<uchar>(data[idx] / scale + mean_values_[c]);
           } else {
-            ptr[img_idx++] = static_cast<uchar>(data[idx] / scale);
+            ptr[img_idx] = static_cast<uchar>(data[idx] / scale);
           }
         }
       }
@@ -867,14 +960,7 @@ void DataTransformer<Dtype>::ExpandImage(const cv::Mat& img,
     }
   }
   if (has_mean_values) {
-    CHECK(mean_values_.size() == 1 || mean_values_.size() == img_channels) <<
-        "Specify either 1 mean_value or as many as channels: " << img_channels;
-    if (img_channels > 1 && mean_values_.size() == 1) {
-      // Replicate the mean_value for simplicity
-      for (int c = 1; c < img_channels; ++c) {
-        mean_values_.push_back(mean_values_[0]);
-      }
-    }
+    ReplicateMeanValues(img_channels);
     vector<cv::Mat> channels(img_channels);
     cv::split(*expand_img, channels);
     CHECK_EQ(channels.size(), mean_values_.size());
@@ -920,7 +1006,8 @@ void DataTransformer<Dtype>::Transform(Blob<Dtype>* input_blob,
   CHECK_EQ(input_channels, channels);
   CHECK_GE(input_height, height);
   CHECK_GE(input_width, width);
-
+  CHECK_EQ(param_.channel_swap_size(), 0) <<
+      "channel_swap is not supported for Blob inputs";
 
   const Dtype scale = param_.scale();
   const bool do_mirror = param_.mirror() && Rand(2);
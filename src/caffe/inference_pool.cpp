@@ -0,0 +1,217 @@
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <vector>
+
+#include "caffe/inference_pool.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class InferenceRequest<Dtype>::sync {
+ public:
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+};
+
+template <typename Dtype>
+InferenceRequest<Dtype>::InferenceRequest(
+    const vector<shared_ptr<Blob<Dtype> > >& inputs)
+    : inputs_(inputs), done_(false), sync_(new sync()) {
+  for (int i = 0; i < inputs_.size(); ++i) {
+    CHECK_GE(inputs_[i]->num_axes(), 1)
+        << "Request inputs need a batch axis.";
+  }
+}
+
+template <typename Dtype>
+bool InferenceRequest<Dtype>::done() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return done_;
+}
+
+template <typename Dtype>
+void InferenceRequest<Dtype>::Wait() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (!done_) {
+    sync_->condition_.wait(lock);
+  }
+}
+
+template <typename Dtype>
+void InferenceRequest<Dtype>::Finish() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  done_ = true;
+  lock.unlock();
+  sync_->condition_.notify_all();
+}
+
+template <typename Dtype>
+class InferencePool<Dtype>::sync {
+ public:
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+  boost::thread_group workers_;
+};
+
+template <typename Dtype>
+InferencePool<Dtype>::InferencePool(const shared_ptr<Net<Dtype> >& net,
+    const int num_workers, const int max_batch_size)
+    : net_(net), max_batch_size_(max_batch_size), stopping_(false),
+      sync_(new sync()) {
+  CHECK_GT(num_workers, 0) << "An InferencePool needs a worker.";
+  CHECK_GT(max_batch_size_, 0) << "max_batch_size must be positive.";
+  CHECK_GT(net_->num_inputs(), 0) << "An InferencePool needs a net with "
+      << "input blobs.";
+  for (int i = 0; i < num_workers; ++i) {
+    replicas_.push_back(net_->CreateReplica());
+  }
+  int device = 0;
+#ifndef CPU_ONLY
+  CUDA_CHECK(cudaGetDevice(&device));
+#endif
+  for (int i = 0; i < num_workers; ++i) {
+    sync_->workers_.create_thread(boost::bind(&InferencePool::WorkerEntry,
+        this, replicas_[i].get(), Caffe::mode(), device));
+  }
+}
+
+template <typename Dtype>
+InferencePool<Dtype>::~InferencePool() {
+  Stop();
+}
+
+template <typename Dtype>
+void InferencePool<Dtype>::Stop() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  stopping_ = true;
+  lock.unlock();
+  sync_->condition_.notify_all();
+  sync_->workers_.join_all();
+}
+
+template <typename Dtype>
+void InferencePool<Dtype>::Submit(
+    const shared_ptr<InferenceRequest<Dtype> >& request) {
+  CHECK_EQ(request->inputs().size(), net_->num_inputs())
+      << "Requests need a value for each net input.";
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  CHECK(!stopping_) << "Submit to a stopped InferencePool.";
+  queue_.push_back(request);
+  lock.unlock();
+  sync_->condition_.notify_one();
+}
+
+template <typename Dtype>
+shared_ptr<InferenceRequest<Dtype> > InferencePool<Dtype>::Submit(
+    const vector<shared_ptr<Blob<Dtype> > >& inputs) {
+  shared_ptr<InferenceRequest<Dtype> > request(
+      new InferenceRequest<Dtype>(inputs));
+  Submit(request);
+  return request;
+}
+
+// Returns whether the inputs of requests a and b have the same shapes past
+// the batch axis, so that they can run as one batch.
+template <typename Dtype>
+static bool SameItemShapes(const InferenceRequest<Dtype>& a,
+    const InferenceRequest<Dtype>& b) {
+  for (int i = 0; i < a.inputs().size(); ++i) {
+    const vector<int>& a_shape = a.inputs()[i]->shape();
+    const vector<int>& b_shape = b.inputs()[i]->shape();
+    if (a_shape.size() != b_shape.size() ||
+        !std::equal(a_shape.begin() + 1, a_shape.end(), b_shape.begin() + 1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename Dtype>
+bool InferencePool<Dtype>::Next(
+    vector<shared_ptr<InferenceRequest<Dtype> > >* batch) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (queue_.empty() && !stopping_) {
+    sync_->condition_.wait(lock);
+  }
+  if (queue_.empty()) {
+    return false;
+  }
+  batch->assign(1, queue_.front());
+  queue_.pop_front();
+  int num = batch->front()->num();
+  while (!queue_.empty() && num + queue_.front()->num() <= max_batch_size_ &&
+      SameItemShapes(*batch->front(), *queue_.front())) {
+    num += queue_.front()->num();
+    batch->push_back(queue_.front());
+    queue_.pop_front();
+  }
+  return true;
+}
+
+template <typename Dtype>
+void InferencePool<Dtype>::Run(Net<Dtype>* replica,
+    const vector<shared_ptr<InferenceRequest<Dtype> > >& batch) {
+  int num = 0;
+  for (int j = 0; j < batch.size(); ++j) {
+    num += batch[j]->num();
+  }
+  // Stack the inputs of the requests along the batch axis.
+  const vector<Blob<Dtype>*>& inputs = replica->input_blobs();
+  for (int i = 0; i < inputs.size(); ++i) {
+    vector<int> shape = batch[0]->inputs()[i]->shape();
+    shape[0] = num;
+    inputs[i]->Reshape(shape);
+    Dtype* input_data = inputs[i]->mutable_cpu_data();
+    for (int j = 0; j < batch.size(); ++j) {
+      const Blob<Dtype>& input = *batch[j]->inputs()[i];
+      caffe_copy(input.count(), input.cpu_data(), input_data);
+      input_data += input.count();
+    }
+  }
+  replica->Forward();
+  // Hand each request its part of the outputs.
+  const vector<Blob<Dtype>*>& outputs = replica->output_blobs();
+  for (int i = 0; i < outputs.size(); ++i) {
+    if (batch.size() > 1) {
+      CHECK(outputs[i]->num_axes() > 0 && outputs[i]->shape(0) == num)
+          << "Only nets whose outputs are batched along their first axis "
+          << "can run requests together, which "
+          << replica->blob_names()[replica->output_blob_indices()[i]]
+          << " is not; use a max_batch_size of 1.";
+    }
+    const Dtype* output_data = outputs[i]->cpu_data();
+    for (int j = 0; j < batch.size(); ++j) {
+      vector<int> shape = outputs[i]->shape();
+      if (batch.size() > 1) {
+        shape[0] = batch[j]->num();
+      }
+      shared_ptr<Blob<Dtype> > output(new Blob<Dtype>(shape));
+      caffe_copy(output->count(), output_data, output->mutable_cpu_data());
+      output_data += output->count();
+      batch[j]->outputs_.push_back(output);
+    }
+  }
+  for (int j = 0; j < batch.size(); ++j) {
+    batch[j]->Finish();
+  }
+}
+
+template <typename Dtype>
+void InferencePool<Dtype>::WorkerEntry(Net<Dtype>* replica,
+    Caffe::Brew mode, int device) {
+  // The Caffe mode and device are per thread.
+#ifndef CPU_ONLY
+  CUDA_CHECK(cudaSetDevice(device));
+#endif
+  Caffe::set_mode(mode);
+  vector<shared_ptr<InferenceRequest<Dtype> > > batch;
+  while (Next(&batch)) {
+    Run(replica, batch);
+  }
+}
+
+INSTANTIATE_CLASS(InferenceRequest);
+INSTANTIATE_CLASS(InferencePool);
+
+}  // namespace caffe
@@ -50,12 +50,17 @@ shared_ptr<Layer<Dtype> > GetConvolutionLayer(
   if (engine == ConvolutionParameter_Engine_DEFAULT) {
     engine = ConvolutionParameter_Engine_CAFFE;
 #ifdef USE_CUDNN
-    if (!use_dilation) {
+    // Only the CAFFE engine applies fused activations and runs in int8.
+    if (!use_dilation && conv_param.fused_activation().type() ==
+        FusedActivationParameter_Type_NONE &&
+        !param.has_quantization_param()) {
       engine = ConvolutionParameter_Engine_CUDNN;
     }
 #endif
   }
-  if (engine == ConvolutionParameter_Engine_CAFFE) {
+  // ConvolutionLayer picks its CPU Forward by the engine it was given.
+  if (engine == ConvolutionParameter_Engine_CAFFE ||
+      engine == ConvolutionParameter_Engine_WINOGRAD) {
     return shared_ptr<Layer<Dtype> >(new ConvolutionLayer<Dtype>(param));
 #ifdef USE_CUDNN
   } else if (engine == ConvolutionParameter_Engine_CUDNN) {
@@ -63,6 +68,11 @@ shared_ptr<Layer<Dtype> > GetConvolutionLayer(
       LOG(FATAL) << "CuDNN doesn't support the dilated convolution at Layer "
                  << param.name();
     }
+    CHECK_EQ(conv_param.fused_activation().type(),
+        FusedActivationParameter_Type_NONE)
+        << "CuDNN doesn't support fused activations at Layer " << param.name();
+    CHECK(!param.has_quantization_param())
+        << "CuDNN doesn't support int8 inference at Layer " << param.name();
     return shared_ptr<Layer<Dtype> >(new CuDNNConvolutionLayer<Dtype>(param));
 #endif
   } else {
@@ -1,10 +1,14 @@
+#include <boost/thread/locks.hpp>
 #include <algorithm>
 #include <vector>
 
 #include "caffe/filler.hpp"
 #include "caffe/layers/base_conv_layer.hpp"
+#include "caffe/util/channels_last.hpp"
+#include "caffe/util/fused_activation.hpp"
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/quantize.hpp"
 
 namespace caffe {
 
@@ -129,9 +133,19 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     conv_out_channels_ = num_output_;
     conv_in_channels_ = channels_;
   }
+  quantize_ = this->layer_param_.has_quantization_param();
+  if (quantize_ && !caffe_cpu_gemm_s8_supported()) {
+    LOG(WARNING) << "Layer " << this->layer_param_.name() << " stays in float:"
+        << " this CPU has no vectorized int8 GEMM.";
+    quantize_ = false;
+  }
+  CHECK(!quantize_ || !reverse_dimensions())
+      << "Only convolutions can be quantized to int8.";
+  derived_weights_.reset(new DerivedWeights());
   // Handle the parameters: weights and biases.
   // - blobs_[0] holds the filter weights
   // - blobs_[1] holds the biases (optional)
+  // - the last blob holds the slopes of a fused PReLU activation (optional)
   vector<int> weight_shape(2);
   weight_shape[0] = conv_out_channels_;
   weight_shape[1] = conv_in_channels_ / group_;
@@ -140,8 +154,16 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
   bias_term_ = this->layer_param_.convolution_param().bias_term();
   vector<int> bias_shape(bias_term_, num_output_);
+  fused_activation_ =
+      this->layer_param_.convolution_param().fused_activation();
+  fuse_activation_ =
+      fused_activation_.type() != FusedActivationParameter_Type_NONE;
+  const bool has_slopes =
+      fused_activation_.type() == FusedActivationParameter_Type_PRELU;
+  vector<int> slopes_shape(has_slopes,
+      fused_activation_.channel_shared() ? 1 : num_output_);
   if (this->blobs_.size() > 0) {
-    CHECK_EQ(1 + bias_term_, this->blobs_.size())
+    CHECK_EQ(1 + bias_term_ + has_slopes, this->blobs_.size())
         << "Incorrect number of weight blobs.";
     if (weight_shape != this->blobs_[0]->shape()) {
       Blob<Dtype> weight_shaped_blob(weight_shape);
@@ -155,13 +177,15 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
           << bias_shaped_blob.shape_string() << "; instead, shape was "
           << this->blobs_[1]->shape_string();
     }
+    if (has_slopes && slopes_shape != this->blobs_.back()->shape()) {
+      Blob<Dtype> slopes_shaped_blob(slopes_shape);
+      LOG(FATAL) << "Incorrect PReLU slopes shape: expected shape "
+          << slopes_shaped_blob.shape_string() << "; instead, shape was "
+          << this->blobs_.back()->shape_string();
+    }
     LOG(INFO) << "Skipping parameter initialization";
   } else {
-    if (bias_term_) {
-      this->blobs_.resize(2);
-    } else {
-      this->blobs_.resize(1);
-    }
+    this->blobs_.resize(1 + bias_term_ + has_slopes);
     // Initialize and fill the weights:
     // output channels x input channels per-group x kernel height x kernel width
     this->blobs_[0].reset(new Blob<Dtype>(weight_shape));
@@ -175,6 +199,12 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
           this->layer_param_.convolution_param().bias_filler()));
       bias_filler->Fill(this->blobs_[1].get());
     }
+    // Fused PReLU slopes start as in PReLULayer.
+    if (has_slopes) {
+      this->blobs_.back().reset(new Blob<Dtype>(slopes_shape));
+      caffe_set(this->blobs_.back()->count(), Dtype(0.25),
+          this->blobs_.back()->mutable_cpu_data());
+    }
   }
   kernel_dim_ = this->blobs_[0]->count(1);
   weight_offset_ = conv_out_channels_ * kernel_dim_ / group_;
@@ -182,6 +212,9 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   this->param_propagate_down_.resize(this->blobs_.size(), true);
 }
 
+// The default col_buffer_limit for layers with packed weights.
+const uint64_t kPackedColBufferLimit = 2 << 20;
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -213,6 +246,11 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   } else {
     conv_out_spatial_dim_ = top[0]->count(first_spatial_axis);
   }
+  // Packing pays off when the weights are reused over many Forwards; for
+  // smaller outputs, BLAS is faster even though it packs them on every call.
+  use_packed_weights_ = !quantize_ && !reverse_dimensions() &&
+      this->phase_ == TEST && conv_out_spatial_dim_ >= 2048 &&
+      caffe_cpu_packed_gemm_supported<Dtype>();
   col_offset_ = kernel_dim_ * conv_out_spatial_dim_;
   output_offset_ = conv_out_channels_ * conv_out_spatial_dim_ / group_;
   // Setup input dimensions (conv_input_shape_).
@@ -226,6 +264,27 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       conv_input_shape_data[i] = bottom[0]->shape(channel_axis_ + i);
     }
   }
+  // Under a col_buffer_limit, the CPU column buffer of a 2D convolution
+  // holds as many output rows as fit. The GPU expands whole images, so the
+  // buffer only shrinks for layers set up in CPU mode. The packed GEMM is
+  // much faster over strips that stay in L2 than over large whole images,
+  // so with packed weights the limit defaults to kPackedColBufferLimit.
+  col_strip_rows_ = 0;
+  const ConvolutionParameter& conv_param =
+      this->layer_param_.convolution_param();
+  const uint64_t col_buffer_limit =
+      use_packed_weights_ && !conv_param.has_col_buffer_limit() ?
+      kPackedColBufferLimit : conv_param.col_buffer_limit();
+  if (col_buffer_limit > 0 && !is_1x1_ && !quantize_ &&
+      !reverse_dimensions() && !force_nd_im2col_ && num_spatial_axes_ == 2 &&
+      Caffe::mode() == Caffe::CPU) {
+    const uint64_t row_bytes = static_cast<uint64_t>(kernel_dim_) * group_ *
+        output_shape_[1] * sizeof(Dtype);
+    const uint64_t rows = std::max<uint64_t>(1, col_buffer_limit / row_bytes);
+    if (rows < static_cast<uint64_t>(output_shape_[0])) {
+      col_strip_rows_ = rows;
+    }
+  }
   // The im2col result buffer will only hold one image at a time to avoid
   // overly large memory usage. In the special case of 1x1 convolution
   // it goes lazily unused to save memory.
@@ -234,11 +293,18 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   for (int i = 0; i < num_spatial_axes_; ++i) {
     if (reverse_dimensions()) {
       col_buffer_shape_.push_back(input_shape(i + 1));
+    } else if (i == 0 && col_strip_rows_ > 0) {
+      col_buffer_shape_.push_back(col_strip_rows_);
     } else {
       col_buffer_shape_.push_back(output_shape_[i]);
     }
   }
   col_buffer_.Reshape(col_buffer_shape_);
+  if (quantize_) {
+    // One group of the packed column buffer and of the output at a time.
+    col_packed_.resize(int8_gemm_k(kernel_dim_) * conv_out_spatial_dim_);
+    output_int32_.resize(conv_out_channels_ / group_ * conv_out_spatial_dim_);
+  }
   bottom_dim_ = bottom[0]->count(channel_axis_);
   top_dim_ = top[0]->count(channel_axis_);
   num_kernels_im2col_ = conv_in_channels_ * conv_out_spatial_dim_;
@@ -256,6 +322,10 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
     const Dtype* weights, Dtype* output, bool skip_im2col) {
+  if (col_strip_rows_ > 0) {
+    forward_cpu_gemm_strips(input, weights, output);
+    return;
+  }
   const Dtype* col_buff = input;
   if (!is_1x1_) {
     if (!skip_im2col) {
@@ -263,11 +333,120 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
     }
     col_buff = col_buffer_.cpu_data();
   }
+  if (quantize_ || use_packed_weights_) {
+    pack_weights();
+  }
+  if (quantize_) {
+    forward_cpu_gemm_int8(input, col_buff, output);
+    return;
+  }
   for (int g = 0; g < group_; ++g) {
-    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
-        group_, conv_out_spatial_dim_, kernel_dim_,
-        (Dtype)1., weights + weight_offset_ * g, col_buff + col_offset_ * g,
-        (Dtype)0., output + output_offset_ * g);
+    if (use_packed_weights_) {
+      caffe_cpu_gemm_packed_a(conv_out_channels_ / group_,
+          conv_out_spatial_dim_, kernel_dim_,
+          &derived_weights_->packed[0] + weight_offset_ * g,
+          col_buff + col_offset_ * g, output + output_offset_ * g,
+          conv_out_spatial_dim_);
+    } else {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
+          group_, conv_out_spatial_dim_, kernel_dim_,
+          (Dtype)1., weights + weight_offset_ * g, col_buff + col_offset_ * g,
+          (Dtype)0., output + output_offset_ * g);
+    }
+  }
+}
+
+// Expands a strip of output rows at a time and multiplies it into those
+// rows of the output; the rows of each output channel are
+// conv_out_spatial_dim_ apart.
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_strips(const Dtype* input,
+    const Dtype* weights, Dtype* output) {
+  if (use_packed_weights_) {
+    pack_weights();
+  }
+  const int height_out = output_shape_[0];
+  const int width_out = output_shape_[1];
+  Dtype* col_buff = col_buffer_.mutable_cpu_data();
+  for (int row = 0; row < height_out; row += col_strip_rows_) {
+    const int rows = std::min(col_strip_rows_, height_out - row);
+    const int strip_dim = rows * width_out;
+    conv_im2col_rows_cpu(input, row, rows, col_buff);
+    for (int g = 0; g < group_; ++g) {
+      Dtype* strip_output = output + output_offset_ * g + row * width_out;
+      if (use_packed_weights_) {
+        caffe_cpu_gemm_packed_a(conv_out_channels_ / group_, strip_dim,
+            kernel_dim_, &derived_weights_->packed[0] + weight_offset_ * g,
+            col_buff + kernel_dim_ * strip_dim * g, strip_output,
+            conv_out_spatial_dim_);
+      } else {
+        caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans,
+            conv_out_channels_ / group_, strip_dim, kernel_dim_, (Dtype)1.,
+            weights + weight_offset_ * g, kernel_dim_,
+            col_buff + kernel_dim_ * strip_dim * g, strip_dim, (Dtype)0.,
+            strip_output, conv_out_spatial_dim_);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::ShareDerivedWeights(Layer<Dtype>* other) {
+  BaseConvolutionLayer* source = dynamic_cast<BaseConvolutionLayer*>(other);
+  CHECK(source && string(source->type()) == this->type())
+      << "Can only share derived weights with a " << this->type()
+      << " layer.";
+  CHECK(this->blobs_[0]->data() == source->blobs_[0]->data())
+      << "Can only share derived weights with a layer sharing the weights.";
+  derived_weights_ = source->derived_weights_;
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::pack_weights() {
+  const Blob<Dtype>& weight_blob = *this->blobs_[0];
+  DerivedWeights& derived = *derived_weights_;
+  boost::lock_guard<WeightMutex> lock(derived.mutex);
+  if (derived.version.Matches(weight_blob)) {
+    return;
+  }
+  const Dtype* weights = weight_blob.cpu_data();
+  if (quantize_) {
+    derived.int8.resize(conv_out_channels_ * int8_gemm_k(kernel_dim_));
+    derived.scales.resize(conv_out_channels_);
+    caffe_cpu_quantize_rows(conv_out_channels_, kernel_dim_, weights,
+        &derived.int8[0], &derived.scales[0]);
+  } else {
+    derived.packed.resize(weight_blob.count());
+    for (int g = 0; g < group_; ++g) {
+      caffe_cpu_pack_a(conv_out_channels_ / group_, kernel_dim_,
+          weights + weight_offset_ * g,
+          &derived.packed[0] + weight_offset_ * g);
+    }
+  }
+  derived.version.Set(weight_blob);
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_int8(const Dtype* input,
+    const Dtype* col_buff, Dtype* output) {
+  const QuantizationParameter& quantization_param =
+      this->layer_param_.quantization_param();
+  // Padding only adds zeros, so the input bounds the column buffer.
+  const Dtype input_scale = int8_scale(quantization_param.has_input_max() ?
+      Dtype(quantization_param.input_max()) :
+      caffe_cpu_amax(bottom_dim_, input));
+  const int out_channels = conv_out_channels_ / group_;
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_quantize_pack(kernel_dim_, conv_out_spatial_dim_, input_scale,
+        col_buff + col_offset_ * g, &col_packed_[0]);
+    caffe_cpu_gemm_s8(out_channels, conv_out_spatial_dim_, kernel_dim_,
+        &derived_weights_->int8[0] +
+            out_channels * int8_gemm_k(kernel_dim_) * g,
+        &col_packed_[0], &output_int32_[0]);
+    caffe_cpu_dequantize(out_channels, conv_out_spatial_dim_,
+        &output_int32_[0], input_scale,
+        &derived_weights_->scales[0] + out_channels * g,
+        static_cast<const Dtype*>(NULL), output + output_offset_ * g);
   }
 }
 
@@ -279,9 +458,85 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
       (Dtype)1., output);
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_bias_activation(Dtype* output,
+    const Dtype* bias) {
+  if (!fuse_activation_) {
+    if (bias) { forward_cpu_bias(output, bias); }
+    return;
+  }
+  const Dtype* slopes =
+      fused_activation_.type() == FusedActivationParameter_Type_PRELU ?
+      this->blobs_.back()->cpu_data() : NULL;
+  fused_activation_cpu(fused_activation_, 1, num_output_, out_spatial_dim_,
+      bias, slopes, output);
+}
+
+// Computes the output a strip of rows at a time, as (rows x width_out) x
+// num_output = (rows x width_out) x kernel_dim * (num_output x kernel_dim)^T,
+// where each row of the column buffer holds the kernel_h x kernel_w x
+// channels inputs of one output pixel. A 1x1 convolution multiplies the
+// input itself.
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_channels_last(const Dtype* input,
+    Dtype* output) {
+  const int K = num_output_;
+  const int C = channels_;
+  const int* kernel_shape = kernel_shape_.cpu_data();
+  const int kernel_spatial = kernel_shape[0] * kernel_shape[1];
+  DerivedWeights& derived = *derived_weights_;
+  {
+    boost::lock_guard<WeightMutex> lock(derived.mutex);
+    if (!derived.channels_last_version.Matches(*this->blobs_[0])) {
+      derived.channels_last.resize(this->blobs_[0]->count());
+      caffe_cpu_to_channels_last(K, C, kernel_spatial,
+          this->blobs_[0]->cpu_data(), &derived.channels_last[0]);
+      derived.channels_last_version.Set(*this->blobs_[0]);
+    }
+  }
+  const int kernel_dim = C * kernel_spatial;
+  const int height_out = output_shape_[0];
+  const int width_out = output_shape_[1];
+  if (is_1x1_) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, height_out * width_out, K,
+        kernel_dim, (Dtype)1., input, &derived.channels_last[0], (Dtype)0.,
+        output);
+  } else {
+    const int* pad = pad_.cpu_data();
+    const int* stride = stride_.cpu_data();
+    const int* dilation = dilation_.cpu_data();
+    const int strip_rows = col_strip_rows_ > 0 ? col_strip_rows_ : height_out;
+    Dtype* col_buff = col_buffer_.mutable_cpu_data();
+    for (int row = 0; row < height_out; row += strip_rows) {
+      const int rows = std::min(strip_rows, height_out - row);
+      im2col_nhwc_rows_cpu(input, C, input_shape(1), input_shape(2),
+          kernel_shape[0], kernel_shape[1], pad[0], pad[1], stride[0],
+          stride[1], dilation[0], dilation[1], row, rows, col_buff);
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, rows * width_out, K,
+          kernel_dim, (Dtype)1., col_buff, &derived.channels_last[0],
+          (Dtype)0., output + row * width_out * K);
+    }
+  }
+  if (fuse_activation_) {
+    const Dtype* slopes = fused_activation_.type() ==
+        FusedActivationParameter_Type_PRELU ?
+        this->blobs_.back()->cpu_data() : NULL;
+    fused_activation_cpu(fused_activation_, out_spatial_dim_, K, 1,
+        bias_term_ ? this->blobs_[1]->cpu_data() : NULL, slopes, output);
+  } else if (bias_term_) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, out_spatial_dim_, K, 1,
+        (Dtype)1., bias_multiplier_.cpu_data(), this->blobs_[1]->cpu_data(),
+        (Dtype)1., output);
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
     const Dtype* weights, Dtype* input) {
+  if (col_strip_rows_ > 0) {
+    backward_cpu_gemm_strips(output, weights, input);
+    return;
+  }
   Dtype* col_buff = col_buffer_.mutable_cpu_data();
   if (is_1x1_) {
     col_buff = input;
@@ -297,9 +552,35 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
   }
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::backward_cpu_gemm_strips(
+    const Dtype* output, const Dtype* weights, Dtype* input) {
+  const int height_out = output_shape_[0];
+  const int width_out = output_shape_[1];
+  Dtype* col_buff = col_buffer_.mutable_cpu_data();
+  caffe_set(bottom_dim_, Dtype(0), input);
+  for (int row = 0; row < height_out; row += col_strip_rows_) {
+    const int rows = std::min(col_strip_rows_, height_out - row);
+    const int strip_dim = rows * width_out;
+    for (int g = 0; g < group_; ++g) {
+      caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, kernel_dim_, strip_dim,
+          conv_out_channels_ / group_, (Dtype)1.,
+          weights + weight_offset_ * g, kernel_dim_,
+          output + output_offset_ * g + row * width_out,
+          conv_out_spatial_dim_, (Dtype)0.,
+          col_buff + kernel_dim_ * strip_dim * g, strip_dim);
+    }
+    conv_col2im_rows_cpu(col_buff, row, rows, input);
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::weight_cpu_gemm(const Dtype* input,
     const Dtype* output, Dtype* weights) {
+  if (col_strip_rows_ > 0) {
+    weight_cpu_gemm_strips(input, output, weights);
+    return;
+  }
   const Dtype* col_buff = input;
   if (!is_1x1_) {
     conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
@@ -313,6 +594,26 @@ void BaseConvolutionLayer<Dtype>::weight_cpu_gemm(const Dtype* input,
   }
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::weight_cpu_gemm_strips(const Dtype* input,
+    const Dtype* output, Dtype* weights) {
+  const int height_out = output_shape_[0];
+  const int width_out = output_shape_[1];
+  Dtype* col_buff = col_buffer_.mutable_cpu_data();
+  for (int row = 0; row < height_out; row += col_strip_rows_) {
+    const int rows = std::min(col_strip_rows_, height_out - row);
+    const int strip_dim = rows * width_out;
+    conv_im2col_rows_cpu(input, row, rows, col_buff);
+    for (int g = 0; g < group_; ++g) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans,
+          conv_out_channels_ / group_, kernel_dim_, strip_dim, (Dtype)1.,
+          output + output_offset_ * g + row * width_out,
+          conv_out_spatial_dim_, col_buff + kernel_dim_ * strip_dim * g,
+          strip_dim, (Dtype)1., weights + weight_offset_ * g, kernel_dim_);
+    }
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_bias(Dtype* bias,
     const Dtype* input) {
@@ -325,6 +626,8 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_bias(Dtype* bias,
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_gpu_gemm(const Dtype* input,
     const Dtype* weights, Dtype* output, bool skip_im2col) {
+  CHECK_EQ(col_strip_rows_, 0) << "Layers with a col_buffer_limit set up "
+      << "in CPU mode must be reshaped before running on the GPU.";
   const Dtype* col_buff = input;
   if (!is_1x1_) {
     if (!skip_im2col) {
@@ -348,9 +651,21 @@ void BaseConvolutionLayer<Dtype>::forward_gpu_bias(Dtype* output,
       (Dtype)1., output);
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_gpu_activation(Dtype* output) {
+  if (!fuse_activation_) { return; }
+  const Dtype* slopes =
+      fused_activation_.type() == FusedActivationParameter_Type_PRELU ?
+      this->blobs_.back()->gpu_data() : NULL;
+  fused_activation_gpu(fused_activation_, 1, num_output_, out_spatial_dim_,
+      slopes, output);
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_gpu_gemm(const Dtype* output,
     const Dtype* weights, Dtype* input) {
+  CHECK_EQ(col_strip_rows_, 0) << "Layers with a col_buffer_limit set up "
+      << "in CPU mode must be reshaped before running on the GPU.";
   Dtype* col_buff = col_buffer_.mutable_gpu_data();
   if (is_1x1_) {
     col_buff = input;
@@ -369,6 +684,8 @@ void BaseConvolutionLayer<Dtype>::backward_gpu_gemm(const Dtype* output,
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::weight_gpu_gemm(const Dtype* input,
     const Dtype* output, Dtype* weights) {
+  CHECK_EQ(col_strip_rows_, 0) << "Layers with a col_buffer_limit set up "
+      << "in CPU mode must be reshaped before running on the GPU.";
   const Dtype* col_buff = input;
   if (!is_1x1_) {
     conv_im2col_gpu(input, col_buffer_.mutable_gpu_data());
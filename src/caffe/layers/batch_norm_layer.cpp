@@ -83,6 +83,24 @@ void BatchNormLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+// Normalizes the channels of each of the pixels in turn, with the stored
+// mean and variance; Forward only, so x_norm_ is not kept.
+template <typename Dtype>
+void BatchNormLayer<Dtype>::forward_cpu_channels_last(const int pixels,
+    Dtype* top_data) {
+  caffe_add_scalar(variance_.count(), eps_, variance_.mutable_cpu_data());
+  caffe_powx(variance_.count(), variance_.cpu_data(), Dtype(0.5),
+             variance_.mutable_cpu_data());
+  const Dtype* mean = mean_.cpu_data();
+  const Dtype* std = variance_.cpu_data();
+  for (int p = 0; p < pixels; ++p) {
+    for (int c = 0; c < channels_; ++c) {
+      top_data[c] = (top_data[c] - mean[c]) / std[c];
+    }
+    top_data += channels_;
+  }
+}
+
 template <typename Dtype>
 void BatchNormLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
@@ -103,6 +121,10 @@ void BatchNormLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
         this->blobs_[0]->cpu_data(), mean_.mutable_cpu_data());
     caffe_cpu_scale(variance_.count(), scale_factor,
         this->blobs_[1]->cpu_data(), variance_.mutable_cpu_data());
+    if (this->channels_last_) {
+      forward_cpu_channels_last(num * spatial_dim, top_data);
+      return;
+    }
   } else {
     // compute mean
     caffe_cpu_gemv<Dtype>(CblasNoTrans, channels_ * num, spatial_dim,
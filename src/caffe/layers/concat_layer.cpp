@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layers/concat_layer.hpp"
@@ -50,9 +51,103 @@ void ConcatLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   if (bottom.size() == 1) {
     top[0]->ShareData(*bottom[0]);
     top[0]->ShareDiff(*bottom[0]);
+  } else if (!view_data_.empty()) {
+    ViewBottoms(bottom, top);
   }
 }
 
+template <typename Dtype>
+void ConcatLayer<Dtype>::set_bottom_views(const vector<bool>& data,
+      const vector<bool>& diff, const vector<vector<Blob<Dtype>*> >& sources) {
+  CHECK_EQ(data.size(), diff.size());
+  CHECK_EQ(data.size(), sources.size());
+  view_data_ = data;
+  view_diff_ = diff;
+  sources_ = sources;
+  data_views_.resize(data.size());
+  diff_views_.resize(diff.size());
+}
+
+template <typename Dtype>
+void ConcatLayer<Dtype>::ViewBottoms(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  CHECK_EQ(view_data_.size(), bottom.size());
+  const bool contiguous = num_concats_ == 1 &&
+      !(this->channels_last_ && concat_axis_ == 1);
+  // The blobs placed in the top: the bottoms, or the blobs they view.
+  vector<Blob<Dtype>*> placed_blobs(bottom.begin(), bottom.end());
+  for (int i = 0; i < bottom.size(); ++i) {
+    if (!sources_[i].empty()) { placed_blobs[i] = sources_[i].back(); }
+  }
+  // Find the bottoms to move, saving their values first, as their old and
+  // new places may overlap.
+  vector<int> moved, moved_offsets;
+  vector<Dtype> values;
+  int offset = 0;
+  for (int i = 0; i < bottom.size(); ++i) {
+    Blob<Dtype>* blob = placed_blobs[i];
+    const int count = bottom[i]->count();
+    const bool view = contiguous && view_data_[i] && count > 0;
+    const bool placed = data_views_[i] && blob->data() == data_views_[i];
+    if (view || placed) {
+      bool in_place = placed &&
+          data_views_[i]->cpu_data() == top[0]->cpu_data() + offset;
+      if (view_diff_[i]) {
+        in_place = in_place && diff_views_[i] &&
+            blob->diff() == diff_views_[i] &&
+            diff_views_[i]->cpu_data() == top[0]->cpu_diff() + offset;
+      }
+      if (!(view && in_place)) {
+        moved.push_back(i);
+        moved_offsets.push_back(offset);
+        if (blob->data()->head() != SyncedMemory::UNINITIALIZED) {
+          const Dtype* blob_data = blob->cpu_data();
+          values.insert(values.end(), blob_data, blob_data + count);
+        }
+      }
+    }
+    offset += count;
+  }
+  int value_offset = 0;
+  for (int k = 0; k < moved.size(); ++k) {
+    const int i = moved[k];
+    Blob<Dtype>* blob = placed_blobs[i];
+    const bool had_values =
+        blob->data()->head() != SyncedMemory::UNINITIALIZED;
+    if (contiguous && view_data_[i] && bottom[i]->count() > 0) {
+      blob->ShareDataView(*top[0], moved_offsets[k]);
+      data_views_[i] = blob->data();
+      if (view_diff_[i]) {
+        blob->ShareDiffView(*top[0], moved_offsets[k]);
+        diff_views_[i] = blob->diff();
+      }
+    } else {
+      blob->ReleaseViews();
+      data_views_[i].reset();
+      diff_views_[i].reset();
+    }
+    if (had_values) {
+      const int count = blob->count();
+      std::copy(values.begin() + value_offset,
+          values.begin() + value_offset + count, blob->mutable_cpu_data());
+      value_offset += count;
+    }
+  }
+  // The views follow the blobs they view, which may have moved, or have
+  // been reallocated by their producers since.
+  for (int i = 0; i < bottom.size(); ++i) {
+    if (sources_[i].empty()) { continue; }
+    bottom[i]->ShareData(*placed_blobs[i]);
+    bottom[i]->ShareDiff(*placed_blobs[i]);
+    for (int j = 0; j + 1 < sources_[i].size(); ++j) {
+      sources_[i][j]->ShareData(*placed_blobs[i]);
+      sources_[i][j]->ShareDiff(*placed_blobs[i]);
+    }
+  }
+  viewed_data_ = top[0]->data();
+  viewed_diff_ = top[0]->diff();
+}
+
 template <typename Dtype>
 void ConcatLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -60,9 +155,28 @@ void ConcatLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   Dtype* top_data = top[0]->mutable_cpu_data();
   int offset_concat_axis = 0;
   const int top_concat_axis = top[0]->shape(concat_axis_);
+  // Channels-last, each pixel of the top holds the channels of every bottom
+  // in turn.
+  const bool interleave = this->channels_last_ && concat_axis_ == 1;
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     const int bottom_concat_axis = bottom[i]->shape(concat_axis_);
+    if (interleave) {
+      const int pixels = num_concats_ * concat_input_size_;
+      for (int p = 0; p < pixels; ++p) {
+        const Dtype* bottom_pixel = bottom_data + p * bottom_concat_axis;
+        std::copy(bottom_pixel, bottom_pixel + bottom_concat_axis,
+            top_data + p * top_concat_axis + offset_concat_axis);
+      }
+      offset_concat_axis += bottom_concat_axis;
+      continue;
+    }
+    // Skip the bottoms that were produced in place; see set_bottom_views.
+    if (num_concats_ == 1 &&
+        bottom_data == top_data + offset_concat_axis * concat_input_size_) {
+      offset_concat_axis += bottom_concat_axis;
+      continue;
+    }
     for (int n = 0; n < num_concats_; ++n) {
       caffe_copy(bottom_concat_axis * concat_input_size_,
           bottom_data + n * bottom_concat_axis * concat_input_size_,
@@ -84,6 +198,11 @@ void ConcatLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const int bottom_concat_axis = bottom[i]->shape(concat_axis_);
     if (propagate_down[i]) {
       Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
+      if (num_concats_ == 1 && bottom_diff ==
+          top_diff + offset_concat_axis * concat_input_size_) {
+        offset_concat_axis += bottom_concat_axis;
+        continue;
+      }
       for (int n = 0; n < num_concats_; ++n) {
         caffe_copy(bottom_concat_axis * concat_input_size_, top_diff +
             (n * top_concat_axis + offset_concat_axis) * concat_input_size_,
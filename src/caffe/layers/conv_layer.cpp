@@ -1,6 +1,10 @@
+#include <boost/thread/locks.hpp>
+#include <algorithm>
 #include <vector>
 
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/winograd.hpp"
 
 namespace caffe {
 
@@ -21,6 +25,108 @@ void ConvolutionLayer<Dtype>::compute_output_shape() {
   }
 }
 
+// The Winograd workspace, V and M, is sized to hold about this many bytes,
+// which bounds how many tiles each GEMM covers; it is faster while it fits
+// in L2.
+const int kWinogradWorkspaceBytes = 2 << 20;
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  BaseConvolutionLayer<Dtype>::Reshape(bottom, top);
+  const ConvolutionParameter& conv_param =
+      this->layer_param_.convolution_param();
+  switch (conv_param.engine()) {
+  case ConvolutionParameter_Engine_WINOGRAD:
+    CHECK(winograd_eligible()) << "The WINOGRAD engine only computes 2D 3x3 "
+        << "convolutions with stride and dilation 1, a single group and no "
+        << "int8 inference, at Layer " << this->layer_param_.name();
+    use_winograd_ = true;
+    break;
+  case ConvolutionParameter_Engine_DEFAULT:
+    // For outputs smaller than 8, im2col is about as fast.
+    use_winograd_ = this->phase_ == TEST && winograd_eligible() &&
+        this->output_shape_[0] >= 8 && this->output_shape_[1] >= 8 &&
+        caffe_cpu_winograd_supported<Dtype>();
+    break;
+  default:
+    use_winograd_ = false;
+  }
+  if (!use_winograd_) {
+    return;
+  }
+  const int height_out = this->output_shape_[0];
+  const int width_out = this->output_shape_[1];
+  winograd_tile_ = conv_param.winograd_tile();
+  if (winograd_tile_ == 0) {
+    winograd_tile_ = height_out < 16 || width_out < 16 ? 2 : 4;
+  }
+  CHECK(winograd_tile_ == 2 || winograd_tile_ == 4)
+      << "winograd_tile must be 0, 2 or 4.";
+  winograd_tiles_h_ = (height_out + winograd_tile_ - 1) / winograd_tile_;
+  winograd_tiles_w_ = (width_out + winograd_tile_ - 1) / winograd_tile_;
+  const int alpha = winograd_alpha(winograd_tile_);
+  const int tiles = this->num_ * winograd_tiles_h_ * winograd_tiles_w_;
+  winograd_chunk_ = std::min(tiles, std::max(256,
+      kWinogradWorkspaceBytes / static_cast<int>(alpha * alpha *
+      (this->channels_ + this->num_output_) * sizeof(Dtype))));
+  winograd_V_.resize(alpha * alpha * this->channels_ * winograd_chunk_);
+  winograd_M_.resize(alpha * alpha * this->num_output_ * winograd_chunk_);
+}
+
+template <typename Dtype>
+bool ConvolutionLayer<Dtype>::winograd_eligible() {
+  if (this->num_spatial_axes_ != 2 || this->group_ != 1 || this->quantize_) {
+    return false;
+  }
+  for (int i = 0; i < 2; ++i) {
+    if (this->kernel_shape_.cpu_data()[i] != 3 ||
+        this->stride_.cpu_data()[i] != 1 ||
+        this->dilation_.cpu_data()[i] != 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Convolves all the images of the batch at once, a chunk of tiles at a
+// time: each of the alpha^2 GEMMs of a chunk multiplies the transformed
+// filters by as many transformed tiles as the chunk holds.
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_cpu_winograd(const Dtype* input,
+    Dtype* output) {
+  const int alpha = winograd_alpha(winograd_tile_);
+  const int K = this->num_output_;
+  const int C = this->channels_;
+  typename BaseConvolutionLayer<Dtype>::DerivedWeights& derived =
+      *this->derived_weights_;
+  {
+    boost::lock_guard<WeightMutex> lock(derived.mutex);
+    if (!derived.winograd_version.Matches(*this->blobs_[0])) {
+      derived.winograd.resize(alpha * alpha * K * C);
+      winograd_filter_transform_cpu(winograd_tile_, K, C,
+          this->blobs_[0]->cpu_data(), &derived.winograd[0]);
+      derived.winograd_version.Set(*this->blobs_[0]);
+    }
+  }
+  const int tiles = this->num_ * winograd_tiles_h_ * winograd_tiles_w_;
+  for (int t = 0; t < tiles; t += winograd_chunk_) {
+    const int P = std::min(winograd_chunk_, tiles - t);
+    winograd_input_transform_cpu(input, C, this->input_shape(1),
+        this->input_shape(2), this->pad_.cpu_data()[0],
+        this->pad_.cpu_data()[1], winograd_tile_, winograd_tiles_h_,
+        winograd_tiles_w_, t, P, &winograd_V_[0]);
+    for (int xi = 0; xi < alpha * alpha; ++xi) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, K, P, C, (Dtype)1.,
+          &derived.winograd[0] + xi * K * C, &winograd_V_[0] + xi * C * P,
+          (Dtype)0., &winograd_M_[0] + xi * K * P);
+    }
+    winograd_output_transform_cpu(&winograd_M_[0], K, this->output_shape_[0],
+        this->output_shape_[1], winograd_tile_, winograd_tiles_h_,
+        winograd_tiles_w_, t, P, output);
+  }
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -28,13 +134,23 @@ void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* top_data = top[i]->mutable_cpu_data();
+    if (this->channels_last_) {
+      for (int n = 0; n < this->num_; ++n) {
+        this->forward_cpu_channels_last(bottom_data + n * this->bottom_dim_,
+            top_data + n * this->top_dim_);
+      }
+      continue;
+    }
+    if (use_winograd_) {
+      forward_cpu_winograd(bottom_data, top_data);
+    }
     for (int n = 0; n < this->num_; ++n) {
-      this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
-          top_data + n * this->top_dim_);
-      if (this->bias_term_) {
-        const Dtype* bias = this->blobs_[1]->cpu_data();
-        this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
+      if (!use_winograd_) {
+        this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
+            top_data + n * this->top_dim_);
       }
+      this->forward_cpu_bias_activation(top_data + n * this->top_dim_,
+          this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL);
     }
   }
 }
@@ -42,6 +158,10 @@ void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  CHECK(!this->fuse_activation_)
+      << "Layers with a fused activation can only run Forward.";
+  CHECK(!this->quantize_)
+      << "Layers quantized to int8 can only run Forward.";
   const Dtype* weight = this->blobs_[0]->cpu_data();
   Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
   for (int i = 0; i < top.size(); ++i) {
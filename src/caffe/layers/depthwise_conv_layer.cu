@@ -66,6 +66,11 @@ template<typename Dtype>
 void DepthwiseConvolutionLayer<Dtype>::Forward_gpu(
 		const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
 //	std::cout << "fp" << std::endl;
+	if (this->quantize_) {
+		// Int8 inference only runs on the CPU.
+		Forward_cpu(bottom, top);
+		return;
+	}
 	const Dtype* weight = this->blobs_[0]->gpu_data();
 	int* kernel_shape_data = this->kernel_shape_.mutable_cpu_data();
 	int* stride_data = this->stride_.mutable_cpu_data();
@@ -261,7 +266,8 @@ template<typename Dtype>
 void DepthwiseConvolutionLayer<Dtype>::Backward_gpu(
 const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
 const vector<Blob<Dtype>*>& bottom) {
-
+	CHECK(!this->quantize_)
+			<< "Layers quantized to int8 can only run Forward.";
 
 	int* kernel_shape_data = this->kernel_shape_.mutable_cpu_data();
 	int* stride_data = this->stride_.mutable_cpu_data();
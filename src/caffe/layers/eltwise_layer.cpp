@@ -1,8 +1,10 @@
-#include <cfloat>
 #include <vector>
 
+#include "boost/bind.hpp"
+
 #include "caffe/layers/eltwise_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -41,36 +43,35 @@ void EltwiseLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+// Combines the elements [begin, end) of the bottoms.
 template <typename Dtype>
-void EltwiseLayer<Dtype>::Forward_cpu(
-    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  int* mask = NULL;
+void EltwiseLayer<Dtype>::forward_cpu_range(
+    const vector<const Dtype*>& bottom_data, Dtype* top_data, int* mask,
+    const int begin, const int end) {
+  const int count = end - begin;
   const Dtype* bottom_data_a = NULL;
   const Dtype* bottom_data_b = NULL;
-  const int count = top[0]->count();
-  Dtype* top_data = top[0]->mutable_cpu_data();
+  top_data += begin;
   switch (op_) {
   case EltwiseParameter_EltwiseOp_PROD:
-    caffe_mul(count, bottom[0]->cpu_data(), bottom[1]->cpu_data(), top_data);
-    for (int i = 2; i < bottom.size(); ++i) {
-      caffe_mul(count, top_data, bottom[i]->cpu_data(), top_data);
+    caffe_mul(count, bottom_data[0] + begin, bottom_data[1] + begin,
+        top_data);
+    for (int i = 2; i < bottom_data.size(); ++i) {
+      caffe_mul(count, top_data, bottom_data[i] + begin, top_data);
     }
     break;
   case EltwiseParameter_EltwiseOp_SUM:
     caffe_set(count, Dtype(0), top_data);
     // TODO(shelhamer) does BLAS optimize to sum for coeff = 1?
-    for (int i = 0; i < bottom.size(); ++i) {
-      caffe_axpy(count, coeffs_[i], bottom[i]->cpu_data(), top_data);
+    for (int i = 0; i < bottom_data.size(); ++i) {
+      caffe_axpy(count, coeffs_[i], bottom_data[i] + begin, top_data);
     }
     break;
   case EltwiseParameter_EltwiseOp_MAX:
-    // Initialize
-    mask = max_idx_.mutable_cpu_data();
-    caffe_set(count, -1, mask);
-    caffe_set(count, Dtype(-FLT_MAX), top_data);
+    mask += begin;
     // bottom 0 & 1
-    bottom_data_a = bottom[0]->cpu_data();
-    bottom_data_b = bottom[1]->cpu_data();
+    bottom_data_a = bottom_data[0] + begin;
+    bottom_data_b = bottom_data[1] + begin;
     for (int idx = 0; idx < count; ++idx) {
       if (bottom_data_a[idx] > bottom_data_b[idx]) {
         top_data[idx] = bottom_data_a[idx];  // maxval
@@ -81,8 +82,8 @@ void EltwiseLayer<Dtype>::Forward_cpu(
       }
     }
     // bottom 2++
-    for (int blob_idx = 2; blob_idx < bottom.size(); ++blob_idx) {
-      bottom_data_b = bottom[blob_idx]->cpu_data();
+    for (int blob_idx = 2; blob_idx < bottom_data.size(); ++blob_idx) {
+      bottom_data_b = bottom_data[blob_idx] + begin;
       for (int idx = 0; idx < count; ++idx) {
         if (bottom_data_b[idx] > top_data[idx]) {
           top_data[idx] = bottom_data_b[idx];  // maxval
@@ -96,6 +97,21 @@ void EltwiseLayer<Dtype>::Forward_cpu(
   }
 }
 
+template <typename Dtype>
+void EltwiseLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  vector<const Dtype*> bottom_data(bottom.size());
+  for (int i = 0; i < bottom.size(); ++i) {
+    bottom_data[i] = bottom[i]->cpu_data();
+  }
+  int* mask = op_ == EltwiseParameter_EltwiseOp_MAX ?
+      max_idx_.mutable_cpu_data() : NULL;
+  parallel_for(top[0]->count(), parallel_grain(bottom.size()),
+      boost::bind(&EltwiseLayer<Dtype>::forward_cpu_range, this,
+          boost::cref(bottom_data), top[0]->mutable_cpu_data(), mask, _1,
+          _2));
+}
+
 template <typename Dtype>
 void EltwiseLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
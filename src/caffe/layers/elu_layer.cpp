@@ -12,9 +12,20 @@ void ELULayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
   Dtype alpha = this->layer_param_.elu_param().alpha();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = std::max(bottom_data[i], Dtype(0))
-        + alpha * (exp(std::min(bottom_data[i], Dtype(0))) - Dtype(1));
+  // Take exp(min(x, 0)) a block at a time, into a buffer, as top may be
+  // bottom.
+  const int kBlock = 1024;
+  Dtype exp_data[kBlock];
+  for (int begin = 0; begin < count; begin += kBlock) {
+    const int n = std::min(kBlock, count - begin);
+    for (int i = 0; i < n; ++i) {
+      exp_data[i] = std::min(bottom_data[begin + i], Dtype(0));
+    }
+    caffe_exp(n, exp_data, exp_data);
+    for (int i = 0; i < n; ++i) {
+      top_data[begin + i] = std::max(bottom_data[begin + i], Dtype(0))
+          + alpha * (exp_data[i] - Dtype(1));
+    }
   }
 }
 
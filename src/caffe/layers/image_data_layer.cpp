@@ -1,4 +1,5 @@
 #ifdef USE_OPENCV
+#include <boost/bind.hpp>
 #include <opencv2/core/core.hpp>
 
 #include <fstream>  // NOLINT(readability/streams)
@@ -11,9 +12,11 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/layers/image_data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/image_cache.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -48,6 +51,12 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
 
   CHECK(!lines_.empty()) << "File is empty";
 
+  const int cache_mb = this->layer_param_.image_data_param().cache_mb();
+  if (cache_mb > 0) {
+    LOG(INFO) << "Caching up to " << cache_mb << " MB of decoded images";
+    image_cache_.reset(new ImageCache(static_cast<size_t>(cache_mb) << 20));
+  }
+
   if (this->layer_param_.image_data_param().shuffle()) {
     // randomly shuffle data
     LOG(INFO) << "Shuffling data";
@@ -100,6 +109,25 @@ void ImageDataLayer<Dtype>::ShuffleImages() {
   shuffle(lines_.begin(), lines_.end(), prefetch_rng);
 }
 
+// Reads the images of filenames [begin, end) into images, through cache
+// unless it is NULL.
+static void ReadImages(const vector<string>* filenames, const int height,
+    const int width, const bool is_color, ImageCache* cache,
+    vector<cv::Mat>* images, int begin, int end) {
+  for (int i = begin; i < end; ++i) {
+    const string& filename = (*filenames)[i];
+    cv::Mat& image = (*images)[i];
+    if (cache && cache->Lookup(filename, &image)) {
+      continue;
+    }
+    image = ReadImageToCVMat(filename, height, width, is_color);
+    CHECK(image.data) << "Could not load " << filename;
+    if (cache) {
+      cache->Insert(filename, image);
+    }
+  }
+}
+
 // This function is called on prefetch thread
 template <typename Dtype>
 void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
@@ -117,38 +145,14 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   const bool is_color = image_data_param.is_color();
   string root_folder = image_data_param.root_folder();
 
-  // Reshape according to the first image of each batch
-  // on single input batches allows for inputs of varying dimension.
-  cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-      new_height, new_width, is_color);
-  CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
-  // Use data_transformer to infer the expected blob shape from a cv_img.
-  vector<int> top_shape = this->data_transformer_->InferBlobShape(cv_img);
-  this->transformed_data_.Reshape(top_shape);
-  // Reshape batch according to the batch_size.
-  top_shape[0] = batch_size;
-  batch->data_.Reshape(top_shape);
-
-  Dtype* prefetch_data = batch->data_.mutable_cpu_data();
   Dtype* prefetch_label = batch->label_.mutable_cpu_data();
 
-  // datum scales
+  // Take the files of the batch off the list, then read them concurrently.
+  vector<string> filenames(batch_size);
   const int lines_size = lines_.size();
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    // get a blob
-    timer.Start();
     CHECK_GT(lines_size, lines_id_);
-    cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_].first,
-        new_height, new_width, is_color);
-    CHECK(cv_img.data) << "Could not load " << lines_[lines_id_].first;
-    read_time += timer.MicroSeconds();
-    timer.Start();
-    // Apply transformations (mirror, crop...) to the image
-    int offset = batch->data_.offset(item_id);
-    this->transformed_data_.set_cpu_data(prefetch_data + offset);
-    this->data_transformer_->Transform(cv_img, &(this->transformed_data_));
-    trans_time += timer.MicroSeconds();
-
+    filenames[item_id] = root_folder + lines_[lines_id_].first;
     prefetch_label[item_id] = lines_[lines_id_].second;
     // go to the next iter
     lines_id_++;
@@ -161,10 +165,32 @@ void ImageDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
       }
     }
   }
+  timer.Start();
+  vector<cv::Mat> cv_imgs(batch_size);
+  parallel_for(batch_size, 1, boost::bind(&ReadImages, &filenames,
+      new_height, new_width, is_color, image_cache_.get(), &cv_imgs, _1, _2));
+  read_time += timer.MicroSeconds();
+
+  // Reshape according to the first image of each batch
+  // on single input batches allows for inputs of varying dimension.
+  // Use data_transformer to infer the expected blob shape from a cv_img.
+  vector<int> top_shape = this->data_transformer_->InferBlobShape(cv_imgs[0]);
+  this->transformed_data_.Reshape(top_shape);
+  // Reshape batch according to the batch_size.
+  top_shape[0] = batch_size;
+  batch->data_.Reshape(top_shape);
+
+  // Apply transformations (mirror, crop...) to the images
+  timer.Start();
+  this->data_transformer_->Transform(cv_imgs, &(batch->data_));
+  trans_time += timer.MicroSeconds();
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
   DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
+  if (image_cache_) {
+    LOG_EVERY_N(INFO, 1000) << image_cache_->Summary();
+  }
 }
 
 INSTANTIATE_CLASS(ImageDataLayer);
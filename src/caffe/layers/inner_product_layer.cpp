@@ -1,8 +1,11 @@
+#include <boost/thread/locks.hpp>
 #include <vector>
 
 #include "caffe/filler.hpp"
 #include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/util/fused_activation.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/quantize.hpp"
 
 namespace caffe {
 
@@ -12,6 +15,22 @@ void InnerProductLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   const int num_output = this->layer_param_.inner_product_param().num_output();
   bias_term_ = this->layer_param_.inner_product_param().bias_term();
   transpose_ = this->layer_param_.inner_product_param().transpose();
+  fused_activation_ =
+      this->layer_param_.inner_product_param().fused_activation();
+  fuse_activation_ =
+      fused_activation_.type() != FusedActivationParameter_Type_NONE;
+  const bool has_slopes =
+      fused_activation_.type() == FusedActivationParameter_Type_PRELU;
+  quantize_ = this->layer_param_.has_quantization_param();
+  if (quantize_ && !caffe_cpu_gemm_s8_supported()) {
+    LOG(WARNING) << "Layer " << this->layer_param_.name() << " stays in float:"
+        << " this CPU has no vectorized int8 GEMM.";
+    quantize_ = false;
+  }
+  // Packing pays off when the weights are reused over many Forwards.
+  use_packed_weights_ = !quantize_ && this->phase_ == TEST &&
+      caffe_cpu_packed_gemm_supported<Dtype>();
+  derived_weights_.reset(new DerivedWeights());
   N_ = num_output;
   const int axis = bottom[0]->CanonicalAxisIndex(
       this->layer_param_.inner_product_param().axis());
@@ -23,11 +42,7 @@ void InnerProductLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   if (this->blobs_.size() > 0) {
     LOG(INFO) << "Skipping parameter initialization";
   } else {
-    if (bias_term_) {
-      this->blobs_.resize(2);
-    } else {
-      this->blobs_.resize(1);
-    }
+    this->blobs_.resize(1 + bias_term_ + has_slopes);
     // Initialize the weights
     vector<int> weight_shape(2);
     if (transpose_) {
@@ -50,6 +65,14 @@ void InnerProductLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
           this->layer_param_.inner_product_param().bias_filler()));
       bias_filler->Fill(this->blobs_[1].get());
     }
+    // Fused PReLU slopes start as in PReLULayer.
+    if (has_slopes) {
+      vector<int> slopes_shape(1,
+          fused_activation_.channel_shared() ? 1 : N_);
+      this->blobs_.back().reset(new Blob<Dtype>(slopes_shape));
+      caffe_set(this->blobs_.back()->count(), Dtype(0.25),
+          this->blobs_.back()->mutable_cpu_data());
+    }
   }  // parameter initialization
   this->param_propagate_down_.resize(this->blobs_.size(), true);
 }
@@ -78,6 +101,11 @@ void InnerProductLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
     bias_multiplier_.Reshape(bias_shape);
     caffe_set(M_, Dtype(1), bias_multiplier_.mutable_cpu_data());
   }
+  if (quantize_) {
+    bottom_int8_.resize(M_ * int8_gemm_k(K_));
+    bottom_scales_.resize(M_);
+    top_int32_.resize(M_ * N_);
+  }
 }
 
 template <typename Dtype>
@@ -86,20 +114,109 @@ void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const Dtype* weight = this->blobs_[0]->cpu_data();
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
-      M_, N_, K_, (Dtype)1.,
-      bottom_data, weight, (Dtype)0., top_data);
-  if (bias_term_) {
+  if (quantize_ || use_packed_weights_) {
+    pack_weights();
+  }
+  if (quantize_) {
+    Forward_cpu_int8(bottom_data, top_data);
+  } else if (use_packed_weights_) {
+    caffe_cpu_gemm_packed_b(M_, N_, K_, bottom_data,
+        &derived_weights_->packed[0], top_data);
+  } else {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
+        M_, N_, K_, (Dtype)1.,
+        bottom_data, weight, (Dtype)0., top_data);
+  }
+  if (fuse_activation_) {
+    // The bias and activation in one pass.
+    const Dtype* slopes =
+        fused_activation_.type() == FusedActivationParameter_Type_PRELU ?
+        this->blobs_.back()->cpu_data() : NULL;
+    fused_activation_cpu(fused_activation_, M_, N_, 1,
+        bias_term_ ? this->blobs_[1]->cpu_data() : NULL, slopes, top_data);
+  } else if (bias_term_) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
         bias_multiplier_.cpu_data(),
         this->blobs_[1]->cpu_data(), (Dtype)1., top_data);
   }
 }
 
+template <typename Dtype>
+void InnerProductLayer<Dtype>::ShareDerivedWeights(Layer<Dtype>* other) {
+  InnerProductLayer* source = dynamic_cast<InnerProductLayer*>(other);
+  CHECK(source) << "Can only share derived weights with an InnerProduct "
+      << "layer.";
+  CHECK(this->blobs_[0]->data() == source->blobs_[0]->data())
+      << "Can only share derived weights with a layer sharing the weights.";
+  derived_weights_ = source->derived_weights_;
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::pack_weights() {
+  const Blob<Dtype>& weight_blob = *this->blobs_[0];
+  DerivedWeights& derived = *derived_weights_;
+  boost::lock_guard<WeightMutex> lock(derived.mutex);
+  if (derived.version.Matches(weight_blob)) {
+    return;
+  }
+  const Dtype* weight = weight_blob.cpu_data();
+  if (quantize_) {
+    // Quantize the weights as N_ x K_, one scale per output, and pack them as
+    // the K_ x N_ operand of the int8 GEMM.
+    vector<int8_t> weight_int8(N_ * int8_gemm_k(K_));
+    derived.int8_packed.resize(N_ * int8_gemm_k(K_));
+    derived.scales.resize(N_);
+    if (transpose_) {
+      vector<Dtype> weight_t(N_ * K_);
+      for (int k = 0; k < K_; ++k) {
+        for (int n = 0; n < N_; ++n) {
+          weight_t[n * K_ + k] = weight[k * N_ + n];
+        }
+      }
+      caffe_cpu_quantize_rows(N_, K_, &weight_t[0], &weight_int8[0],
+          &derived.scales[0]);
+    } else {
+      caffe_cpu_quantize_rows(N_, K_, weight, &weight_int8[0],
+          &derived.scales[0]);
+    }
+    caffe_cpu_pack_s8(N_, K_, &weight_int8[0], &derived.int8_packed[0]);
+  } else {
+    derived.packed.resize(caffe_cpu_packed_b_size(K_, N_));
+    caffe_cpu_pack_b(transpose_ ? CblasNoTrans : CblasTrans, K_, N_, weight,
+        &derived.packed[0]);
+  }
+  derived.version.Set(weight_blob);
+}
+
+template <typename Dtype>
+void InnerProductLayer<Dtype>::Forward_cpu_int8(const Dtype* bottom_data,
+    Dtype* top_data) {
+  // Quantize the input with the calibrated scale, or one scale per row.
+  const QuantizationParameter& quantization_param =
+      this->layer_param_.quantization_param();
+  Dtype input_scale = 1;
+  const Dtype* row_scales = NULL;
+  if (quantization_param.has_input_max()) {
+    input_scale = int8_scale(Dtype(quantization_param.input_max()));
+    caffe_cpu_quantize(M_, K_, input_scale, bottom_data, &bottom_int8_[0]);
+  } else {
+    caffe_cpu_quantize_rows(M_, K_, bottom_data, &bottom_int8_[0],
+        &bottom_scales_[0]);
+    row_scales = &bottom_scales_[0];
+  }
+  caffe_cpu_gemm_s8(M_, N_, K_, &bottom_int8_[0],
+      &derived_weights_->int8_packed[0], &top_int32_[0]);
+  caffe_cpu_dequantize(M_, N_, &top_int32_[0], input_scale, row_scales,
+      &derived_weights_->scales[0], top_data);
+}
+
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
+  CHECK(!fuse_activation_)
+      << "Layers with a fused activation can only run Forward.";
+  CHECK(!quantize_) << "Layers quantized to int8 can only run Forward.";
   if (this->param_propagate_down_[0]) {
     const Dtype* top_diff = top[0]->cpu_diff();
     const Dtype* bottom_data = bottom[0]->cpu_data();
@@ -2,6 +2,7 @@
 
 #include "caffe/filler.hpp"
 #include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/util/fused_activation.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -9,6 +10,11 @@ namespace caffe {
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
+  if (quantize_) {
+    // Int8 inference only runs on the CPU.
+    Forward_cpu(bottom, top);
+    return;
+  }
   const Dtype* bottom_data = bottom[0]->gpu_data();
   Dtype* top_data = top[0]->mutable_gpu_data();
   const Dtype* weight = this->blobs_[0]->gpu_data();
@@ -28,12 +34,21 @@ void InnerProductLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
                             bias_multiplier_.gpu_data(),
                             this->blobs_[1]->gpu_data(), (Dtype)1., top_data);
   }
+  if (fuse_activation_) {
+    const Dtype* slopes =
+        fused_activation_.type() == FusedActivationParameter_Type_PRELU ?
+        this->blobs_.back()->gpu_data() : NULL;
+    fused_activation_gpu(fused_activation_, M_, N_, 1, slopes, top_data);
+  }
 }
 
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
+  CHECK(!fuse_activation_)
+      << "Layers with a fused activation can only run Forward.";
+  CHECK(!quantize_) << "Layers quantized to int8 can only run Forward.";
   if (this->param_propagate_down_[0]) {
     const Dtype* top_diff = top[0]->gpu_diff();
     const Dtype* bottom_data = bottom[0]->gpu_data();
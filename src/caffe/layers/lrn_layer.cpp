@@ -1,7 +1,13 @@
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
+#include "boost/bind.hpp"
+
 #include "caffe/layers/lrn_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/simd_math.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -104,51 +110,148 @@ void LRNLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+// Normalizes one pixel of an image whose channels lie stride apart, keeping
+// the window sum of squares as it slides down the channels. The squares of
+// the last pre_pad + 1 channels wait in the ring squares, as top may be
+// bottom and overwrite them before they leave the window.
 template <typename Dtype>
-void LRNLayer<Dtype>::CrossChannelForward_cpu(
-    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* top_data = top[0]->mutable_cpu_data();
-  Dtype* scale_data = scale_.mutable_cpu_data();
-  // start with the constant value
-  for (int i = 0; i < scale_.count(); ++i) {
-    scale_data[i] = k_;
+static void lrn_pixel(const Dtype* bottom, Dtype* top, Dtype* scale,
+    const int channels, const int stride, const int pre_pad,
+    const Dtype alpha_over_size, const Dtype k, const Dtype beta,
+    Dtype* squares) {
+  // The window of channel c covers the channels [c - pre_pad, c + pre_pad].
+  const int ring = pre_pad + 1;
+  Dtype sum = 0;
+  for (int c = 0; c < std::min(channels, pre_pad); ++c) {
+    sum += bottom[c * stride] * bottom[c * stride];
   }
-  Blob<Dtype> padded_square(1, channels_ + size_ - 1, height_, width_);
-  Dtype* padded_square_data = padded_square.mutable_cpu_data();
-  caffe_set(padded_square.count(), Dtype(0), padded_square_data);
-  Dtype alpha_over_size = alpha_ / size_;
-  // go through the images
-  for (int n = 0; n < num_; ++n) {
-    // compute the padded square
-    caffe_sqr(channels_ * height_ * width_,
-        bottom_data + bottom[0]->offset(n),
-        padded_square_data + padded_square.offset(0, pre_pad_));
-    // Create the first channel scale
-    for (int c = 0; c < size_; ++c) {
-      caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-          padded_square_data + padded_square.offset(0, c),
-          scale_data + scale_.offset(n, 0));
+  for (int c = 0; c < channels; ++c) {
+    const int head = c + pre_pad;
+    if (head < channels) {
+      sum += bottom[head * stride] * bottom[head * stride];
     }
-    for (int c = 1; c < channels_; ++c) {
-      // copy previous scale
-      caffe_copy<Dtype>(height_ * width_,
-          scale_data + scale_.offset(n, c - 1),
-          scale_data + scale_.offset(n, c));
-      // add head
-      caffe_axpy<Dtype>(height_ * width_, alpha_over_size,
-          padded_square_data + padded_square.offset(0, c + size_ - 1),
-          scale_data + scale_.offset(n, c));
-      // subtract tail
-      caffe_axpy<Dtype>(height_ * width_, -alpha_over_size,
-          padded_square_data + padded_square.offset(0, c - 1),
-          scale_data + scale_.offset(n, c));
+    // Channel c - pre_pad - 1 left its square in the slot of channel c.
+    Dtype* square = squares + c % ring;
+    if (c >= ring) {
+      sum -= *square;
     }
+    const Dtype x = bottom[c * stride];
+    *square = x * x;
+    scale[c * stride] = k + alpha_over_size * sum;
+    top[c * stride] = x * std::pow(scale[c * stride], -beta);
+  }
+}
+
+#ifdef USE_SSE_MATH
+// Normalizes 4 * kVectors contiguous pixels as lrn_pixel does, with their
+// window sums in registers, and scale^-beta from vectorized exp and log, or
+// from square roots for the common beta of 0.75. The ring squares holds
+// 4 * kVectors floats for each of pre_pad + 1 channels.
+template <int kVectors>
+static void lrn_pixels_sse(const float* bottom, float* top, float* scale,
+    const int channels, const int stride, const int pre_pad,
+    const float alpha_over_size, const float k, const float beta,
+    float* squares) {
+  const __m128 alpha_v = _mm_set1_ps(alpha_over_size);
+  const __m128 k_v = _mm_set1_ps(k);
+  const bool three_quarters = beta == 0.75f;
+  const int ring = pre_pad + 1;
+  __m128 sum[kVectors];
+  for (int v = 0; v < kVectors; ++v) {
+    sum[v] = _mm_setzero_ps();
+  }
+  for (int c = 0; c < std::min(channels, pre_pad); ++c) {
+    for (int v = 0; v < kVectors; ++v) {
+      const __m128 x = _mm_loadu_ps(bottom + c * stride + 4 * v);
+      sum[v] = _mm_add_ps(sum[v], _mm_mul_ps(x, x));
+    }
+  }
+  for (int c = 0; c < channels; ++c) {
+    const int head = c + pre_pad;
+    float* square = squares + (c % ring) * 4 * kVectors;
+    for (int v = 0; v < kVectors; ++v) {
+      if (head < channels) {
+        const __m128 x = _mm_loadu_ps(bottom + head * stride + 4 * v);
+        sum[v] = _mm_add_ps(sum[v], _mm_mul_ps(x, x));
+      }
+      if (c >= ring) {
+        sum[v] = _mm_sub_ps(sum[v], _mm_loadu_ps(square + 4 * v));
+      }
+      const __m128 x = _mm_loadu_ps(bottom + c * stride + 4 * v);
+      _mm_storeu_ps(square + 4 * v, _mm_mul_ps(x, x));
+      const __m128 s = _mm_add_ps(k_v, _mm_mul_ps(alpha_v, sum[v]));
+      _mm_storeu_ps(scale + c * stride + 4 * v, s);
+      __m128 y;
+      if (three_quarters) {
+        const __m128 root = _mm_sqrt_ps(s);
+        y = _mm_div_ps(x, _mm_mul_ps(root, _mm_sqrt_ps(root)));
+      } else {
+        y = _mm_mul_ps(x, caffe_sse_pow(s, -beta));
+      }
+      _mm_storeu_ps(top + c * stride + 4 * v, y);
+    }
+  }
+}
+#endif
+
+template <typename Dtype>
+static void lrn_pixels(const Dtype* bottom, Dtype* top, Dtype* scale,
+    const int pixels, const int channels, const int stride, const int pre_pad,
+    const Dtype alpha_over_size, const Dtype k, const Dtype beta) {
+  vector<Dtype> squares(pre_pad + 1);
+  for (int p = 0; p < pixels; ++p) {
+    lrn_pixel(bottom + p, top + p, scale + p, channels, stride, pre_pad,
+        alpha_over_size, k, beta, &squares[0]);
+  }
+}
+
+#ifdef USE_SSE_MATH
+static void lrn_pixels(const float* bottom, float* top, float* scale,
+    const int pixels, const int channels, const int stride, const int pre_pad,
+    const float alpha_over_size, const float k, const float beta) {
+  vector<float> squares((pre_pad + 1) * 16);
+  // Sixteen pixels fill a cache line of each channel.
+  int p = 0;
+  for (; p + 16 <= pixels; p += 16) {
+    lrn_pixels_sse<4>(bottom + p, top + p, scale + p, channels, stride,
+        pre_pad, alpha_over_size, k, beta, &squares[0]);
+  }
+  for (; p + 4 <= pixels; p += 4) {
+    lrn_pixels_sse<1>(bottom + p, top + p, scale + p, channels, stride,
+        pre_pad, alpha_over_size, k, beta, &squares[0]);
   }
+  lrn_pixels<float>(bottom + p, top + p, scale + p, pixels - p, channels,
+      stride, pre_pad, alpha_over_size, k, beta);
+}
+#endif
 
-  // In the end, compute output
-  caffe_powx<Dtype>(scale_.count(), scale_data, -beta_, top_data);
-  caffe_mul<Dtype>(scale_.count(), top_data, bottom_data, top_data);
+// Normalizes the rows [begin, end) of all images, in one pass over the
+// channels of each run of pixels; scale_data keeps the scales for backward.
+template <typename Dtype>
+void LRNLayer<Dtype>::CrossChannelForward_cpu_rows(const Dtype* bottom_data,
+    Dtype* top_data, Dtype* scale_data, const int begin, const int end) {
+  const int spatial_dim = height_ * width_;
+  for (int row = begin; row < end; ) {
+    const int n = row / height_;
+    const int h = row % height_;
+    const int rows = std::min(height_ - h, end - row);
+    const int offset = n * channels_ * spatial_dim + h * width_;
+    lrn_pixels(bottom_data + offset, top_data + offset, scale_data + offset,
+        rows * width_, channels_, spatial_dim, pre_pad_, alpha_ / size_, k_,
+        beta_);
+    row += rows;
+  }
+}
+
+template <typename Dtype>
+void LRNLayer<Dtype>::CrossChannelForward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  // Rows of pixels normalize independently; the pool splits the N x H rows
+  // among its threads.
+  parallel_for(num_ * height_, parallel_grain(8 * width_ * channels_),
+      boost::bind(&LRNLayer<Dtype>::CrossChannelForward_cpu_rows, this,
+          bottom[0]->cpu_data(), top[0]->mutable_cpu_data(),
+          scale_.mutable_cpu_data(), _1, _2));
 }
 
 template <typename Dtype>
@@ -1,15 +1,80 @@
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define USE_SSE_POOLING
+#endif
+
 #include <algorithm>
 #include <cfloat>
 #include <vector>
 
+#include "boost/bind.hpp"
+
 #include "caffe/layers/pooling_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
 using std::min;
 using std::max;
 
+// Pools count outputs of one row of kernel x kernel windows with stride 2,
+// the first starting at column wstart of the kernel rows from window_data,
+// all of which lie inside the input.
+template <typename Dtype>
+static void pool_row_stride2(const bool max_pool, const int kernel,
+    const Dtype* window_data, const int width, const int wstart,
+    const int count, Dtype* top_row) {
+  for (int i = 0; i < count; ++i) {
+    const Dtype* window = window_data + wstart + 2 * i;
+    Dtype value = max_pool ? window[0] : Dtype(0);
+    for (int h = 0; h < kernel; ++h) {
+      for (int w = 0; w < kernel; ++w) {
+        value = max_pool ? max(value, window[h * width + w]) :
+            value + window[h * width + w];
+      }
+    }
+    top_row[i] = max_pool ? value : value / (kernel * kernel);
+  }
+}
+
+#ifdef USE_SSE_POOLING
+// Pools four outputs at a time: the even and the odd columns of eight inputs
+// cover 2x2 windows, and the even columns two further on complete 3x3 ones.
+static void pool_row_stride2(const bool max_pool, const int kernel,
+    const float* window_data, const int width, const int wstart,
+    const int count, float* top_row) {
+  // The columns read for four outputs.
+  const int span = kernel == 3 ? 10 : 8;
+  const __m128 area = _mm_set1_ps(kernel * kernel);
+  int i = 0;
+  for (; i + 4 <= count && wstart + 2 * i + span <= width; i += 4) {
+    __m128 pooled = _mm_setzero_ps();
+    for (int h = 0; h < kernel; ++h) {
+      const float* p = window_data + h * width + wstart + 2 * i;
+      const __m128 a = _mm_loadu_ps(p);
+      const __m128 b = _mm_loadu_ps(p + 4);
+      const __m128 even = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+      const __m128 odd = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+      __m128 row = max_pool ? _mm_max_ps(even, odd) : _mm_add_ps(even, odd);
+      if (kernel == 3) {
+        const __m128 next = _mm_shuffle_ps(_mm_loadu_ps(p + 2),
+            _mm_loadu_ps(p + 6), _MM_SHUFFLE(2, 0, 2, 0));
+        row = max_pool ? _mm_max_ps(row, next) : _mm_add_ps(row, next);
+      }
+      pooled = h == 0 ? row :
+          (max_pool ? _mm_max_ps(pooled, row) : _mm_add_ps(pooled, row));
+    }
+    if (!max_pool) {
+      pooled = _mm_div_ps(pooled, area);
+    }
+    _mm_storeu_ps(top_row + i, pooled);
+  }
+  pool_row_stride2<float>(max_pool, kernel, window_data, width,
+      wstart + 2 * i, count - i, top_row + i);
+}
+#endif
+
 template <typename Dtype>
 void PoolingLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -122,6 +187,230 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+// Pools the channels of each output pixel together, from whole input pixels
+// of channels_ contiguous values, for the output rows [begin, end) of all
+// images. Forward only: it leaves max_idx_ unset.
+template <typename Dtype>
+void PoolingLayer<Dtype>::forward_cpu_channels_last(const Dtype* bottom_data,
+    Dtype* top_data, const int begin, const int end) {
+  const bool max_pool = this->layer_param_.pooling_param().pool() ==
+      PoolingParameter_PoolMethod_MAX;
+  for (int row = begin; row < end; ++row) {
+    const int n = row / pooled_height_;
+    const int ph = row % pooled_height_;
+    const Dtype* bottom_image = bottom_data + n * height_ * width_ * channels_;
+    for (int pw = 0; pw < pooled_width_; ++pw) {
+      int hstart = ph * stride_h_ - pad_h_;
+      int wstart = pw * stride_w_ - pad_w_;
+      int hend = min(hstart + kernel_h_, height_ + pad_h_);
+      int wend = min(wstart + kernel_w_, width_ + pad_w_);
+      const int pool_size = (hend - hstart) * (wend - wstart);
+      hstart = max(hstart, 0);
+      wstart = max(wstart, 0);
+      hend = min(hend, height_);
+      wend = min(wend, width_);
+      Dtype* top_pixel = top_data + (row * pooled_width_ + pw) * channels_;
+      std::fill(top_pixel, top_pixel + channels_,
+          max_pool ? Dtype(-FLT_MAX) : Dtype(0));
+      for (int h = hstart; h < hend; ++h) {
+        for (int w = wstart; w < wend; ++w) {
+          const Dtype* bottom_pixel =
+              bottom_image + (h * width_ + w) * channels_;
+          if (max_pool) {
+            for (int c = 0; c < channels_; ++c) {
+              top_pixel[c] = max(top_pixel[c], bottom_pixel[c]);
+            }
+          } else {
+            for (int c = 0; c < channels_; ++c) {
+              top_pixel[c] += bottom_pixel[c];
+            }
+          }
+        }
+      }
+      if (!max_pool) {
+        for (int c = 0; c < channels_; ++c) {
+          top_pixel[c] /= pool_size;
+        }
+      }
+    }
+  }
+}
+
+// Max pools the planes [begin, end) of all images; a plane is one channel of
+// one image.
+template <typename Dtype>
+void PoolingLayer<Dtype>::forward_cpu_max(const Dtype* bottom_data,
+    Dtype* top_data, int* mask, Dtype* top_mask, const int begin,
+    const int end) {
+  const int bottom_plane = height_ * width_;
+  const int top_plane = pooled_height_ * pooled_width_;
+  for (int plane = begin; plane < end; ++plane) {
+    const Dtype* bottom = bottom_data + plane * bottom_plane;
+    Dtype* top = top_data + plane * top_plane;
+    // Initialize
+    caffe_set(top_plane, Dtype(-FLT_MAX), top);
+    if (top_mask) {
+      caffe_set(top_plane, Dtype(-1), top_mask + plane * top_plane);
+    } else {
+      caffe_set(top_plane, -1, mask + plane * top_plane);
+    }
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      for (int pw = 0; pw < pooled_width_; ++pw) {
+        int hstart = ph * stride_h_ - pad_h_;
+        int wstart = pw * stride_w_ - pad_w_;
+        int hend = min(hstart + kernel_h_, height_);
+        int wend = min(wstart + kernel_w_, width_);
+        hstart = max(hstart, 0);
+        wstart = max(wstart, 0);
+        const int pool_index = ph * pooled_width_ + pw;
+        int max_index = -1;
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            const int index = h * width_ + w;
+            if (bottom[index] > top[pool_index]) {
+              top[pool_index] = bottom[index];
+              max_index = index;
+            }
+          }
+        }
+        if (max_index >= 0) {
+          if (top_mask) {
+            top_mask[plane * top_plane + pool_index] =
+                static_cast<Dtype>(max_index);
+          } else {
+            mask[plane * top_plane + pool_index] = max_index;
+          }
+        }
+      }
+    }
+  }
+}
+
+// Max or average pools one output pixel of a plane.
+template <typename Dtype>
+Dtype PoolingLayer<Dtype>::pool_window(const Dtype* bottom, const int ph,
+    const int pw, const bool max_pool) const {
+  int hstart = ph * stride_h_ - pad_h_;
+  int wstart = pw * stride_w_ - pad_w_;
+  int hend = min(hstart + kernel_h_, height_ + pad_h_);
+  int wend = min(wstart + kernel_w_, width_ + pad_w_);
+  const int pool_size = (hend - hstart) * (wend - wstart);
+  hstart = max(hstart, 0);
+  wstart = max(wstart, 0);
+  hend = min(hend, height_);
+  wend = min(wend, width_);
+  Dtype value = max_pool ? Dtype(-FLT_MAX) : Dtype(0);
+  for (int h = hstart; h < hend; ++h) {
+    for (int w = wstart; w < wend; ++w) {
+      if (max_pool) {
+        value = max(value, bottom[h * width_ + w]);
+      } else {
+        value += bottom[h * width_ + w];
+      }
+    }
+  }
+  return max_pool ? value : value / pool_size;
+}
+
+// Max or average pools the planes [begin, end) of all images without a
+// mask. Rows of 2x2 and 3x3 windows of stride 2 pool with vectorized kernels
+// where the windows lie inside the input.
+template <typename Dtype>
+void PoolingLayer<Dtype>::forward_cpu_unmasked(const Dtype* bottom_data,
+    Dtype* top_data, const int begin, const int end) {
+  const bool max_pool = this->layer_param_.pooling_param().pool() ==
+      PoolingParameter_PoolMethod_MAX;
+  const bool stride2 = stride_h_ == 2 && stride_w_ == 2 &&
+      kernel_h_ == kernel_w_ && (kernel_h_ == 2 || kernel_h_ == 3);
+  // The outputs whose windows lie inside the input along the width.
+  const int inside_begin = min(pooled_width_, (pad_w_ + 1) / 2);
+  const int last_wstart = width_ + pad_w_ - kernel_w_;
+  const int inside_end = last_wstart < 0 ? inside_begin :
+      max(inside_begin, min(pooled_width_, last_wstart / 2 + 1));
+  const int bottom_plane = height_ * width_;
+  const int top_plane = pooled_height_ * pooled_width_;
+  for (int plane = begin; plane < end; ++plane) {
+    const Dtype* bottom = bottom_data + plane * bottom_plane;
+    Dtype* top = top_data + plane * top_plane;
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      Dtype* top_row = top + ph * pooled_width_;
+      const int hstart = ph * stride_h_ - pad_h_;
+      const bool fast = stride2 && inside_begin < inside_end &&
+          hstart >= 0 && hstart + kernel_h_ <= height_;
+      for (int pw = 0; pw < pooled_width_; ++pw) {
+        if (fast && pw == inside_begin) {
+          pool_row_stride2(max_pool, kernel_h_, bottom + hstart * width_,
+              width_, pw * stride_w_ - pad_w_, inside_end - inside_begin,
+              top_row + pw);
+          pw = inside_end - 1;
+          continue;
+        }
+        top_row[pw] = pool_window(bottom, ph, pw, max_pool);
+      }
+    }
+  }
+}
+
+// Stochastic pooling of the planes [begin, end) of all images, without
+// padding, as on the GPU. With rand_idx, given a uniform sample per output,
+// it samples each window in proportion to its activations and replaces the
+// sample with the bottom index picked; without, it takes the activation
+// weighted average of each window, as for TEST.
+template <typename Dtype>
+void PoolingLayer<Dtype>::forward_cpu_stochastic(const Dtype* bottom_data,
+    Dtype* top_data, Dtype* rand_idx, const int begin, const int end) {
+  const int bottom_plane = height_ * width_;
+  const int top_plane = pooled_height_ * pooled_width_;
+  for (int plane = begin; plane < end; ++plane) {
+    const Dtype* bottom = bottom_data + plane * bottom_plane;
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      for (int pw = 0; pw < pooled_width_; ++pw) {
+        const int hstart = ph * stride_h_;
+        const int hend = min(hstart + kernel_h_, height_);
+        const int wstart = pw * stride_w_;
+        const int wend = min(wstart + kernel_w_, width_);
+        const int index = plane * top_plane + ph * pooled_width_ + pw;
+        if (rand_idx) {
+          Dtype cumsum = 0;
+          for (int h = hstart; h < hend; ++h) {
+            for (int w = wstart; w < wend; ++w) {
+              cumsum += bottom[h * width_ + w];
+            }
+          }
+          const Dtype thres = rand_idx[index] * cumsum;
+          // Rounding may leave the threshold unmet; the last element is
+          // picked then.
+          int picked = (hend - 1) * width_ + wend - 1;
+          bool found = false;
+          cumsum = 0;
+          for (int h = hstart; h < hend && !found; ++h) {
+            for (int w = wstart; w < wend && !found; ++w) {
+              cumsum += bottom[h * width_ + w];
+              if (cumsum >= thres) {
+                picked = h * width_ + w;
+                found = true;
+              }
+            }
+          }
+          top_data[index] = bottom[picked];
+          rand_idx[index] = plane * bottom_plane + picked;
+        } else {
+          // We set cumsum to be FLT_MIN to avoid divide-by-zero problems
+          Dtype cumsum = FLT_MIN;
+          Dtype cumvalues = 0;
+          for (int h = hstart; h < hend; ++h) {
+            for (int w = wstart; w < wend; ++w) {
+              cumsum += bottom[h * width_ + w];
+              cumvalues += bottom[h * width_ + w] * bottom[h * width_ + w];
+            }
+          }
+          top_data[index] = cumvalues / cumsum;
+        }
+      }
+    }
+  }
+}
+
 // TODO(Yangqing): Is there a faster way to do pooling in the channel-first
 // case?
 template <typename Dtype>
@@ -129,97 +418,58 @@ void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  const int top_count = top[0]->count();
+  // Images and channels pool independently; the pool splits them among its
+  // threads.
+  const int window_work = kernel_h_ * kernel_w_ * pooled_width_;
+  if (this->channels_last_) {
+    parallel_for(bottom[0]->num() * pooled_height_,
+        parallel_grain(window_work * channels_),
+        boost::bind(&PoolingLayer<Dtype>::forward_cpu_channels_last, this,
+            bottom_data, top_data, _1, _2));
+    return;
+  }
+  const int planes = bottom[0]->num() * channels_;
+  const int grain = parallel_grain(window_work * pooled_height_);
   // We'll output the mask to top[1] if it's of size >1.
   const bool use_top_mask = top.size() > 1;
   int* mask = NULL;  // suppress warnings about uninitalized variables
   Dtype* top_mask = NULL;
+  Dtype* rand_idx = NULL;
   // Different pooling methods. We explicitly do the switch outside the for
   // loop to save time, although this results in more code.
   switch (this->layer_param_.pooling_param().pool()) {
   case PoolingParameter_PoolMethod_MAX:
-    // Initialize
+    // TEST nets rarely run backward, which finds the maxima again if they
+    // do; the forward skips the mask.
+    if (!use_top_mask && this->phase_ == TEST) {
+      parallel_for(planes, grain,
+          boost::bind(&PoolingLayer<Dtype>::forward_cpu_unmasked, this,
+              bottom_data, top_data, _1, _2));
+      break;
+    }
     if (use_top_mask) {
       top_mask = top[1]->mutable_cpu_data();
-      caffe_set(top_count, Dtype(-1), top_mask);
     } else {
       mask = max_idx_.mutable_cpu_data();
-      caffe_set(top_count, -1, mask);
-    }
-    caffe_set(top_count, Dtype(-FLT_MAX), top_data);
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_);
-            int wend = min(wstart + kernel_w_, width_);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            const int pool_index = ph * pooled_width_ + pw;
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                const int index = h * width_ + w;
-                if (bottom_data[index] > top_data[pool_index]) {
-                  top_data[pool_index] = bottom_data[index];
-                  if (use_top_mask) {
-                    top_mask[pool_index] = static_cast<Dtype>(index);
-                  } else {
-                    mask[pool_index] = index;
-                  }
-                }
-              }
-            }
-          }
-        }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
-        if (use_top_mask) {
-          top_mask += top[0]->offset(0, 1);
-        } else {
-          mask += top[0]->offset(0, 1);
-        }
-      }
     }
+    parallel_for(planes, grain,
+        boost::bind(&PoolingLayer<Dtype>::forward_cpu_max, this, bottom_data,
+            top_data, mask, top_mask, _1, _2));
     break;
   case PoolingParameter_PoolMethod_AVE:
-    for (int i = 0; i < top_count; ++i) {
-      top_data[i] = 0;
-    }
-    // The main loop
-    for (int n = 0; n < bottom[0]->num(); ++n) {
-      for (int c = 0; c < channels_; ++c) {
-        for (int ph = 0; ph < pooled_height_; ++ph) {
-          for (int pw = 0; pw < pooled_width_; ++pw) {
-            int hstart = ph * stride_h_ - pad_h_;
-            int wstart = pw * stride_w_ - pad_w_;
-            int hend = min(hstart + kernel_h_, height_ + pad_h_);
-            int wend = min(wstart + kernel_w_, width_ + pad_w_);
-            int pool_size = (hend - hstart) * (wend - wstart);
-            hstart = max(hstart, 0);
-            wstart = max(wstart, 0);
-            hend = min(hend, height_);
-            wend = min(wend, width_);
-            for (int h = hstart; h < hend; ++h) {
-              for (int w = wstart; w < wend; ++w) {
-                top_data[ph * pooled_width_ + pw] +=
-                    bottom_data[h * width_ + w];
-              }
-            }
-            top_data[ph * pooled_width_ + pw] /= pool_size;
-          }
-        }
-        // compute offset
-        bottom_data += bottom[0]->offset(0, 1);
-        top_data += top[0]->offset(0, 1);
-      }
-    }
+    parallel_for(planes, grain,
+        boost::bind(&PoolingLayer<Dtype>::forward_cpu_unmasked, this,
+            bottom_data, top_data, _1, _2));
     break;
   case PoolingParameter_PoolMethod_STOCHASTIC:
-    NOT_IMPLEMENTED;
+    if (this->phase_ == TRAIN) {
+      // We need to create the random index as well.
+      rand_idx = rand_idx_.mutable_cpu_data();
+      caffe_rng_uniform(rand_idx_.count(), Dtype(0), Dtype(1), rand_idx);
+    }
+    parallel_for(planes, grain,
+        boost::bind(&PoolingLayer<Dtype>::forward_cpu_stochastic, this,
+            bottom_data, top_data, rand_idx, _1, _2));
     break;
   default:
     LOG(FATAL) << "Unknown pooling method.";
@@ -241,12 +491,23 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   const bool use_top_mask = top.size() > 1;
   const int* mask = NULL;  // suppress warnings about uninitialized variables
   const Dtype* top_mask = NULL;
+  const Dtype* rand_idx = NULL;
   switch (this->layer_param_.pooling_param().pool()) {
   case PoolingParameter_PoolMethod_MAX:
     // The main loop
     if (use_top_mask) {
       top_mask = top[1]->cpu_data();
     } else {
+      if (this->phase_ == TEST) {
+        // The forward skipped the mask; find the maxima again, without
+        // touching top, which later layers may have changed in place.
+        Blob<Dtype> pooled(top[0]->shape());
+        parallel_for(bottom[0]->num() * channels_, 1,
+            boost::bind(&PoolingLayer<Dtype>::forward_cpu_max, this,
+                bottom[0]->cpu_data(), pooled.mutable_cpu_data(),
+                max_idx_.mutable_cpu_data(), static_cast<Dtype*>(NULL), _1,
+                _2));
+      }
       mask = max_idx_.cpu_data();
     }
     for (int n = 0; n < top[0]->num(); ++n) {
@@ -299,7 +560,11 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     }
     break;
   case PoolingParameter_PoolMethod_STOCHASTIC:
-    NOT_IMPLEMENTED;
+    // The random index holds the bottom index each output sampled.
+    rand_idx = rand_idx_.cpu_data();
+    for (int i = 0; i < top[0]->count(); ++i) {
+      bottom_diff[static_cast<int>(rand_idx[i])] += top_diff[i];
+    }
     break;
   default:
     LOG(FATAL) << "Unknown pooling method.";
@@ -1,24 +1,16 @@
-#include <cmath>
 #include <vector>
 
 #include "caffe/layers/sigmoid_layer.hpp"
 
 namespace caffe {
 
-template <typename Dtype>
-inline Dtype sigmoid(Dtype x) {
-  return 1. / (1. + exp(-x));
-}
-
 template <typename Dtype>
 void SigmoidLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int count = bottom[0]->count();
-  for (int i = 0; i < count; ++i) {
-    top_data[i] = sigmoid(bottom_data[i]);
-  }
+  caffe_sigmoid(count, bottom_data, top_data);
 }
 
 template <typename Dtype>
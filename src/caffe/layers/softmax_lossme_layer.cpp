@@ -1,9 +1,11 @@
 #include <algorithm>
 #include <cfloat>
+#include <cmath>
 #include <vector>
 
 #include "caffe/layers/softmax_lossme_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/softmax.hpp"
 
 namespace caffe {
 
@@ -53,6 +55,7 @@ void SoftmaxWithLossMeLayer<Dtype>::Reshape(
     // softmax output
     top[1]->ReshapeLike(*bottom[0]);
   }
+  log_norm_.Reshape(vector<int>(1, outer_num_ * inner_num_));
 }
 
 template <typename Dtype>
@@ -88,10 +91,15 @@ Dtype SoftmaxWithLossMeLayer<Dtype>::get_normalizer(
 template <typename Dtype>
 void SoftmaxWithLossMeLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  // The forward pass computes the softmax prob values.
-  softmax_layer_->Forward(softmax_bottom_vec_, softmax_top_vec_);
-  const Dtype* prob_data = prob_.cpu_data();
+  // The forward pass computes the softmax prob values, and the log of their
+  // normalizers, from which the loss of each column follows as its log
+  // normalizer less its label's input, at most -log(FLT_MIN).
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  caffe_cpu_softmax(outer_num_, bottom[0]->shape(softmax_axis_), inner_num_,
+      bottom_data, prob_.mutable_cpu_data(), log_norm_.mutable_cpu_data());
+  const Dtype* log_norm = log_norm_.cpu_data();
   const Dtype* label = bottom[1]->cpu_data();
+  const Dtype max_loss = -std::log(Dtype(FLT_MIN));
   int dim = prob_.count() / outer_num_;
   int count = 0;
   Dtype loss = 0;
@@ -103,8 +111,8 @@ void SoftmaxWithLossMeLayer<Dtype>::Forward_cpu(
       }
       DCHECK_GE(label_value, 0);
       DCHECK_LT(label_value, prob_.shape(softmax_axis_));
-      loss -= log(std::max(prob_data[i * dim + label_value * inner_num_ + j],
-                           Dtype(FLT_MIN)));
+      loss += std::min(log_norm[i * inner_num_ + j]
+          - bottom_data[i * dim + label_value * inner_num_ + j], max_loss);
       ++count;
     }
   }
@@ -128,32 +136,19 @@ void SoftmaxWithLossMeLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top
                << " Layer cannot backpropagate to label inputs.";
   }
   if (propagate_down[0]) {
-    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-    const Dtype* prob_data = prob_.cpu_data();
-    caffe_copy(prob_.count(), prob_data, bottom_diff);
     const Dtype* label = bottom[1]->cpu_data();
-    int dim = prob_.count() / outer_num_;
     int count = 0;
-    for (int i = 0; i < outer_num_; ++i) {
-      for (int j = 0; j < inner_num_; ++j) {
-        const int label_value = static_cast<int>(label[i * inner_num_ + j]);
-        if (has_ignore_label_ && label_value == ignore_label_) {
-          for (int c = 0; c < bottom[0]->shape(softmax_axis_); ++c) {
-            bottom_diff[i * dim + c * inner_num_ + j] = 0;
-          }
-        } else {
-          bottom_diff[i * dim + label_value * inner_num_ + j] -= 1;
-          ++count;
-        }
+    for (int i = 0; i < outer_num_ * inner_num_; ++i) {
+      if (!has_ignore_label_ || static_cast<int>(label[i]) != ignore_label_) {
+        ++count;
       }
     }
     // Scale gradient
     Dtype norm = get_normalizer(normalization_, count);
-    if (norm > 1e-8) {
-      Dtype loss_weight = top[0]->cpu_diff()[0] /
-                          get_normalizer(normalization_, count);
-      caffe_scal(prob_.count(), loss_weight, bottom_diff);
-    }
+    Dtype loss_weight = norm > 1e-8 ? top[0]->cpu_diff()[0] / norm : Dtype(1);
+    caffe_cpu_softmax_loss_diff(outer_num_, bottom[0]->shape(softmax_axis_),
+        inner_num_, prob_.cpu_data(), label, has_ignore_label_, ignore_label_,
+        loss_weight, bottom[0]->mutable_cpu_diff());
   }
 }
 
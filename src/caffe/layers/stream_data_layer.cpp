@@ -0,0 +1,198 @@
+#include <boost/thread.hpp>
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#endif  // USE_OPENCV
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/layers/stream_data_layer.hpp"
+#include "caffe/util/io.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class StreamDataRequest<Dtype>::sync {
+ public:
+  sync() : done_(false), enqueued_(boost::get_system_time()) {}
+
+  mutable boost::mutex mutex_;
+  boost::condition_variable condition_;
+  bool done_;
+  const boost::system_time enqueued_;
+};
+
+template <typename Dtype>
+StreamDataRequest<Dtype>::StreamDataRequest(Datum* datum)
+    : sync_(new sync()) {
+  datum_.Swap(datum);
+}
+
+template <typename Dtype>
+void StreamDataRequest<Dtype>::Wait() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (!sync_->done_) {
+    sync_->condition_.wait(lock);
+  }
+}
+
+template <typename Dtype>
+bool StreamDataRequest<Dtype>::TimedWait(const int timeout_us) {
+  const boost::system_time deadline =
+      boost::get_system_time() + boost::posix_time::microseconds(timeout_us);
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (!sync_->done_) {
+    if (!sync_->condition_.timed_wait(lock, deadline)) {
+      return sync_->done_;
+    }
+  }
+  return true;
+}
+
+template <typename Dtype>
+bool StreamDataRequest<Dtype>::done() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return sync_->done_;
+}
+
+template <typename Dtype>
+class StreamDataLayer<Dtype>::sync {
+ public:
+  mutable boost::mutex mutex_;
+  // Signaled when a request is queued, and when one leaves the queue.
+  boost::condition_variable queued_;
+  boost::condition_variable space_;
+};
+
+template <typename Dtype>
+StreamDataLayer<Dtype>::StreamDataLayer(const LayerParameter& param)
+    : BaseDataLayer<Dtype>(param), sync_(new sync()) {}
+
+template <typename Dtype>
+void StreamDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
+     const vector<Blob<Dtype>*>& top) {
+  const StreamDataParameter& param = this->layer_param_.stream_data_param();
+  batch_size_ = param.batch_size();
+  channels_ = param.channels();
+  height_ = param.height();
+  width_ = param.width();
+  max_latency_us_ = param.max_latency_us();
+  queue_size_ = param.queue_size();
+  CHECK_GT(batch_size_ * channels_ * height_ * width_, 0) <<
+      "batch_size, channels, height, and width must be specified and"
+      " positive in stream_data_param";
+  CHECK_GT(queue_size_, 0) << "queue_size must be positive";
+  vector<int> label_shape(1, batch_size_);
+  top[0]->Reshape(batch_size_, channels_, height_, width_);
+  top[1]->Reshape(label_shape);
+}
+
+template <typename Dtype>
+shared_ptr<StreamDataRequest<Dtype> > StreamDataLayer<Dtype>::Enqueue(
+    Datum* datum) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (queue_.size() >= queue_size_) {
+    sync_->space_.wait(lock);
+  }
+  shared_ptr<StreamDataRequest<Dtype> > request(
+      new StreamDataRequest<Dtype>(datum));
+  queue_.push_back(request);
+  lock.unlock();
+  sync_->queued_.notify_all();
+  return request;
+}
+
+#ifdef USE_OPENCV
+template <typename Dtype>
+shared_ptr<StreamDataRequest<Dtype> > StreamDataLayer<Dtype>::Enqueue(
+    const cv::Mat& cv_img, const int label) {
+  Datum datum;
+  CVMatToDatum(cv_img, &datum);
+  datum.set_label(label);
+  return Enqueue(&datum);
+}
+#endif  // USE_OPENCV
+
+template <typename Dtype>
+bool StreamDataLayer<Dtype>::WaitForRequest(const int timeout_us) {
+  const boost::system_time deadline =
+      boost::get_system_time() + boost::posix_time::microseconds(timeout_us);
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (queue_.empty()) {
+    if (!sync_->queued_.timed_wait(lock, deadline)) {
+      return !queue_.empty();
+    }
+  }
+  return true;
+}
+
+template <typename Dtype>
+int StreamDataLayer<Dtype>::queued() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return queue_.size();
+}
+
+template <typename Dtype>
+void StreamDataLayer<Dtype>::CompleteBatch(
+    const vector<Blob<Dtype>*>& outputs) {
+  for (int j = 0; j < outputs.size(); ++j) {
+    CHECK_GT(outputs[j]->num_axes(), 0) << "Outputs must have a batch axis.";
+    CHECK_EQ(outputs[j]->shape(0), batch_.size()) <<
+        "Outputs must have an item per request of the batch.";
+  }
+  for (int i = 0; i < batch_.size(); ++i) {
+    StreamDataRequest<Dtype>* request = batch_[i].get();
+    request->results_.resize(outputs.size());
+    for (int j = 0; j < outputs.size(); ++j) {
+      const int dim = outputs[j]->count(1);
+      const Dtype* output = outputs[j]->cpu_data() + i * dim;
+      request->results_[j].assign(output, output + dim);
+    }
+    boost::mutex::scoped_lock lock(request->sync_->mutex_);
+    request->sync_->done_ = true;
+    lock.unlock();
+    request->sync_->condition_.notify_all();
+  }
+  batch_.clear();
+}
+
+template <typename Dtype>
+void StreamDataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  CHECK(batch_.empty()) <<
+      "CompleteBatch must be called on a batch before the next Forward.";
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (queue_.empty()) {
+    sync_->queued_.wait(lock);
+  }
+  // Wait for the batch to fill until the oldest request is due.
+  const boost::system_time deadline = queue_.front()->sync_->enqueued_ +
+      boost::posix_time::microseconds(max_latency_us_);
+  while (queue_.size() < batch_size_ &&
+      sync_->queued_.timed_wait(lock, deadline)) {}
+  const int num = std::min<int>(queue_.size(), batch_size_);
+  batch_.assign(queue_.begin(), queue_.begin() + num);
+  queue_.erase(queue_.begin(), queue_.begin() + num);
+  lock.unlock();
+  sync_->space_.notify_all();
+
+  batch_datums_.resize(num);
+  for (int item_id = 0; item_id < num; ++item_id) {
+    batch_datums_[item_id].Swap(&batch_[item_id]->datum_);
+  }
+  vector<int> label_shape(1, num);
+  top[0]->Reshape(num, channels_, height_, width_);
+  top[1]->Reshape(label_shape);
+  // Apply data transformations (mirror, scale, crop...)
+  this->data_transformer_->Transform(batch_datums_, top[0]);
+  Dtype* top_label = top[1]->mutable_cpu_data();
+  for (int item_id = 0; item_id < num; ++item_id) {
+    top_label[item_id] = batch_datums_[item_id].label();
+  }
+}
+
+INSTANTIATE_CLASS(StreamDataRequest);
+INSTANTIATE_CLASS(StreamDataLayer);
+REGISTER_LAYER_CLASS(StreamData);
+
+}  // namespace caffe
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <climits>
 #include <map>
 #include <set>
 #include <string>
@@ -9,9 +10,11 @@
 
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
+#include "caffe/layers/concat_layer.hpp"
 #include "caffe/net.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/channels_last.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/insert_splits.hpp"
 #include "caffe/util/math_functions.hpp"
@@ -23,7 +26,7 @@ namespace caffe {
 
 template <typename Dtype>
 Net<Dtype>::Net(const NetParameter& param, const Net* root_net)
-    : root_net_(root_net) {
+    : learnable_params_arena_count_(0), root_net_(root_net) {
   Init(param);
 }
 
@@ -31,7 +34,7 @@ template <typename Dtype>
 Net<Dtype>::Net(const string& param_file, Phase phase,
     const int level, const vector<string>* stages,
     const Net* root_net)
-    : root_net_(root_net) {
+    : learnable_params_arena_count_(0), root_net_(root_net) {
   NetParameter param;
   ReadNetParamsFromTextFileOrDie(param_file, &param);
   // Set phase, stages and level
@@ -51,6 +54,11 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
       << "root_net_ needs to be set for all non-root solvers";
   // Set phase from the state.
   phase_ = in_param.state().phase();
+  // Keep the definition, without any weights, to create replicas from.
+  param_ = in_param;
+  for (int i = 0; i < param_.layer_size(); ++i) {
+    param_.mutable_layer(i)->clear_blobs();
+  }
   // Filter layers based on their include/exclude rules and
   // the current NetState.
   NetParameter filtered_param;
@@ -280,6 +288,10 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   }
   ShareWeights();
   debug_info_ = param.debug_info();
+  channels_last_ = param.channels_last();
+  PlanChannelsLast();
+  zero_copy_concat_ = param.zero_copy_concat();
+  PlanZeroCopyConcat();
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
 
@@ -540,20 +552,189 @@ void Net<Dtype>::AppendParam(const NetParameter& param, const int layer_id,
   }
 }
 
+// Only blobs of N x C x spatial values with more than one channel and one
+// spatial position have a layout to speak of.
+template <typename Dtype>
+static bool HasLayout(const Blob<Dtype>& blob) {
+  return blob.num_axes() > 2 && blob.shape(1) > 1 && blob.count(2) > 1;
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanChannelsLast() {
+  channels_last_data_.clear();
+  // A layer runs channels-last if it can and either prefers to or gets a
+  // channels-last bottom, so chains start where they pay off and run for as
+  // long as they can.
+  vector<bool> blob_channels_last(blobs_.size(), false);
+  for (int i = 0; i < layers_.size(); ++i) {
+    bool channels_last = false;
+    if (channels_last_ && layers_[i]->SupportsChannelsLast()) {
+      channels_last = layers_[i]->PrefersChannelsLast();
+      for (int j = 0; j < bottom_id_vecs_[i].size(); ++j) {
+        channels_last |= blob_channels_last[bottom_id_vecs_[i][j]];
+      }
+    }
+    layers_[i]->set_channels_last(channels_last);
+    for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+      blob_channels_last[top_id_vecs_[i][j]] = channels_last;
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanZeroCopyConcat() {
+  // Converting a layout in place would convert the views with it.
+  if (!zero_copy_concat_ || channels_last_ || Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  // The layer that produces each blob, -1 for the net's inputs; the blob
+  // each view, like a Flatten top, views, else -1; the last layer that
+  // modifies each memory in place, through any blob sharing it; and whether
+  // a layer otherwise shares a blob's memory, or it is already placed in a
+  // Concat top.
+  vector<int> producer(blobs_.size(), -1);
+  vector<int> viewed(blobs_.size(), -1);
+  map<const SyncedMemory*, int> last_in_place;
+  vector<bool> excluded(blobs_.size(), false);
+  for (int i = 0; i < layers_.size(); ++i) {
+    for (int j = 0; j < top_id_vecs_[i].size(); ++j) {
+      const int top_id = top_id_vecs_[i][j];
+      if (producer[top_id] < 0) { producer[top_id] = i; }
+      if (layers_[i]->ViewsBottom() && bottom_id_vecs_[i][0] != top_id) {
+        viewed[top_id] = bottom_id_vecs_[i][0];
+        continue;
+      }
+      for (int k = 0; k < bottom_id_vecs_[i].size(); ++k) {
+        const int bottom_id = bottom_id_vecs_[i][k];
+        if (bottom_id == top_id) {
+          last_in_place[blobs_[top_id]->data().get()] = i;
+        } else if (blobs_[bottom_id]->data() == blobs_[top_id]->data()) {
+          excluded[bottom_id] = true;
+          excluded[top_id] = true;
+        }
+      }
+    }
+  }
+  for (int i = 0; i < layers_.size(); ++i) {
+    ConcatLayer<Dtype>* concat =
+        dynamic_cast<ConcatLayer<Dtype>*>(layers_[i].get());
+    if (!concat || bottom_id_vecs_[i].size() < 2 ||
+        last_in_place[top_vecs_[i][0]->data().get()] > i) {
+      continue;
+    }
+    const vector<int>& bottom_ids = bottom_id_vecs_[i];
+    vector<bool> view_data(bottom_ids.size(), false);
+    vector<bool> view_diff(bottom_ids.size(), false);
+    vector<vector<Blob<Dtype>*> > sources(bottom_ids.size());
+    bool any = false;
+    for (int j = 0; j < bottom_ids.size(); ++j) {
+      // A view is placed through the blob it views, down to the one that
+      // its producer writes, so every blob on the way must qualify.
+      vector<int> ids(1, bottom_ids[j]);
+      while (viewed[ids.back()] >= 0) { ids.push_back(viewed[ids.back()]); }
+      view_data[j] = producer[ids.back()] >= 0 &&
+          std::count(bottom_ids.begin(), bottom_ids.end(), ids[0]) == 1;
+      for (int k = 0; k < ids.size(); ++k) {
+        view_data[j] = view_data[j] && !excluded[ids[k]] &&
+            last_in_place[blobs_[ids[k]]->data().get()] <= i &&
+            blob_loss_weights_[ids[k]] == 0;
+      }
+      view_diff[j] = view_data[j] && bottom_need_backward_[i][j];
+      if (!view_data[j]) { continue; }
+      any = true;
+      for (int k = 0; k < ids.size(); ++k) {
+        excluded[ids[k]] = true;
+        if (k > 0) { sources[j].push_back(blobs_[ids[k]].get()); }
+      }
+      LOG_IF(INFO, Caffe::root_solver()) << blob_names_[ids.back()]
+          << " is produced in place in " << layer_names_[i];
+    }
+    if (!any) { continue; }
+    concat->set_bottom_views(view_data, view_diff, sources);
+    // Place the bottoms now, so that their own memory is freed.
+    concat->Reshape(bottom_vecs_[i], top_vecs_[i]);
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::ConvertLayout(Blob<Dtype>* blob,
+    const bool channels_last) const {
+  if (!HasLayout(*blob)) { return; }
+  const SyncedMemory* data = blob->data().get();
+  if ((channels_last_data_.count(data) > 0) == channels_last) { return; }
+  const int num = blob->shape(0);
+  const int channels = blob->shape(1);
+  const int spatial = blob->count(2);
+  channels_last_buffer_.resize(blob->count());
+  Dtype* blob_data = blob->mutable_cpu_data();
+  if (channels_last) {
+    caffe_cpu_to_channels_last(num, channels, spatial, blob_data,
+        &channels_last_buffer_[0]);
+    channels_last_data_.insert(data);
+  } else {
+    caffe_cpu_to_channels_first(num, channels, spatial, blob_data,
+        &channels_last_buffer_[0]);
+    channels_last_data_.erase(data);
+  }
+  caffe_copy(blob->count(), &channels_last_buffer_[0], blob_data);
+}
+
 template <typename Dtype>
 Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
   CHECK_LT(end, layers_.size());
+  // Layouts only change in CPU mode; on the GPU, layers run channels-first.
+  const bool convert = channels_last_ && Caffe::mode() == Caffe::CPU;
+  if (convert && start == 0) {
+    // The inputs are channels-first, and the rest will be overwritten.
+    channels_last_data_.clear();
+  }
   Dtype loss = 0;
   for (int i = start; i <= end; ++i) {
     // LOG(ERROR) << "Forwarding " << layer_names_[i];
+    if (convert) {
+      for (int j = 0; j < bottom_vecs_[i].size(); ++j) {
+        ConvertLayout(bottom_vecs_[i][j], layers_[i]->channels_last());
+      }
+    }
     Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
     loss += layer_loss;
+    if (convert) {
+      for (int j = 0; j < top_vecs_[i].size(); ++j) {
+        const Blob<Dtype>& top = *top_vecs_[i][j];
+        if (!HasLayout(top)) { continue; }
+        if (layers_[i]->channels_last()) {
+          channels_last_data_.insert(top.data().get());
+        } else {
+          channels_last_data_.erase(top.data().get());
+        }
+      }
+    }
     if (debug_info_) { ForwardDebugInfo(i); }
   }
+  if (convert) {
+    // Hand back the inputs, the outputs and the tops of the last layer run
+    // channels-first.
+    for (int i = 0; i < net_input_blobs_.size(); ++i) {
+      ConvertLayout(net_input_blobs_[i], false);
+    }
+    for (int i = 0; i < net_output_blobs_.size(); ++i) {
+      ConvertLayout(net_output_blobs_[i], false);
+    }
+    for (int i = 0; i < top_vecs_[end].size(); ++i) {
+      ConvertLayout(top_vecs_[end][i], false);
+    }
+  }
   return loss;
 }
 
+template <typename Dtype>
+void Net<Dtype>::RestoreChannelsFirst() const {
+  for (int i = 0; i < blobs_.size() && !channels_last_data_.empty(); ++i) {
+    ConvertLayout(blobs_[i].get(), false);
+  }
+}
+
 template <typename Dtype>
 Dtype Net<Dtype>::ForwardFrom(int start) {
   return ForwardFromTo(start, layers_.size() - 1);
@@ -592,6 +773,9 @@ void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_LT(start, layers_.size());
   for (int i = start; i >= end; --i) {
     if (layer_need_backward_[i]) {
+      CHECK(!layers_[i]->channels_last() || Caffe::mode() != Caffe::CPU)
+          << "Layer " << layer_names_[i] << " runs channels-last, which only "
+          << "supports Forward; set channels_last: false to run Backward.";
       layers_[i]->Backward(
           top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
       if (debug_info_) { BackwardDebugInfo(i); }
@@ -708,6 +892,9 @@ void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
       target_blobs[j]->ShareData(*source_blob);
     }
   }
+  // The shared blobs may point into the other net's mapped weights.
+  mapped_weights_.insert(mapped_weights_.end(),
+      other->mapped_weights_.begin(), other->mapped_weights_.end());
 }
 
 template <typename Dtype>
@@ -744,6 +931,36 @@ void Net<Dtype>::Reshape() {
   for (int i = 0; i < layers_.size(); ++i) {
     layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
   }
+  PlanChannelsLast();
+}
+
+template <typename Dtype>
+shared_ptr<Net<Dtype> > Net<Dtype>::CreateReplica() const {
+  CHECK_EQ(phase_, TEST) << "Only TEST phase nets can be replicated.";
+  // Sync the weights to the host (and device) now. Reading synced memory
+  // only returns its pointer, so the replicas' concurrent Forward passes
+  // never allocate or copy into the shared SyncedMemory.
+  for (int i = 0; i < layers_.size(); ++i) {
+    for (int j = 0; j < layers_[i]->blobs().size(); ++j) {
+      const Blob<Dtype>* blob = layers_[i]->blobs()[j].get();
+      if (blob->count() == 0) { continue; }
+      blob->cpu_data();
+      if (Caffe::mode() == Caffe::GPU) {
+        blob->gpu_data();
+      }
+    }
+  }
+  shared_ptr<Net<Dtype> > replica(new Net<Dtype>(param_, root_net_));
+  replica->ShareTrainedLayersWith(this);
+  // And the copies derived from the weights, such as packed weights, so
+  // that the replicas build them once between them.
+  CHECK_EQ(replica->layers_.size(), layers_.size());
+  for (int i = 0; i < layers_.size(); ++i) {
+    if (layers_[i]->blobs().size() > 0) {
+      replica->layers_[i]->ShareDerivedWeights(layers_[i].get());
+    }
+  }
+  return replica;
 }
 
 template <typename Dtype>
@@ -789,6 +1006,8 @@ void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
   if (trained_filename.size() >= 3 &&
       trained_filename.compare(trained_filename.size() - 3, 3, ".h5") == 0) {
     CopyTrainedLayersFromHDF5(trained_filename);
+  } else if (MappedWeights::IsMappedWeightsFile(trained_filename)) {
+    CopyTrainedLayersFromMapped(trained_filename);
   } else {
     CopyTrainedLayersFromBinaryProto(trained_filename);
   }
@@ -852,6 +1071,70 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
   H5Fclose(file_hid);
 }
 
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFromMapped(const string trained_filename) {
+  shared_ptr<MappedWeights> weights(new MappedWeights(trained_filename));
+  const MappedWeightsIndex& index = weights->index();
+  const bool kDoubleDtype = sizeof(Dtype) == sizeof(double);
+  // Repointing blobs of a contiguous net would take them out of the arena.
+  const bool contiguous = learnable_params_contiguous();
+  bool mapped = false;
+  for (int i = 0; i < index.layer_size(); ++i) {
+    const MappedLayer& source_layer = index.layer(i);
+    const string& source_layer_name = source_layer.name();
+    if (!layer_names_index_.count(source_layer_name)) {
+      LOG(INFO) << "Ignoring source layer " << source_layer_name;
+      continue;
+    }
+    int target_layer_id = layer_names_index_[source_layer_name];
+    DLOG(INFO) << "Mapping source layer " << source_layer_name;
+    vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+        layers_[target_layer_id]->blobs();
+    CHECK_EQ(target_blobs.size(), source_layer.blob_size())
+        << "Incompatible number of blobs for layer " << source_layer_name;
+    for (int j = 0; j < target_blobs.size(); ++j) {
+      const MappedBlob& source_blob = source_layer.blob(j);
+      vector<int> source_shape(source_blob.shape().dim_size());
+      for (int k = 0; k < source_shape.size(); ++k) {
+        source_shape[k] = source_blob.shape().dim(k);
+      }
+      bool shape_equals = target_blobs[j]->shape() == source_shape;
+      if (source_blob.legacy_shape()) {
+        CHECK_EQ(source_shape.size(), 4);
+        BlobProto legacy_proto;
+        legacy_proto.set_num(source_shape[0]);
+        legacy_proto.set_channels(source_shape[1]);
+        legacy_proto.set_height(source_shape[2]);
+        legacy_proto.set_width(source_shape[3]);
+        shape_equals = target_blobs[j]->ShapeEquals(legacy_proto);
+      }
+      CHECK(shape_equals)
+          << "Cannot copy param " << j << " weights from layer '"
+          << source_layer_name << "'; shape mismatch.  Source param shape is "
+          << Blob<Dtype>(source_shape).shape_string()
+          << "; target param shape is " << target_blobs[j]->shape_string()
+          << ". To learn this layer's parameters from scratch rather than "
+          << "copying from a saved net, rename the layer.";
+      const int count = target_blobs[j]->count();
+      if (count == 0) { continue; }
+      void* source_data = weights->data(source_blob);
+      if (source_blob.double_data() == kDoubleDtype && !contiguous) {
+        target_blobs[j]->data()->set_cpu_data(source_data);
+        mapped = true;
+      } else if (source_blob.double_data()) {
+        const double* data = static_cast<const double*>(source_data);
+        std::copy(data, data + count, target_blobs[j]->mutable_cpu_data());
+      } else {
+        const float* data = static_cast<const float*>(source_data);
+        std::copy(data, data + count, target_blobs[j]->mutable_cpu_data());
+      }
+    }
+  }
+  if (mapped) {
+    mapped_weights_.push_back(weights);
+  }
+}
+
 template <typename Dtype>
 void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
   param->Clear();
@@ -923,6 +1206,12 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
 
 template <typename Dtype>
 void Net<Dtype>::Update() {
+  if (Caffe::mode() == Caffe::CPU && learnable_params_contiguous()) {
+    // Padding between params has zero diff, so it is safe to update it too.
+    caffe_axpy<Dtype>(learnable_params_arena_count_, Dtype(-1),
+        learnable_params_cpu_diff(), mutable_learnable_params_cpu_data());
+    return;
+  }
   for (int i = 0; i < learnable_params_.size(); ++i) {
     learnable_params_[i]->Update();
   }
@@ -930,6 +1219,11 @@ void Net<Dtype>::Update() {
 
 template <typename Dtype>
 void Net<Dtype>::ClearParamDiffs() {
+  if (Caffe::mode() == Caffe::CPU && learnable_params_contiguous()) {
+    caffe_set(learnable_params_arena_count_, static_cast<Dtype>(0),
+              mutable_learnable_params_cpu_diff());
+    return;
+  }
   for (int i = 0; i < learnable_params_.size(); ++i) {
     Blob<Dtype>* blob = learnable_params_[i];
     switch (Caffe::mode()) {
@@ -958,6 +1252,108 @@ void Net<Dtype>::ShareWeights() {
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::MakeLearnableParamsContiguous() {
+  const size_t align = kArenaAlignment / sizeof(Dtype);
+  learnable_params_offsets_.resize(learnable_params_.size());
+  size_t count = 0;
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    learnable_params_offsets_[i] = count;
+    count += (learnable_params_[i]->count() + align - 1) / align * align;
+  }
+  CHECK_LE(count, INT_MAX) << "learnable params too large for one arena";
+  // Allocate new arenas before releasing the old ones, as the params may
+  // still be views into them. Fresh host memory is zeroed, so the padding
+  // between params starts (and stays) zero.
+  shared_ptr<SyncedMemory> data_arena(
+      new SyncedMemory(count * sizeof(Dtype) + kArenaAlignment));
+  shared_ptr<SyncedMemory> diff_arena(
+      new SyncedMemory(count * sizeof(Dtype) + kArenaAlignment));
+  Dtype* data = static_cast<Dtype*>(
+      AlignArenaPointer(data_arena->mutable_cpu_data()));
+  Dtype* diff = static_cast<Dtype*>(
+      AlignArenaPointer(diff_arena->mutable_cpu_data()));
+  params_data_views_.resize(learnable_params_.size());
+  params_diff_views_.resize(learnable_params_.size());
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    Blob<Dtype>* blob = learnable_params_[i];
+    if (blob->count() > 0) {
+      const size_t offset = learnable_params_offsets_[i];
+      caffe_copy(blob->count(), blob->cpu_data(), data + offset);
+      caffe_copy(blob->count(), blob->cpu_diff(), diff + offset);
+      blob->data()->set_cpu_data(data + offset);
+      blob->diff()->set_cpu_data(diff + offset);
+    }
+    params_data_views_[i] = blob->data().get();
+    params_diff_views_[i] = blob->diff().get();
+  }
+  params_data_arena_ = data_arena;
+  params_diff_arena_ = diff_arena;
+  learnable_params_arena_count_ = count;
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Learnable params laid out contiguously: " << count << " elements";
+}
+
+template <typename Dtype>
+bool Net<Dtype>::learnable_params_contiguous() const {
+  if (!params_data_arena_) { return false; }
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    if (learnable_params_[i]->data().get() != params_data_views_[i] ||
+        learnable_params_[i]->diff().get() != params_diff_views_[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename Dtype>
+const Dtype* Net<Dtype>::learnable_params_cpu_data() {
+  CHECK(learnable_params_contiguous()) << "Learnable params not contiguous";
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    if (learnable_params_[i]->count() > 0) {
+      learnable_params_[i]->cpu_data();
+    }
+  }
+  return static_cast<const Dtype*>(
+      AlignArenaPointer(params_data_arena_->mutable_cpu_data()));
+}
+
+template <typename Dtype>
+Dtype* Net<Dtype>::mutable_learnable_params_cpu_data() {
+  CHECK(learnable_params_contiguous()) << "Learnable params not contiguous";
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    if (learnable_params_[i]->count() > 0) {
+      learnable_params_[i]->mutable_cpu_data();
+    }
+  }
+  return static_cast<Dtype*>(
+      AlignArenaPointer(params_data_arena_->mutable_cpu_data()));
+}
+
+template <typename Dtype>
+const Dtype* Net<Dtype>::learnable_params_cpu_diff() {
+  CHECK(learnable_params_contiguous()) << "Learnable params not contiguous";
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    if (learnable_params_[i]->count() > 0) {
+      learnable_params_[i]->cpu_diff();
+    }
+  }
+  return static_cast<const Dtype*>(
+      AlignArenaPointer(params_diff_arena_->mutable_cpu_data()));
+}
+
+template <typename Dtype>
+Dtype* Net<Dtype>::mutable_learnable_params_cpu_diff() {
+  CHECK(learnable_params_contiguous()) << "Learnable params not contiguous";
+  for (int i = 0; i < learnable_params_.size(); ++i) {
+    if (learnable_params_[i]->count() > 0) {
+      learnable_params_[i]->mutable_cpu_diff();
+    }
+  }
+  return static_cast<Dtype*>(
+      AlignArenaPointer(params_diff_arena_->mutable_cpu_data()));
+}
+
 template <typename Dtype>
 bool Net<Dtype>::has_blob(const string& blob_name) const {
   return blob_names_index_.find(blob_name) != blob_names_index_.end();
@@ -969,6 +1365,7 @@ const shared_ptr<Blob<Dtype> > Net<Dtype>::blob_by_name(
   shared_ptr<Blob<Dtype> > blob_ptr;
   if (has_blob(blob_name)) {
     blob_ptr = blobs_[blob_names_index_.find(blob_name)->second];
+    ConvertLayout(blob_ptr.get(), false);
   } else {
     blob_ptr.reset((Blob<Dtype>*)(NULL));
     LOG(WARNING) << "Unknown blob name " << blob_name;
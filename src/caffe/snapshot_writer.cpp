@@ -0,0 +1,237 @@
+#include <fcntl.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/wire_format_lite.h>
+#include <unistd.h>
+
+#include <boost/thread.hpp>
+#include <cstdio>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/snapshot_writer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+using google::protobuf::kint32max;
+using google::protobuf::Message;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::io::FileOutputStream;
+using google::protobuf::internal::WireFormatLite;
+
+// Writes message as one entry of the repeated message field field_number of
+// the enclosing message. Concatenating such entries after the rest of the
+// message gives the same wire format as serializing the whole message.
+static void WriteRepeatedEntry(int field_number, const Message& message,
+    CodedOutputStream* output) {
+  output->WriteTag(WireFormatLite::MakeTag(field_number,
+      WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+  const size_t size = message.ByteSizeLong();
+  CHECK_LE(size, kint32max) << "Snapshot entry too large to serialize.";
+  output->WriteVarint32(static_cast<uint32_t>(size));
+  message.SerializeWithCachedSizes(output);
+}
+
+void Snapshot::Write() {
+  const string temp_filename = filename_ + ".tmp";
+  int fd = open(temp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  CHECK_NE(fd, -1) << "Couldn't open " << temp_filename << " to snapshot.";
+  FileOutputStream raw_output(fd);
+  {
+    CodedOutputStream output(&raw_output);
+    Serialize(&output);
+    CHECK(!output.HadError()) << "Error writing snapshot " << temp_filename;
+  }
+  CHECK(raw_output.Flush()) << "Error writing snapshot " << temp_filename;
+  CHECK_EQ(fsync(fd), 0) << "Error writing snapshot " << temp_filename;
+  CHECK(raw_output.Close()) << "Error writing snapshot " << temp_filename;
+  CHECK_EQ(std::rename(temp_filename.c_str(), filename_.c_str()), 0)
+      << "Couldn't rename " << temp_filename << " to " << filename_;
+}
+
+template <typename Dtype>
+vector<shared_ptr<Blob<Dtype> > > Snapshot::StageBlobs(
+    const vector<Blob<Dtype>*>& blobs, bool diff,
+    shared_ptr<SyncedMemory>* buffer) {
+  map<const SyncedMemory*, size_t> offsets;
+  size_t count = 0;
+  for (int i = 0; i < blobs.size(); ++i) {
+    const SyncedMemory* memory =
+        diff ? blobs[i]->diff().get() : blobs[i]->data().get();
+    if (blobs[i]->count() > 0 &&
+        offsets.insert(std::make_pair(memory, count)).second) {
+      count += blobs[i]->count();
+    }
+  }
+  buffer->reset(new SyncedMemory(count * sizeof(Dtype)));
+  Dtype* staged_data =
+      count > 0 ? static_cast<Dtype*>((*buffer)->mutable_cpu_data()) : NULL;
+  vector<shared_ptr<Blob<Dtype> > > staged(blobs.size());
+  std::set<const SyncedMemory*> copied;
+  for (int i = 0; i < blobs.size(); ++i) {
+    staged[i].reset(new Blob<Dtype>(blobs[i]->shape()));
+    if (blobs[i]->count() == 0) { continue; }
+    const SyncedMemory* memory =
+        diff ? blobs[i]->diff().get() : blobs[i]->data().get();
+    Dtype* view = staged_data + offsets[memory];
+    if (copied.insert(memory).second) {
+      caffe_copy(blobs[i]->count(),
+          diff ? blobs[i]->cpu_diff() : blobs[i]->cpu_data(), view);
+    }
+    if (diff) {
+      staged[i]->diff()->set_cpu_data(view);
+    } else {
+      staged[i]->set_cpu_data(view);
+    }
+  }
+  return staged;
+}
+
+template <typename Dtype>
+NetSnapshot<Dtype>::NetSnapshot(Net<Dtype>* net, const string& filename,
+    bool write_diff)
+    : Snapshot(filename), write_diff_(write_diff) {
+  header_.set_name(net->name());
+  // Gather the blobs of every layer, in the order Net::ToProto writes them.
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net->layers();
+  vector<Blob<Dtype>*> blobs;
+  for (int i = 0; i < layers.size(); ++i) {
+    layer_params_.push_back(layers[i]->layer_param());
+    layer_params_.back().clear_blobs();
+    for (int j = 0; j < layers[i]->blobs().size(); ++j) {
+      blobs.push_back(layers[i]->blobs()[j].get());
+    }
+  }
+  vector<shared_ptr<Blob<Dtype> > > staged;
+  if (net->learnable_params_contiguous()) {
+    // Every layer blob is a learnable param or shares one's memory, so one
+    // copy of the arena stages all of them.
+    const vector<Blob<Dtype>*>& params = net->learnable_params();
+    map<const SyncedMemory*, size_t> offsets;
+    for (int i = 0; i < params.size(); ++i) {
+      offsets[params[i]->data().get()] = net->learnable_params_offsets()[i];
+    }
+    const size_t count = net->learnable_params_arena_count();
+    data_buffer_.reset(new SyncedMemory(count * sizeof(Dtype)));
+    Dtype* staged_data = static_cast<Dtype*>(data_buffer_->mutable_cpu_data());
+    caffe_copy(count, net->learnable_params_cpu_data(), staged_data);
+    for (int i = 0; i < blobs.size(); ++i) {
+      staged.push_back(shared_ptr<Blob<Dtype> >(
+          new Blob<Dtype>(blobs[i]->shape())));
+      if (blobs[i]->count() == 0) { continue; }
+      CHECK(offsets.count(blobs[i]->data().get()))
+          << "Layer blob outside of the learnable param arena";
+      staged[i]->set_cpu_data(staged_data + offsets[blobs[i]->data().get()]);
+    }
+  } else {
+    staged = StageBlobs(blobs, false, &data_buffer_);
+  }
+  if (write_diff_) {
+    vector<shared_ptr<Blob<Dtype> > > staged_diff =
+        StageBlobs(blobs, true, &diff_buffer_);
+    for (int i = 0; i < staged.size(); ++i) {
+      if (staged[i]->count() > 0) { staged[i]->ShareDiff(*staged_diff[i]); }
+    }
+  }
+  layer_blobs_.resize(layers.size());
+  int blob_id = 0;
+  for (int i = 0; i < layers.size(); ++i) {
+    for (int j = 0; j < layers[i]->blobs().size(); ++j) {
+      layer_blobs_[i].push_back(staged[blob_id++]);
+    }
+  }
+}
+
+template <typename Dtype>
+void NetSnapshot<Dtype>::Serialize(CodedOutputStream* output) {
+  header_.SerializeToCodedStream(output);
+  for (int i = 0; i < layer_params_.size(); ++i) {
+    LayerParameter layer_param(layer_params_[i]);
+    for (int j = 0; j < layer_blobs_[i].size(); ++j) {
+      layer_blobs_[i][j]->ToProto(layer_param.add_blobs(), write_diff_);
+    }
+    WriteRepeatedEntry(NetParameter::kLayerFieldNumber, layer_param, output);
+  }
+}
+
+template <typename Dtype>
+SolverStateSnapshot<Dtype>::SolverStateSnapshot(const SolverState& state,
+    const vector<shared_ptr<Blob<Dtype> > >& history, const string& filename)
+    : Snapshot(filename), header_(state) {
+  header_.clear_history();
+  vector<Blob<Dtype>*> blobs;
+  for (int i = 0; i < history.size(); ++i) {
+    blobs.push_back(history[i].get());
+  }
+  history_ = StageBlobs(blobs, false, &buffer_);
+}
+
+template <typename Dtype>
+void SolverStateSnapshot<Dtype>::Serialize(CodedOutputStream* output) {
+  header_.SerializeToCodedStream(output);
+  for (int i = 0; i < history_.size(); ++i) {
+    BlobProto history_blob;
+    history_[i]->ToProto(&history_blob);
+    WriteRepeatedEntry(SolverState::kHistoryFieldNumber, history_blob, output);
+  }
+}
+
+SnapshotWriter::SnapshotWriter(int max_in_flight)
+    : max_in_flight_(max_in_flight) {
+  CHECK_GT(max_in_flight_, 0) << "max_snapshots_in_flight must be positive";
+  StartInternalThread();
+}
+
+SnapshotWriter::~SnapshotWriter() {
+  Wait();
+  StopInternalThread();
+}
+
+void SnapshotWriter::BeginUnit() {
+  while (static_cast<int>(units_.size()) >= max_in_flight_) {
+    ReleaseUnit();
+  }
+  units_.push_back(0);
+}
+
+void SnapshotWriter::Push(Snapshot* snapshot) {
+  CHECK(!units_.empty()) << "BeginUnit must be called before Push.";
+  ++units_.back();
+  queue_.push(snapshot);
+}
+
+void SnapshotWriter::Wait() {
+  while (!units_.empty()) {
+    ReleaseUnit();
+  }
+}
+
+void SnapshotWriter::ReleaseUnit() {
+  // Snapshots are written in order, so the oldest unit's come out first.
+  for (int i = 0; i < units_.front(); ++i) {
+    delete written_.pop("Waiting for a snapshot to be written");
+  }
+  units_.pop_front();
+}
+
+void SnapshotWriter::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      Snapshot* snapshot = queue_.pop();
+      snapshot->Write();
+      LOG(INFO) << "Wrote snapshot " << snapshot->filename();
+      written_.push(snapshot);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+INSTANTIATE_CLASS(NetSnapshot);
+INSTANTIATE_CLASS(SolverStateSnapshot);
+
+}  // namespace caffe
@@ -121,6 +121,9 @@ void Solver<Dtype>::InitTrainNet() {
   } else {
     net_.reset(new Net<Dtype>(net_param, root_solver_->net_.get()));
   }
+  if (param_.contiguous_params()) {
+    net_->MakeLearnableParamsContiguous();
+  }
 }
 
 template <typename Dtype>
@@ -319,6 +322,7 @@ void Solver<Dtype>::Solve(const char* resume_file) {
       && (!param_.snapshot() || iter_ % param_.snapshot() != 0)) {
     Snapshot();
   }
+  WaitForSnapshots();
   if (requested_early_exit_) {
     LOG(INFO) << "Optimization stopped early.";
     return;
@@ -564,6 +568,14 @@ void Solver<Dtype>::TestDetection(const int test_net_id) {
 template <typename Dtype>
 void Solver<Dtype>::Snapshot() {
   CHECK(Caffe::root_solver());
+  if (param_.async_snapshot()) {
+    // The model and solver state are one unit, staged once a unit is free.
+    if (!snapshot_writer_) {
+      snapshot_writer_.reset(
+          new SnapshotWriter(param_.max_snapshots_in_flight()));
+    }
+    snapshot_writer_->BeginUnit();
+  }
   string model_filename;
   switch (param_.snapshot_format()) {
   case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
@@ -603,10 +615,38 @@ string Solver<Dtype>::SnapshotFilename(const string extension) {
     + extension;
 }
 
+template <typename Dtype>
+void Solver<Dtype>::WaitForSnapshots() {
+  if (snapshot_writer_) {
+    snapshot_writer_->Wait();
+  }
+}
+
+template <typename Dtype>
+bool Solver<Dtype>::StagedSnapshots() const {
+  return param_.async_snapshot() || param_.snapshot_chunked();
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WriteSnapshot(caffe::Snapshot* snapshot) {
+  if (!param_.async_snapshot()) {
+    snapshot->Write();
+    delete snapshot;
+    return;
+  }
+  CHECK(snapshot_writer_) << "Snapshot starts the asynchronous snapshots.";
+  snapshot_writer_->Push(snapshot);
+}
+
 template <typename Dtype>
 string Solver<Dtype>::SnapshotToBinaryProto() {
   string model_filename = SnapshotFilename(".caffemodel");
   LOG(INFO) << "Snapshotting to binary proto file " << model_filename;
+  if (StagedSnapshots()) {
+    WriteSnapshot(new NetSnapshot<Dtype>(net_.get(), model_filename,
+        param_.snapshot_diff()));
+    return model_filename;
+  }
   NetParameter net_param;
   net_->ToProto(&net_param, param_.snapshot_diff());
   WriteProtoToBinaryFile(net_param, model_filename);
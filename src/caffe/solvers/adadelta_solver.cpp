@@ -14,6 +14,7 @@ void AdaDeltaSolver<Dtype>::AdaDeltaPreSolve() {
         this->history_.push_back(
                 shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
   }
+  this->MakeHistoryContiguous();
 }
 
 #ifndef CPU_ONLY
@@ -106,6 +107,41 @@ void AdaDeltaSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void adadelta_fused_update_cpu(int N, Dtype* w, Dtype* g, Dtype* h,
+    Dtype* h2, const FusedGradient<Dtype> gradient, Dtype momentum,
+    Dtype delta, Dtype local_rate) {
+#ifdef _OPENMP
+#pragma omp parallel for simd if (N >= kFusedUpdateParallelThreshold)
+#endif
+  for (int i = 0; i < N; ++i) {
+    const Dtype gi = gradient(w[i], g[i]);
+    // history of gradients, then history of updates
+    const Dtype hi = momentum * h[i] + (1 - momentum) * gi * gi;
+    h[i] = hi;
+    const Dtype ui = gi * std::sqrt((h2[i] + delta) / (hi + delta));
+    h2[i] = momentum * h2[i] + (1 - momentum) * ui * ui;
+    const Dtype update = local_rate * ui;
+    g[i] = update;
+    w[i] -= update;
+  }
+}
+
+template <typename Dtype>
+void AdaDeltaSolver<Dtype>::ComputeFusedUpdate(int begin, int end,
+    Dtype rate, const FusedGradient<Dtype>& gradient) {
+  Dtype* data;
+  Dtype* diff;
+  vector<Dtype*> history;
+  const int count =
+      this->GetFusedUpdateSpan(begin, end, &data, &diff, &history);
+  const Dtype local_rate = rate * this->net_->params_lr()[begin];
+  // history[1] is the update history.
+  adadelta_fused_update_cpu(count, data, diff, history[0], history[1],
+      gradient, Dtype(this->param_.momentum()), Dtype(this->param_.delta()),
+      local_rate);
+}
+
 INSTANTIATE_CLASS(AdaDeltaSolver);
 REGISTER_SOLVER_CLASS(AdaDelta);
 
@@ -64,6 +64,36 @@ void AdaGradSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void adagrad_fused_update_cpu(int N, Dtype* w, Dtype* g, Dtype* h,
+    const FusedGradient<Dtype> gradient, Dtype delta, Dtype local_rate) {
+#ifdef _OPENMP
+#pragma omp parallel for simd if (N >= kFusedUpdateParallelThreshold)
+#endif
+  for (int i = 0; i < N; ++i) {
+    const Dtype gi = gradient(w[i], g[i]);
+    const Dtype hi = h[i] + gi * gi;
+    h[i] = hi;
+    const Dtype update = local_rate * gi / (std::sqrt(hi) + delta);
+    g[i] = update;
+    w[i] -= update;
+  }
+}
+
+template <typename Dtype>
+void AdaGradSolver<Dtype>::ComputeFusedUpdate(int begin, int end,
+    Dtype rate, const FusedGradient<Dtype>& gradient) {
+  CHECK(Caffe::root_solver());
+  Dtype* data;
+  Dtype* diff;
+  vector<Dtype*> history;
+  const int count =
+      this->GetFusedUpdateSpan(begin, end, &data, &diff, &history);
+  const Dtype local_rate = rate * this->net_->params_lr()[begin];
+  adagrad_fused_update_cpu(count, data, diff, history[0], gradient,
+      Dtype(this->param_.delta()), local_rate);
+}
+
 INSTANTIATE_CLASS(AdaGradSolver);
 REGISTER_SOLVER_CLASS(AdaGrad);
 
@@ -14,6 +14,7 @@ void AdamSolver<Dtype>::AdamPreSolve() {
     this->history_.push_back(
             shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
   }
+  this->MakeHistoryContiguous();
 }
 
 #ifndef CPU_ONLY
@@ -88,6 +89,45 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void adam_fused_update_cpu(int N, Dtype* w, Dtype* g, Dtype* m, Dtype* v,
+    const FusedGradient<Dtype> gradient, Dtype beta1, Dtype beta2,
+    Dtype eps_hat, Dtype corrected_local_rate) {
+#ifdef _OPENMP
+#pragma omp parallel for simd if (N >= kFusedUpdateParallelThreshold)
+#endif
+  for (int i = 0; i < N; ++i) {
+    const Dtype gi = gradient(w[i], g[i]);
+    const Dtype mi = beta1 * m[i] + (1 - beta1) * gi;
+    const Dtype vi = beta2 * v[i] + (1 - beta2) * gi * gi;
+    m[i] = mi;
+    v[i] = vi;
+    const Dtype update = corrected_local_rate * mi / (std::sqrt(vi) + eps_hat);
+    g[i] = update;
+    w[i] -= update;
+  }
+}
+
+template <typename Dtype>
+void AdamSolver<Dtype>::ComputeFusedUpdate(int begin, int end, Dtype rate,
+    const FusedGradient<Dtype>& gradient) {
+  Dtype* data;
+  Dtype* diff;
+  vector<Dtype*> history;
+  const int count =
+      this->GetFusedUpdateSpan(begin, end, &data, &diff, &history);
+  const Dtype local_rate = rate * this->net_->params_lr()[begin];
+  const Dtype beta1 = this->param_.momentum();
+  const Dtype beta2 = this->param_.momentum2();
+  const int t = this->iter_ + 1;
+  const Dtype correction = std::sqrt(Dtype(1) - pow(beta2, t)) /
+      (Dtype(1.) - pow(beta1, t));
+  // history[0] holds m and history[1] v.
+  adam_fused_update_cpu(count, data, diff, history[0], history[1],
+      gradient, beta1, beta2, Dtype(this->param_.delta()),
+      local_rate * correction);
+}
+
 INSTANTIATE_CLASS(AdamSolver);
 REGISTER_SOLVER_CLASS(Adam);
 
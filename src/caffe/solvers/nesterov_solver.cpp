@@ -56,6 +56,37 @@ void NesterovSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void nesterov_fused_update_cpu(int N, Dtype* w, Dtype* g, Dtype* h,
+    const FusedGradient<Dtype> gradient, Dtype momentum, Dtype local_rate) {
+#ifdef _OPENMP
+#pragma omp parallel for simd if (N >= kFusedUpdateParallelThreshold)
+#endif
+  for (int i = 0; i < N; ++i) {
+    const Dtype hi = h[i];
+    const Dtype hi_new = momentum * hi + local_rate * gradient(w[i], g[i]);
+    h[i] = hi_new;
+    // step back then over step
+    const Dtype update = (1 + momentum) * hi_new - momentum * hi;
+    g[i] = update;
+    w[i] -= update;
+  }
+}
+
+template <typename Dtype>
+void NesterovSolver<Dtype>::ComputeFusedUpdate(int begin, int end,
+    Dtype rate, const FusedGradient<Dtype>& gradient) {
+  CHECK(Caffe::root_solver());
+  Dtype* data;
+  Dtype* diff;
+  vector<Dtype*> history;
+  const int count =
+      this->GetFusedUpdateSpan(begin, end, &data, &diff, &history);
+  const Dtype local_rate = rate * this->net_->params_lr()[begin];
+  nesterov_fused_update_cpu(count, data, diff, history[0], gradient,
+      Dtype(this->param_.momentum()), local_rate);
+}
+
 INSTANTIATE_CLASS(NesterovSolver);
 REGISTER_SOLVER_CLASS(Nesterov);
 
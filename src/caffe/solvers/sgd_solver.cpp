@@ -105,18 +105,106 @@ void SGDSolver<Dtype>::PreSolve() {
     update_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
     temp_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
   }
+  MakeHistoryContiguous();
 
   this->minimum_loss_ = std::numeric_limits<float>::max();
 }
 
 template <typename Dtype>
-void SGDSolver<Dtype>::ClipGradients() {
+void SGDSolver<Dtype>::MakeHistoryContiguous() {
+  if (!this->net_->learnable_params_contiguous()) { return; }
+  // Lay out each set of history blobs (one per learnable param) like the
+  // param arena, one set after the other.
+  const vector<size_t>& offsets = this->net_->learnable_params_offsets();
+  const size_t set_count = this->net_->learnable_params_arena_count();
+  const int num_params = offsets.size();
+  if (num_params == 0) { return; }
+  CHECK_EQ(history_.size() % num_params, 0);
+  shared_ptr<SyncedMemory> arena(new SyncedMemory(
+      history_.size() / num_params * set_count * sizeof(Dtype)
+      + kArenaAlignment));
+  Dtype* history = static_cast<Dtype*>(
+      AlignArenaPointer(arena->mutable_cpu_data()));
+  for (int i = 0; i < history_.size(); ++i) {
+    if (history_[i]->count() == 0) { continue; }
+    Dtype* view =
+        history + i / num_params * set_count + offsets[i % num_params];
+    caffe_copy(history_[i]->count(), history_[i]->cpu_data(), view);
+    history_[i]->set_cpu_data(view);
+  }
+  history_arena_ = arena;
+}
+
+template <typename Dtype>
+bool SGDSolver<Dtype>::history_contiguous() const {
+  if (!history_arena_ || !this->net_->learnable_params_contiguous()) {
+    return false;
+  }
+  const vector<size_t>& offsets = this->net_->learnable_params_offsets();
+  const size_t set_count = this->net_->learnable_params_arena_count();
+  const int num_params = offsets.size();
+  if (history_arena_->size() <
+      history_.size() / num_params * set_count * sizeof(Dtype)) {
+    return false;
+  }
+  const Dtype* history = static_cast<const Dtype*>(
+      AlignArenaPointer(const_cast<void*>(history_arena_->cpu_data())));
+  for (int i = 0; i < history_.size(); ++i) {
+    if (history_[i]->count() > 0 && history_[i]->cpu_data() !=
+        history + i / num_params * set_count + offsets[i % num_params]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename Dtype>
+int SGDSolver<Dtype>::GetFusedUpdateSpan(int begin, int end, Dtype** data,
+    Dtype** diff, vector<Dtype*>* history) {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  const int num_params = net_params.size();
+  const int num_sets = history_.size() / num_params;
+  history->resize(num_sets);
+  if (end == begin + 1) {
+    Blob<Dtype>* param = net_params[begin];
+    *data = param->mutable_cpu_data();
+    *diff = param->mutable_cpu_diff();
+    for (int i = 0; i < num_sets; ++i) {
+      (*history)[i] = history_[i * num_params + begin]->mutable_cpu_data();
+    }
+    return param->count();
+  }
+  DCHECK(history_contiguous());
+  // The padding between the params is zero in every arena, and stays zero.
+  const vector<size_t>& offsets = this->net_->learnable_params_offsets();
+  const size_t set_count = this->net_->learnable_params_arena_count();
+  const size_t first = offsets[begin];
+  const size_t last = end < num_params ? offsets[end] : set_count;
+  *data = this->net_->mutable_learnable_params_cpu_data() + first;
+  *diff = this->net_->mutable_learnable_params_cpu_diff() + first;
+  Dtype* history_data = static_cast<Dtype*>(
+      AlignArenaPointer(history_arena_->mutable_cpu_data()));
+  for (int i = 0; i < num_sets; ++i) {
+    (*history)[i] = history_data + i * set_count + first;
+  }
+  return last - first;
+}
+
+template <typename Dtype>
+Dtype SGDSolver<Dtype>::GetClipGradientsScale() {
   const Dtype clip_gradients = this->param_.clip_gradients();
-  if (clip_gradients < 0) { return; }
+  if (clip_gradients < 0) { return Dtype(1); }
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
   Dtype sumsq_diff = 0;
-  for (int i = 0; i < net_params.size(); ++i) {
-    sumsq_diff += net_params[i]->sumsq_diff();
+  if (Caffe::mode() == Caffe::CPU &&
+      this->net_->learnable_params_contiguous()) {
+    const Dtype* diff = this->net_->learnable_params_cpu_diff();
+    sumsq_diff = caffe_cpu_dot(
+        this->net_->learnable_params_arena_count(), diff, diff);
+  } else {
+    for (int i = 0; i < net_params.size(); ++i) {
+      sumsq_diff += net_params[i]->sumsq_diff();
+    }
   }
   const Dtype l2norm_diff = std::sqrt(sumsq_diff);
   if (l2norm_diff > clip_gradients) {
@@ -124,9 +212,24 @@ void SGDSolver<Dtype>::ClipGradients() {
     LOG(INFO) << "Gradient clipping: scaling down gradients (L2 norm "
         << l2norm_diff << " > " << clip_gradients << ") "
         << "by scale factor " << scale_factor;
-    for (int i = 0; i < net_params.size(); ++i) {
-      net_params[i]->scale_diff(scale_factor);
-    }
+    return scale_factor;
+  }
+  return Dtype(1);
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::ClipGradients() {
+  const Dtype scale_factor = GetClipGradientsScale();
+  if (scale_factor == Dtype(1)) { return; }
+  if (Caffe::mode() == Caffe::CPU &&
+      this->net_->learnable_params_contiguous()) {
+    caffe_scal(this->net_->learnable_params_arena_count(), scale_factor,
+               this->net_->mutable_learnable_params_cpu_diff());
+    return;
+  }
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  for (int i = 0; i < net_params.size(); ++i) {
+    net_params[i]->scale_diff(scale_factor);
   }
 }
 
@@ -137,6 +240,30 @@ void SGDSolver<Dtype>::ApplyUpdate() {
   if (this->param_.display() && this->iter_ % this->param_.display() == 0) {
     LOG(INFO) << "Iteration " << this->iter_ << ", lr = " << rate;
   }
+  if (this->param_.fused_update() && Caffe::mode() == Caffe::CPU) {
+    // Clipping is folded into the fused update as a gradient scale, and the
+    // parameters are updated in place, so there is no Net::Update pass.
+    const Dtype clip_scale = GetClipGradientsScale();
+    const vector<float>& net_params_lr = this->net_->params_lr();
+    const vector<float>& net_params_weight_decay =
+        this->net_->params_weight_decay();
+    const int num_params = this->net_->learnable_params().size();
+    // With the history laid out like the param arena, each run of params
+    // sharing their multipliers is updated in one pass, so the whole arena
+    // is when they all do.
+    const bool contiguous = history_contiguous();
+    for (int begin = 0, end; begin < num_params; begin = end) {
+      end = begin + 1;
+      while (contiguous && end < num_params &&
+             net_params_lr[end] == net_params_lr[begin] &&
+             net_params_weight_decay[end] == net_params_weight_decay[begin]) {
+        ++end;
+      }
+      ComputeFusedUpdate(begin, end, rate,
+          GetFusedGradient(begin, clip_scale));
+    }
+    return;
+  }
   ClipGradients();
   for (int param_id = 0; param_id < this->net_->learnable_params().size();
        ++param_id) {
@@ -235,6 +362,25 @@ void SGDSolver<Dtype>::Regularize(int param_id) {
   }
 }
 
+template <typename Dtype>
+FusedGradient<Dtype> SGDSolver<Dtype>::GetFusedGradient(int param_id,
+    Dtype clip_scale) {
+  const vector<float>& net_params_weight_decay =
+      this->net_->params_weight_decay();
+  const string& regularization_type = this->param_.regularization_type();
+  const Dtype local_decay =
+      this->param_.weight_decay() * net_params_weight_decay[param_id];
+  // Scale gradient to counterbalance accumulation.
+  const Dtype scale = clip_scale / this->param_.iter_size();
+  if (regularization_type == "L2") {
+    return FusedGradient<Dtype>(scale, local_decay, Dtype(0));
+  } else if (regularization_type == "L1") {
+    return FusedGradient<Dtype>(scale, Dtype(0), local_decay);
+  }
+  LOG(FATAL) << "Unknown regularization type: " << regularization_type;
+  return FusedGradient<Dtype>(scale, Dtype(0), Dtype(0));
+}
+
 #ifndef CPU_ONLY
 template <typename Dtype>
 void sgd_update_gpu(int N, Dtype* g, Dtype* h, Dtype momentum,
@@ -274,6 +420,32 @@ void SGDSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void sgd_fused_update_cpu(int N, Dtype* w, Dtype* g, Dtype* h,
+    const FusedGradient<Dtype> gradient, Dtype momentum, Dtype local_rate) {
+#ifdef _OPENMP
+#pragma omp parallel for simd if (N >= kFusedUpdateParallelThreshold)
+#endif
+  for (int i = 0; i < N; ++i) {
+    const Dtype hi = momentum * h[i] + local_rate * gradient(w[i], g[i]);
+    h[i] = hi;
+    g[i] = hi;
+    w[i] -= hi;
+  }
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::ComputeFusedUpdate(int begin, int end, Dtype rate,
+    const FusedGradient<Dtype>& gradient) {
+  Dtype* data;
+  Dtype* diff;
+  vector<Dtype*> history;
+  const int count = GetFusedUpdateSpan(begin, end, &data, &diff, &history);
+  const Dtype local_rate = rate * this->net_->params_lr()[begin];
+  sgd_fused_update_cpu(count, data, diff, history[0], gradient,
+      Dtype(this->param_.momentum()), local_rate);
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
   switch (this->param_.snapshot_format()) {
@@ -298,14 +470,20 @@ void SGDSolver<Dtype>::SnapshotSolverStateToBinaryProto(
   state.set_iter_last_event(this->iter_last_event_);
   state.set_minimum_loss(this->minimum_loss_);
   state.clear_history();
+  string snapshot_filename = Solver<Dtype>::SnapshotFilename(".solverstate");
+  LOG(INFO)
+    << "Snapshotting solver state to binary proto file " << snapshot_filename;
+  if (this->StagedSnapshots()) {
+    // The history is staged and serialized blob by blob.
+    this->WriteSnapshot(new SolverStateSnapshot<Dtype>(state, history_,
+        snapshot_filename));
+    return;
+  }
   for (int i = 0; i < history_.size(); ++i) {
     // Add history
     BlobProto* history_blob = state.add_history();
     history_[i]->ToProto(history_blob);
   }
-  string snapshot_filename = Solver<Dtype>::SnapshotFilename(".solverstate");
-  LOG(INFO)
-    << "Snapshotting solver state to binary proto file " << snapshot_filename;
   WriteProtoToBinaryFile(state, snapshot_filename.c_str());
 }
 
@@ -89,6 +89,7 @@ void SyncedMemory::set_cpu_data(void* data) {
   cpu_ptr_ = data;
   head_ = HEAD_AT_CPU;
   own_cpu_data_ = false;
+  ++version_;
 }
 
 const void* SyncedMemory::gpu_data() {
@@ -116,6 +117,7 @@ void SyncedMemory::set_gpu_data(void* data) {
   gpu_ptr_ = data;
   head_ = HEAD_AT_GPU;
   own_gpu_data_ = false;
+  ++version_;
 #else
   NO_GPU;
 #endif
@@ -124,6 +126,7 @@ void SyncedMemory::set_gpu_data(void* data) {
 void* SyncedMemory::mutable_cpu_data() {
   to_cpu();
   head_ = HEAD_AT_CPU;
+  ++version_;
   return cpu_ptr_;
 }
 
@@ -131,6 +134,7 @@ void* SyncedMemory::mutable_gpu_data() {
 #ifndef CPU_ONLY
   to_gpu();
   head_ = HEAD_AT_GPU;
+  ++version_;
   return gpu_ptr_;
 #else
   NO_GPU;
@@ -59,6 +59,61 @@ TYPED_TEST(BlobSimpleTest, TestReshapeZero) {
   EXPECT_EQ(this->blob_->count(), 0);
 }
 
+// Deletes a SyncedMemory and counts the deletions.
+struct CountingDeleter {
+  explicit CountingDeleter(int* deletions) : deletions_(deletions) {}
+  void operator()(SyncedMemory* memory) const {
+    delete memory;
+    ++*deletions_;
+  }
+  int* deletions_;
+};
+
+TYPED_TEST(BlobSimpleTest, TestSetData) {
+  vector<TypeParam> buffer(120);
+  int deletions = 0;
+  shared_ptr<SyncedMemory> memory(
+      new SyncedMemory(buffer.size() * sizeof(TypeParam)),
+      CountingDeleter(&deletions));
+  memory->set_cpu_data(&buffer[0]);
+  vector<int> shape(2);
+  shape[0] = 4;
+  shape[1] = 30;
+  this->blob_->set_data(memory, shape);
+  memory.reset();
+  EXPECT_TRUE(this->blob_->shape() == shape);
+  EXPECT_EQ(&buffer[0], this->blob_->cpu_data());
+  // Shrinking and growing back within the buffer keep it.
+  this->blob_->Reshape(1, 3, 4, 5);
+  this->blob_->Reshape(shape);
+  EXPECT_EQ(&buffer[0], this->blob_->mutable_cpu_data());
+  EXPECT_EQ(120 * sizeof(TypeParam), this->blob_->diff()->size());
+  EXPECT_EQ(0, deletions);
+  // Growing past it releases it.
+  shape[0] = 5;
+  this->blob_->Reshape(shape);
+  EXPECT_NE(&buffer[0], this->blob_->cpu_data());
+  EXPECT_EQ(1, deletions);
+}
+
+TYPED_TEST(BlobSimpleTest, TestReleaseViews) {
+  this->blob_->Reshape(1, 3, 4, 5);
+  this->blob_->ShareDataView(*this->blob_preshaped_, 60);
+  this->blob_->ShareDiffView(*this->blob_preshaped_, 60);
+  EXPECT_EQ(this->blob_preshaped_->cpu_data() + 60, this->blob_->cpu_data());
+  EXPECT_EQ(this->blob_preshaped_->cpu_diff() + 60, this->blob_->cpu_diff());
+  this->blob_->ReleaseViews();
+  EXPECT_EQ(60, this->blob_->count());
+  EXPECT_EQ(60 * sizeof(TypeParam), this->blob_->data()->size());
+  EXPECT_EQ(60 * sizeof(TypeParam), this->blob_->diff()->size());
+  // Writing the blob no longer writes the other.
+  this->blob_preshaped_->mutable_cpu_data()[60] = 1;
+  this->blob_->mutable_cpu_data()[0] = 2;
+  EXPECT_EQ(1, this->blob_preshaped_->cpu_data()[60]);
+  this->blob_->mutable_cpu_diff()[0] = 2;
+  EXPECT_NE(this->blob_preshaped_->cpu_diff() + 60, this->blob_->cpu_diff());
+}
+
 TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   BlobProto blob_proto;
 
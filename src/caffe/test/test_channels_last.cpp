@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/channels_last.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class ChannelsLastTest : public CPUDeviceTest<Dtype> {
+ protected:
+  ChannelsLastTest() {
+    Caffe::set_random_seed(1701);
+  }
+
+  // Builds the net channels-first and channels-last, with the same trained
+  // weights.
+  void InitNets(const string& proto) {
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    param.mutable_state()->set_phase(TEST);
+    net_.reset(new Net<Dtype>(param));
+    FillerParameter filler_param;
+    filler_param.set_min(0.5);
+    filler_param.set_max(2);
+    UniformFiller<Dtype> filler(filler_param);
+    for (int i = 0; i < net_->layers().size(); ++i) {
+      if (string(net_->layers()[i]->type()) == "BatchNorm") {
+        // Positive variances and moving average scale factor.
+        for (int j = 0; j < net_->layers()[i]->blobs().size(); ++j) {
+          filler.Fill(net_->layers()[i]->blobs()[j].get());
+        }
+      }
+    }
+    param.set_channels_last(true);
+    channels_last_net_.reset(new Net<Dtype>(param));
+    channels_last_net_->ShareTrainedLayersWith(net_.get());
+  }
+
+  void ExpectBlobsNear(const Blob<Dtype>& expected,
+      const Blob<Dtype>& actual) {
+    ASSERT_TRUE(expected.shape() == actual.shape());
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_NEAR(expected.cpu_data()[i], actual.cpu_data()[i],
+          1e-4 * std::max(Dtype(1), std::fabs(expected.cpu_data()[i])));
+    }
+  }
+
+  void FillInput() {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(net_->input_blobs()[0]);
+    channels_last_net_->input_blobs()[0]->CopyFrom(*net_->input_blobs()[0]);
+  }
+
+  shared_ptr<Net<Dtype> > net_;
+  shared_ptr<Net<Dtype> > channels_last_net_;
+};
+
+TYPED_TEST_CASE(ChannelsLastTest, TestDtypes);
+
+TYPED_TEST(ChannelsLastTest, TestTranspose) {
+  const int num = 2, channels = 37, spatial = 45;
+  vector<int> shape(3);
+  shape[0] = num;
+  shape[1] = channels;
+  shape[2] = spatial;
+  Blob<TypeParam> blob(shape), channels_last(shape), channels_first(shape);
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(&blob);
+  caffe_cpu_to_channels_last(num, channels, spatial, blob.cpu_data(),
+      channels_last.mutable_cpu_data());
+  for (int n = 0; n < num; ++n) {
+    for (int c = 0; c < channels; ++c) {
+      for (int s = 0; s < spatial; ++s) {
+        EXPECT_EQ(blob.data_at(n, c, s, 0),
+            channels_last.cpu_data()[(n * spatial + s) * channels + c]);
+      }
+    }
+  }
+  caffe_cpu_to_channels_first(num, channels, spatial,
+      channels_last.cpu_data(), channels_first.mutable_cpu_data());
+  for (int i = 0; i < blob.count(); ++i) {
+    EXPECT_EQ(blob.cpu_data()[i], channels_first.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(ChannelsLastTest, TestForward) {
+  const string proto =
+      "name: 'ChannelsLastNet' "
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 5 dim: 9 dim: 8 } } } "
+      "layer { name: 'conv1' type: 'Convolution' bottom: 'data' "
+      "  top: 'conv1' convolution_param { num_output: 6 kernel_size: 3 "
+      "    pad: 1 engine: CAFFE weight_filler { type: 'gaussian' } "
+      "    bias_filler { type: 'gaussian' } } } "
+      "layer { name: 'bn1' type: 'BatchNorm' bottom: 'conv1' top: 'conv1' } "
+      "layer { name: 'relu1' type: 'ReLU' bottom: 'conv1' top: 'conv1' } "
+      "layer { name: 'pool1' type: 'Pooling' bottom: 'conv1' top: 'pool1' "
+      "  pooling_param { pool: MAX kernel_size: 3 stride: 2 pad: 1 } } "
+      "layer { name: 'conv2a' type: 'Convolution' bottom: 'pool1' "
+      "  top: 'conv2a' convolution_param { num_output: 4 kernel_size: 1 "
+      "    weight_filler { type: 'gaussian' } "
+      "    bias_filler { type: 'gaussian' } } } "
+      "layer { name: 'conv2b' type: 'Convolution' bottom: 'pool1' "
+      "  top: 'conv2b' convolution_param { num_output: 4 kernel_size: 3 "
+      "    pad: 2 dilation: 2 col_buffer_limit: 1 "
+      "    weight_filler { type: 'gaussian' } "
+      "    bias_filler { type: 'gaussian' } "
+      "    fused_activation { type: RELU } } } "
+      "layer { name: 'sum' type: 'Eltwise' bottom: 'conv2a' bottom: 'conv2b' "
+      "  top: 'sum' } "
+      "layer { name: 'concat' type: 'Concat' bottom: 'sum' bottom: 'pool1' "
+      "  top: 'concat' } "
+      "layer { name: 'pool2' type: 'Pooling' bottom: 'concat' top: 'pool2' "
+      "  pooling_param { pool: AVE kernel_size: 2 stride: 2 } } "
+      "layer { name: 'conv3' type: 'Convolution' bottom: 'concat' "
+      "  top: 'conv3' convolution_param { num_output: 3 kernel_size: 3 "
+      "    stride: 2 weight_filler { type: 'gaussian' } } } "
+      "layer { name: 'ip' type: 'InnerProduct' bottom: 'pool2' top: 'ip' "
+      "  inner_product_param { num_output: 3 "
+      "    weight_filler { type: 'gaussian' } } } ";
+  this->InitNets(proto);
+  // The chain starts at conv1 and ends at the InnerProduct layer.
+  EXPECT_FALSE(this->net_->layer_by_name("conv1")->channels_last());
+  EXPECT_TRUE(this->channels_last_net_->layer_by_name("conv1")->
+      channels_last());
+  EXPECT_TRUE(this->channels_last_net_->layer_by_name("concat")->
+      channels_last());
+  EXPECT_TRUE(this->channels_last_net_->layer_by_name("pool2")->
+      channels_last());
+  EXPECT_FALSE(this->channels_last_net_->layer_by_name("ip")->
+      channels_last());
+  for (int i = 0; i < 2; ++i) {
+    this->FillInput();
+    Blob<TypeParam> input;
+    input.CopyFrom(*this->net_->input_blobs()[0], false, true);
+    this->net_->Forward();
+    this->channels_last_net_->Forward();
+    // The outputs, and the input, come back channels-first.
+    this->ExpectBlobsNear(*this->net_->blob_by_name("ip"),
+        *this->channels_last_net_->blob_by_name("ip"));
+    this->ExpectBlobsNear(*this->net_->blob_by_name("conv3"),
+        *this->channels_last_net_->blob_by_name("conv3"));
+    this->ExpectBlobsNear(input, *this->channels_last_net_->input_blobs()[0]);
+    // The rest are reordered channels-first when read, by name, or all at
+    // once; the next Forward reorders them back as it needs.
+    if (i == 0) {
+      this->ExpectBlobsNear(*this->net_->blob_by_name("pool1"),
+          *this->channels_last_net_->blob_by_name("pool1"));
+      this->ExpectBlobsNear(*this->net_->blob_by_name("sum"),
+          *this->channels_last_net_->blob_by_name("sum"));
+    } else {
+      this->channels_last_net_->RestoreChannelsFirst();
+      for (int j = 0; j < this->net_->blobs().size(); ++j) {
+        this->ExpectBlobsNear(*this->net_->blobs()[j],
+            *this->channels_last_net_->blobs()[j]);
+      }
+    }
+  }
+  // So do the tops of the last layer a partial Forward runs.
+  const vector<string>& layer_names = this->net_->layer_names();
+  const int concat_id = std::find(layer_names.begin(), layer_names.end(),
+      "concat") - layer_names.begin();
+  this->FillInput();
+  this->net_->ForwardTo(concat_id);
+  this->channels_last_net_->ForwardTo(concat_id);
+  this->ExpectBlobsNear(*this->net_->blob_by_name("concat"),
+      *this->channels_last_net_->blob_by_name("concat"));
+}
+
+}  // namespace caffe
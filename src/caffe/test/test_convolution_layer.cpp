@@ -811,6 +811,74 @@ TYPED_TEST(ConvolutionLayerTest, TestGradientGroup) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestColBufferLimit) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(3);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // Strips of 4 of the 6 output rows: 3 x 9 columns of 4 values each.
+  convolution_param->set_col_buffer_limit(27 * 4 * 4 * sizeof(Dtype));
+  ConvolutionLayer<Dtype> strip_layer(layer_param);
+  vector<Blob<Dtype>*> strip_top_vec(1, this->blob_top_2_);
+  strip_layer.SetUp(this->blob_bottom_vec_, strip_top_vec);
+  for (int i = 0; i < layer.blobs().size(); ++i) {
+    strip_layer.blobs()[i]->CopyFrom(*layer.blobs()[i]);
+  }
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  strip_layer.Forward(this->blob_bottom_vec_, strip_top_vec);
+  for (int i = 0; i < this->blob_top_->count(); ++i) {
+    EXPECT_NEAR(this->blob_top_->cpu_data()[i],
+        this->blob_top_2_->cpu_data()[i], 1e-4);
+  }
+  // Backward, with the same top diff, into the same bottom diff.
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_top_);
+  caffe_copy(this->blob_top_->count(), this->blob_top_->cpu_diff(),
+      this->blob_top_2_->mutable_cpu_diff());
+  vector<bool> propagate_down(1, true);
+  layer.Backward(this->blob_top_vec_, propagate_down, this->blob_bottom_vec_);
+  Blob<Dtype> bottom_diff;
+  bottom_diff.CopyFrom(*this->blob_bottom_, true, true);
+  strip_layer.Backward(strip_top_vec, propagate_down, this->blob_bottom_vec_);
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    EXPECT_NEAR(bottom_diff.cpu_diff()[i], this->blob_bottom_->cpu_diff()[i],
+        1e-4);
+  }
+  for (int i = 0; i < layer.blobs()[0]->count(); ++i) {
+    EXPECT_NEAR(layer.blobs()[0]->cpu_diff()[i],
+        strip_layer.blobs()[0]->cpu_diff()[i], 1e-4);
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestGradientColBufferLimit) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(3);
+  convolution_param->set_group(3);
+  // One output row at a time.
+  convolution_param->set_col_buffer_limit(1);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
 #ifdef USE_CUDNN
 
 template <typename Dtype>
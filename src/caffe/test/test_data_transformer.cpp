@@ -1,4 +1,5 @@
 #ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
 #include <algorithm>
 #include <string>
 #include <vector>
@@ -346,6 +347,81 @@ TYPED_TEST(DataTransformTest, TestMeanFile) {
   }
 }
 
+TYPED_TEST(DataTransformTest, TestChannelSwap) {
+  TransformationParameter transform_param;
+  const bool unique_pixels = true;  // pixels are consecutive ints [0,size]
+  const int label = 0;
+  const int size = this->height_ * this->width_;
+
+  for (int c = 0; c < this->channels_; ++c) {
+    transform_param.add_channel_swap(this->channels_ - 1 - c);
+    transform_param.add_mean_value(c);
+  }
+  Datum datum;
+  this->FillDatum(label, unique_pixels, &datum);
+  Blob<TypeParam> blob(1, this->channels_, this->height_, this->width_);
+  DataTransformer<TypeParam> transformer(transform_param, TEST);
+  transformer.InitRand();
+  transformer.Transform(datum, &blob);
+  for (int c = 0; c < this->channels_; ++c) {
+    const int source = this->channels_ - 1 - c;
+    for (int j = 0; j < size; ++j) {
+      EXPECT_EQ(blob.cpu_data()[blob.offset(0, c) + j],
+                static_cast<uint8_t>(source * size + j) - c);
+    }
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestMatVector) {
+  typedef TypeParam Dtype;
+  TransformationParameter transform_param;
+  const int channels = 3;
+  const int crop_size = 6;
+  const Dtype scale = 0.5;
+  transform_param.set_crop_size(crop_size);
+  transform_param.set_scale(scale);
+  for (int c = 0; c < channels; ++c) {
+    transform_param.add_channel_swap(channels - 1 - c);
+    transform_param.add_mean_value(10 * c);
+  }
+  // Images of distinct pixels, interleaved by channel.
+  vector<cv::Mat> images;
+  for (int i = 0; i < 5; ++i) {
+    cv::Mat image(this->height_, this->width_, CV_8UC3);
+    for (int h = 0; h < this->height_; ++h) {
+      uchar* ptr = image.ptr<uchar>(h);
+      for (int j = 0; j < this->width_ * channels; ++j) {
+        ptr[j] = static_cast<uchar>(i * 31 + h * 7 + j);
+      }
+    }
+    images.push_back(image);
+  }
+  DataTransformer<Dtype> transformer(transform_param, TEST);
+  transformer.InitRand();
+  Blob<Dtype> blob(transformer.InferBlobShape(images));
+  transformer.Transform(images, &blob);
+  ASSERT_EQ(images.size(), blob.num());
+  const int offset = (this->height_ - crop_size) / 2;
+  for (int i = 0; i < images.size(); ++i) {
+    // Each image comes out as it does on its own.
+    Blob<Dtype> image_blob(transformer.InferBlobShape(images[i]));
+    transformer.Transform(images[i], &image_blob);
+    for (int j = 0; j < image_blob.count(); ++j) {
+      EXPECT_EQ(image_blob.cpu_data()[j], blob.cpu_data()[blob.offset(i) + j]);
+    }
+    for (int c = 0; c < channels; ++c) {
+      for (int h = 0; h < crop_size; ++h) {
+        const uchar* ptr = images[i].ptr<uchar>(h + offset);
+        for (int w = 0; w < crop_size; ++w) {
+          const Dtype pixel = ptr[(w + offset) * channels + channels - 1 - c];
+          EXPECT_EQ((pixel - 10 * c) * scale,
+                    blob.data_at(i, c, h, w));
+        }
+      }
+    }
+  }
+}
+
 TYPED_TEST(DataTransformTest, TestRichLabel) {
   TransformationParameter transform_param;
   const bool unique_pixels = false;  // all pixels the same equal to label
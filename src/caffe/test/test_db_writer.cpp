@@ -0,0 +1,88 @@
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost/thread.hpp"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/db_writer.hpp"
+#include "caffe/util/format.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// A db that keeps its committed records in order, and counts its commits.
+class MemoryDB : public db::DB {
+ public:
+  class MemoryTransaction : public db::Transaction {
+   public:
+    explicit MemoryTransaction(MemoryDB* db) : db_(db) {}
+    virtual void Put(const string& key, const string& value) {
+      records_.push_back(std::make_pair(key, value));
+    }
+    virtual void Commit() {
+      db_->records_.insert(db_->records_.end(), records_.begin(),
+          records_.end());
+      records_.clear();
+      ++db_->num_commits_;
+    }
+
+   private:
+    MemoryDB* db_;
+    vector<std::pair<string, string> > records_;
+  };
+
+  MemoryDB() : num_commits_(0) {}
+  virtual void Open(const string& source, db::Mode mode) {}
+  virtual void Close() {}
+  virtual db::Cursor* NewCursor() { return NULL; }
+  virtual db::Transaction* NewTransaction() {
+    return new MemoryTransaction(this);
+  }
+
+  vector<std::pair<string, string> > records_;
+  int num_commits_;
+};
+
+// Makes a record of item bytes for each item but the multiples of 7, taking
+// longer for the early items, so that the workers finish out of order.
+static bool MakeRecord(int item, string* key, string* value) {
+  if (item % 7 == 0) {
+    return false;
+  }
+  if (item < 8) {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(8 - item));
+  }
+  *key = format_int(item, 8);
+  value->assign(item, static_cast<char>(item));
+  return true;
+}
+
+class DBWriterTest : public ::testing::Test {};
+
+TEST_F(DBWriterTest, TestWriteInOrder) {
+  const int num_items = 100;
+  for (int num_workers = 1; num_workers <= 4; num_workers *= 2) {
+    MemoryDB db;
+    const int records = db::WriteRecords(&db, num_items, &MakeRecord,
+        num_workers, 500);
+    ASSERT_EQ(db.records_.size(), records);
+    int item = 0;
+    for (int i = 0; i < records; ++i, ++item) {
+      if (item % 7 == 0) {
+        ++item;
+      }
+      EXPECT_EQ(format_int(item, 8), db.records_[i].first);
+      EXPECT_EQ(string(item, static_cast<char>(item)),
+          db.records_[i].second);
+    }
+    EXPECT_EQ(num_items, item);
+    // A commit each 500 bytes or so, rather than one per record.
+    EXPECT_GT(db.num_commits_, 1);
+    EXPECT_LT(db.num_commits_, records / 4);
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,72 @@
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/image_cache.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ImageCacheTest : public ::testing::Test {
+ protected:
+  // A 3-channel image of 100 bytes a row.
+  cv::Mat Image(const int rows, const int value) {
+    return cv::Mat(rows, 100 / 3 + 1, CV_8UC3, cv::Scalar(value));
+  }
+};
+
+TEST_F(ImageCacheTest, TestLookup) {
+  ImageCache cache(1 << 20);
+  cv::Mat image;
+  EXPECT_FALSE(cache.Lookup("a", &image));
+  cache.Insert("a", Image(10, 7));
+  ASSERT_TRUE(cache.Lookup("a", &image));
+  EXPECT_EQ(10, image.rows);
+  EXPECT_EQ(7, image.data[0]);
+  EXPECT_EQ(1, cache.size());
+  EXPECT_EQ(10 * (100 / 3 + 1) * 3, cache.bytes());
+  EXPECT_EQ(1, cache.hits());
+  EXPECT_EQ(1, cache.misses());
+  EXPECT_FLOAT_EQ(0.5, cache.hit_rate());
+}
+
+TEST_F(ImageCacheTest, TestEvictLeastRecentlyUsed) {
+  const cv::Mat image = Image(10, 0);
+  const size_t image_bytes = image.total() * image.elemSize();
+  ImageCache cache(3 * image_bytes);
+  cache.Insert("a", image);
+  cache.Insert("b", image);
+  cache.Insert("c", image);
+  cv::Mat found;
+  // Using a makes b the least recently used.
+  EXPECT_TRUE(cache.Lookup("a", &found));
+  cache.Insert("d", image);
+  EXPECT_EQ(3, cache.size());
+  EXPECT_EQ(3 * image_bytes, cache.bytes());
+  EXPECT_FALSE(cache.Lookup("b", &found));
+  EXPECT_TRUE(cache.Lookup("a", &found));
+  EXPECT_TRUE(cache.Lookup("c", &found));
+  EXPECT_TRUE(cache.Lookup("d", &found));
+  // A larger image makes room for itself.
+  cache.Insert("e", Image(20, 0));
+  EXPECT_EQ(2, cache.size());
+  EXPECT_FALSE(cache.Lookup("a", &found));
+  EXPECT_FALSE(cache.Lookup("c", &found));
+  EXPECT_TRUE(cache.Lookup("d", &found));
+}
+
+TEST_F(ImageCacheTest, TestSkipOversizedImage) {
+  const cv::Mat image = Image(10, 0);
+  ImageCache cache(image.total() * image.elemSize() - 1);
+  cache.Insert("a", image);
+  cv::Mat found;
+  EXPECT_FALSE(cache.Lookup("a", &found));
+  EXPECT_EQ(0, cache.size());
+  EXPECT_EQ(0, cache.bytes());
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV
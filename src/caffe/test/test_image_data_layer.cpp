@@ -10,6 +10,7 @@
 #include "caffe/filler.hpp"
 #include "caffe/layers/image_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/image_cache.hpp"
 #include "caffe/util/io.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -152,6 +153,54 @@ TYPED_TEST(ImageDataLayerTest, TestReshape) {
   EXPECT_EQ(this->blob_top_data_->width(), 481);
 }
 
+// An ImageDataLayer that loads batches only when asked, so that its cache
+// sees each load once.
+template <typename Dtype>
+class CachingImageDataLayer : public ImageDataLayer<Dtype> {
+ public:
+  explicit CachingImageDataLayer(const LayerParameter& param)
+      : ImageDataLayer<Dtype>(param) {}
+  void LoadBatch(Batch<Dtype>* batch) { this->load_batch(batch); }
+  const ImageCache* image_cache() const { return this->image_cache_.get(); }
+
+ protected:
+  virtual void InternalThreadEntry() {}
+};
+
+TYPED_TEST(ImageDataLayerTest, TestCache) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(1);
+  image_data_param->set_source(this->filename_reshape_.c_str());
+  image_data_param->set_shuffle(false);
+  image_data_param->set_cache_mb(64);
+  CachingImageDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  ASSERT_TRUE(layer.image_cache());
+  Batch<Dtype> batch;
+  batch.data_.ReshapeLike(*this->blob_top_data_);
+  batch.label_.ReshapeLike(*this->blob_top_label_);
+  // The images of the second epoch come from the cache, and match the first.
+  vector<shared_ptr<Blob<Dtype> > > first_epoch;
+  for (int iter = 0; iter < 4; ++iter) {
+    layer.LoadBatch(&batch);
+    EXPECT_EQ(iter % 2, batch.label_.cpu_data()[0]);
+    if (iter < 2) {
+      first_epoch.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      first_epoch.back()->CopyFrom(batch.data_, false, true);
+      continue;
+    }
+    const Blob<Dtype>& expected = *first_epoch[iter % 2];
+    ASSERT_EQ(expected.shape(), batch.data_.shape());
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_EQ(expected.cpu_data()[i], batch.data_.cpu_data()[i]);
+    }
+  }
+  EXPECT_EQ(2, layer.image_cache()->hits());
+  EXPECT_EQ(2, layer.image_cache()->misses());
+}
+
 TYPED_TEST(ImageDataLayerTest, TestShuffle) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter param;
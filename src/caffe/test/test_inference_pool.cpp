@@ -0,0 +1,133 @@
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/inference_pool.hpp"
+#include "caffe/net.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class InferencePoolTest : public CPUDeviceTest<Dtype> {
+ protected:
+  void InitNet(const string& proto) {
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    param.mutable_state()->set_phase(TEST);
+    Caffe::set_random_seed(1701);
+    net_.reset(new Net<Dtype>(param));
+  }
+
+  // Makes a request input of the given shape with random values.
+  shared_ptr<Blob<Dtype> > MakeInput(const int num, const int channels,
+      const int height, const int width) {
+    shared_ptr<Blob<Dtype> > input(
+        new Blob<Dtype>(num, channels, height, width));
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(input.get());
+    return input;
+  }
+
+  // Runs inputs through the net itself, and copies its outputs.
+  vector<shared_ptr<Blob<Dtype> > > Forward(
+      const vector<shared_ptr<Blob<Dtype> > >& inputs) {
+    for (int i = 0; i < inputs.size(); ++i) {
+      net_->input_blobs()[i]->CopyFrom(*inputs[i], false, true);
+    }
+    const vector<Blob<Dtype>*>& outputs = net_->Forward();
+    vector<shared_ptr<Blob<Dtype> > > copies;
+    for (int i = 0; i < outputs.size(); ++i) {
+      copies.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      copies[i]->CopyFrom(*outputs[i], false, true);
+    }
+    return copies;
+  }
+
+  void ExpectOutputs(const InferenceRequest<Dtype>& request,
+      const vector<shared_ptr<Blob<Dtype> > >& expected) {
+    ASSERT_EQ(expected.size(), request.outputs().size());
+    for (int i = 0; i < expected.size(); ++i) {
+      const Blob<Dtype>& output = *request.outputs()[i];
+      ASSERT_TRUE(expected[i]->shape() == output.shape());
+      for (int j = 0; j < output.count(); ++j) {
+        EXPECT_NEAR(expected[i]->cpu_data()[j], output.cpu_data()[j], 1e-5);
+      }
+    }
+  }
+
+  shared_ptr<Net<Dtype> > net_;
+};
+
+TYPED_TEST_CASE(InferencePoolTest, TestDtypes);
+
+// A fully convolutional net, which takes inputs of any batch and size.
+static const char* kConvNet =
+    "name: 'ConvNet' "
+    "layer { name: 'data' type: 'Input' top: 'data' "
+    "  input_param { shape { dim: 1 dim: 3 dim: 5 dim: 5 } } } "
+    "layer { name: 'conv1' type: 'Convolution' bottom: 'data' top: 'conv1' "
+    "  convolution_param { num_output: 4 kernel_size: 3 pad: 1 "
+    "    weight_filler { type: 'gaussian' } "
+    "    bias_filler { type: 'gaussian' } } } "
+    "layer { name: 'relu1' type: 'ReLU' bottom: 'conv1' top: 'conv1' } "
+    "layer { name: 'conv2' type: 'Convolution' bottom: 'conv1' top: 'conv2' "
+    "  convolution_param { num_output: 2 kernel_size: 1 "
+    "    weight_filler { type: 'gaussian' } } } "
+    "layer { name: 'prob' type: 'Softmax' bottom: 'conv2' top: 'prob' } ";
+
+TYPED_TEST(InferencePoolTest, TestForward) {
+  typedef TypeParam Dtype;
+  this->InitNet(kConvNet);
+  vector<vector<shared_ptr<Blob<Dtype> > > > inputs(8);
+  vector<vector<shared_ptr<Blob<Dtype> > > > expected;
+  for (int i = 0; i < inputs.size(); ++i) {
+    inputs[i].push_back(this->MakeInput(1 + i % 3, 3, 4 + i % 2, 5));
+    expected.push_back(this->Forward(inputs[i]));
+  }
+  InferencePool<Dtype> pool(this->net_, 3, 1);
+  EXPECT_EQ(3, pool.num_workers());
+  vector<shared_ptr<InferenceRequest<Dtype> > > requests;
+  for (int i = 0; i < inputs.size(); ++i) {
+    requests.push_back(pool.Submit(inputs[i]));
+  }
+  for (int i = 0; i < requests.size(); ++i) {
+    requests[i]->Wait();
+    EXPECT_TRUE(requests[i]->done());
+    this->ExpectOutputs(*requests[i], expected[i]);
+  }
+}
+
+TYPED_TEST(InferencePoolTest, TestBatchRequests) {
+  typedef TypeParam Dtype;
+  this->InitNet(kConvNet);
+  // Requests of two sizes, which only run together with requests of their
+  // own size.
+  vector<vector<shared_ptr<Blob<Dtype> > > > inputs(12);
+  vector<vector<shared_ptr<Blob<Dtype> > > > expected;
+  for (int i = 0; i < inputs.size(); ++i) {
+    inputs[i].push_back(this->MakeInput(1 + i % 2, 3, i < 6 ? 5 : 3, 4));
+    expected.push_back(this->Forward(inputs[i]));
+  }
+  vector<shared_ptr<InferenceRequest<Dtype> > > requests;
+  {
+    InferencePool<Dtype> pool(this->net_, 1, 4);
+    for (int i = 0; i < inputs.size(); ++i) {
+      requests.push_back(pool.Submit(inputs[i]));
+    }
+    // The pool finishes the queued requests before it goes.
+  }
+  for (int i = 0; i < requests.size(); ++i) {
+    EXPECT_TRUE(requests[i]->done());
+    this->ExpectOutputs(*requests[i], expected[i]);
+  }
+}
+
+}  // namespace caffe
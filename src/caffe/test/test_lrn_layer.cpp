@@ -158,6 +158,55 @@ TYPED_TEST(LRNLayerTest, TestForwardAcrossChannelsLargeRegion) {
   }
 }
 
+TYPED_TEST(LRNLayerTest, TestForwardAcrossChannelsWide) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Enough pixels per image for the vectorized runs, with a ragged end, and
+  // both the beta with a square root kernel and a general one.
+  this->blob_bottom_->Reshape(2, 7, 5, 9);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  const Dtype betas[] = {0.75, 0.6};
+  for (int i = 0; i < 2; ++i) {
+    LayerParameter layer_param;
+    layer_param.mutable_lrn_param()->set_beta(betas[i]);
+    LRNLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    Blob<Dtype> top_reference;
+    this->ReferenceLRNForward(*(this->blob_bottom_), layer_param,
+        &top_reference);
+    for (int j = 0; j < this->blob_bottom_->count(); ++j) {
+      EXPECT_NEAR(this->blob_top_->cpu_data()[j], top_reference.cpu_data()[j],
+                  this->epsilon_);
+    }
+  }
+}
+
+TYPED_TEST(LRNLayerTest, TestForwardAcrossChannelsInPlace) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Vectorized runs and a ragged end, with windows of 1, 5 and 15 channels.
+  this->blob_bottom_->Reshape(2, 7, 5, 9);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  const int sizes[] = {1, 5, 15};
+  for (int i = 0; i < 3; ++i) {
+    filler.Fill(this->blob_bottom_);
+    LayerParameter layer_param;
+    layer_param.mutable_lrn_param()->set_local_size(sizes[i]);
+    Blob<Dtype> top_reference;
+    this->ReferenceLRNForward(*(this->blob_bottom_), layer_param,
+        &top_reference);
+    LRNLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_bottom_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_bottom_vec_);
+    for (int j = 0; j < this->blob_bottom_->count(); ++j) {
+      EXPECT_NEAR(this->blob_bottom_->cpu_data()[j],
+          top_reference.cpu_data()[j], this->epsilon_);
+    }
+  }
+}
+
 TYPED_TEST(LRNLayerTest, TestGradientAcrossChannels) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -0,0 +1,188 @@
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
+#include "caffe/util/mapped_weights.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class MappedWeightsTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  virtual void SetUp() {
+    const string proto =
+        "name: 'TestNetwork' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 4 dim: 5 } "
+        "    data_filler { type: 'gaussian' std: 10 } "
+        "  } "
+        "  top: 'data' "
+        "} "
+        "layer { "
+        "  name: 'innerproduct1' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 3 "
+        "    weight_filler { type: 'gaussian' std: 10 } "
+        "    bias_filler { type: 'gaussian' std: 10 } "
+        "  } "
+        "  bottom: 'data' "
+        "  top: 'innerproduct1' "
+        "} "
+        "layer { "
+        "  name: 'innerproduct2' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 7 "
+        "    weight_filler { type: 'gaussian' std: 10 } "
+        "    bias_filler { type: 'gaussian' std: 10 } "
+        "  } "
+        "  bottom: 'innerproduct1' "
+        "  top: 'innerproduct2' "
+        "} ";
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &net_param_));
+    Caffe::set_random_seed(1701);
+    net_.reset(new Net<Dtype>(net_param_));
+    net_->ToProto(&weights_);
+    MakeTempFilename(&filename_);
+  }
+
+  // Returns a net with fresh weights, loaded from filename_.
+  shared_ptr<Net<Dtype> > LoadNet(bool contiguous) {
+    Caffe::set_random_seed(1702);
+    shared_ptr<Net<Dtype> > net(new Net<Dtype>(net_param_));
+    if (contiguous) { net->MakeLearnableParamsContiguous(); }
+    net->CopyTrainedLayersFrom(filename_);
+    return net;
+  }
+
+  void CheckWeights(const Net<Dtype>& net) {
+    const vector<Blob<Dtype>*>& expected = net_->learnable_params();
+    const vector<Blob<Dtype>*>& actual = net.learnable_params();
+    ASSERT_EQ(expected.size(), actual.size());
+    for (int i = 0; i < expected.size(); ++i) {
+      ASSERT_TRUE(expected[i]->shape() == actual[i]->shape());
+      for (int j = 0; j < expected[i]->count(); ++j) {
+        EXPECT_FLOAT_EQ(expected[i]->cpu_data()[j], actual[i]->cpu_data()[j]);
+      }
+    }
+  }
+
+  NetParameter net_param_;
+  NetParameter weights_;
+  shared_ptr<Net<Dtype> > net_;
+  string filename_;
+};
+
+TYPED_TEST_CASE(MappedWeightsTest, TestDtypesAndDevices);
+
+TYPED_TEST(MappedWeightsTest, TestIsMappedWeightsFile) {
+  WriteProtoToBinaryFile(this->weights_, this->filename_);
+  EXPECT_FALSE(MappedWeights::IsMappedWeightsFile(this->filename_));
+  WriteMappedWeights(this->weights_, this->filename_);
+  EXPECT_TRUE(MappedWeights::IsMappedWeightsFile(this->filename_));
+}
+
+TYPED_TEST(MappedWeightsTest, TestIndex) {
+  WriteMappedWeights(this->weights_, this->filename_);
+  MappedWeights weights(this->filename_);
+  const MappedWeightsIndex& index = weights.index();
+  // Only the layers with blobs are indexed.
+  ASSERT_EQ(2, index.layer_size());
+  EXPECT_EQ("innerproduct1", index.layer(0).name());
+  EXPECT_EQ("innerproduct2", index.layer(1).name());
+  for (int i = 0; i < index.layer_size(); ++i) {
+    ASSERT_EQ(2, index.layer(i).blob_size());
+    for (int j = 0; j < index.layer(i).blob_size(); ++j) {
+      EXPECT_EQ(0, reinterpret_cast<uintptr_t>(
+          weights.data(index.layer(i).blob(j))) % kArenaAlignment);
+    }
+  }
+}
+
+TYPED_TEST(MappedWeightsTest, TestLoadMapped) {
+  typedef typename TypeParam::Dtype Dtype;
+  WriteMappedWeights(this->weights_, this->filename_);
+  shared_ptr<Net<Dtype> > net = this->LoadNet(false);
+  this->CheckWeights(*net);
+  for (int i = 0; i < net->learnable_params().size(); ++i) {
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(
+        net->learnable_params()[i]->cpu_data()) % kArenaAlignment);
+  }
+  // Writing to the weights must leave the file untouched.
+  Blob<Dtype>* weight = net->learnable_params()[0];
+  caffe_set(weight->count(), Dtype(0), weight->mutable_cpu_data());
+  this->CheckWeights(*this->LoadNet(false));
+}
+
+TYPED_TEST(MappedWeightsTest, TestLoadContiguous) {
+  typedef typename TypeParam::Dtype Dtype;
+  WriteMappedWeights(this->weights_, this->filename_);
+  shared_ptr<Net<Dtype> > net = this->LoadNet(true);
+  EXPECT_TRUE(net->learnable_params_contiguous());
+  this->CheckWeights(*net);
+}
+
+TYPED_TEST(MappedWeightsTest, TestLoadConverted) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Store the weights as the other floating point type.
+  for (int i = 0; i < this->weights_.layer_size(); ++i) {
+    LayerParameter* layer = this->weights_.mutable_layer(i);
+    for (int j = 0; j < layer->blobs_size(); ++j) {
+      BlobProto* blob = layer->mutable_blobs(j);
+      if (blob->double_data_size() > 0) {
+        for (int k = 0; k < blob->double_data_size(); ++k) {
+          blob->add_data(blob->double_data(k));
+        }
+        blob->clear_double_data();
+      } else {
+        for (int k = 0; k < blob->data_size(); ++k) {
+          blob->add_double_data(blob->data(k));
+        }
+        blob->clear_data();
+      }
+    }
+  }
+  WriteMappedWeights(this->weights_, this->filename_);
+  shared_ptr<Net<Dtype> > net = this->LoadNet(false);
+  this->CheckWeights(*net);
+}
+
+TYPED_TEST(MappedWeightsTest, TestLoadLegacyShapes) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Give the blobs legacy 4D dimensions, as in older caffemodels: the
+  // weights become 1 x 1 x M x N and the biases 1 x 1 x 1 x N.
+  for (int i = 0; i < this->weights_.layer_size(); ++i) {
+    LayerParameter* layer = this->weights_.mutable_layer(i);
+    for (int j = 0; j < layer->blobs_size(); ++j) {
+      BlobProto* blob = layer->mutable_blobs(j);
+      const BlobShape shape = blob->shape();
+      blob->clear_shape();
+      blob->set_num(1);
+      blob->set_channels(1);
+      blob->set_height(shape.dim_size() > 1 ? shape.dim(0) : 1);
+      blob->set_width(shape.dim(shape.dim_size() - 1));
+    }
+  }
+  WriteMappedWeights(this->weights_, this->filename_);
+  this->CheckWeights(*this->LoadNet(false));
+  this->CheckWeights(*this->LoadNet(true));
+}
+
+}  // namespace caffe
@@ -2,6 +2,8 @@
 #include <utility>
 #include <vector>
 
+#include "boost/bind.hpp"
+#include "boost/thread.hpp"
 #include "google/protobuf/text_format.h"
 
 #include "gtest/gtest.h"
@@ -11,6 +13,7 @@
 #include "caffe/net.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/packed_gemm.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -1342,6 +1345,219 @@ TYPED_TEST(NetTest, TestSharedWeightsResume) {
   }
 }
 
+TYPED_TEST(NetTest, TestContiguousParamsUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  const vector<Blob<Dtype>*>& params = this->net_->learnable_params();
+  // Keep copies of the params to check the arena preserves their values.
+  vector<shared_ptr<Blob<Dtype> > > copies(params.size());
+  const bool kReshape = true;
+  const bool kCopyDiff = false;
+  for (int i = 0; i < params.size(); ++i) {
+    copies[i].reset(new Blob<Dtype>());
+    copies[i]->CopyFrom(*params[i], kCopyDiff, kReshape);
+  }
+  EXPECT_FALSE(this->net_->learnable_params_contiguous());
+  this->net_->MakeLearnableParamsContiguous();
+  ASSERT_TRUE(this->net_->learnable_params_contiguous());
+  Blob<Dtype>* ip1_weights = this->net_->layers()[1]->blobs()[0].get();
+  Blob<Dtype>* ip2_weights = this->net_->layers()[2]->blobs()[0].get();
+  EXPECT_EQ(ip1_weights->cpu_data(), ip2_weights->cpu_data());
+  EXPECT_EQ(ip1_weights->cpu_diff(), ip2_weights->cpu_diff());
+  const Dtype* data_arena = this->net_->learnable_params_cpu_data();
+  const Dtype* diff_arena = this->net_->learnable_params_cpu_diff();
+  const vector<size_t>& offsets = this->net_->learnable_params_offsets();
+  for (int i = 0; i < params.size(); ++i) {
+    EXPECT_EQ(data_arena + offsets[i], params[i]->cpu_data());
+    EXPECT_EQ(diff_arena + offsets[i], params[i]->cpu_diff());
+    EXPECT_EQ(0, reinterpret_cast<size_t>(params[i]->cpu_data())
+        % kArenaAlignment);
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(copies[i]->cpu_data()[j], params[i]->cpu_data()[j]);
+    }
+  }
+  // Update through the arena and compare with updating each copy.
+  this->net_->Forward();
+  this->net_->Backward();
+  for (int i = 0; i < params.size(); ++i) {
+    copies[i]->CopyFrom(*params[i], !kCopyDiff, kReshape);
+    caffe_axpy(params[i]->count(), Dtype(-1), copies[i]->cpu_diff(),
+               copies[i]->mutable_cpu_data());
+  }
+  this->net_->Update();
+  for (int i = 0; i < params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(copies[i]->cpu_data()[j], params[i]->cpu_data()[j]);
+    }
+  }
+  this->net_->ClearParamDiffs();
+  for (int i = 0; i < params.size(); ++i) {
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(0, params[i]->cpu_diff()[j]);
+    }
+  }
+}
+
+template <typename Dtype>
+static void ForwardReplica(Net<Dtype>* net, Caffe::Brew mode) {
+  Caffe::set_mode(mode);
+  net->Forward();
+}
+
+TYPED_TEST(NetTest, TestCreateReplica) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string proto =
+      "name: 'ReplicatedNetwork' "
+      "state { phase: TEST } "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { shape { dim: 2 dim: 5 } } "
+      "} "
+      "layer { "
+      "  name: 'innerproduct1' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 4 "
+      "    weight_filler { type: 'gaussian' std: 1 } "
+      "    bias_filler { type: 'gaussian' std: 1 } "
+      "  } "
+      "  bottom: 'data' "
+      "  top: 'innerproduct1' "
+      "} "
+      "layer { "
+      "  name: 'tanh' "
+      "  type: 'TanH' "
+      "  bottom: 'innerproduct1' "
+      "  top: 'innerproduct1' "
+      "} "
+      "layer { "
+      "  name: 'innerproduct2' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 3 "
+      "    weight_filler { type: 'gaussian' std: 1 } "
+      "  } "
+      "  bottom: 'innerproduct1' "
+      "  top: 'innerproduct2' "
+      "} ";
+  Caffe::set_random_seed(this->seed_);
+  this->InitNetFromProtoString(proto);
+  Blob<Dtype> data;
+  data.ReshapeLike(*this->net_->input_blobs()[0]);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&data);
+  this->net_->input_blobs()[0]->CopyFrom(data);
+  const Blob<Dtype>& expected = *this->net_->Forward()[0];
+  const int kNumReplicas = 3;
+  vector<shared_ptr<Net<Dtype> > > replicas;
+  for (int i = 0; i < kNumReplicas; ++i) {
+    replicas.push_back(this->net_->CreateReplica());
+    replicas[i]->input_blobs()[0]->CopyFrom(data);
+  }
+  // The replicas share the weights, which are synced, but not activations.
+  vector<SyncedMemory::SyncedHead> heads;
+  for (int i = 0; i < this->net_->learnable_params().size(); ++i) {
+    const Blob<Dtype>* param = this->net_->learnable_params()[i];
+    heads.push_back(param->data()->head());
+    EXPECT_TRUE(heads[i] == SyncedMemory::HEAD_AT_CPU ||
+                heads[i] == SyncedMemory::SYNCED);
+    for (int j = 0; j < kNumReplicas; ++j) {
+      EXPECT_EQ(param->data(), replicas[j]->learnable_params()[i]->data());
+    }
+  }
+  for (int i = 0; i < kNumReplicas; ++i) {
+    EXPECT_NE(this->net_->output_blobs()[0]->data(),
+              replicas[i]->output_blobs()[0]->data());
+  }
+  boost::thread_group threads;
+  for (int i = 0; i < kNumReplicas; ++i) {
+    threads.create_thread(boost::bind(&ForwardReplica<Dtype>,
+        replicas[i].get(), Caffe::mode()));
+  }
+  threads.join_all();
+  for (int i = 0; i < kNumReplicas; ++i) {
+    const Blob<Dtype>& output = *replicas[i]->output_blobs()[0];
+    ASSERT_TRUE(expected.shape() == output.shape());
+    for (int j = 0; j < expected.count(); ++j) {
+      EXPECT_EQ(expected.cpu_data()[j], output.cpu_data()[j]);
+    }
+  }
+  // Forward on the replicas left the shared weights alone.
+  for (int i = 0; i < this->net_->learnable_params().size(); ++i) {
+    EXPECT_EQ(heads[i], this->net_->learnable_params()[i]->data()->head());
+  }
+}
+
+TYPED_TEST(NetTest, TestCreateReplicaSharesDerivedWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU ||
+      !caffe_cpu_packed_gemm_supported<Dtype>()) {
+    return;  // Nothing is derived from the weights.
+  }
+  const string proto =
+      "name: 'ReplicatedNetwork' "
+      "state { phase: TEST } "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { shape { dim: 2 dim: 5 } } "
+      "} "
+      "layer { "
+      "  name: 'innerproduct' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 4 "
+      "    bias_term: false "
+      "    weight_filler { type: 'gaussian' std: 1 } "
+      "  } "
+      "  bottom: 'data' "
+      "  top: 'innerproduct' "
+      "} ";
+  Caffe::set_random_seed(this->seed_);
+  this->InitNetFromProtoString(proto);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->net_->input_blobs()[0]);
+  Blob<Dtype> expected;
+  expected.CopyFrom(*this->net_->Forward()[0], false, true);
+  const int kNumReplicas = 3;
+  vector<shared_ptr<Net<Dtype> > > replicas;
+  for (int i = 0; i < kNumReplicas; ++i) {
+    replicas.push_back(this->net_->CreateReplica());
+    replicas[i]->input_blobs()[0]->CopyFrom(*this->net_->input_blobs()[0]);
+  }
+  // Zero the weights without bumping their version: a replica packing its
+  // own copy would see the zeros, one sharing the net's copy does not.
+  Blob<Dtype>* weights = this->net_->params()[0].get();
+  caffe_set(weights->count(), Dtype(0),
+            const_cast<Dtype*>(weights->cpu_data()));
+  for (int i = 0; i < kNumReplicas; ++i) {
+    const Blob<Dtype>& output = *replicas[i]->Forward()[0];
+    for (int j = 0; j < expected.count(); ++j) {
+      EXPECT_EQ(expected.cpu_data()[j], output.cpu_data()[j]);
+    }
+  }
+  // A write bumping the version has the replicas repack the shared copy once.
+  weights->mutable_cpu_data();
+  boost::thread_group threads;
+  for (int i = 0; i < kNumReplicas; ++i) {
+    threads.create_thread(boost::bind(&ForwardReplica<Dtype>,
+        replicas[i].get(), Caffe::mode()));
+  }
+  threads.join_all();
+  for (int i = 0; i < kNumReplicas; ++i) {
+    const Blob<Dtype>& output = *replicas[i]->output_blobs()[0];
+    for (int j = 0; j < expected.count(); ++j) {
+      EXPECT_EQ(0, output.cpu_data()[j]);
+    }
+  }
+}
+
 TYPED_TEST(NetTest, TestParamPropagateDown) {
   typedef typename TypeParam::Dtype Dtype;
   const bool kBiasTerm = true, kForceBackward = false;
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/optimize_net.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class OptimizeNetTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  OptimizeNetTest() : seed_(1701) {}
+
+  // Builds the net, with random trained weights, and optimizes it.
+  void InitNet(const string& proto) {
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param_));
+    param_.mutable_state()->set_phase(TEST);
+    Caffe::set_random_seed(seed_);
+    net_.reset(new Net<Dtype>(param_));
+    FillerParameter filler_param;
+    filler_param.set_min(0.5);
+    filler_param.set_max(2);
+    UniformFiller<Dtype> positive_filler(filler_param);
+    GaussianFiller<Dtype> gaussian_filler(filler_param);
+    for (int i = 0; i < param_.layer_size(); ++i) {
+      LayerParameter* layer_param = param_.mutable_layer(i);
+      const vector<shared_ptr<Blob<Dtype> > >& blobs =
+          net_->layer_by_name(layer_param->name())->blobs();
+      for (int j = 0; j < blobs.size(); ++j) {
+        if (layer_param->type() == "BatchNorm") {
+          // Positive variances and moving average scale factor.
+          if (j == 0) {
+            gaussian_filler.Fill(blobs[j].get());
+          } else {
+            positive_filler.Fill(blobs[j].get());
+          }
+        } else if (layer_param->type() != "Convolution" &&
+                   layer_param->type() != "InnerProduct") {
+          positive_filler.Fill(blobs[j].get());
+        }
+        blobs[j]->ToProto(layer_param->add_blobs());
+      }
+    }
+    removed_layers_.clear();
+    OptimizeNetForInference(param_, &optimized_param_, &removed_layers_);
+    optimized_net_.reset(new Net<Dtype>(optimized_param_));
+  }
+
+  // Checks that both nets compute the same outputs on the same input.
+  void CheckOutputs() {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(net_->input_blobs()[0]);
+    optimized_net_->input_blobs()[0]->CopyFrom(*net_->input_blobs()[0]);
+    net_->Forward();
+    optimized_net_->Forward();
+    ASSERT_EQ(net_->num_outputs(), optimized_net_->num_outputs());
+    for (int i = 0; i < net_->num_outputs(); ++i) {
+      const string& name =
+          net_->blob_names()[net_->output_blob_indices()[i]];
+      const Blob<Dtype>& expected = *net_->output_blobs()[i];
+      const Blob<Dtype>& actual = *optimized_net_->blob_by_name(name);
+      ASSERT_TRUE(expected.shape() == actual.shape());
+      for (int j = 0; j < expected.count(); ++j) {
+        EXPECT_NEAR(expected.cpu_data()[j], actual.cpu_data()[j],
+            1e-4 * std::max(Dtype(1), std::fabs(expected.cpu_data()[j])));
+      }
+    }
+  }
+
+  const LayerParameter& OptimizedLayer(const string& name) {
+    for (int i = 0; i < optimized_param_.layer_size(); ++i) {
+      if (optimized_param_.layer(i).name() == name) {
+        return optimized_param_.layer(i);
+      }
+    }
+    LOG(FATAL) << "No layer " << name;
+    return optimized_param_.layer(0);
+  }
+
+  int seed_;
+  NetParameter param_, optimized_param_;
+  shared_ptr<Net<Dtype> > net_, optimized_net_;
+  vector<string> removed_layers_;
+};
+
+TYPED_TEST_CASE(OptimizeNetTest, TestDtypesAndDevices);
+
+TYPED_TEST(OptimizeNetTest, TestFoldConvolution) {
+  this->InitNet(
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 6 dim: 5 } } } "
+      "layer { name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv' "
+      "  convolution_param { num_output: 4 kernel_size: 3 bias_term: false "
+      "    weight_filler { type: 'gaussian' } } } "
+      "layer { name: 'bn' type: 'BatchNorm' bottom: 'conv' top: 'conv' } "
+      "layer { name: 'scale' type: 'Scale' bottom: 'conv' top: 'conv' "
+      "  scale_param { bias_term: true } } "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'conv' top: 'conv' "
+      "  relu_param { negative_slope: 0.1 } } ");
+  ASSERT_EQ(3, this->removed_layers_.size());
+  EXPECT_EQ("bn", this->removed_layers_[0]);
+  EXPECT_EQ("scale", this->removed_layers_[1]);
+  EXPECT_EQ("relu", this->removed_layers_[2]);
+  const ConvolutionParameter& conv_param =
+      this->OptimizedLayer("conv").convolution_param();
+  EXPECT_TRUE(conv_param.bias_term());
+  EXPECT_EQ(FusedActivationParameter_Type_RELU,
+      conv_param.fused_activation().type());
+  EXPECT_FLOAT_EQ(0.1, conv_param.fused_activation().negative_slope());
+  this->CheckOutputs();
+}
+
+TYPED_TEST(OptimizeNetTest, TestFoldInnerProduct) {
+  this->InitNet(
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 3 dim: 8 } } } "
+      "layer { name: 'ip' type: 'InnerProduct' bottom: 'data' top: 'ip' "
+      "  inner_product_param { num_output: 5 transpose: true "
+      "    weight_filler { type: 'gaussian' } "
+      "    bias_filler { type: 'gaussian' } } } "
+      "layer { name: 'bias' type: 'Bias' bottom: 'ip' top: 'biased' } "
+      "layer { name: 'prelu' type: 'PReLU' bottom: 'biased' top: 'out' } ");
+  ASSERT_EQ(2, this->removed_layers_.size());
+  const LayerParameter& ip_param = this->OptimizedLayer("ip");
+  EXPECT_EQ("out", ip_param.top(0));
+  EXPECT_EQ(FusedActivationParameter_Type_PRELU,
+      ip_param.inner_product_param().fused_activation().type());
+  EXPECT_EQ(3, ip_param.blobs_size());
+  this->CheckOutputs();
+}
+
+TYPED_TEST(OptimizeNetTest, TestKeepSharedOutput) {
+  // The convolution output is read by more than the BatchNorm layer, so
+  // nothing can be folded into it.
+  this->InitNet(
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 4 dim: 4 } } } "
+      "layer { name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv' "
+      "  convolution_param { num_output: 2 kernel_size: 1 "
+      "    weight_filler { type: 'gaussian' } } } "
+      "layer { name: 'bn' type: 'BatchNorm' bottom: 'conv' top: 'bn' } "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'conv' top: 'relu' } ");
+  EXPECT_EQ(0, this->removed_layers_.size());
+  EXPECT_EQ(this->param_.layer_size(), this->optimized_param_.layer_size());
+  this->CheckOutputs();
+}
+
+}  // namespace caffe
@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/packed_gemm.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class PackedGemmTest : public CPUDeviceTest<Dtype> {
+ protected:
+  PackedGemmTest() {
+    Caffe::set_random_seed(1701);
+  }
+
+  void Fill(Blob<Dtype>* blob) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob);
+  }
+
+  // Checks that the layer computes the same outputs in the TEST phase, with
+  // packed weights, as in the TRAIN phase, also once its weights change.
+  void CheckPackedForward(LayerParameter layer_param,
+      const vector<int>& bottom_shape) {
+    Blob<Dtype> bottom(bottom_shape), top, packed_top;
+    Fill(&bottom);
+    vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+    vector<Blob<Dtype>*> top_vec(1, &top), packed_top_vec(1, &packed_top);
+    layer_param.set_phase(TRAIN);
+    shared_ptr<Layer<Dtype> > layer =
+        LayerRegistry<Dtype>::CreateLayer(layer_param);
+    layer->SetUp(bottom_vec, top_vec);
+    layer_param.set_phase(TEST);
+    shared_ptr<Layer<Dtype> > packed_layer =
+        LayerRegistry<Dtype>::CreateLayer(layer_param);
+    packed_layer->SetUp(bottom_vec, packed_top_vec);
+    packed_layer->blobs()[0]->ShareData(*layer->blobs()[0]);
+    packed_layer->blobs()[1]->ShareData(*layer->blobs()[1]);
+    for (int i = 0; i < 2; ++i) {
+      if (i > 0) {
+        Fill(layer->blobs()[0].get());
+      }
+      layer->Forward(bottom_vec, top_vec);
+      packed_layer->Forward(bottom_vec, packed_top_vec);
+      for (int j = 0; j < top.count(); ++j) {
+        EXPECT_NEAR(top.cpu_data()[j], packed_top.cpu_data()[j],
+            1e-4 * std::max(Dtype(1), std::fabs(top.cpu_data()[j])));
+      }
+    }
+  }
+};
+
+TYPED_TEST_CASE(PackedGemmTest, TestDtypes);
+
+TYPED_TEST(PackedGemmTest, TestGemmPackedA) {
+  // Sizes that leave partial panels of rows and columns, and more than one
+  // block of K.
+  const int M = 19, N = 45, K = 300;
+  Blob<TypeParam> a(1, 1, M, K), b(1, 1, K, N), c(1, 1, M, N);
+  this->Fill(&a);
+  this->Fill(&b);
+  caffe_cpu_gemm<TypeParam>(CblasNoTrans, CblasNoTrans, M, N, K, 1,
+      a.cpu_data(), b.cpu_data(), 0, c.mutable_cpu_data());
+  vector<TypeParam> packed_a(M * K), packed_c(M * N);
+  caffe_cpu_pack_a(M, K, a.cpu_data(), &packed_a[0]);
+  caffe_cpu_gemm_packed_a(M, N, K, &packed_a[0], b.cpu_data(),
+      &packed_c[0], N);
+  for (int i = 0; i < M * N; ++i) {
+    EXPECT_NEAR(c.cpu_data()[i], packed_c[i],
+        1e-4 * std::max(TypeParam(1), std::fabs(c.cpu_data()[i])));
+  }
+}
+
+TYPED_TEST(PackedGemmTest, TestGemmPackedB) {
+  const int M = 13, N = 45, K = 300;
+  Blob<TypeParam> a(1, 1, M, K), b(1, 1, K, N), b_t(1, 1, N, K);
+  Blob<TypeParam> c(1, 1, M, N);
+  this->Fill(&a);
+  this->Fill(&b);
+  for (int k = 0; k < K; ++k) {
+    for (int n = 0; n < N; ++n) {
+      b_t.mutable_cpu_data()[n * K + k] = b.cpu_data()[k * N + n];
+    }
+  }
+  caffe_cpu_gemm<TypeParam>(CblasNoTrans, CblasNoTrans, M, N, K, 1,
+      a.cpu_data(), b.cpu_data(), 0, c.mutable_cpu_data());
+  vector<TypeParam> packed_b(caffe_cpu_packed_b_size(K, N));
+  vector<TypeParam> packed_c(M * N);
+  for (int trans = 0; trans < 2; ++trans) {
+    if (trans) {
+      caffe_cpu_pack_b(CblasTrans, K, N, b_t.cpu_data(), &packed_b[0]);
+    } else {
+      caffe_cpu_pack_b(CblasNoTrans, K, N, b.cpu_data(), &packed_b[0]);
+    }
+    caffe_cpu_gemm_packed_b(M, N, K, a.cpu_data(), &packed_b[0],
+        &packed_c[0]);
+    for (int i = 0; i < M * N; ++i) {
+      EXPECT_NEAR(c.cpu_data()[i], packed_c[i],
+          1e-4 * std::max(TypeParam(1), std::fabs(c.cpu_data()[i])));
+    }
+  }
+}
+
+TYPED_TEST(PackedGemmTest, TestBlobDataVersion) {
+  Blob<TypeParam> blob(1, 2, 3, 4), other(1, 2, 3, 4);
+  BlobDataVersion version;
+  EXPECT_FALSE(version.Matches(blob));
+  version.Set(blob);
+  EXPECT_TRUE(version.Matches(blob));
+  blob.cpu_data();
+  EXPECT_TRUE(version.Matches(blob));
+  blob.mutable_cpu_data();
+  EXPECT_FALSE(version.Matches(blob));
+  version.Set(blob);
+  blob.ShareData(other);
+  EXPECT_FALSE(version.Matches(blob));
+}
+
+TYPED_TEST(PackedGemmTest, TestConvolution) {
+  LayerParameter layer_param;
+  layer_param.set_type("Convolution");
+  ConvolutionParameter* conv_param = layer_param.mutable_convolution_param();
+  conv_param->add_kernel_size(3);
+  conv_param->add_pad(1);
+  conv_param->set_num_output(10);
+  conv_param->set_group(2);
+  conv_param->mutable_weight_filler()->set_type("gaussian");
+  conv_param->mutable_bias_filler()->set_type("gaussian");
+  // Large enough outputs to use packed weights.
+  vector<int> bottom_shape(4);
+  bottom_shape[0] = 2;
+  bottom_shape[1] = 4;
+  bottom_shape[2] = 48;
+  bottom_shape[3] = 50;
+  this->CheckPackedForward(layer_param, bottom_shape);
+  // Also over strips of 5 output rows.
+  conv_param->set_col_buffer_limit(18 * 2 * 50 * 5 * sizeof(TypeParam));
+  this->CheckPackedForward(layer_param, bottom_shape);
+}
+
+TYPED_TEST(PackedGemmTest, TestInnerProduct) {
+  LayerParameter layer_param;
+  layer_param.set_type("InnerProduct");
+  InnerProductParameter* ip_param = layer_param.mutable_inner_product_param();
+  ip_param->set_num_output(37);
+  ip_param->mutable_weight_filler()->set_type("gaussian");
+  ip_param->mutable_bias_filler()->set_type("gaussian");
+  vector<int> bottom_shape(2);
+  bottom_shape[0] = 5;
+  bottom_shape[1] = 300;
+  this->CheckPackedForward(layer_param, bottom_shape);
+  ip_param->set_transpose(true);
+  this->CheckPackedForward(layer_param, bottom_shape);
+}
+
+}  // namespace caffe
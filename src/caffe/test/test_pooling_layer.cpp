@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cfloat>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -609,6 +611,80 @@ TYPED_TEST(PoolingLayerTest, TestGradientAvePadded) {
   }
 }
 
+TYPED_TEST(PoolingLayerTest, TestForwardStride2TestPhase) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Wide enough for the vectorized rows, with a ragged end.
+  this->blob_bottom_->Reshape(2, 3, 9, 23);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  const Dtype* bottom_data = this->blob_bottom_->cpu_data();
+  for (int max_pool = 0; max_pool <= 1; ++max_pool) {
+    for (int kernel = 2; kernel <= 3; ++kernel) {
+      for (int pad = 0; pad < kernel - 1; ++pad) {
+        LayerParameter layer_param;
+        layer_param.set_phase(TEST);
+        PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+        pooling_param->set_kernel_size(kernel);
+        pooling_param->set_stride(2);
+        pooling_param->set_pad(pad);
+        pooling_param->set_pool(max_pool ? PoolingParameter_PoolMethod_MAX :
+            PoolingParameter_PoolMethod_AVE);
+        PoolingLayer<Dtype> layer(layer_param);
+        layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+        layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+        const Blob<Dtype>& top = *this->blob_top_;
+        for (int n = 0; n < top.num(); ++n) {
+          for (int c = 0; c < top.channels(); ++c) {
+            for (int ph = 0; ph < top.height(); ++ph) {
+              for (int pw = 0; pw < top.width(); ++pw) {
+                const int hstart = ph * 2 - pad;
+                const int wstart = pw * 2 - pad;
+                const int hend = std::min(hstart + kernel,
+                    this->blob_bottom_->height() + pad);
+                const int wend = std::min(wstart + kernel,
+                    this->blob_bottom_->width() + pad);
+                const int pool_size = (hend - hstart) * (wend - wstart);
+                Dtype expected = max_pool ? -FLT_MAX : 0;
+                for (int h = std::max(hstart, 0);
+                     h < std::min(hend, this->blob_bottom_->height()); ++h) {
+                  for (int w = std::max(wstart, 0);
+                       w < std::min(wend, this->blob_bottom_->width()); ++w) {
+                    const Dtype value =
+                        bottom_data[this->blob_bottom_->offset(n, c, h, w)];
+                    expected = max_pool ? std::max(expected, value) :
+                        expected + value;
+                  }
+                }
+                if (!max_pool) {
+                  expected /= pool_size;
+                }
+                EXPECT_NEAR(expected, top.data_at(n, c, ph, pw), 1e-5)
+                    << "kernel " << kernel << " pad " << pad;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(PoolingLayerTest, TestGradientMaxTestPhase) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+  pooling_param->set_kernel_size(3);
+  pooling_param->set_stride(2);
+  pooling_param->set_pad(1);
+  pooling_param->set_pool(PoolingParameter_PoolMethod_MAX);
+  PoolingLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-4, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNPoolingLayerTest : public GPUDeviceTest<Dtype> {
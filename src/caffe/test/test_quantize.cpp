@@ -0,0 +1,234 @@
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/util/quantize.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class QuantizeTest : public CPUDeviceTest<Dtype> {
+ protected:
+  QuantizeTest()
+      : blob_bottom_(new Blob<Dtype>(2, 6, 7, 5)),
+        blob_top_(new Blob<Dtype>()),
+        blob_top_int8_(new Blob<Dtype>()) {
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+  }
+  virtual ~QuantizeTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+    delete blob_top_int8_;
+  }
+
+  // Checks that the layer computes about the same outputs once quantized.
+  void CheckInt8Forward(const LayerParameter& layer_param) {
+    vector<Blob<Dtype>*> top_vec(1, blob_top_);
+    shared_ptr<Layer<Dtype> > layer =
+        LayerRegistry<Dtype>::CreateLayer(layer_param);
+    layer->SetUp(blob_bottom_vec_, top_vec);
+    layer->Forward(blob_bottom_vec_, top_vec);
+    LayerParameter int8_layer_param(layer_param);
+    int8_layer_param.mutable_quantization_param();
+    vector<Blob<Dtype>*> int8_top_vec(1, blob_top_int8_);
+    shared_ptr<Layer<Dtype> > int8_layer =
+        LayerRegistry<Dtype>::CreateLayer(int8_layer_param);
+    int8_layer->SetUp(blob_bottom_vec_, int8_top_vec);
+    for (int i = 0; i < layer->blobs().size(); ++i) {
+      int8_layer->blobs()[i]->CopyFrom(*layer->blobs()[i]);
+    }
+    // Once with the range of each input, then with a calibrated range.
+    for (int calibrated = 0; calibrated < 2; ++calibrated) {
+      if (calibrated) {
+        int8_layer_param.mutable_quantization_param()->set_input_max(
+            caffe_cpu_amax(blob_bottom_->count(), blob_bottom_->cpu_data()));
+        shared_ptr<Layer<Dtype> > calibrated_layer =
+            LayerRegistry<Dtype>::CreateLayer(int8_layer_param);
+        calibrated_layer->SetUp(blob_bottom_vec_, int8_top_vec);
+        for (int i = 0; i < layer->blobs().size(); ++i) {
+          calibrated_layer->blobs()[i]->CopyFrom(*layer->blobs()[i]);
+        }
+        int8_layer = calibrated_layer;
+      }
+      int8_layer->Forward(blob_bottom_vec_, int8_top_vec);
+      ASSERT_TRUE(blob_top_->shape() == blob_top_int8_->shape());
+      const Dtype max_output =
+          caffe_cpu_amax(blob_top_->count(), blob_top_->cpu_data());
+      for (int i = 0; i < blob_top_->count(); ++i) {
+        EXPECT_NEAR(blob_top_->cpu_data()[i], blob_top_int8_->cpu_data()[i],
+            0.02 * max_output);
+      }
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  Blob<Dtype>* const blob_top_int8_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+};
+
+TYPED_TEST_CASE(QuantizeTest, TestDtypes);
+
+TYPED_TEST(QuantizeTest, TestQuantize) {
+  const TypeParam x[] = {-1.27, -0.5, 0, 0.004, 0.006, 1.27, 3};
+  int8_t q[8];
+  caffe_cpu_quantize(1, 7, TypeParam(0.01), x, q);
+  const int8_t expected[] = {-127, -50, 0, 0, 1, 127, 127, 0};
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_EQ(expected[i], q[i]);
+  }
+}
+
+TYPED_TEST(QuantizeTest, TestQuantizeRoundsHalfToEven) {
+  // Enough values for the vectorized paths, and a scalar tail.
+  const int num = 37;
+  const TypeParam ties[] = {0.5, 1.5, 2.5, -0.5, -1.5, -2.5};
+  const int8_t expected[] = {0, 2, 2, 0, -2, -2};
+  vector<TypeParam> x(num);
+  for (int i = 0; i < num; ++i) {
+    x[i] = ties[i % 6];
+  }
+  vector<int8_t> q(int8_gemm_k(num));
+  caffe_cpu_quantize(1, num, TypeParam(1), &x[0], &q[0]);
+  vector<uint8_t> q_packed(int8_gemm_k(num));
+  caffe_cpu_quantize_pack(num, 1, TypeParam(1), &x[0], &q_packed[0]);
+  for (int i = 0; i < num; ++i) {
+    EXPECT_EQ(expected[i % 6], q[i]);
+    EXPECT_EQ(expected[i % 6] + 128, q_packed[i]);
+  }
+}
+
+TYPED_TEST(QuantizeTest, TestQuantizeRows) {
+  const TypeParam x[] = {1, -2, 0.5, 0.25, 0, 0};
+  int8_t q[12];
+  TypeParam scales[3];
+  caffe_cpu_quantize_rows(3, 2, x, q, scales);
+  EXPECT_FLOAT_EQ(2. / kInt8Max, scales[0]);
+  EXPECT_FLOAT_EQ(0.5 / kInt8Max, scales[1]);
+  EXPECT_EQ(1, scales[2]);
+  EXPECT_EQ(-kInt8Max, q[1]);
+  EXPECT_EQ(kInt8Max, q[4]);
+  EXPECT_EQ(0, q[9]);
+}
+
+TYPED_TEST(QuantizeTest, TestQuantizePack) {
+  const int K = 7, N = 21;
+  vector<TypeParam> x(K * N);
+  for (int i = 0; i < x.size(); ++i) {
+    x[i] = (i % 255) - 127;
+  }
+  vector<uint8_t> q(int8_gemm_k(K) * N);
+  caffe_cpu_quantize_pack(K, N, TypeParam(1), &x[0], &q[0]);
+  for (int k = 0; k < int8_gemm_k(K); ++k) {
+    for (int n = 0; n < N; ++n) {
+      const int expected = k < K ? x[k * N + n] + 128 : 128;
+      EXPECT_EQ(expected, q[(k / 4 * N + n) * 4 + k % 4]);
+    }
+  }
+}
+
+TYPED_TEST(QuantizeTest, TestGemmS8) {
+  // Sizes that leave partial blocks of rows, columns and K.
+  const int M = 11, N = 45, K = 37;
+  vector<TypeParam> a(M * K), b(K * N);
+  for (int i = 0; i < a.size(); ++i) { a[i] = (i * 7) % 255 - 127; }
+  for (int i = 0; i < b.size(); ++i) { b[i] = (i * 13) % 255 - 127; }
+  vector<int8_t> A(M * int8_gemm_k(K));
+  vector<uint8_t> B(int8_gemm_k(K) * N);
+  caffe_cpu_quantize(M, K, TypeParam(1), &a[0], &A[0]);
+  caffe_cpu_quantize_pack(K, N, TypeParam(1), &b[0], &B[0]);
+  // Each kernel this CPU has, from the scalar one up.
+  const Int8GemmKernel kernel = caffe_cpu_gemm_s8_kernel();
+  for (int limit = INT8_GEMM_SCALAR; limit <= kernel; ++limit) {
+    caffe_cpu_limit_gemm_s8_kernel(static_cast<Int8GemmKernel>(limit));
+    vector<int32_t> C(M * N);
+    caffe_cpu_gemm_s8(M, N, K, &A[0], &B[0], &C[0]);
+    for (int m = 0; m < M; ++m) {
+      for (int n = 0; n < N; ++n) {
+        int32_t expected = 0;
+        for (int k = 0; k < K; ++k) {
+          expected += a[m * K + k] * b[k * N + n];
+        }
+        EXPECT_EQ(expected, C[m * N + n]) << "kernel " << limit;
+      }
+    }
+  }
+  caffe_cpu_limit_gemm_s8_kernel(INT8_GEMM_VNNI);
+  // The same product, with B packed from its transpose.
+  vector<TypeParam> b_t(N * K);
+  for (int k = 0; k < K; ++k) {
+    for (int n = 0; n < N; ++n) {
+      b_t[n * K + k] = b[k * N + n];
+    }
+  }
+  vector<int8_t> B_t(N * int8_gemm_k(K));
+  caffe_cpu_quantize(N, K, TypeParam(1), &b_t[0], &B_t[0]);
+  vector<uint8_t> B_packed(int8_gemm_k(K) * N);
+  caffe_cpu_pack_s8(N, K, &B_t[0], &B_packed[0]);
+  EXPECT_TRUE(B == B_packed);
+}
+
+TYPED_TEST(QuantizeTest, TestConvolution) {
+  LayerParameter layer_param;
+  layer_param.set_type("Convolution");
+  ConvolutionParameter* conv_param = layer_param.mutable_convolution_param();
+  conv_param->add_kernel_size(3);
+  conv_param->add_stride(2);
+  conv_param->add_pad(1);
+  conv_param->set_num_output(4);
+  conv_param->set_group(2);
+  conv_param->mutable_weight_filler()->set_type("gaussian");
+  conv_param->mutable_bias_filler()->set_type("gaussian");
+  this->CheckInt8Forward(layer_param);
+}
+
+TYPED_TEST(QuantizeTest, TestConvolution1x1) {
+  LayerParameter layer_param;
+  layer_param.set_type("Convolution");
+  ConvolutionParameter* conv_param = layer_param.mutable_convolution_param();
+  conv_param->add_kernel_size(1);
+  conv_param->set_num_output(5);
+  conv_param->mutable_weight_filler()->set_type("gaussian");
+  this->CheckInt8Forward(layer_param);
+}
+
+TYPED_TEST(QuantizeTest, TestDepthwiseConvolution) {
+  LayerParameter layer_param;
+  layer_param.set_type("DepthwiseConvolution");
+  ConvolutionParameter* conv_param = layer_param.mutable_convolution_param();
+  conv_param->add_kernel_size(3);
+  conv_param->add_pad(1);
+  conv_param->set_num_output(6);
+  conv_param->set_group(6);
+  conv_param->mutable_weight_filler()->set_type("gaussian");
+  this->CheckInt8Forward(layer_param);
+}
+
+TYPED_TEST(QuantizeTest, TestInnerProduct) {
+  LayerParameter layer_param;
+  layer_param.set_type("InnerProduct");
+  InnerProductParameter* ip_param = layer_param.mutable_inner_product_param();
+  ip_param->set_num_output(10);
+  ip_param->mutable_weight_filler()->set_type("gaussian");
+  ip_param->mutable_bias_filler()->set_type("gaussian");
+  this->CheckInt8Forward(layer_param);
+  ip_param->set_transpose(true);
+  this->CheckInt8Forward(layer_param);
+}
+
+}  // namespace caffe
@@ -0,0 +1,168 @@
+#include <cfloat>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/simd_math.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class SimdMathTest : public ::testing::Test {
+ protected:
+  SimdMathTest() {
+    // Not a multiple of any vector width, to cover the tails.
+    const int n = 10007;
+    const float lo = -20, hi = 20;
+    for (int i = 0; i < n; ++i) {
+      x_.push_back(lo + (hi - lo) * i / (n - 1));
+    }
+    y_.resize(n);
+    const float inf = std::numeric_limits<float>::infinity();
+    const float special[] = {0.f, -0.f, 1.f, -1.f, FLT_MIN, FLT_MIN / 4,
+        FLT_MAX, -FLT_MAX, inf, -inf, std::numeric_limits<float>::quiet_NaN(),
+        80.f, 89.f, -87.f, -88.f, -100.f, 100.f, 1e-30f, 1e30f, 0.625f};
+    special_.assign(special, special + sizeof(special) / sizeof(special[0]));
+  }
+
+  // Expects y to be within max_ulp of ref, the result in double precision.
+  void ExpectNear(const vector<float>& x, const vector<float>& y,
+      const vector<double>& ref, const double max_ulp) {
+    for (int i = 0; i < x.size(); ++i) {
+      const double ulp = std::ldexp(1.,
+          std::max(std::ilogb(std::max(std::fabs(ref[i]), 1e-30)), -126) - 23);
+      EXPECT_LE(std::fabs(y[i] - ref[i]), max_ulp * ulp) << "x " << x[i];
+    }
+  }
+
+  // Expects actual to match libm, and to be a NaN or infinity where it is.
+  void ExpectSame(const float expected, const float actual, const float x) {
+    if (std::isnan(expected)) {
+      EXPECT_TRUE(std::isnan(actual)) << "x " << x;
+    } else if (std::isinf(expected)) {
+      EXPECT_EQ(expected, actual) << "x " << x;
+    } else {
+      EXPECT_NEAR(expected, actual, std::fabs(expected) * 1e-6) << "x " << x;
+    }
+  }
+
+  vector<float> x_;
+  vector<float> y_;
+  vector<float> special_;
+};
+
+TEST_F(SimdMathTest, TestExp) {
+  caffe_simd_exp(x_.size(), &x_[0], &y_[0]);
+  vector<double> ref;
+  for (int i = 0; i < x_.size(); ++i) {
+    ref.push_back(std::exp(static_cast<double>(x_[i])));
+  }
+  ExpectNear(x_, y_, ref, 1.5);
+}
+
+TEST_F(SimdMathTest, TestLog) {
+  vector<float> x;
+  for (int i = 0; i < x_.size(); ++i) {
+    x.push_back(std::exp(x_[i] * 4));
+  }
+  caffe_simd_log(x.size(), &x[0], &y_[0]);
+  vector<double> ref;
+  for (int i = 0; i < x.size(); ++i) {
+    ref.push_back(std::log(static_cast<double>(x[i])));
+  }
+  ExpectNear(x, y_, ref, 1.5);
+}
+
+TEST_F(SimdMathTest, TestTanh) {
+  caffe_simd_tanh(x_.size(), &x_[0], &y_[0]);
+  vector<double> ref;
+  for (int i = 0; i < x_.size(); ++i) {
+    ref.push_back(std::tanh(static_cast<double>(x_[i])));
+  }
+  ExpectNear(x_, y_, ref, 2);
+}
+
+TEST_F(SimdMathTest, TestSigmoid) {
+  caffe_simd_sigmoid(x_.size(), &x_[0], &y_[0]);
+  vector<double> ref;
+  for (int i = 0; i < x_.size(); ++i) {
+    ref.push_back(1 / (1 + std::exp(-static_cast<double>(x_[i]))));
+  }
+  ExpectNear(x_, y_, ref, 3);
+}
+
+TEST_F(SimdMathTest, TestPowx) {
+  vector<float> x;
+  for (int i = 0; i < x_.size(); ++i) {
+    x.push_back(std::exp(x_[i] / 4));
+  }
+  const float powers[] = {-0.75f, 0.5f, 1.f, 2.f, 3.5f};
+  for (int p = 0; p < sizeof(powers) / sizeof(powers[0]); ++p) {
+    caffe_simd_powx(x.size(), &x[0], powers[p], &y_[0]);
+    vector<double> ref;
+    for (int i = 0; i < x.size(); ++i) {
+      ref.push_back(std::pow(static_cast<double>(x[i]), powers[p]));
+    }
+    // |p log(x)| stays below 18.
+    ExpectNear(x, y_, ref, 40);
+  }
+}
+
+TEST_F(SimdMathTest, TestSpecialValues) {
+  // Each special value in turn, among ordinary ones, so that every vector
+  // path sees it.
+  for (int i = 0; i < special_.size(); ++i) {
+    vector<float> x(37, 0.5f);
+    x[i % x.size()] = special_[i];
+    vector<float> y(x.size());
+    const float v = special_[i];
+    caffe_simd_exp(x.size(), &x[0], &y[0]);
+    ExpectSame(std::exp(v), y[i % x.size()], v);
+    caffe_simd_log(x.size(), &x[0], &y[0]);
+    ExpectSame(std::log(v), y[i % x.size()], v);
+    caffe_simd_tanh(x.size(), &x[0], &y[0]);
+    ExpectSame(std::tanh(v), y[i % x.size()], v);
+    caffe_simd_sigmoid(x.size(), &x[0], &y[0]);
+    ExpectSame(1 / (1 + std::exp(-v)), y[i % x.size()], v);
+    caffe_simd_powx(x.size(), &x[0], 0.75f, &y[0]);
+    ExpectSame(std::pow(v, 0.75f), y[i % x.size()], v);
+    caffe_simd_powx(x.size(), &x[0], 2.f, &y[0]);
+    ExpectSame(v * v, y[i % x.size()], v);
+    for (int j = 0; j < x.size(); ++j) {
+      if (j != i % x.size()) {
+        EXPECT_NEAR(0.25f, y[j], 1e-7);
+      }
+    }
+  }
+}
+
+TEST_F(SimdMathTest, TestInPlace) {
+  vector<float> y(x_);
+  caffe_simd_tanh(y.size(), &y[0], &y[0]);
+  caffe_simd_tanh(x_.size(), &x_[0], &y_[0]);
+  for (int i = 0; i < y.size(); ++i) {
+    EXPECT_EQ(y_[i], y[i]);
+  }
+}
+
+TEST_F(SimdMathTest, TestDoubleMatchesFloat) {
+  vector<double> x(x_.begin(), x_.end());
+  vector<double> y(x.size());
+  caffe_tanh(x.size(), &x[0], &y[0]);
+  caffe_tanh(x_.size(), &x_[0], &y_[0]);
+  for (int i = 0; i < x.size(); ++i) {
+    EXPECT_NEAR(y[i], y_[i], 1e-6);
+  }
+  caffe_sigmoid(x.size(), &x[0], &y[0]);
+  caffe_sigmoid(x_.size(), &x_[0], &y_[0]);
+  for (int i = 0; i < x.size(); ++i) {
+    EXPECT_NEAR(y[i], y_[i], 1e-6);
+  }
+}
+
+}  // namespace caffe
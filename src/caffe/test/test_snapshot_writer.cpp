@@ -0,0 +1,261 @@
+#include <string>
+#include <vector>
+
+#include "boost/filesystem.hpp"
+#include "boost/thread.hpp"
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/snapshot_writer.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class SnapshotWriterTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  SnapshotWriterTest() : seed_(1701) {}
+
+  virtual void SetUp() {
+    // Two inner product layers sharing their weights, with a bias each.
+    const string proto =
+        "name: 'TestNetwork' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  dummy_data_param { "
+        "    shape { dim: 4 dim: 5 } "
+        "    data_filler { type: 'gaussian' std: 10 } "
+        "  } "
+        "  top: 'data' "
+        "} "
+        "layer { "
+        "  name: 'innerproduct1' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { type: 'gaussian' std: 10 } "
+        "    bias_filler { type: 'gaussian' std: 10 } "
+        "  } "
+        "  param { name: 'sharedweights' } "
+        "  bottom: 'data' "
+        "  top: 'innerproduct1' "
+        "} "
+        "layer { "
+        "  name: 'innerproduct2' "
+        "  type: 'InnerProduct' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { type: 'gaussian' std: 10 } "
+        "    bias_filler { type: 'gaussian' std: 10 } "
+        "  } "
+        "  param { name: 'sharedweights' } "
+        "  bottom: 'innerproduct1' "
+        "  top: 'innerproduct2' "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'data' "
+        "  bottom: 'innerproduct2' "
+        "} ";
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    Caffe::set_random_seed(seed_);
+    net_.reset(new Net<Dtype>(param));
+    net_->ForwardBackward();
+    MakeTempDir(&snapshot_dir_);
+  }
+
+  // Checks that filename holds what Net::ToProto gives for the net now.
+  void CheckNetSnapshot(const string& filename, bool write_diff) {
+    NetParameter expected, actual;
+    net_->ToProto(&expected, write_diff);
+    ASSERT_TRUE(ReadProtoFromBinaryFile(filename, &actual));
+    EXPECT_EQ(expected.SerializeAsString(), actual.SerializeAsString());
+  }
+
+  int seed_;
+  shared_ptr<Net<Dtype> > net_;
+  string snapshot_dir_;
+};
+
+TYPED_TEST_CASE(SnapshotWriterTest, TestDtypesAndDevices);
+
+TYPED_TEST(SnapshotWriterTest, TestNetSnapshot) {
+  const string filename = this->snapshot_dir_ + "/net.caffemodel";
+  for (int write_diff = false; write_diff <= true; ++write_diff) {
+    NetSnapshot<typename TypeParam::Dtype> snapshot(this->net_.get(),
+        filename, write_diff);
+    snapshot.Write();
+    this->CheckNetSnapshot(filename, write_diff);
+    EXPECT_FALSE(boost::filesystem::exists(filename + ".tmp"));
+  }
+}
+
+TYPED_TEST(SnapshotWriterTest, TestNetSnapshotContiguous) {
+  const string filename = this->snapshot_dir_ + "/net.caffemodel";
+  this->net_->MakeLearnableParamsContiguous();
+  NetSnapshot<typename TypeParam::Dtype> snapshot(this->net_.get(), filename,
+      false);
+  snapshot.Write();
+  this->CheckNetSnapshot(filename, false);
+}
+
+TYPED_TEST(SnapshotWriterTest, TestNetSnapshotIsStaged) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string filename = this->snapshot_dir_ + "/net.caffemodel";
+  NetParameter expected;
+  this->net_->ToProto(&expected);
+  NetSnapshot<Dtype> snapshot(this->net_.get(), filename, false);
+  // Changing the weights after staging must not affect the snapshot.
+  this->net_->Update();
+  snapshot.Write();
+  NetParameter actual;
+  ASSERT_TRUE(ReadProtoFromBinaryFile(filename, &actual));
+  EXPECT_EQ(expected.SerializeAsString(), actual.SerializeAsString());
+}
+
+TYPED_TEST(SnapshotWriterTest, TestSolverStateSnapshot) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string filename = this->snapshot_dir_ + "/net.solverstate";
+  SolverState expected;
+  expected.set_iter(10);
+  expected.set_learned_net("net.caffemodel");
+  expected.set_current_step(2);
+  vector<shared_ptr<Blob<Dtype> > > history;
+  for (int i = 0; i < this->net_->learnable_params().size(); ++i) {
+    history.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    history[i]->CopyFrom(*this->net_->learnable_params()[i], false, true);
+  }
+  SolverStateSnapshot<Dtype>(expected, history, filename).Write();
+  for (int i = 0; i < history.size(); ++i) {
+    history[i]->ToProto(expected.add_history());
+  }
+  SolverState actual;
+  ASSERT_TRUE(ReadProtoFromBinaryFile(filename, &actual));
+  EXPECT_EQ(expected.DebugString(), actual.DebugString());
+}
+
+TYPED_TEST(SnapshotWriterTest, TestSnapshotWriter) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int kNumSnapshots = 5;
+  vector<string> filenames;
+  {
+    SnapshotWriter writer(2);
+    for (int i = 0; i < kNumSnapshots; ++i) {
+      filenames.push_back(this->snapshot_dir_ + "/net_" +
+          caffe::format_int(i) + ".caffemodel");
+      writer.BeginUnit();
+      writer.Push(new NetSnapshot<Dtype>(this->net_.get(), filenames[i],
+          false));
+    }
+    writer.Wait();
+    for (int i = 0; i < kNumSnapshots; ++i) {
+      this->CheckNetSnapshot(filenames[i], false);
+    }
+    // Snapshots still in flight are written on destruction.
+    writer.BeginUnit();
+    writer.Push(new NetSnapshot<Dtype>(this->net_.get(),
+        this->snapshot_dir_ + "/last.caffemodel", false));
+  }
+  this->CheckNetSnapshot(this->snapshot_dir_ + "/last.caffemodel", false);
+}
+
+// A snapshot of an empty message whose writing waits until the gate opens.
+class GatedSnapshot : public Snapshot {
+ public:
+  struct Gate {
+    Gate() : open(false) {}
+    boost::mutex mutex;
+    boost::condition_variable opened;
+    bool open;
+  };
+
+  GatedSnapshot(const string& filename, Gate* gate)
+      : Snapshot(filename), gate_(gate) {}
+
+ protected:
+  virtual void Serialize(google::protobuf::io::CodedOutputStream* output) {
+    boost::mutex::scoped_lock lock(gate_->mutex);
+    while (!gate_->open) {
+      gate_->opened.wait(lock);
+    }
+  }
+
+  Gate* gate_;
+};
+
+static void OpenGateLater(GatedSnapshot::Gate* gate, bool* opened) {
+  boost::this_thread::sleep(boost::posix_time::milliseconds(500));
+  boost::mutex::scoped_lock lock(gate->mutex);
+  gate->open = true;
+  *opened = true;
+  gate->opened.notify_all();
+}
+
+TYPED_TEST(SnapshotWriterTest, TestSnapshotWriterUnit) {
+  // With the default of one unit in flight, the solver state of a unit is
+  // pushed while its model is still being written.
+  GatedSnapshot::Gate gate;
+  bool opened = false;
+  SnapshotWriter writer(1);
+  boost::thread opener(&OpenGateLater, &gate, &opened);
+  writer.BeginUnit();
+  writer.Push(new GatedSnapshot(this->snapshot_dir_ + "/a.caffemodel",
+      &gate));
+  writer.Push(new GatedSnapshot(this->snapshot_dir_ + "/a.solverstate",
+      &gate));
+  {
+    boost::mutex::scoped_lock lock(gate.mutex);
+    EXPECT_FALSE(opened);
+  }
+  // The next unit waits for the first to be written.
+  writer.BeginUnit();
+  {
+    boost::mutex::scoped_lock lock(gate.mutex);
+    EXPECT_TRUE(opened);
+  }
+  EXPECT_TRUE(boost::filesystem::exists(this->snapshot_dir_ + "/a.caffemodel"));
+  EXPECT_TRUE(boost::filesystem::exists(
+      this->snapshot_dir_ + "/a.solverstate"));
+  opener.join();
+}
+
+TYPED_TEST(SnapshotWriterTest, TestNetSnapshotLegacyInputs) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string proto =
+      "name: 'TestNetwork' "
+      "input: 'data' "
+      "input_shape { dim: 4 dim: 5 } "
+      "layer { "
+      "  name: 'innerproduct' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 3 "
+      "    weight_filler { type: 'gaussian' std: 10 } "
+      "  } "
+      "  bottom: 'data' "
+      "  top: 'innerproduct' "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  // Loading a net moves legacy inputs into an Input layer.
+  UpgradeNetAsNeeded("legacy inputs", &param);
+  this->net_.reset(new Net<Dtype>(param));
+  const string filename = this->snapshot_dir_ + "/net.caffemodel";
+  NetSnapshot<Dtype> snapshot(this->net_.get(), filename, false);
+  snapshot.Write();
+  this->CheckNetSnapshot(filename, false);
+}
+
+}  // namespace caffe
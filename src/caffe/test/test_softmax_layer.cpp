@@ -7,6 +7,7 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/softmax_layer.hpp"
+#include "caffe/util/softmax.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_softmax_layer.hpp"
@@ -83,6 +84,79 @@ TYPED_TEST(SoftmaxLayerTest, TestGradient) {
       this->blob_top_vec_);
 }
 
+template <typename Dtype>
+class SoftmaxKernelTest : public CPUDeviceTest<Dtype> {
+ protected:
+  // Checks caffe_cpu_softmax and caffe_cpu_softmax_backward against the
+  // definitions, on outer_num x channels x inner_num values offset by shift.
+  void TestShape(const int outer_num, const int channels, const int inner_num,
+      const Dtype shift) {
+    vector<int> shape(3);
+    shape[0] = outer_num;
+    shape[1] = channels;
+    shape[2] = inner_num;
+    Blob<Dtype> x(shape), y(shape), dy(shape), dx(shape);
+    Blob<Dtype> log_norm(vector<int>(1, outer_num * inner_num));
+    FillerParameter filler_param;
+    filler_param.set_std(4);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(&x);
+    filler.Fill(&dy);
+    caffe_add_scalar(x.count(), shift, x.mutable_cpu_data());
+    caffe_cpu_softmax(outer_num, channels, inner_num, x.cpu_data(),
+        y.mutable_cpu_data(), log_norm.mutable_cpu_data());
+    caffe_cpu_softmax_backward(outer_num, channels, inner_num, y.cpu_data(),
+        dy.cpu_data(), dx.mutable_cpu_data());
+    for (int i = 0; i < outer_num; ++i) {
+      for (int k = 0; k < inner_num; ++k) {
+        double max = -HUGE_VAL;
+        for (int c = 0; c < channels; ++c) {
+          max = std::max(max, static_cast<double>(x.data_at(i, c, k, 0)));
+        }
+        double sum = 0, dot = 0;
+        for (int c = 0; c < channels; ++c) {
+          sum += std::exp(x.data_at(i, c, k, 0) - max);
+          dot += dy.data_at(i, c, k, 0) * y.data_at(i, c, k, 0);
+        }
+        EXPECT_NEAR(max + std::log(sum), log_norm.cpu_data()[i * inner_num + k],
+            1e-5 * std::fabs(max + std::log(sum)) + 1e-5);
+        for (int c = 0; c < channels; ++c) {
+          const double prob = std::exp(x.data_at(i, c, k, 0) - max) / sum;
+          EXPECT_NEAR(prob, y.data_at(i, c, k, 0), 1e-5 * prob + 1e-7);
+          EXPECT_NEAR(prob * (dy.data_at(i, c, k, 0) - dot),
+              dx.data_at(i, c, k, 0), 1e-4);
+        }
+      }
+    }
+    // In place.
+    caffe_cpu_softmax(outer_num, channels, inner_num, x.cpu_data(),
+        x.mutable_cpu_data(), static_cast<Dtype*>(NULL));
+    for (int i = 0; i < x.count(); ++i) {
+      EXPECT_EQ(y.cpu_data()[i], x.cpu_data()[i]);
+    }
+  }
+};
+
+TYPED_TEST_CASE(SoftmaxKernelTest, TestDtypes);
+
+TYPED_TEST(SoftmaxKernelTest, TestWholeSlices) {
+  this->TestShape(5, 10, 7, 0);
+}
+
+TYPED_TEST(SoftmaxKernelTest, TestOneInner) {
+  this->TestShape(101, 21, 1, 0);
+}
+
+TYPED_TEST(SoftmaxKernelTest, TestPartialSlices) {
+  // Blocks of 2048 / 300 columns, which do not divide 37.
+  this->TestShape(3, 300, 37, 0);
+}
+
+TYPED_TEST(SoftmaxKernelTest, TestLargeInputs) {
+  this->TestShape(4, 10, 9, 1000);
+  this->TestShape(4, 10, 9, -1000);
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNSoftmaxLayerTest : public GPUDeviceTest<Dtype> {
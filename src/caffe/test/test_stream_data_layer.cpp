@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <vector>
+
+#include "boost/bind.hpp"
+#include "boost/thread.hpp"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/stream_data_layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// A datum whose pixels at index i are (label + i) % 256.
+static Datum MakeDatum(const int label, const int channels, const int height,
+    const int width) {
+  Datum datum;
+  datum.set_channels(channels);
+  datum.set_height(height);
+  datum.set_width(width);
+  datum.set_label(label);
+  string* data = datum.mutable_data();
+  for (int i = 0; i < channels * height * width; ++i) {
+    data->push_back(static_cast<char>((label + i) % 256));
+  }
+  return datum;
+}
+
+// Queues the samples of labels [begin, end) one at a time, and checks the
+// results of each, which are its data. A failure here does not end the
+// thread, so that the serving loop still gets every sample.
+template <typename Dtype>
+static void RunClient(StreamDataLayer<Dtype>* layer, const int begin,
+    const int end) {
+  for (int label = begin; label < end; ++label) {
+    Datum datum = MakeDatum(label, layer->channels(), layer->height(),
+        layer->width());
+    const int dim = datum.data().size();
+    shared_ptr<StreamDataRequest<Dtype> > request = layer->Enqueue(&datum);
+    request->Wait();
+    const vector<vector<Dtype> >& results = request->results();
+    EXPECT_EQ(1, results.size());
+    if (results.size() != 1) { continue; }
+    EXPECT_EQ(dim, results[0].size());
+    for (int i = 0; i < std::min<int>(dim, results[0].size()); ++i) {
+      EXPECT_EQ((label + i) % 256, results[0][i]);
+    }
+  }
+}
+
+template <typename TypeParam>
+class StreamDataLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  StreamDataLayerTest()
+      : batch_size_(4), channels_(2), height_(3), width_(5),
+        data_blob_(new Blob<Dtype>()),
+        label_blob_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    blob_top_vec_.push_back(data_blob_);
+    blob_top_vec_.push_back(label_blob_);
+    StreamDataParameter* sd_param = layer_param_.mutable_stream_data_param();
+    sd_param->set_batch_size(batch_size_);
+    sd_param->set_channels(channels_);
+    sd_param->set_height(height_);
+    sd_param->set_width(width_);
+    sd_param->set_max_latency_us(1000);
+  }
+
+  virtual ~StreamDataLayerTest() {
+    delete data_blob_;
+    delete label_blob_;
+  }
+
+  const int batch_size_;
+  const int channels_;
+  const int height_;
+  const int width_;
+  LayerParameter layer_param_;
+  Blob<Dtype>* const data_blob_;
+  Blob<Dtype>* const label_blob_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(StreamDataLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(StreamDataLayerTest, TestSetup) {
+  typedef typename TypeParam::Dtype Dtype;
+  StreamDataLayer<Dtype> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->batch_size_, this->data_blob_->num());
+  EXPECT_EQ(this->channels_, this->data_blob_->channels());
+  EXPECT_EQ(this->height_, this->data_blob_->height());
+  EXPECT_EQ(this->width_, this->data_blob_->width());
+  EXPECT_EQ(this->batch_size_, this->label_blob_->count());
+  EXPECT_FALSE(layer.WaitForRequest(1000));
+}
+
+TYPED_TEST(StreamDataLayerTest, TestMicroBatches) {
+  typedef typename TypeParam::Dtype Dtype;
+  StreamDataLayer<Dtype> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int num = this->batch_size_ + 2;
+  vector<shared_ptr<StreamDataRequest<Dtype> > > requests;
+  for (int label = 0; label < num; ++label) {
+    Datum datum = MakeDatum(label, this->channels_, this->height_,
+        this->width_);
+    requests.push_back(layer.Enqueue(&datum));
+  }
+  EXPECT_EQ(num, layer.queued());
+  EXPECT_TRUE(layer.WaitForRequest(0));
+  // A full batch, then the rest once the latency deadline has passed.
+  const int dim = this->channels_ * this->height_ * this->width_;
+  int label = 0;
+  for (int batch = 0; batch < 2; ++batch) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    const int batch_num = batch == 0 ? this->batch_size_ : 2;
+    ASSERT_EQ(batch_num, this->data_blob_->num());
+    ASSERT_EQ(batch_num, layer.batch().size());
+    for (int n = 0; n < batch_num; ++n) {
+      EXPECT_EQ(label + n, this->label_blob_->cpu_data()[n]);
+      for (int i = 0; i < dim; ++i) {
+        EXPECT_EQ((label + n + i) % 256,
+            this->data_blob_->cpu_data()[n * dim + i]);
+      }
+      EXPECT_FALSE(requests[label + n]->done());
+    }
+    layer.CompleteBatch(vector<Blob<Dtype>*>(1, this->label_blob_));
+    EXPECT_EQ(0, layer.batch().size());
+    for (int n = 0; n < batch_num; ++n) {
+      ASSERT_TRUE(requests[label + n]->TimedWait(0));
+      ASSERT_EQ(1, requests[label + n]->results().size());
+      ASSERT_EQ(1, requests[label + n]->results()[0].size());
+      EXPECT_EQ(label + n, requests[label + n]->results()[0][0]);
+    }
+    label += batch_num;
+  }
+  EXPECT_EQ(0, layer.queued());
+}
+
+TYPED_TEST(StreamDataLayerTest, TestConcurrentClients) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->layer_param_.mutable_stream_data_param()->set_queue_size(3);
+  StreamDataLayer<Dtype> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const int num_clients = 4;
+  const int samples_per_client = 25;
+  boost::thread_group clients;
+  for (int c = 0; c < num_clients; ++c) {
+    clients.create_thread(boost::bind(&RunClient<Dtype>, &layer,
+        c * samples_per_client, (c + 1) * samples_per_client));
+  }
+  // Serve until every sample has its results, or the deadline passes.
+  const boost::system_time deadline =
+      boost::get_system_time() + boost::posix_time::seconds(30);
+  int served = 0;
+  while (served < num_clients * samples_per_client) {
+    if (boost::get_system_time() > deadline) {
+      ADD_FAILURE() << "Served only " << served << " samples by the deadline.";
+      // Wake the clients blocked on the layer.
+      clients.interrupt_all();
+      break;
+    }
+    if (layer.WaitForRequest(100000)) {
+      layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      EXPECT_LE(this->data_blob_->num(), this->batch_size_);
+      served += this->data_blob_->num();
+      layer.CompleteBatch(vector<Blob<Dtype>*>(1, this->data_blob_));
+    }
+  }
+  clients.join_all();
+  EXPECT_EQ(0, layer.queued());
+}
+
+}  // namespace caffe
@@ -22,6 +22,21 @@ TEST_F(SyncedMemoryTest, TestInitialization) {
   delete p_mem;
 }
 
+TEST_F(SyncedMemoryTest, TestVersion) {
+  SyncedMemory mem(10);
+  const size_t initial_version = mem.version();
+  mem.cpu_data();
+  EXPECT_EQ(initial_version, mem.version());
+  mem.mutable_cpu_data();
+  const size_t written_version = mem.version();
+  EXPECT_NE(initial_version, written_version);
+  mem.cpu_data();
+  EXPECT_EQ(written_version, mem.version());
+  char data[10];
+  mem.set_cpu_data(data);
+  EXPECT_NE(written_version, mem.version());
+}
+
 #ifndef CPU_ONLY  // GPU test
 
 TEST_F(SyncedMemoryTest, TestAllocationCPUGPU) {
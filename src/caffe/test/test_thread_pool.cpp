@@ -0,0 +1,107 @@
+#include <vector>
+
+#include "boost/bind.hpp"
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ThreadPoolTest : public ::testing::Test {
+ protected:
+  ThreadPoolTest() {
+    ThreadPool::set_num_threads(4);
+  }
+  virtual ~ThreadPoolTest() {
+    ThreadPool::set_num_threads(0);
+  }
+};
+
+static void CountRange(vector<int>* counts, const int begin, const int end) {
+  for (int i = begin; i < end; ++i) {
+    ++(*counts)[i];
+  }
+}
+
+static void CountRows(vector<vector<int> >* counts, const int begin,
+    const int end) {
+  for (int i = begin; i < end; ++i) {
+    parallel_for((*counts)[i].size(), 3,
+        boost::bind(&CountRange, &(*counts)[i], _1, _2));
+  }
+}
+
+static void RecordRange(vector<int>* ranges, const int begin,
+    const int end) {
+  ranges->push_back(begin);
+  ranges->push_back(end);
+}
+
+TEST_F(ThreadPoolTest, TestNumThreads) {
+  EXPECT_EQ(4, ThreadPool::num_threads());
+  ThreadPool::set_num_threads(1);
+  EXPECT_EQ(1, ThreadPool::num_threads());
+}
+
+TEST_F(ThreadPoolTest, TestRunsEachIndexOnce) {
+  const int sizes[] = {1, 5, 64, 1000, 12345};
+  for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    vector<int> counts(sizes[s], 0);
+    parallel_for(sizes[s], 7, boost::bind(&CountRange, &counts, _1, _2));
+    for (int i = 0; i < sizes[s]; ++i) {
+      EXPECT_EQ(1, counts[i]) << "n " << sizes[s] << " index " << i;
+    }
+  }
+}
+
+TEST_F(ThreadPoolTest, TestRepeatedLoops) {
+  vector<int> counts(1000, 0);
+  for (int iter = 0; iter < 100; ++iter) {
+    parallel_for(counts.size(), 1, boost::bind(&CountRange, &counts, _1, _2));
+  }
+  for (int i = 0; i < counts.size(); ++i) {
+    EXPECT_EQ(100, counts[i]);
+  }
+}
+
+TEST_F(ThreadPoolTest, TestNestedLoops) {
+  vector<vector<int> > counts(50, vector<int>(40, 0));
+  parallel_for(counts.size(), 1, boost::bind(&CountRows, &counts, _1, _2));
+  for (int i = 0; i < counts.size(); ++i) {
+    for (int j = 0; j < counts[i].size(); ++j) {
+      EXPECT_EQ(1, counts[i][j]);
+    }
+  }
+}
+
+TEST_F(ThreadPoolTest, TestSmallLoopRunsAsOneRange) {
+  vector<int> ranges;
+  parallel_for(10, 10, boost::bind(&RecordRange, &ranges, _1, _2));
+  ASSERT_EQ(2, ranges.size());
+  EXPECT_EQ(0, ranges[0]);
+  EXPECT_EQ(10, ranges[1]);
+  ranges.clear();
+  parallel_for(0, 1, boost::bind(&RecordRange, &ranges, _1, _2));
+  EXPECT_EQ(0, ranges.size());
+}
+
+TEST_F(ThreadPoolTest, TestStats) {
+  ThreadPool::ResetStats();
+  vector<int> counts(4096, 0);
+  for (int iter = 0; iter < 10; ++iter) {
+    parallel_for(counts.size(), 16, boost::bind(&CountRange, &counts, _1, _2));
+  }
+  const ThreadPool::Stats stats = ThreadPool::stats();
+  EXPECT_EQ(10, stats.parallel_loops);
+  EXPECT_EQ(0, stats.inline_loops);
+  EXPECT_GE(stats.ranges, 10 * 4096 / 16);
+  EXPECT_GE(stats.utilization(), 0);
+  EXPECT_LE(stats.utilization(), 1.01);
+  ThreadPool::ResetStats();
+  EXPECT_EQ(0, ThreadPool::stats().parallel_loops);
+}
+
+}  // namespace caffe
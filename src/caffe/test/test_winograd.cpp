@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/util/winograd.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class WinogradTest : public CPUDeviceTest<Dtype> {
+ protected:
+  WinogradTest() {
+    Caffe::set_random_seed(1701);
+  }
+
+  void Fill(Blob<Dtype>* blob) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob);
+  }
+
+  // Checks that the WINOGRAD engine computes the same outputs as the CAFFE
+  // engine, also once the weights change.
+  void CheckWinogradForward(LayerParameter layer_param,
+      const vector<int>& bottom_shape) {
+    Blob<Dtype> bottom(bottom_shape), top, winograd_top;
+    Fill(&bottom);
+    vector<Blob<Dtype>*> bottom_vec(1, &bottom);
+    vector<Blob<Dtype>*> top_vec(1, &top), winograd_top_vec(1, &winograd_top);
+    ConvolutionParameter* conv_param = layer_param.mutable_convolution_param();
+    conv_param->set_engine(ConvolutionParameter_Engine_CAFFE);
+    shared_ptr<Layer<Dtype> > layer =
+        LayerRegistry<Dtype>::CreateLayer(layer_param);
+    layer->SetUp(bottom_vec, top_vec);
+    conv_param->set_engine(ConvolutionParameter_Engine_WINOGRAD);
+    shared_ptr<Layer<Dtype> > winograd_layer =
+        LayerRegistry<Dtype>::CreateLayer(layer_param);
+    winograd_layer->SetUp(bottom_vec, winograd_top_vec);
+    ASSERT_TRUE(top.shape() == winograd_top.shape());
+    winograd_layer->blobs()[0]->ShareData(*layer->blobs()[0]);
+    winograd_layer->blobs()[1]->ShareData(*layer->blobs()[1]);
+    for (int i = 0; i < 2; ++i) {
+      if (i > 0) {
+        Fill(layer->blobs()[0].get());
+      }
+      layer->Forward(bottom_vec, top_vec);
+      winograd_layer->Forward(bottom_vec, winograd_top_vec);
+      for (int j = 0; j < top.count(); ++j) {
+        EXPECT_NEAR(top.cpu_data()[j], winograd_top.cpu_data()[j],
+            1e-3 * std::max(Dtype(1), std::fabs(top.cpu_data()[j])));
+      }
+    }
+  }
+
+  LayerParameter ConvolutionParam(const int pad, const int tile) {
+    LayerParameter layer_param;
+    layer_param.set_type("Convolution");
+    layer_param.set_phase(TEST);
+    ConvolutionParameter* conv_param = layer_param.mutable_convolution_param();
+    conv_param->add_kernel_size(3);
+    conv_param->add_pad(pad);
+    conv_param->set_num_output(7);
+    conv_param->set_winograd_tile(tile);
+    conv_param->mutable_weight_filler()->set_type("gaussian");
+    conv_param->mutable_bias_filler()->set_type("gaussian");
+    return layer_param;
+  }
+};
+
+TYPED_TEST_CASE(WinogradTest, TestDtypes);
+
+TYPED_TEST(WinogradTest, TestForward) {
+  // Odd sizes leave partial tiles at the bottom and right edges, and 17
+  // images of 130 channels make more 2 x 2 tiles than one chunk holds.
+  vector<int> bottom_shape(4);
+  bottom_shape[0] = 17;
+  bottom_shape[1] = 130;
+  bottom_shape[2] = 13;
+  bottom_shape[3] = 11;
+  for (int tile = 2; tile <= 4; tile += 2) {
+    for (int pad = 0; pad <= 1; ++pad) {
+      this->CheckWinogradForward(this->ConvolutionParam(pad, tile),
+          bottom_shape);
+    }
+  }
+}
+
+TYPED_TEST(WinogradTest, TestForwardFusedReLU) {
+  LayerParameter layer_param = this->ConvolutionParam(1, 0);
+  layer_param.mutable_convolution_param()->mutable_fused_activation()->
+      set_type(FusedActivationParameter_Type_RELU);
+  vector<int> bottom_shape(4);
+  bottom_shape[0] = 2;
+  bottom_shape[1] = 3;
+  bottom_shape[2] = 16;
+  bottom_shape[3] = 9;
+  this->CheckWinogradForward(layer_param, bottom_shape);
+}
+
+TYPED_TEST(WinogradTest, TestDefaultEngine) {
+  // DEFAULT only picks Winograd in the TEST phase, where it has SIMD
+  // transforms; either way, it computes the same outputs.
+  LayerParameter layer_param = this->ConvolutionParam(1, 0);
+  vector<int> bottom_shape(4);
+  bottom_shape[0] = 2;
+  bottom_shape[1] = 6;
+  bottom_shape[2] = 20;
+  bottom_shape[3] = 20;
+  Blob<TypeParam> bottom(bottom_shape), top, default_top;
+  this->Fill(&bottom);
+  vector<Blob<TypeParam>*> bottom_vec(1, &bottom);
+  vector<Blob<TypeParam>*> top_vec(1, &top), default_top_vec(1, &default_top);
+  layer_param.mutable_convolution_param()->set_engine(
+      ConvolutionParameter_Engine_CAFFE);
+  shared_ptr<Layer<TypeParam> > layer =
+      LayerRegistry<TypeParam>::CreateLayer(layer_param);
+  layer->SetUp(bottom_vec, top_vec);
+  layer_param.mutable_convolution_param()->set_engine(
+      ConvolutionParameter_Engine_DEFAULT);
+  shared_ptr<Layer<TypeParam> > default_layer =
+      LayerRegistry<TypeParam>::CreateLayer(layer_param);
+  default_layer->SetUp(bottom_vec, default_top_vec);
+  default_layer->blobs()[0]->ShareData(*layer->blobs()[0]);
+  default_layer->blobs()[1]->ShareData(*layer->blobs()[1]);
+  layer->Forward(bottom_vec, top_vec);
+  default_layer->Forward(bottom_vec, default_top_vec);
+  for (int i = 0; i < top.count(); ++i) {
+    EXPECT_NEAR(top.cpu_data()[i], default_top.cpu_data()[i],
+        1e-3 * std::max(TypeParam(1), std::fabs(top.cpu_data()[i])));
+  }
+}
+
+}  // namespace caffe
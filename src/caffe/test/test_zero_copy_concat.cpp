@@ -0,0 +1,248 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class ZeroCopyConcatTest : public CPUDeviceTest<Dtype> {
+ protected:
+  // Builds the net with and without zero-copy concat, with the same weights.
+  void InitNets(const string& proto, const Phase phase) {
+    NetParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+    param.mutable_state()->set_phase(phase);
+    Caffe::set_random_seed(1701);
+    net_.reset(new Net<Dtype>(param));
+    param.set_zero_copy_concat(true);
+    Caffe::set_random_seed(1701);
+    zero_copy_net_.reset(new Net<Dtype>(param));
+  }
+
+  // Runs both nets on the same input, and Backward too if backward, and
+  // expects every blob, and every param diff, to match.
+  void RunAndCompare(const bool backward) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    Blob<Dtype>* input = net_->blob_by_name("data").get();
+    Blob<Dtype>* zero_copy_input = zero_copy_net_->blob_by_name("data").get();
+    zero_copy_input->ReshapeLike(*input);
+    filler.Fill(input);
+    caffe_copy(input->count(), input->cpu_data(),
+        zero_copy_input->mutable_cpu_data());
+    net_->Forward();
+    zero_copy_net_->Forward();
+    if (backward) {
+      net_->ClearParamDiffs();
+      zero_copy_net_->ClearParamDiffs();
+      net_->Backward();
+      zero_copy_net_->Backward();
+    }
+    const vector<string>& names = net_->blob_names();
+    for (int i = 0; i < names.size(); ++i) {
+      const Blob<Dtype>& expected = *net_->blob_by_name(names[i]);
+      const Blob<Dtype>& actual = *zero_copy_net_->blob_by_name(names[i]);
+      ASSERT_TRUE(expected.shape() == actual.shape()) << names[i];
+      for (int j = 0; j < expected.count(); ++j) {
+        EXPECT_EQ(expected.cpu_data()[j], actual.cpu_data()[j]) << names[i];
+        // relu_b backpropagates in place through its part of the diff of
+        // the Concat top, which is otherwise not read any more.
+        if (backward && names[i] != "concat") {
+          EXPECT_EQ(expected.cpu_diff()[j], actual.cpu_diff()[j]) << names[i];
+        }
+      }
+    }
+    for (int i = 0; backward && i < net_->learnable_params().size(); ++i) {
+      const Blob<Dtype>& expected = *net_->learnable_params()[i];
+      const Blob<Dtype>& actual = *zero_copy_net_->learnable_params()[i];
+      for (int j = 0; j < expected.count(); ++j) {
+        EXPECT_EQ(expected.cpu_diff()[j], actual.cpu_diff()[j]);
+      }
+    }
+  }
+
+  // Returns whether the blob named bottom is held in the top of the Concat
+  // at the given offset.
+  bool IsInPlace(const string& bottom, const string& top, const int offset) {
+    const Blob<Dtype>& top_blob = *zero_copy_net_->blob_by_name(top);
+    return zero_copy_net_->blob_by_name(bottom)->cpu_data() ==
+        top_blob.cpu_data() + offset;
+  }
+
+  shared_ptr<Net<Dtype> > net_;
+  shared_ptr<Net<Dtype> > zero_copy_net_;
+};
+
+TYPED_TEST_CASE(ZeroCopyConcatTest, TestDtypes);
+
+// Three branches concatenated along the channels of a single image, and
+// trained through a loss.
+static const char* kChannelConcatNet =
+    "name: 'ConcatNet' "
+    "force_backward: true "
+    "layer { name: 'data' type: 'Input' top: 'data' "
+    "  input_param { shape { dim: 1 dim: 3 dim: 6 dim: 5 } } } "
+    "layer { name: 'conv_a' type: 'Convolution' bottom: 'data' "
+    "  top: 'conv_a' convolution_param { num_output: 4 kernel_size: 3 "
+    "    pad: 1 weight_filler { type: 'gaussian' } "
+    "    bias_filler { type: 'gaussian' } } } "
+    "layer { name: 'conv_b' type: 'Convolution' bottom: 'data' "
+    "  top: 'conv_b' convolution_param { num_output: 2 kernel_size: 1 "
+    "    weight_filler { type: 'gaussian' } "
+    "    bias_filler { type: 'gaussian' } } } "
+    "layer { name: 'relu_b' type: 'ReLU' bottom: 'conv_b' top: 'conv_b' } "
+    "layer { name: 'tanh_c' type: 'TanH' bottom: 'data' top: 'tanh_c' } "
+    "layer { name: 'concat' type: 'Concat' bottom: 'conv_a' "
+    "  bottom: 'conv_b' bottom: 'tanh_c' top: 'concat' } "
+    "layer { name: 'conv_d' type: 'Convolution' bottom: 'concat' "
+    "  top: 'conv_d' convolution_param { num_output: 3 kernel_size: 3 "
+    "    weight_filler { type: 'gaussian' } "
+    "    bias_filler { type: 'gaussian' } } } "
+    "layer { name: 'loss' type: 'Reduction' bottom: 'conv_d' top: 'loss' "
+    "  reduction_param { operation: SUMSQ } loss_weight: 1 } ";
+
+TYPED_TEST(ZeroCopyConcatTest, TestForwardBackward) {
+  this->InitNets(kChannelConcatNet, TRAIN);
+  this->RunAndCompare(true);
+  const int spatial = 6 * 5;
+  EXPECT_TRUE(this->IsInPlace("conv_a", "concat", 0));
+  EXPECT_TRUE(this->IsInPlace("conv_b", "concat", 4 * spatial));
+  EXPECT_TRUE(this->IsInPlace("tanh_c", "concat", 6 * spatial));
+  const Blob<TypeParam>& concat = *this->zero_copy_net_->blob_by_name("concat");
+  EXPECT_EQ(concat.cpu_diff() + 4 * spatial,
+      this->zero_copy_net_->blob_by_name("conv_b")->cpu_diff());
+  EXPECT_FALSE(this->net_->blob_by_name("conv_a")->cpu_data() ==
+      this->net_->blob_by_name("concat")->cpu_data());
+  // Again, now that everything is in place.
+  this->RunAndCompare(true);
+}
+
+TYPED_TEST(ZeroCopyConcatTest, TestReshape) {
+  this->InitNets(kChannelConcatNet, TRAIN);
+  // Two images interleave the branches, so they are copied.
+  vector<int> shape = this->net_->blob_by_name("data")->shape();
+  shape[0] = 2;
+  this->net_->blob_by_name("data")->Reshape(shape);
+  this->RunAndCompare(true);
+  EXPECT_FALSE(this->IsInPlace("conv_a", "concat", 0));
+  // Back to one, and larger, which moves the branches.
+  shape[0] = 1;
+  shape[2] = 8;
+  this->net_->blob_by_name("data")->Reshape(shape);
+  this->RunAndCompare(true);
+  EXPECT_TRUE(this->IsInPlace("conv_a", "concat", 0));
+  EXPECT_TRUE(this->IsInPlace("conv_b", "concat", 4 * 8 * 5));
+  this->RunAndCompare(true);
+}
+
+TYPED_TEST(ZeroCopyConcatTest, TestNumConcat) {
+  const string proto =
+      "name: 'NumConcatNet' "
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 4 dim: 4 } } } "
+      "layer { name: 'conv_a' type: 'Convolution' bottom: 'data' "
+      "  top: 'conv_a' convolution_param { num_output: 3 kernel_size: 1 "
+      "    weight_filler { type: 'gaussian' } } } "
+      "layer { name: 'sigmoid_b' type: 'Sigmoid' bottom: 'data' "
+      "  top: 'sigmoid_b' } "
+      "layer { name: 'concat' type: 'Concat' bottom: 'conv_a' "
+      "  bottom: 'sigmoid_b' top: 'concat' concat_param { axis: 0 } } ";
+  this->InitNets(proto, TEST);
+  this->RunAndCompare(false);
+  EXPECT_TRUE(this->IsInPlace("conv_a", "concat", 0));
+  EXPECT_TRUE(this->IsInPlace("sigmoid_b", "concat", 2 * 3 * 4 * 4));
+}
+
+TYPED_TEST(ZeroCopyConcatTest, TestSharedBlobsAreCopied) {
+  // concat_2 is modified in place, so its bottoms may not live in it; flat_b
+  // only views sigmoid_b, which is placed in concat_1 for it.
+  const string proto =
+      "name: 'SharedNet' "
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 1 dim: 3 dim: 4 dim: 4 } } } "
+      "layer { name: 'conv_a' type: 'Convolution' bottom: 'data' "
+      "  top: 'conv_a' convolution_param { num_output: 3 kernel_size: 1 "
+      "    weight_filler { type: 'gaussian' } } } "
+      "layer { name: 'sigmoid_b' type: 'Sigmoid' bottom: 'data' "
+      "  top: 'sigmoid_b' } "
+      "layer { name: 'flat_b' type: 'Reshape' bottom: 'sigmoid_b' "
+      "  top: 'flat_b' reshape_param { shape { dim: 1 dim: 3 dim: 4 "
+      "    dim: 4 } } } "
+      "layer { name: 'concat_1' type: 'Concat' bottom: 'conv_a' "
+      "  bottom: 'flat_b' top: 'concat_1' } "
+      "layer { name: 'tanh_c' type: 'TanH' bottom: 'data' top: 'tanh_c' } "
+      "layer { name: 'sigmoid_d' type: 'Sigmoid' bottom: 'data' "
+      "  top: 'sigmoid_d' } "
+      "layer { name: 'concat_2' type: 'Concat' bottom: 'tanh_c' "
+      "  bottom: 'sigmoid_d' top: 'concat_2' } "
+      "layer { name: 'relu_2' type: 'ReLU' bottom: 'concat_2' "
+      "  top: 'concat_2' } ";
+  this->InitNets(proto, TEST);
+  this->RunAndCompare(false);
+  EXPECT_TRUE(this->IsInPlace("conv_a", "concat_1", 0));
+  EXPECT_TRUE(this->IsInPlace("flat_b", "concat_1", 3 * 4 * 4));
+  EXPECT_TRUE(this->IsInPlace("sigmoid_b", "concat_1", 3 * 4 * 4));
+  EXPECT_FALSE(this->IsInPlace("tanh_c", "concat_2", 0));
+  EXPECT_FALSE(this->IsInPlace("sigmoid_d", "concat_2", 3 * 4 * 4));
+}
+
+TYPED_TEST(ZeroCopyConcatTest, TestPermuteFlattenConcat) {
+  // The heads of an SSD net: each branch is permuted channels-last and
+  // flattened, so the Permute tops are placed in the Concat top of an image.
+  const string proto =
+      "name: 'HeadsNet' "
+      "force_backward: true "
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 1 dim: 3 dim: 4 dim: 5 } } } "
+      "layer { name: 'conv_a' type: 'Convolution' bottom: 'data' "
+      "  top: 'conv_a' convolution_param { num_output: 4 kernel_size: 3 "
+      "    pad: 1 weight_filler { type: 'gaussian' } } } "
+      "layer { name: 'perm_a' type: 'Permute' bottom: 'conv_a' "
+      "  top: 'perm_a' permute_param { order: 0 order: 2 order: 3 "
+      "    order: 1 } } "
+      "layer { name: 'flat_a' type: 'Flatten' bottom: 'perm_a' "
+      "  top: 'flat_a' flatten_param { axis: 1 } } "
+      "layer { name: 'conv_b' type: 'Convolution' bottom: 'data' "
+      "  top: 'conv_b' convolution_param { num_output: 2 kernel_size: 1 "
+      "    weight_filler { type: 'gaussian' } } } "
+      "layer { name: 'perm_b' type: 'Permute' bottom: 'conv_b' "
+      "  top: 'perm_b' permute_param { order: 0 order: 2 order: 3 "
+      "    order: 1 } } "
+      "layer { name: 'flat_b' type: 'Flatten' bottom: 'perm_b' "
+      "  top: 'flat_b' flatten_param { axis: 1 } } "
+      "layer { name: 'concat' type: 'Concat' bottom: 'flat_a' "
+      "  bottom: 'flat_b' top: 'concat' } "
+      "layer { name: 'loss' type: 'Reduction' bottom: 'concat' top: 'loss' "
+      "  reduction_param { operation: SUMSQ } loss_weight: 1 } ";
+  this->InitNets(proto, TRAIN);
+  this->RunAndCompare(true);
+  const int count_a = 4 * 5 * 4;
+  EXPECT_TRUE(this->IsInPlace("perm_a", "concat", 0));
+  EXPECT_TRUE(this->IsInPlace("flat_a", "concat", 0));
+  EXPECT_TRUE(this->IsInPlace("perm_b", "concat", count_a));
+  EXPECT_TRUE(this->IsInPlace("flat_b", "concat", count_a));
+  const Blob<TypeParam>& concat = *this->zero_copy_net_->blob_by_name("concat");
+  EXPECT_EQ(concat.cpu_diff() + count_a,
+      this->zero_copy_net_->blob_by_name("perm_b")->cpu_diff());
+  // Again, now that everything is in place, and after moving the branches.
+  this->RunAndCompare(true);
+  vector<int> shape = this->net_->blob_by_name("data")->shape();
+  shape[2] = 6;
+  this->net_->blob_by_name("data")->Reshape(shape);
+  this->RunAndCompare(true);
+  EXPECT_TRUE(this->IsInPlace("perm_b", "concat", 6 * 5 * 4));
+  EXPECT_TRUE(this->IsInPlace("flat_b", "concat", 6 * 5 * 4));
+}
+
+}  // namespace caffe
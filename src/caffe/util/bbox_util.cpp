@@ -8,9 +8,11 @@
 #include <utility>
 #include <vector>
 
+#include "boost/bind.hpp"
 #include "boost/iterator/counting_iterator.hpp"
 #include "boost/typeof/typeof.hpp"
 #include "caffe/util/bbox_util.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -528,6 +530,19 @@ void DecodeBBox(
   }
 }
 
+// Decodes the boxes [begin, end) into decode_bboxes, already sized.
+static void DecodeBBoxRange(const vector<NormalizedBBox>& prior_bboxes,
+    const vector<vector<float> >& prior_variances,
+    const CodeType code_type, const bool variance_encoded_in_target,
+    const bool clip_bbox, const vector<NormalizedBBox>& bboxes,
+    vector<NormalizedBBox>* decode_bboxes, const int begin, const int end) {
+  for (int i = begin; i < end; ++i) {
+    DecodeBBox(prior_bboxes[i], prior_variances[i], code_type,
+               variance_encoded_in_target, clip_bbox, bboxes[i],
+               &(*decode_bboxes)[i]);
+  }
+}
+
 void DecodeBBoxes(
     const vector<NormalizedBBox>& prior_bboxes,
     const vector<vector<float> >& prior_variances,
@@ -541,12 +556,13 @@ void DecodeBBoxes(
     CHECK_EQ(prior_variances[0].size(), 4);
   }
   decode_bboxes->clear();
-  for (int i = 0; i < num_bboxes; ++i) {
-    NormalizedBBox decode_bbox;
-    DecodeBBox(prior_bboxes[i], prior_variances[i], code_type,
-               variance_encoded_in_target, clip_bbox, bboxes[i], &decode_bbox);
-    decode_bboxes->push_back(decode_bbox);
-  }
+  decode_bboxes->resize(num_bboxes);
+  // Boxes decode independently; the pool splits them among its threads.
+  parallel_for(num_bboxes, parallel_grain(64),
+      boost::bind(&DecodeBBoxRange, boost::cref(prior_bboxes),
+                  boost::cref(prior_variances), code_type,
+                  variance_encoded_in_target, clip_bbox, boost::cref(bboxes),
+                  decode_bboxes, _1, _2));
 }
 
 void DecodeBBoxesAll(const vector<LabelBBox>& all_loc_preds,
@@ -4,6 +4,7 @@
 #include "caffe/data_reader.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/parallel.hpp"
+#include "caffe/snapshot_writer.hpp"
 #include "caffe/util/blocking_queue.hpp"
 
 namespace caffe {
@@ -95,5 +96,8 @@ template class BlockingQueue<
   shared_ptr<DataReader<AnnotatedDatum>::QueuePair> >;
 template class BlockingQueue<P2PSync<float>*>;
 template class BlockingQueue<P2PSync<double>*>;
+template class BlockingQueue<Snapshot*>;
+template class BlockingQueue<Blob<float>*>;
+template class BlockingQueue<Blob<double>*>;
 
 }  // namespace caffe
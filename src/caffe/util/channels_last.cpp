@@ -0,0 +1,37 @@
+#include <algorithm>
+
+#include "caffe/util/channels_last.hpp"
+
+namespace caffe {
+
+// Transposes in square blocks that fit in L1, so that neither the reads nor
+// the writes stride through memory a value at a time.
+const int kTransposeBlock = 32;
+
+template <typename Dtype>
+void caffe_cpu_batched_transpose(const int num, const int rows,
+    const int cols, const Dtype* src, Dtype* dst) {
+  for (int n = 0; n < num; ++n) {
+    for (int r0 = 0; r0 < rows; r0 += kTransposeBlock) {
+      const int r1 = std::min(r0 + kTransposeBlock, rows);
+      for (int c0 = 0; c0 < cols; c0 += kTransposeBlock) {
+        const int c1 = std::min(c0 + kTransposeBlock, cols);
+        for (int r = r0; r < r1; ++r) {
+          const Dtype* src_row = src + r * cols;
+          for (int c = c0; c < c1; ++c) {
+            dst[c * rows + r] = src_row[c];
+          }
+        }
+      }
+    }
+    src += rows * cols;
+    dst += rows * cols;
+  }
+}
+
+template void caffe_cpu_batched_transpose<float>(const int num,
+    const int rows, const int cols, const float* src, float* dst);
+template void caffe_cpu_batched_transpose<double>(const int num,
+    const int rows, const int cols, const double* src, double* dst);
+
+}  // namespace caffe
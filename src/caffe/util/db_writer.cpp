@@ -0,0 +1,155 @@
+#include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "caffe/util/db_writer.hpp"
+
+namespace caffe { namespace db {
+
+// How many items, per worker, the workers may get ahead of the writer.
+static const int kItemsAheadPerWorker = 8;
+
+// Hands out items to the workers, and their records back to the writer in
+// item order. The records wait in a ring of slots indexed by item.
+class RecordPipeline {
+ public:
+  RecordPipeline(const int num_items, const RecordMaker& make_record,
+      const int window)
+      : num_items_(num_items), make_record_(make_record), window_(window),
+        slots_(window), next_item_(0), next_write_(0) {}
+
+  void WorkerEntry() {
+    while (true) {
+      boost::mutex::scoped_lock lock(mutex_);
+      while (next_item_ < num_items_ &&
+          next_item_ >= next_write_ + window_) {
+        space_.wait(lock);
+      }
+      if (next_item_ >= num_items_) {
+        return;
+      }
+      const int item = next_item_++;
+      lock.unlock();
+      // The slot is this worker's until it is marked done.
+      Slot& slot = slots_[item % window_];
+      slot.ok = make_record_(item, &slot.key, &slot.value);
+      lock.lock();
+      slot.done = true;
+      lock.unlock();
+      ready_.notify_all();
+    }
+  }
+
+  // Waits for the record of the next item in order and takes it; returns
+  // false if the item is left out.
+  bool Take(string* key, string* value) {
+    boost::mutex::scoped_lock lock(mutex_);
+    Slot& slot = slots_[next_write_ % window_];
+    while (!slot.done) {
+      ready_.wait(lock);
+    }
+    const bool ok = slot.ok;
+    key->swap(slot.key);
+    value->swap(slot.value);
+    slot.done = false;
+    ++next_write_;
+    lock.unlock();
+    space_.notify_all();
+    return ok;
+  }
+
+ private:
+  struct Slot {
+    Slot() : done(false), ok(false) {}
+    bool done;
+    bool ok;
+    string key;
+    string value;
+  };
+
+  const int num_items_;
+  const RecordMaker& make_record_;
+  const int window_;
+  vector<Slot> slots_;
+  int next_item_;
+  int next_write_;
+  boost::mutex mutex_;
+  boost::condition_variable ready_;
+  boost::condition_variable space_;
+
+  DISABLE_COPY_AND_ASSIGN(RecordPipeline);
+};
+
+static void LogProgress(const int records, const int64_t bytes,
+    const boost::posix_time::ptime& start) {
+  const float seconds = std::max(1e-3f, 1e-6f *
+      (boost::posix_time::microsec_clock::local_time() - start)
+          .total_microseconds());
+  LOG(INFO) << "Processed " << records << " files, "
+      << records / seconds << " files/s, "
+      << bytes / 1e6 / seconds << " MB/s.";
+}
+
+int WriteRecords(DB* db, const int num_items, const RecordMaker& make_record,
+    const int num_workers, const int64_t commit_bytes, const int log_every) {
+  CHECK_GT(num_workers, 0) << "WriteRecords needs a worker.";
+  CHECK_GT(log_every, 0);
+  const boost::posix_time::ptime start =
+      boost::posix_time::microsec_clock::local_time();
+  RecordPipeline pipeline(num_items, make_record,
+      kItemsAheadPerWorker * num_workers);
+  boost::thread_group workers;
+  for (int i = 0; i < num_workers; ++i) {
+    workers.create_thread(
+        boost::bind(&RecordPipeline::WorkerEntry, &pipeline));
+  }
+  shared_ptr<Transaction> txn(db->NewTransaction());
+  int records = 0;
+  int64_t bytes = 0;
+  int64_t txn_bytes = 0;
+  string key, value;
+  for (int item = 0; item < num_items; ++item) {
+    if (!pipeline.Take(&key, &value)) {
+      continue;
+    }
+    txn->Put(key, value);
+    txn_bytes += key.size() + value.size();
+    bytes += key.size() + value.size();
+    if (txn_bytes >= commit_bytes) {
+      txn->Commit();
+      txn.reset(db->NewTransaction());
+      txn_bytes = 0;
+    }
+    if (++records % log_every == 0) {
+      LogProgress(records, bytes, start);
+    }
+  }
+  workers.join_all();
+  // Write the last batch.
+  if (txn_bytes > 0) {
+    txn->Commit();
+  }
+  if (records % log_every != 0) {
+    LogProgress(records, bytes, start);
+  }
+  return records;
+}
+
+SizeCheck::SizeCheck() : mutex_(new boost::mutex()), data_size_(-1) {}
+
+void SizeCheck::Check(const Datum& datum) {
+  boost::mutex::scoped_lock lock(*mutex_);
+  if (data_size_ < 0) {
+    data_size_ = datum.channels() * datum.height() * datum.width();
+  } else {
+    const string& data = datum.data();
+    CHECK_EQ(data.size(), data_size_) << "Incorrect data field size "
+        << data.size();
+  }
+}
+
+}  // namespace db
+}  // namespace caffe
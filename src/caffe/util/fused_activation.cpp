@@ -0,0 +1,51 @@
+#include <algorithm>
+
+#include "caffe/common.hpp"
+#include "caffe/util/fused_activation.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void fused_activation_cpu(const FusedActivationParameter& param,
+    const int outer_num, const int channels, const int inner_num,
+    const Dtype* bias, const Dtype* slopes, Dtype* data) {
+  // Each outer_num x channel row has a constant bias and negative slope;
+  // with no activation, the negative slope of 1 leaves the values as they
+  // are.
+  switch (param.type()) {
+  case FusedActivationParameter_Type_NONE:
+  case FusedActivationParameter_Type_RELU:
+    break;
+  case FusedActivationParameter_Type_PRELU:
+    CHECK(slopes) << "PReLU activation needs slopes";
+    break;
+  default:
+    LOG(FATAL) << "Unknown fused activation type: " << param.type();
+  }
+  for (int i = 0; i < outer_num * channels; ++i) {
+    const int c = i % channels;
+    const Dtype row_bias = bias ? bias[c] : Dtype(0);
+    Dtype slope = Dtype(1);
+    if (param.type() == FusedActivationParameter_Type_RELU) {
+      slope = param.negative_slope();
+    } else if (param.type() == FusedActivationParameter_Type_PRELU) {
+      slope = slopes[param.channel_shared() ? 0 : c];
+    }
+    Dtype* row = data + i * inner_num;
+    for (int j = 0; j < inner_num; ++j) {
+      const Dtype value = row[j] + row_bias;
+      row[j] = std::max(value, Dtype(0)) + slope * std::min(value, Dtype(0));
+    }
+  }
+}
+
+template void fused_activation_cpu<float>(
+    const FusedActivationParameter& param, const int outer_num,
+    const int channels, const int inner_num, const float* bias,
+    const float* slopes, float* data);
+template void fused_activation_cpu<double>(
+    const FusedActivationParameter& param, const int outer_num,
+    const int channels, const int inner_num, const double* bias,
+    const double* slopes, double* data);
+
+}  // namespace caffe
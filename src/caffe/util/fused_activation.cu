@@ -0,0 +1,62 @@
+#include <algorithm>
+
+#include "caffe/common.hpp"
+#include "caffe/util/fused_activation.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+__global__ void FusedReLUKernel(const int n, const Dtype negative_slope,
+    Dtype* data) {
+  CUDA_KERNEL_LOOP(index, n) {
+    data[index] = data[index] > 0 ? data[index] : data[index] * negative_slope;
+  }
+}
+
+template <typename Dtype>
+__global__ void FusedPReLUKernel(const int n, const int channels,
+    const int inner_num, const int div_factor, const Dtype* slopes,
+    Dtype* data) {
+  CUDA_KERNEL_LOOP(index, n) {
+    const int c = (index / inner_num) % channels / div_factor;
+    data[index] = data[index] > 0 ? data[index] : data[index] * slopes[c];
+  }
+}
+
+template <typename Dtype>
+void fused_activation_gpu(const FusedActivationParameter& param,
+    const int outer_num, const int channels, const int inner_num,
+    const Dtype* slopes, Dtype* data) {
+  const int count = outer_num * channels * inner_num;
+  switch (param.type()) {
+  case FusedActivationParameter_Type_NONE:
+    break;
+  case FusedActivationParameter_Type_RELU:
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    FusedReLUKernel<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
+        count, Dtype(param.negative_slope()), data);
+    CUDA_POST_KERNEL_CHECK;
+    break;
+  case FusedActivationParameter_Type_PRELU:
+    CHECK(slopes) << "PReLU activation needs slopes";
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    FusedPReLUKernel<Dtype><<<CAFFE_GET_BLOCKS(count),
+        CAFFE_CUDA_NUM_THREADS>>>(count, channels, inner_num,
+        param.channel_shared() ? channels : 1, slopes, data);
+    CUDA_POST_KERNEL_CHECK;
+    break;
+  default:
+    LOG(FATAL) << "Unknown fused activation type: " << param.type();
+  }
+}
+
+template void fused_activation_gpu<float>(
+    const FusedActivationParameter& param, const int outer_num,
+    const int channels, const int inner_num, const float* slopes,
+    float* data);
+template void fused_activation_gpu<double>(
+    const FusedActivationParameter& param, const int outer_num,
+    const int channels, const int inner_num, const double* slopes,
+    double* data);
+
+}  // namespace caffe
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "caffe/util/im2col.hpp"
@@ -16,22 +17,22 @@ inline bool is_a_ge_zero_and_a_lt_b(int a, int b) {
 }
 
 template <typename Dtype>
-void im2col_cpu(const Dtype* data_im, const int channels,
+void im2col_rows_cpu(const Dtype* data_im, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
     const int pad_h, const int pad_w,
     const int stride_h, const int stride_w,
     const int dilation_h, const int dilation_w,
+    const int first_row, const int num_rows,
     Dtype* data_col) {
-  const int output_h = (height + 2 * pad_h -
-    (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
   const int output_w = (width + 2 * pad_w -
     (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
   const int channel_size = height * width;
   for (int channel = channels; channel--; data_im += channel_size) {
     for (int kernel_row = 0; kernel_row < kernel_h; kernel_row++) {
       for (int kernel_col = 0; kernel_col < kernel_w; kernel_col++) {
-        int input_row = -pad_h + kernel_row * dilation_h;
-        for (int output_rows = output_h; output_rows; output_rows--) {
+        int input_row = -pad_h + kernel_row * dilation_h +
+            first_row * stride_h;
+        for (int output_rows = num_rows; output_rows; output_rows--) {
           if (!is_a_ge_zero_and_a_lt_b(input_row, height)) {
             for (int output_cols = output_w; output_cols; output_cols--) {
               *(data_col++) = 0;
@@ -54,6 +55,82 @@ void im2col_cpu(const Dtype* data_im, const int channels,
   }
 }
 
+// Explicit instantiation
+template void im2col_rows_cpu<float>(const float* data_im,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, const int first_row, const int num_rows,
+    float* data_col);
+template void im2col_rows_cpu<double>(const double* data_im,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, const int first_row, const int num_rows,
+    double* data_col);
+
+template <typename Dtype>
+void im2col_nhwc_rows_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w,
+    const int first_row, const int num_rows,
+    Dtype* data_col) {
+  const int output_w = (width + 2 * pad_w -
+    (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
+  for (int output_row = first_row; output_row < first_row + num_rows;
+      ++output_row) {
+    for (int output_col = 0; output_col < output_w; ++output_col) {
+      for (int kernel_row = 0; kernel_row < kernel_h; kernel_row++) {
+        const int input_row = -pad_h + kernel_row * dilation_h +
+            output_row * stride_h;
+        for (int kernel_col = 0; kernel_col < kernel_w; kernel_col++) {
+          const int input_col = -pad_w + kernel_col * dilation_w +
+              output_col * stride_w;
+          if (is_a_ge_zero_and_a_lt_b(input_row, height) &&
+              is_a_ge_zero_and_a_lt_b(input_col, width)) {
+            const Dtype* pixel =
+                data_im + (input_row * width + input_col) * channels;
+            std::copy(pixel, pixel + channels, data_col);
+          } else {
+            std::fill(data_col, data_col + channels, Dtype(0));
+          }
+          data_col += channels;
+        }
+      }
+    }
+  }
+}
+
+// Explicit instantiation
+template void im2col_nhwc_rows_cpu<float>(const float* data_im,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, const int first_row, const int num_rows,
+    float* data_col);
+template void im2col_nhwc_rows_cpu<double>(const double* data_im,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, const int first_row, const int num_rows,
+    double* data_col);
+
+template <typename Dtype>
+void im2col_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w,
+    Dtype* data_col) {
+  const int output_h = (height + 2 * pad_h -
+    (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
+  im2col_rows_cpu(data_im, channels, height, width, kernel_h, kernel_w,
+      pad_h, pad_w, stride_h, stride_w, dilation_h, dilation_w, 0, output_h,
+      data_col);
+}
+
 // Explicit instantiation
 template void im2col_cpu<float>(const float* data_im, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
@@ -160,23 +237,22 @@ template void im2col_nd_cpu<double>(const double* data_im,
     const int* dilation, double* data_col);
 
 template <typename Dtype>
-void col2im_cpu(const Dtype* data_col, const int channels,
+void col2im_rows_cpu(const Dtype* data_col, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
     const int pad_h, const int pad_w,
     const int stride_h, const int stride_w,
     const int dilation_h, const int dilation_w,
+    const int first_row, const int num_rows,
     Dtype* data_im) {
-  caffe_set(height * width * channels, Dtype(0), data_im);
-  const int output_h = (height + 2 * pad_h -
-    (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
   const int output_w = (width + 2 * pad_w -
     (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
   const int channel_size = height * width;
   for (int channel = channels; channel--; data_im += channel_size) {
     for (int kernel_row = 0; kernel_row < kernel_h; kernel_row++) {
       for (int kernel_col = 0; kernel_col < kernel_w; kernel_col++) {
-        int input_row = -pad_h + kernel_row * dilation_h;
-        for (int output_rows = output_h; output_rows; output_rows--) {
+        int input_row = -pad_h + kernel_row * dilation_h +
+            first_row * stride_h;
+        for (int output_rows = num_rows; output_rows; output_rows--) {
           if (!is_a_ge_zero_and_a_lt_b(input_row, height)) {
             data_col += output_w;
           } else {
@@ -196,6 +272,35 @@ void col2im_cpu(const Dtype* data_col, const int channels,
   }
 }
 
+// Explicit instantiation
+template void col2im_rows_cpu<float>(const float* data_col,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, const int first_row, const int num_rows,
+    float* data_im);
+template void col2im_rows_cpu<double>(const double* data_col,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, const int first_row, const int num_rows,
+    double* data_im);
+
+template <typename Dtype>
+void col2im_cpu(const Dtype* data_col, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w,
+    Dtype* data_im) {
+  caffe_set(height * width * channels, Dtype(0), data_im);
+  const int output_h = (height + 2 * pad_h -
+    (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
+  col2im_rows_cpu(data_col, channels, height, width, kernel_h, kernel_w,
+      pad_h, pad_w, stride_h, stride_w, dilation_h, dilation_w, 0, output_h,
+      data_im);
+}
+
 // Explicit instantiation
 template void col2im_cpu<float>(const float* data_col, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
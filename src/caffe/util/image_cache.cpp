@@ -0,0 +1,90 @@
+#ifdef USE_OPENCV
+#include <boost/thread.hpp>
+#include <opencv2/core/core.hpp>
+
+#include <sstream>
+#include <string>
+
+#include "caffe/util/image_cache.hpp"
+
+namespace caffe {
+
+ImageCache::ImageCache(const size_t capacity)
+    : capacity_(capacity), bytes_(0), hits_(0), misses_(0),
+      mutex_(new boost::mutex()) {}
+
+bool ImageCache::Lookup(const string& key, cv::Mat* image) {
+  boost::mutex::scoped_lock lock(*mutex_);
+  std::map<string, Entry>::iterator it = entries_.find(key);
+  if (it == entries_.end()) {
+    ++misses_;
+    return false;
+  }
+  ++hits_;
+  recency_.splice(recency_.begin(), recency_, it->second.recency);
+  *image = it->second.image;
+  return true;
+}
+
+void ImageCache::Insert(const string& key, const cv::Mat& image) {
+  const size_t image_bytes = image.total() * image.elemSize();
+  if (image_bytes > capacity_) {
+    return;
+  }
+  boost::mutex::scoped_lock lock(*mutex_);
+  // Another thread may have missed on the same key and cached it first.
+  if (entries_.count(key)) {
+    return;
+  }
+  while (bytes_ + image_bytes > capacity_) {
+    std::map<string, Entry>::iterator lru = entries_.find(recency_.back());
+    bytes_ -= lru->second.bytes;
+    entries_.erase(lru);
+    recency_.pop_back();
+  }
+  recency_.push_front(key);
+  Entry& entry = entries_[key];
+  entry.image = image;
+  entry.bytes = image_bytes;
+  entry.recency = recency_.begin();
+  bytes_ += image_bytes;
+}
+
+size_t ImageCache::bytes() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return bytes_;
+}
+
+size_t ImageCache::size() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return entries_.size();
+}
+
+int64_t ImageCache::hits() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return hits_;
+}
+
+int64_t ImageCache::misses() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  return misses_;
+}
+
+float ImageCache::hit_rate() const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  const int64_t lookups = hits_ + misses_;
+  return lookups ? static_cast<float>(hits_) / lookups : 0;
+}
+
+string ImageCache::Summary() const {
+  const float rate = hit_rate();
+  boost::mutex::scoped_lock lock(*mutex_);
+  std::ostringstream summary;
+  summary << "Image cache: " << entries_.size() << " images, "
+      << bytes_ / 1e6 << " of " << capacity_ / 1e6 << " MB, hit rate "
+      << 100 * rate << "% of " << hits_ + misses_ << " lookups.";
+  return summary.str();
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV
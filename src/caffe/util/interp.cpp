@@ -2,23 +2,21 @@
 
 #include "caffe/common.hpp"
 #include "caffe/util/interp.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include <algorithm>
 #include <cmath>
 
 namespace caffe {
 
-// Bi-linear interpolation
-// IN : [channels height1 width1] cropped from a bigger [Height1 Width1] image
-// OUT: [channels height2 width2] cropped from a bigger [Height2 Width2] image
+// Bi-linear interpolation of the output rows [h2_begin, h2_end)
 template <typename Dtype, bool packed>
-void caffe_cpu_interp2(const int channels,
+static void caffe_cpu_interp2_rows(const int channels,
     const Dtype *data1, const int x1, const int y1, const int height1, const int width1, const int Height1, const int Width1,
-    Dtype *data2, const int x2, const int y2, const int height2, const int width2, const int Height2, const int Width2) {
-  CHECK(x1 >= 0 && y1 >= 0 && height1 > 0 && width1 > 0 && x2 >= 0 && y2 >= 0 && height2 > 0 && width2 > 0);
-  CHECK(Width1 >= width1 + x1 && Height1 >= height1 + y1 && Width2 >= width2 + x2 && Height2 >= height2 + y2);
+    Dtype *data2, const int x2, const int y2, const int height2, const int width2, const int Height2, const int Width2,
+    const int h2_begin, const int h2_end) {
   // special case: just copy
   if (height1 == height2 && width1 == width2) {
-    for (int h2 = 0; h2 < height2; ++h2) {
+    for (int h2 = h2_begin; h2 < h2_end; ++h2) {
       const int h1 = h2;
       for (int w2 = 0; w2 < width2; ++w2) {
 	const int w1 = w2;
@@ -46,7 +44,7 @@ void caffe_cpu_interp2(const int channels,
   }
   const float rheight = (height2 > 1) ? static_cast<float>(height1 - 1) / (height2 - 1) : 0.f;
   const float rwidth = (width2 > 1) ? static_cast<float>(width1 - 1) / (width2 - 1) : 0.f;
-  for (int h2 = 0; h2 < height2; ++h2) {
+  for (int h2 = h2_begin; h2 < h2_end; ++h2) {
     const float h1r = rheight * h2;
     const int h1 = h1r;
     const int h1p = (h1 < height1 - 1) ? 1 : 0;
@@ -84,6 +82,41 @@ void caffe_cpu_interp2(const int channels,
   }
 }
 
+// The rows of an interpolation, as the body of a parallel_for
+template <typename Dtype, bool packed>
+struct Interp2Rows {
+  Interp2Rows(const int channels,
+      const Dtype *data1, const int x1, const int y1, const int height1, const int width1, const int Height1, const int Width1,
+      Dtype *data2, const int x2, const int y2, const int height2, const int width2, const int Height2, const int Width2)
+      : channels(channels), data1(data1), x1(x1), y1(y1), height1(height1), width1(width1), Height1(Height1), Width1(Width1),
+        data2(data2), x2(x2), y2(y2), height2(height2), width2(width2), Height2(Height2), Width2(Width2) {}
+  void operator()(const int begin, const int end) const {
+    caffe_cpu_interp2_rows<Dtype,packed>(channels,
+        data1, x1, y1, height1, width1, Height1, Width1,
+        data2, x2, y2, height2, width2, Height2, Width2, begin, end);
+  }
+  const int channels;
+  const Dtype *data1;
+  const int x1, y1, height1, width1, Height1, Width1;
+  Dtype *data2;
+  const int x2, y2, height2, width2, Height2, Width2;
+};
+
+// Bi-linear interpolation
+// IN : [channels height1 width1] cropped from a bigger [Height1 Width1] image
+// OUT: [channels height2 width2] cropped from a bigger [Height2 Width2] image
+// The output rows are split among the threads of the ThreadPool.
+template <typename Dtype, bool packed>
+void caffe_cpu_interp2(const int channels,
+    const Dtype *data1, const int x1, const int y1, const int height1, const int width1, const int Height1, const int Width1,
+    Dtype *data2, const int x2, const int y2, const int height2, const int width2, const int Height2, const int Width2) {
+  CHECK(x1 >= 0 && y1 >= 0 && height1 > 0 && width1 > 0 && x2 >= 0 && y2 >= 0 && height2 > 0 && width2 > 0);
+  CHECK(Width1 >= width1 + x1 && Height1 >= height1 + y1 && Width2 >= width2 + x2 && Height2 >= height2 + y2);
+  parallel_for(height2, parallel_grain(4 * width2 * channels),
+      Interp2Rows<Dtype,packed>(channels,
+          data1, x1, y1, height1, width1, Height1, Width1,
+          data2, x2, y2, height2, width2, Height2, Width2));
+}
 
 // Backward (adjoint) operation 1 <- 2 (accumulates)
 template <typename Dtype, bool packed>
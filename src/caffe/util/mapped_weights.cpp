@@ -0,0 +1,157 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "caffe/util/mapped_weights.hpp"
+
+namespace caffe {
+
+static const char kMappedWeightsMagic[8] =
+    {'C', 'A', 'F', 'F', 'E', 'M', 'A', 'P'};
+static const uint32_t kMappedWeightsVersion = 1;
+
+struct MappedWeightsHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t index_offset;
+  uint64_t index_size;
+};
+
+// Rounds offset up to the next multiple of kArenaAlignment.
+static uint64_t AlignOffset(uint64_t offset) {
+  return (offset + kArenaAlignment - 1) / kArenaAlignment * kArenaAlignment;
+}
+
+bool MappedWeights::IsMappedWeightsFile(const string& filename) {
+  char magic[sizeof(kMappedWeightsMagic)];
+  std::ifstream input(filename.c_str(), std::ios::in | std::ios::binary);
+  return input.read(magic, sizeof(magic)) &&
+      memcmp(magic, kMappedWeightsMagic, sizeof(magic)) == 0;
+}
+
+MappedWeights::MappedWeights(const string& filename)
+    : filename_(filename), map_(NULL), size_(0) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << filename;
+  struct stat file_stat;
+  CHECK_EQ(fstat(fd, &file_stat), 0) << "Couldn't stat " << filename;
+  size_ = file_stat.st_size;
+  CHECK_GE(size_, sizeof(MappedWeightsHeader))
+      << filename << " is not a mapped weight file";
+  map_ = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  CHECK(map_ != MAP_FAILED) << "Couldn't map " << filename;
+  const MappedWeightsHeader* header =
+      static_cast<const MappedWeightsHeader*>(map_);
+  CHECK_EQ(memcmp(header->magic, kMappedWeightsMagic,
+      sizeof(kMappedWeightsMagic)), 0)
+      << filename << " is not a mapped weight file";
+  CHECK_EQ(header->version, kMappedWeightsVersion)
+      << "Unsupported mapped weight file version in " << filename;
+  const uint64_t index_offset = header->index_offset;
+  CHECK_LE(index_offset + header->index_size, size_)
+      << filename << " is truncated";
+  CHECK(index_.ParseFromArray(static_cast<const char*>(map_) + index_offset,
+      header->index_size)) << "Couldn't parse the index of " << filename;
+  for (int i = 0; i < index_.layer_size(); ++i) {
+    for (int j = 0; j < index_.layer(i).blob_size(); ++j) {
+      const MappedBlob& blob = index_.layer(i).blob(j);
+      uint64_t count = 1;
+      for (int k = 0; k < blob.shape().dim_size(); ++k) {
+        count *= blob.shape().dim(k);
+      }
+      const uint64_t bytes =
+          count * (blob.double_data() ? sizeof(double) : sizeof(float));
+      CHECK_EQ(blob.offset() % kArenaAlignment, 0)
+          << "Misaligned blob in " << filename;
+      CHECK_LE(blob.offset() + bytes, index_offset)
+          << filename << " is truncated";
+    }
+  }
+}
+
+MappedWeights::~MappedWeights() {
+  if (map_ != NULL && map_ != MAP_FAILED) {
+    munmap(map_, size_);
+  }
+}
+
+void WriteMappedWeights(const NetParameter& param, const string& filename) {
+  std::ofstream output(filename.c_str(),
+      std::ios::out | std::ios::trunc | std::ios::binary);
+  CHECK(output.good()) << "Couldn't open " << filename;
+  // The header is written last, once the index offset is known.
+  const vector<char> padding(kArenaAlignment, 0);
+  uint64_t offset = AlignOffset(sizeof(MappedWeightsHeader));
+  output.write(&padding[0], offset);
+  MappedWeightsIndex index;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer = param.layer(i);
+    if (layer.blobs_size() == 0) { continue; }
+    MappedLayer* mapped_layer = index.add_layer();
+    mapped_layer->set_name(layer.name());
+    for (int j = 0; j < layer.blobs_size(); ++j) {
+      const BlobProto& blob = layer.blobs(j);
+      MappedBlob* mapped_blob = mapped_layer->add_blob();
+      if (blob.has_num() || blob.has_channels() ||
+          blob.has_height() || blob.has_width()) {
+        // Legacy 4D blob dimensions, as in Blob::FromProto.
+        mapped_blob->mutable_shape()->add_dim(blob.num());
+        mapped_blob->mutable_shape()->add_dim(blob.channels());
+        mapped_blob->mutable_shape()->add_dim(blob.height());
+        mapped_blob->mutable_shape()->add_dim(blob.width());
+        mapped_blob->set_legacy_shape(true);
+      } else {
+        mapped_blob->mutable_shape()->CopyFrom(blob.shape());
+      }
+      uint64_t count = 1;
+      for (int k = 0; k < mapped_blob->shape().dim_size(); ++k) {
+        count *= mapped_blob->shape().dim(k);
+      }
+      const bool double_data = blob.double_data_size() > 0;
+      const uint64_t data_size =
+          double_data ? blob.double_data_size() : blob.data_size();
+      CHECK_EQ(data_size, count) << "Blob " << j << " of layer " << layer.name()
+          << " does not hold as many values as its shape.";
+      mapped_blob->set_double_data(double_data);
+      mapped_blob->set_offset(offset);
+      uint64_t bytes;
+      if (double_data) {
+        bytes = blob.double_data_size() * sizeof(double);
+        output.write(reinterpret_cast<const char*>(blob.double_data().data()),
+            bytes);
+      } else {
+        bytes = blob.data_size() * sizeof(float);
+        output.write(reinterpret_cast<const char*>(blob.data().data()), bytes);
+      }
+      const uint64_t next_offset = AlignOffset(offset + bytes);
+      output.write(&padding[0], next_offset - offset - bytes);
+      offset = next_offset;
+    }
+  }
+  string serialized_index;
+  CHECK(index.SerializeToString(&serialized_index));
+  output.write(serialized_index.data(), serialized_index.size());
+  MappedWeightsHeader header;
+  std::copy(kMappedWeightsMagic,
+      kMappedWeightsMagic + sizeof(kMappedWeightsMagic), header.magic);
+  header.version = kMappedWeightsVersion;
+  header.reserved = 0;
+  header.index_offset = offset;
+  header.index_size = serialized_index.size();
+  output.seekp(0);
+  output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  output.close();
+  CHECK(!output.fail()) << "Error writing mapped weights to " << filename;
+}
+
+}  // namespace caffe
@@ -1,11 +1,13 @@
 #include <boost/math/special_functions/next.hpp>
 #include <boost/random.hpp>
 
+#include <cmath>
 #include <limits>
 
 #include "caffe/common.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/simd_math.hpp"
 
 namespace caffe {
 
@@ -31,6 +33,24 @@ void caffe_cpu_gemm<double>(const CBLAS_TRANSPOSE TransA,
       ldb, beta, C, N);
 }
 
+template<>
+void caffe_cpu_gemm<float>(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const float alpha, const float* A, const int lda, const float* B,
+    const int ldb, const float beta, float* C, const int ldc) {
+  cblas_sgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
+      ldb, beta, C, ldc);
+}
+
+template<>
+void caffe_cpu_gemm<double>(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const double alpha, const double* A, const int lda, const double* B,
+    const int ldb, const double beta, double* C, const int ldc) {
+  cblas_dgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
+      ldb, beta, C, ldc);
+}
+
 template <>
 void caffe_cpu_gemv<float>(const CBLAS_TRANSPOSE TransA, const int M,
     const int N, const float alpha, const float* A, const float* x,
@@ -178,7 +198,11 @@ void caffe_div<double>(const int n, const double* a, const double* b,
 template <>
 void caffe_powx<float>(const int n, const float* a, const float b,
     float* y) {
+#ifdef USE_MKL
   vsPowx(n, a, b, y);
+#else
+  caffe_simd_powx(n, a, b, y);
+#endif
 }
 
 template <>
@@ -199,7 +223,11 @@ void caffe_sqr<double>(const int n, const double* a, double* y) {
 
 template <>
 void caffe_exp<float>(const int n, const float* a, float* y) {
+#ifdef USE_MKL
   vsExp(n, a, y);
+#else
+  caffe_simd_exp(n, a, y);
+#endif
 }
 
 template <>
@@ -209,7 +237,11 @@ void caffe_exp<double>(const int n, const double* a, double* y) {
 
 template <>
 void caffe_log<float>(const int n, const float* a, float* y) {
+#ifdef USE_MKL
   vsLn(n, a, y);
+#else
+  caffe_simd_log(n, a, y);
+#endif
 }
 
 template <>
@@ -217,6 +249,30 @@ void caffe_log<double>(const int n, const double* a, double* y) {
   vdLn(n, a, y);
 }
 
+template <>
+void caffe_tanh<float>(const int n, const float* a, float* y) {
+  caffe_simd_tanh(n, a, y);
+}
+
+template <>
+void caffe_tanh<double>(const int n, const double* a, double* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = std::tanh(a[i]);
+  }
+}
+
+template <>
+void caffe_sigmoid<float>(const int n, const float* a, float* y) {
+  caffe_simd_sigmoid(n, a, y);
+}
+
+template <>
+void caffe_sigmoid<double>(const int n, const double* a, double* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = 1. / (1. + std::exp(-a[i]));
+  }
+}
+
 template <>
 void caffe_abs<float>(const int n, const float* a, float* y) {
     vsAbs(n, a, y);
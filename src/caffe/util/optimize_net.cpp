@@ -0,0 +1,216 @@
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "caffe/util/optimize_net.hpp"
+
+namespace caffe {
+
+// Returns the values of a blob, whether stored as floats or doubles.
+static vector<double> BlobValues(const BlobProto& blob) {
+  if (blob.double_data_size() > 0) {
+    return vector<double>(blob.double_data().begin(),
+        blob.double_data().end());
+  }
+  return vector<double>(blob.data().begin(), blob.data().end());
+}
+
+// Replaces the values of a blob, stored as doubles or floats.
+static void SetBlobValues(const vector<double>& values, bool double_data,
+    BlobProto* blob) {
+  blob->clear_data();
+  blob->clear_double_data();
+  for (int i = 0; i < values.size(); ++i) {
+    if (double_data) {
+      blob->add_double_data(values[i]);
+    } else {
+      blob->add_data(values[i]);
+    }
+  }
+}
+
+// Whether the blobs of layer hold one value per channel, for channels, along
+// axis 1.
+static bool HasChannelBlob(const LayerParameter& layer, int blob_id,
+    int channels) {
+  return layer.blobs_size() > blob_id &&
+      BlobValues(layer.blobs(blob_id)).size() == channels;
+}
+
+// Whether layer is a Convolution or InnerProduct layer that can absorb the
+// layers that follow it.
+static bool IsFoldTarget(const LayerParameter& layer) {
+  if (layer.bottom_size() != 1 || layer.top_size() != 1) { return false; }
+  // Weights shared with other layers can't change.
+  for (int i = 0; i < layer.param_size(); ++i) {
+    if (layer.param(i).name().size() > 0) { return false; }
+  }
+  if (layer.type() == "Convolution") {
+    const ConvolutionParameter& conv_param = layer.convolution_param();
+    return conv_param.axis() == 1 &&
+        !conv_param.has_fused_activation() &&
+        layer.blobs_size() == 1 + conv_param.bias_term();
+  } else if (layer.type() == "InnerProduct") {
+    const InnerProductParameter& ip_param = layer.inner_product_param();
+    return ip_param.axis() == 1 &&
+        !ip_param.has_fused_activation() &&
+        layer.blobs_size() == 1 + ip_param.bias_term();
+  }
+  return false;
+}
+
+// Whether layer computes a per-channel affine function or activation of
+// blob, with the trained weights needed to fold it.
+static bool IsFoldable(const LayerParameter& layer, const string& blob,
+    int channels) {
+  if (layer.bottom_size() != 1 || layer.top_size() != 1 ||
+      layer.bottom(0) != blob) {
+    return false;
+  }
+  if (layer.type() == "BatchNorm") {
+    const BatchNormParameter& bn_param = layer.batch_norm_param();
+    return (!bn_param.has_use_global_stats() || bn_param.use_global_stats())
+        && HasChannelBlob(layer, 0, channels)
+        && HasChannelBlob(layer, 1, channels)
+        && HasChannelBlob(layer, 2, 1);
+  } else if (layer.type() == "Scale") {
+    const ScaleParameter& scale_param = layer.scale_param();
+    return scale_param.axis() == 1 && scale_param.num_axes() == 1
+        && layer.blobs_size() == 1 + scale_param.bias_term()
+        && HasChannelBlob(layer, 0, channels)
+        && (!scale_param.bias_term() || HasChannelBlob(layer, 1, channels));
+  } else if (layer.type() == "Bias") {
+    const BiasParameter& bias_param = layer.bias_param();
+    return bias_param.axis() == 1 && bias_param.num_axes() == 1
+        && layer.blobs_size() == 1 && HasChannelBlob(layer, 0, channels);
+  } else if (layer.type() == "ReLU") {
+    return true;
+  } else if (layer.type() == "PReLU") {
+    return layer.blobs_size() == 1 && HasChannelBlob(layer, 0,
+        layer.prelu_param().channel_shared() ? 1 : channels);
+  }
+  return false;
+}
+
+// Computes y = scale * x + shift, per output channel, in the weights and
+// bias of target.
+static void FoldAffine(const vector<double>& scale,
+    const vector<double>& shift, LayerParameter* target) {
+  const int channels = scale.size();
+  const bool transpose = target->type() == "InnerProduct" &&
+      target->inner_product_param().transpose();
+  const bool double_data = target->blobs(0).double_data_size() > 0;
+  vector<double> weights = BlobValues(target->blobs(0));
+  const int dim = weights.size() / channels;
+  for (int i = 0; i < weights.size(); ++i) {
+    // Transposed InnerProduct weights are K x N rather than N x K.
+    weights[i] *= scale[transpose ? i % channels : i / dim];
+  }
+  SetBlobValues(weights, double_data, target->mutable_blobs(0));
+  if (target->blobs_size() == 1) {
+    // Add a zero bias to fold the shift into.
+    BlobProto* bias_blob = target->add_blobs();
+    bias_blob->mutable_shape()->add_dim(channels);
+    SetBlobValues(vector<double>(channels, 0), double_data, bias_blob);
+    if (target->type() == "Convolution") {
+      target->mutable_convolution_param()->set_bias_term(true);
+    } else {
+      target->mutable_inner_product_param()->set_bias_term(true);
+    }
+  }
+  vector<double> bias = BlobValues(target->blobs(1));
+  for (int c = 0; c < channels; ++c) {
+    bias[c] = bias[c] * scale[c] + shift[c];
+  }
+  SetBlobValues(bias, double_data, target->mutable_blobs(1));
+}
+
+// Folds layer into target, which has the given number of output channels.
+static void Fold(const LayerParameter& layer, int channels,
+    LayerParameter* target) {
+  vector<double> scale(channels, 1), shift(channels, 0);
+  if (layer.type() == "BatchNorm") {
+    // As in BatchNormLayer::Forward_cpu with global statistics.
+    const double scale_factor = BlobValues(layer.blobs(2))[0] == 0 ?
+        0 : 1 / BlobValues(layer.blobs(2))[0];
+    const vector<double> mean = BlobValues(layer.blobs(0));
+    const vector<double> variance = BlobValues(layer.blobs(1));
+    const double eps = layer.batch_norm_param().eps();
+    for (int c = 0; c < channels; ++c) {
+      scale[c] = 1 / std::sqrt(variance[c] * scale_factor + eps);
+      shift[c] = -mean[c] * scale_factor * scale[c];
+    }
+  } else if (layer.type() == "Scale") {
+    scale = BlobValues(layer.blobs(0));
+    if (layer.scale_param().bias_term()) {
+      shift = BlobValues(layer.blobs(1));
+    }
+  } else if (layer.type() == "Bias") {
+    shift = BlobValues(layer.blobs(0));
+  } else {
+    FusedActivationParameter* activation = target->type() == "Convolution" ?
+        target->mutable_convolution_param()->mutable_fused_activation() :
+        target->mutable_inner_product_param()->mutable_fused_activation();
+    if (layer.type() == "ReLU") {
+      activation->set_type(FusedActivationParameter_Type_RELU);
+      activation->set_negative_slope(layer.relu_param().negative_slope());
+    } else {
+      activation->set_type(FusedActivationParameter_Type_PRELU);
+      activation->set_channel_shared(layer.prelu_param().channel_shared());
+      target->add_blobs()->CopyFrom(layer.blobs(0));
+    }
+    return;
+  }
+  FoldAffine(scale, shift, target);
+}
+
+// Returns the index of the first layer from start on reading blob, or -1.
+static int NextReader(const NetParameter& param, int start,
+    const string& blob) {
+  for (int i = start; i < param.layer_size(); ++i) {
+    for (int j = 0; j < param.layer(i).bottom_size(); ++j) {
+      if (param.layer(i).bottom(j) == blob) { return i; }
+    }
+  }
+  return -1;
+}
+
+void OptimizeNetForInference(const NetParameter& param,
+    NetParameter* param_optimized, vector<string>* removed_layers) {
+  param_optimized->CopyFrom(param);
+  param_optimized->clear_layer();
+  vector<bool> removed(param.layer_size(), false);
+  for (int i = 0; i < param.layer_size(); ++i) {
+    if (removed[i]) { continue; }
+    LayerParameter* layer = param_optimized->add_layer();
+    layer->CopyFrom(param.layer(i));
+    if (!IsFoldTarget(*layer)) { continue; }
+    const int channels = layer->type() == "Convolution" ?
+        layer->convolution_param().num_output() :
+        layer->inner_product_param().num_output();
+    int last = i;
+    while (true) {
+      const string& top = layer->top(0);
+      const int next = NextReader(param, last + 1, top);
+      if (next < 0 || !IsFoldable(param.layer(next), top, channels)) {
+        break;
+      }
+      const LayerParameter& next_layer = param.layer(next);
+      const bool in_place = next_layer.top(0) == top;
+      if (!in_place && NextReader(param, next + 1, top) >= 0) { break; }
+      Fold(next_layer, channels, layer);
+      removed[next] = true;
+      removed_layers->push_back(next_layer.name());
+      if (!in_place) {
+        layer->set_top(0, next_layer.top(0));
+      }
+      last = next;
+      // Nothing folds through an activation.
+      if (next_layer.type() == "ReLU" || next_layer.type() == "PReLU") {
+        break;
+      }
+    }
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,288 @@
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define USE_AVX512_SGEMM
+#endif
+
+#include <boost/thread.hpp>
+#include <algorithm>
+
+#include "caffe/util/packed_gemm.hpp"
+
+namespace caffe {
+
+// Packed A holds panels of up to kPanelRows rows, each column major: value
+// (i, k) of the panel from row m is at m * K + k * rows + i. Packed B holds
+// panels of kPanelCols columns, zero-padded, each row major: value (k, j) of
+// the panel from column n is at n * K + k * kPanelCols + j.
+const int kPanelRows = 8;
+const int kPanelCols = 32;
+// The kernels go over K in blocks of kBlockK, so that a block of a panel of
+// B stays in L1 while it is multiplied by every row.
+const int kBlockK = 256;
+
+#ifdef USE_AVX512_SGEMM
+static bool cpu_has_avx512f() {
+  static const bool has_avx512f = __builtin_cpu_supports("avx512f");
+  return has_avx512f;
+}
+
+// Computes MR rows by up to 32 columns of C, held in two vectors of 16
+// accumulators per row, over kc values of K: row i of A has its values
+// a_cs apart, and the rows are a_rs apart. C is added to, rather than
+// overwritten, if accumulate.
+template <int MR>
+__attribute__((target("avx512f")))
+static void sgemm_avx512_block(const int kc, const float* a, const int a_rs,
+    const int a_cs, const float* b, const int ldb, const int nr, float* c,
+    const int ldc, const bool accumulate) {
+  const __mmask16 mask0 = nr >= 16 ? 0xFFFF : (1 << nr) - 1;
+  const __mmask16 mask1 = nr >= 32 ? 0xFFFF :
+      nr > 16 ? (1 << (nr - 16)) - 1 : 0;
+  __m512 acc[MR][2];
+#pragma GCC unroll 8
+  for (int i = 0; i < MR; ++i) {
+    if (accumulate) {
+      acc[i][0] = _mm512_maskz_loadu_ps(mask0, c + i * ldc);
+      acc[i][1] = _mm512_maskz_loadu_ps(mask1, c + i * ldc + 16);
+    } else {
+      acc[i][0] = _mm512_setzero_ps();
+      acc[i][1] = _mm512_setzero_ps();
+    }
+  }
+  for (int k = 0; k < kc; ++k) {
+    const __m512 b0 = _mm512_maskz_loadu_ps(mask0, b + k * ldb);
+    const __m512 b1 = _mm512_maskz_loadu_ps(mask1, b + k * ldb + 16);
+#pragma GCC unroll 8
+    for (int i = 0; i < MR; ++i) {
+      const __m512 a_ik = _mm512_set1_ps(a[i * a_rs + k * a_cs]);
+      acc[i][0] = _mm512_fmadd_ps(a_ik, b0, acc[i][0]);
+      acc[i][1] = _mm512_fmadd_ps(a_ik, b1, acc[i][1]);
+    }
+  }
+#pragma GCC unroll 8
+  for (int i = 0; i < MR; ++i) {
+    _mm512_mask_storeu_ps(c + i * ldc, mask0, acc[i][0]);
+    _mm512_mask_storeu_ps(c + i * ldc + 16, mask1, acc[i][1]);
+  }
+}
+
+// Computes any number of rows, in blocks of 8, then 4, 2 and 1.
+__attribute__((target("avx512f")))
+static void sgemm_avx512_rows(const int rows, const int kc, const float* a,
+    const int a_rs, const int a_cs, const float* b, const int ldb,
+    const int nr, float* c, const int ldc, const bool accumulate) {
+  int i = 0;
+  for (; i + 8 <= rows; i += 8) {
+    sgemm_avx512_block<8>(kc, a + i * a_rs, a_rs, a_cs, b, ldb, nr,
+        c + i * ldc, ldc, accumulate);
+  }
+  if (rows - i >= 4) {
+    sgemm_avx512_block<4>(kc, a + i * a_rs, a_rs, a_cs, b, ldb, nr,
+        c + i * ldc, ldc, accumulate);
+    i += 4;
+  }
+  if (rows - i >= 2) {
+    sgemm_avx512_block<2>(kc, a + i * a_rs, a_rs, a_cs, b, ldb, nr,
+        c + i * ldc, ldc, accumulate);
+    i += 2;
+  }
+  if (rows - i >= 1) {
+    sgemm_avx512_block<1>(kc, a + i * a_rs, a_rs, a_cs, b, ldb, nr,
+        c + i * ldc, ldc, accumulate);
+  }
+}
+
+static void gemm_packed_a_avx512(const int M, const int N, const int K,
+    const float* packed_a, const float* B, float* C, const int ldc) {
+  for (int k0 = 0; k0 < K; k0 += kBlockK) {
+    const int kc = std::min(kBlockK, K - k0);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int n = 0; n < N; n += kPanelCols) {
+      const int nr = std::min(kPanelCols, N - n);
+      for (int m = 0; m < M; m += kPanelRows) {
+        const int mr = std::min(kPanelRows, M - m);
+        sgemm_avx512_rows(mr, kc, packed_a + m * K + k0 * mr, 1, mr,
+            B + k0 * N + n, N, nr, C + m * ldc + n, ldc, k0 > 0);
+      }
+    }
+  }
+}
+
+static void gemm_packed_b_avx512(const int M, const int N, const int K,
+    const float* A, const float* packed_b, float* C) {
+  for (int k0 = 0; k0 < K; k0 += kBlockK) {
+    const int kc = std::min(kBlockK, K - k0);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (int n = 0; n < N; n += kPanelCols) {
+      sgemm_avx512_rows(M, kc, A + k0, K, 1,
+          packed_b + n * K + k0 * kPanelCols, kPanelCols,
+          std::min(kPanelCols, N - n), C + n, N, k0 > 0);
+    }
+  }
+}
+#endif  // USE_AVX512_SGEMM
+
+// Only float has vectorized kernels; these return false when there is none
+// for the Dtype or the CPU.
+template <typename Dtype>
+static bool gemm_packed_a_simd(const int M, const int N, const int K,
+    const Dtype* packed_a, const Dtype* B, Dtype* C, const int ldc) {
+  return false;
+}
+
+static bool gemm_packed_a_simd(const int M, const int N, const int K,
+    const float* packed_a, const float* B, float* C, const int ldc) {
+#ifdef USE_AVX512_SGEMM
+  if (cpu_has_avx512f()) {
+    gemm_packed_a_avx512(M, N, K, packed_a, B, C, ldc);
+    return true;
+  }
+#endif
+  return false;
+}
+
+template <typename Dtype>
+static bool gemm_packed_b_simd(const int M, const int N, const int K,
+    const Dtype* A, const Dtype* packed_b, Dtype* C) {
+  return false;
+}
+
+static bool gemm_packed_b_simd(const int M, const int N, const int K,
+    const float* A, const float* packed_b, float* C) {
+#ifdef USE_AVX512_SGEMM
+  if (cpu_has_avx512f()) {
+    gemm_packed_b_avx512(M, N, K, A, packed_b, C);
+    return true;
+  }
+#endif
+  return false;
+}
+
+template <>
+bool caffe_cpu_packed_gemm_supported<float>() {
+#ifdef USE_AVX512_SGEMM
+  return cpu_has_avx512f();
+#else
+  return false;
+#endif
+}
+
+template <>
+bool caffe_cpu_packed_gemm_supported<double>() {
+  return false;
+}
+
+template <typename Dtype>
+void caffe_cpu_pack_a(const int M, const int K, const Dtype* A,
+    Dtype* packed) {
+  for (int m = 0; m < M; m += kPanelRows) {
+    const int mr = std::min(kPanelRows, M - m);
+    Dtype* panel = packed + m * K;
+    for (int k = 0; k < K; ++k) {
+      for (int i = 0; i < mr; ++i) {
+        panel[k * mr + i] = A[(m + i) * K + k];
+      }
+    }
+  }
+}
+
+template void caffe_cpu_pack_a<float>(const int M, const int K,
+    const float* A, float* packed);
+template void caffe_cpu_pack_a<double>(const int M, const int K,
+    const double* A, double* packed);
+
+template <typename Dtype>
+void caffe_cpu_gemm_packed_a(const int M, const int N, const int K,
+    const Dtype* packed_a, const Dtype* B, Dtype* C, const int ldc) {
+  if (gemm_packed_a_simd(M, N, K, packed_a, B, C, ldc)) { return; }
+  for (int m = 0; m < M; m += kPanelRows) {
+    const int mr = std::min(kPanelRows, M - m);
+    const Dtype* panel = packed_a + m * K;
+    for (int i = 0; i < mr; ++i) {
+      Dtype* c = C + (m + i) * ldc;
+      std::fill(c, c + N, Dtype(0));
+      for (int k = 0; k < K; ++k) {
+        const Dtype a_ik = panel[k * mr + i];
+        for (int n = 0; n < N; ++n) {
+          c[n] += a_ik * B[k * N + n];
+        }
+      }
+    }
+  }
+}
+
+template void caffe_cpu_gemm_packed_a<float>(const int M, const int N,
+    const int K, const float* packed_a, const float* B, float* C,
+    const int ldc);
+template void caffe_cpu_gemm_packed_a<double>(const int M, const int N,
+    const int K, const double* packed_a, const double* B, double* C,
+    const int ldc);
+
+int caffe_cpu_packed_b_size(const int K, const int N) {
+  return (N + kPanelCols - 1) / kPanelCols * kPanelCols * K;
+}
+
+template <typename Dtype>
+void caffe_cpu_pack_b(const CBLAS_TRANSPOSE TransB, const int K, const int N,
+    const Dtype* B, Dtype* packed) {
+  for (int n = 0; n < N; n += kPanelCols) {
+    const int nr = std::min(kPanelCols, N - n);
+    Dtype* panel = packed + n * K;
+    for (int k = 0; k < K; ++k) {
+      for (int j = 0; j < nr; ++j) {
+        panel[k * kPanelCols + j] = TransB == CblasNoTrans ?
+            B[k * N + n + j] : B[(n + j) * K + k];
+      }
+      std::fill(panel + k * kPanelCols + nr, panel + (k + 1) * kPanelCols,
+          Dtype(0));
+    }
+  }
+}
+
+template void caffe_cpu_pack_b<float>(const CBLAS_TRANSPOSE TransB,
+    const int K, const int N, const float* B, float* packed);
+template void caffe_cpu_pack_b<double>(const CBLAS_TRANSPOSE TransB,
+    const int K, const int N, const double* B, double* packed);
+
+template <typename Dtype>
+void caffe_cpu_gemm_packed_b(const int M, const int N, const int K,
+    const Dtype* A, const Dtype* packed_b, Dtype* C) {
+  if (gemm_packed_b_simd(M, N, K, A, packed_b, C)) { return; }
+  for (int m = 0; m < M; ++m) {
+    for (int n = 0; n < N; ++n) {
+      const Dtype* panel =
+          packed_b + n / kPanelCols * kPanelCols * K + n % kPanelCols;
+      Dtype sum = 0;
+      for (int k = 0; k < K; ++k) {
+        sum += A[m * K + k] * panel[k * kPanelCols];
+      }
+      C[m * N + n] = sum;
+    }
+  }
+}
+
+template void caffe_cpu_gemm_packed_b<float>(const int M, const int N,
+    const int K, const float* A, const float* packed_b, float* C);
+template void caffe_cpu_gemm_packed_b<double>(const int M, const int N,
+    const int K, const double* A, const double* packed_b, double* C);
+
+class WeightMutex::sync {
+ public:
+  boost::mutex mutex_;
+};
+
+WeightMutex::WeightMutex() : sync_(new sync()) {}
+
+void WeightMutex::lock() {
+  sync_->mutex_.lock();
+}
+
+void WeightMutex::unlock() {
+  sync_->mutex_.unlock();
+}
+
+}  // namespace caffe
@@ -0,0 +1,482 @@
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define USE_X86_INT8
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/util/io.hpp"
+#include "caffe/util/quantize.hpp"
+
+namespace caffe {
+
+// Rounds x / scale, given as x * inv_scale, to the nearest int8 value. As
+// in the vectorized paths, ties follow the current rounding mode: to even by
+// default.
+template <typename Dtype>
+static inline int8_t quantize_value(const Dtype x, const Dtype inv_scale) {
+  const Dtype v = std::min(std::max(x * inv_scale, Dtype(-kInt8Max)),
+      Dtype(kInt8Max));
+  return static_cast<int8_t>(std::nearbyint(v));
+}
+
+// The packed B operand stores int8 values offset by 128.
+static inline uint8_t to_packed(const int8_t q) {
+  return static_cast<uint8_t>(q + 128);
+}
+
+#ifdef USE_X86_INT8
+static bool cpu_has_avx2() {
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  return has_avx2;
+}
+
+static bool cpu_has_avx512bw() {
+  static const bool has_avx512bw = __builtin_cpu_supports("avx512f") &&
+      __builtin_cpu_supports("avx512bw");
+  return has_avx512bw;
+}
+
+static bool cpu_has_vnni() {
+  static const bool has_vnni = cpu_has_avx512bw() &&
+      __builtin_cpu_supports("avx512vnni");
+  return has_vnni;
+}
+
+// The largest magnitude of x, 16 values at a time.
+__attribute__((target("avx512f")))
+static float amax_avx512(const int n, const float* x) {
+  __m512 max_abs = _mm512_setzero_ps();
+  for (int i = 0; i < n; i += 16) {
+    const __mmask16 mask = n - i >= 16 ? 0xFFFF : (1 << (n - i)) - 1;
+    max_abs = _mm512_max_ps(max_abs,
+        _mm512_abs_ps(_mm512_maskz_loadu_ps(mask, x + i)));
+  }
+  return _mm512_reduce_max_ps(max_abs);
+}
+
+// Quantizes x 16 values at a time.
+__attribute__((target("avx512f")))
+static void quantize_avx512(const int n, const float scale, const float* x,
+    int8_t* q) {
+  const __m512 inv_scale = _mm512_set1_ps(1 / scale);
+  const __m512i lower = _mm512_set1_epi32(-kInt8Max);
+  const __m512i upper = _mm512_set1_epi32(kInt8Max);
+  for (int i = 0; i < n; i += 16) {
+    const __mmask16 mask = n - i >= 16 ? 0xFFFF : (1 << (n - i)) - 1;
+    const __m512 v = _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, x + i),
+        inv_scale);
+    const __m512i v_int = _mm512_min_epi32(_mm512_max_epi32(
+        _mm512_cvtps_epi32(v), lower), upper);
+    _mm512_mask_cvtepi32_storeu_epi8(q + i, mask, v_int);
+  }
+}
+
+// Quantizes and packs x 16 columns at a time: the 4 rows of each group are
+// quantized to 4 x 16 bytes, then interleaved so that each column's 4 bytes
+// are consecutive.
+__attribute__((target("avx512f,avx512bw")))
+static void quantize_pack_avx512(const int K, const int N, const float scale,
+    const float* x, uint8_t* q) {
+  const __m512 inv_scale = _mm512_set1_ps(1 / scale);
+  const __m512i lower = _mm512_set1_epi32(-kInt8Max);
+  const __m512i upper = _mm512_set1_epi32(kInt8Max);
+  const __m128i offset = _mm_set1_epi8(static_cast<char>(0x80));
+  for (int k = 0; k < K; k += 4) {
+    for (int n = 0; n < N; n += 16) {
+      const __mmask16 mask = N - n >= 16 ? 0xFFFF : (1 << (N - n)) - 1;
+      __m128i rows[4];
+      for (int j = 0; j < 4; ++j) {
+        __m128i row = _mm_setzero_si128();
+        if (k + j < K) {
+          const __m512 v = _mm512_mul_ps(
+              _mm512_maskz_loadu_ps(mask, x + (k + j) * N + n), inv_scale);
+          const __m512i v_int = _mm512_min_epi32(_mm512_max_epi32(
+              _mm512_cvtps_epi32(v), lower), upper);
+          row = _mm512_cvtepi32_epi8(v_int);
+        }
+        rows[j] = _mm_xor_si128(row, offset);
+      }
+      const __m128i rows01_lo = _mm_unpacklo_epi8(rows[0], rows[1]);
+      const __m128i rows01_hi = _mm_unpackhi_epi8(rows[0], rows[1]);
+      const __m128i rows23_lo = _mm_unpacklo_epi8(rows[2], rows[3]);
+      const __m128i rows23_hi = _mm_unpackhi_epi8(rows[2], rows[3]);
+      __m512i packed = _mm512_castsi128_si512(
+          _mm_unpacklo_epi16(rows01_lo, rows23_lo));
+      packed = _mm512_inserti32x4(packed,
+          _mm_unpackhi_epi16(rows01_lo, rows23_lo), 1);
+      packed = _mm512_inserti32x4(packed,
+          _mm_unpacklo_epi16(rows01_hi, rows23_hi), 2);
+      packed = _mm512_inserti32x4(packed,
+          _mm_unpackhi_epi16(rows01_hi, rows23_hi), 3);
+      _mm512_mask_storeu_epi32(q + (k * N + n * 4), mask, packed);
+    }
+  }
+}
+
+// Computes MR rows by up to 32 columns of C, from column n, with the
+// columns held in two vectors of 16 int32 accumulators per row. comp holds
+// the correction for the offset of B for each row.
+template <int MR>
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static void gemm_s8_vnni_block(const int N, const int K, const int8_t* A,
+    const uint8_t* B, const int32_t* comp, const int n, int32_t* C) {
+  const int lda = int8_gemm_k(K);
+  const __mmask16 mask0 = N - n >= 16 ? 0xFFFF : (1 << (N - n)) - 1;
+  const __mmask16 mask1 = N - n >= 32 ? 0xFFFF :
+      N - n > 16 ? (1 << (N - n - 16)) - 1 : 0;
+  // The loops over MR are unrolled to keep the accumulators in registers.
+  __m512i acc[MR][2];
+#pragma GCC unroll 8
+  for (int i = 0; i < MR; ++i) {
+    acc[i][0] = _mm512_set1_epi32(-comp[i]);
+    acc[i][1] = acc[i][0];
+  }
+  for (int k = 0; k < lda; k += 4) {
+    const uint8_t* b = B + k * N + n * 4;
+    const __m512i b0 = _mm512_maskz_loadu_epi32(mask0, b);
+    const __m512i b1 = _mm512_maskz_loadu_epi32(mask1, b + 64);
+#pragma GCC unroll 8
+    for (int i = 0; i < MR; ++i) {
+      const __m512i a = _mm512_broadcastd_epi32(
+          _mm_loadu_si32(A + i * lda + k));
+      acc[i][0] = _mm512_dpbusd_epi32(acc[i][0], b0, a);
+      acc[i][1] = _mm512_dpbusd_epi32(acc[i][1], b1, a);
+    }
+  }
+#pragma GCC unroll 8
+  for (int i = 0; i < MR; ++i) {
+    _mm512_mask_storeu_epi32(C + i * N + n, mask0, acc[i][0]);
+    _mm512_mask_storeu_epi32(C + i * N + n + 16, mask1, acc[i][1]);
+  }
+}
+
+static void gemm_s8_vnni(const int M, const int N, const int K,
+    const int8_t* A, const uint8_t* B, const int32_t* comp, int32_t* C) {
+  const int lda = int8_gemm_k(K);
+  // Each panel of 32 columns of B stays in cache while all of A passes.
+  for (int n = 0; n < N; n += 32) {
+    int m = 0;
+    for (; m + 8 <= M; m += 8) {
+      gemm_s8_vnni_block<8>(N, K, A + m * lda, B, comp + m, n, C + m * N);
+    }
+    for (; m < M; ++m) {
+      gemm_s8_vnni_block<1>(N, K, A + m * lda, B, comp + m, n, C + m * N);
+    }
+  }
+}
+
+// Computes MR rows by 8 columns of C, from column n. vpmaddubsw would
+// saturate its int16 sums of B, up to 255, times A, so both are widened to
+// int16 and multiplied with vpmaddwd, which sums pairs exactly into int32.
+// Each accumulator holds 4 columns, as 2 partial sums each.
+template <int MR>
+__attribute__((target("avx2")))
+static void gemm_s8_avx2_block(const int N, const int K, const int8_t* A,
+    const uint8_t* B, const int32_t* comp, const int n, int32_t* C) {
+  const int lda = int8_gemm_k(K);
+  __m256i acc[MR][2];
+#pragma GCC unroll 4
+  for (int i = 0; i < MR; ++i) {
+    acc[i][0] = _mm256_setzero_si256();
+    acc[i][1] = acc[i][0];
+  }
+  for (int k = 0; k < lda; k += 4) {
+    const uint8_t* b = B + k * N + n * 4;
+    const __m256i b0 = _mm256_cvtepu8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(b)));
+    const __m256i b1 = _mm256_cvtepu8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + 16)));
+#pragma GCC unroll 4
+    for (int i = 0; i < MR; ++i) {
+      const __m256i a = _mm256_broadcastq_epi64(
+          _mm_cvtepi8_epi16(_mm_loadu_si32(A + i * lda + k)));
+      acc[i][0] = _mm256_add_epi32(acc[i][0], _mm256_madd_epi16(a, b0));
+      acc[i][1] = _mm256_add_epi32(acc[i][1], _mm256_madd_epi16(a, b1));
+    }
+  }
+#pragma GCC unroll 4
+  for (int i = 0; i < MR; ++i) {
+    // The pair sums come out as columns 0 1 4 5 | 2 3 6 7.
+    const __m256i sums = _mm256_permute4x64_epi64(
+        _mm256_hadd_epi32(acc[i][0], acc[i][1]), 0xD8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(C + i * N + n),
+        _mm256_sub_epi32(sums, _mm256_set1_epi32(comp[i])));
+  }
+}
+
+// Computes the columns of C in whole groups of 8, and returns how many.
+static int gemm_s8_avx2(const int M, const int N, const int K,
+    const int8_t* A, const uint8_t* B, const int32_t* comp, int32_t* C) {
+  const int lda = int8_gemm_k(K);
+  const int n_end = N / 8 * 8;
+  // Each panel of 8 columns of B stays in cache while all of A passes.
+  for (int n = 0; n < n_end; n += 8) {
+    int m = 0;
+    for (; m + 4 <= M; m += 4) {
+      gemm_s8_avx2_block<4>(N, K, A + m * lda, B, comp + m, n, C + m * N);
+    }
+    for (; m < M; ++m) {
+      gemm_s8_avx2_block<1>(N, K, A + m * lda, B, comp + m, n, C + m * N);
+    }
+  }
+  return n_end;
+}
+#endif  // USE_X86_INT8
+
+// Computes the columns [n_begin, N) of C.
+static void gemm_s8_scalar(const int M, const int N, const int K,
+    const int8_t* A, const uint8_t* B, const int32_t* comp, const int n_begin,
+    int32_t* C) {
+  const int lda = int8_gemm_k(K);
+  for (int m = 0; m < M; ++m) {
+    const int8_t* a = A + m * lda;
+    int32_t* c = C + m * N;
+    for (int n = n_begin; n < N; ++n) {
+      c[n] = -comp[m];
+    }
+    for (int k = 0; k < lda; k += 4) {
+      const int32_t a0 = a[k], a1 = a[k + 1], a2 = a[k + 2], a3 = a[k + 3];
+      const uint8_t* b = B + k * N;
+      for (int n = n_begin; n < N; ++n) {
+        c[n] += a0 * b[n * 4] + a1 * b[n * 4 + 1] + a2 * b[n * 4 + 2]
+            + a3 * b[n * 4 + 3];
+      }
+    }
+  }
+}
+
+// The fastest kernel caffe_cpu_gemm_s8 may use.
+static Int8GemmKernel gemm_s8_kernel_limit = INT8_GEMM_VNNI;
+
+Int8GemmKernel caffe_cpu_gemm_s8_kernel() {
+  Int8GemmKernel kernel = INT8_GEMM_SCALAR;
+#ifdef USE_X86_INT8
+  if (cpu_has_vnni()) {
+    kernel = INT8_GEMM_VNNI;
+  } else if (cpu_has_avx2()) {
+    kernel = INT8_GEMM_AVX2;
+  }
+#endif
+  return std::min(kernel, gemm_s8_kernel_limit);
+}
+
+void caffe_cpu_limit_gemm_s8_kernel(const Int8GemmKernel max_kernel) {
+  gemm_s8_kernel_limit = max_kernel;
+}
+
+// Only float inputs have vectorized paths; these return false when there is
+// none for the Dtype or the CPU.
+template <typename Dtype>
+static bool amax_simd(const int n, const Dtype* x, Dtype* max_abs) {
+  return false;
+}
+
+static bool amax_simd(const int n, const float* x, float* max_abs) {
+#ifdef USE_X86_INT8
+  if (cpu_has_avx512bw()) {
+    *max_abs = amax_avx512(n, x);
+    return true;
+  }
+#endif
+  return false;
+}
+
+template <typename Dtype>
+static bool quantize_simd(const int n, const Dtype scale, const Dtype* x,
+    int8_t* q) {
+  return false;
+}
+
+static bool quantize_simd(const int n, const float scale, const float* x,
+    int8_t* q) {
+#ifdef USE_X86_INT8
+  if (cpu_has_avx512bw()) {
+    quantize_avx512(n, scale, x, q);
+    return true;
+  }
+#endif
+  return false;
+}
+
+template <typename Dtype>
+static bool quantize_pack_simd(const int K, const int N, const Dtype scale,
+    const Dtype* x, uint8_t* q) {
+  return false;
+}
+
+static bool quantize_pack_simd(const int K, const int N, const float scale,
+    const float* x, uint8_t* q) {
+#ifdef USE_X86_INT8
+  if (cpu_has_avx512bw()) {
+    quantize_pack_avx512(K, N, scale, x, q);
+    return true;
+  }
+#endif
+  return false;
+}
+
+template <typename Dtype>
+Dtype caffe_cpu_amax(const int n, const Dtype* x) {
+  Dtype max_abs = 0;
+  if (amax_simd(n, x, &max_abs)) { return max_abs; }
+  for (int i = 0; i < n; ++i) {
+    max_abs = std::max(max_abs, std::fabs(x[i]));
+  }
+  return max_abs;
+}
+
+template float caffe_cpu_amax<float>(const int n, const float* x);
+template double caffe_cpu_amax<double>(const int n, const double* x);
+
+template <typename Dtype>
+void caffe_cpu_quantize(const int rows, const int cols, const Dtype scale,
+    const Dtype* x, int8_t* q) {
+  const int ld = int8_gemm_k(cols);
+  const Dtype inv_scale = 1 / scale;
+  for (int r = 0; r < rows; ++r) {
+    if (!quantize_simd(cols, scale, x + r * cols, q + r * ld)) {
+      for (int c = 0; c < cols; ++c) {
+        q[r * ld + c] = quantize_value(x[r * cols + c], inv_scale);
+      }
+    }
+    for (int c = cols; c < ld; ++c) {
+      q[r * ld + c] = 0;
+    }
+  }
+}
+
+template void caffe_cpu_quantize<float>(const int rows, const int cols,
+    const float scale, const float* x, int8_t* q);
+template void caffe_cpu_quantize<double>(const int rows, const int cols,
+    const double scale, const double* x, int8_t* q);
+
+template <typename Dtype>
+void caffe_cpu_quantize_rows(const int rows, const int cols, const Dtype* x,
+    int8_t* q, Dtype* scales) {
+  const int ld = int8_gemm_k(cols);
+  for (int r = 0; r < rows; ++r) {
+    scales[r] = int8_scale(caffe_cpu_amax(cols, x + r * cols));
+    caffe_cpu_quantize(1, cols, scales[r], x + r * cols, q + r * ld);
+  }
+}
+
+template void caffe_cpu_quantize_rows<float>(const int rows, const int cols,
+    const float* x, int8_t* q, float* scales);
+template void caffe_cpu_quantize_rows<double>(const int rows, const int cols,
+    const double* x, int8_t* q, double* scales);
+
+template <typename Dtype>
+void caffe_cpu_quantize_pack(const int K, const int N, const Dtype scale,
+    const Dtype* x, uint8_t* q) {
+  if (quantize_pack_simd(K, N, scale, x, q)) { return; }
+  const Dtype inv_scale = 1 / scale;
+  for (int k = 0; k < K; k += 4) {
+    for (int j = 0; j < 4; ++j) {
+      for (int n = 0; n < N; ++n) {
+        q[k * N + n * 4 + j] = to_packed(k + j < K ?
+            quantize_value(x[(k + j) * N + n], inv_scale) : int8_t(0));
+      }
+    }
+  }
+}
+
+template void caffe_cpu_quantize_pack<float>(const int K, const int N,
+    const float scale, const float* x, uint8_t* q);
+template void caffe_cpu_quantize_pack<double>(const int K, const int N,
+    const double scale, const double* x, uint8_t* q);
+
+void caffe_cpu_pack_s8(const int N, const int K, const int8_t* x,
+    uint8_t* q) {
+  const int ld = int8_gemm_k(K);
+  // Write q in order; the rows of x are read 4 bytes at a time, and each of
+  // their cache lines is reused by the next groups.
+  for (int k = 0; k < ld; k += 4) {
+    for (int n = 0; n < N; ++n) {
+      for (int j = 0; j < 4; ++j) {
+        q[k * N + n * 4 + j] = to_packed(x[n * ld + k + j]);
+      }
+    }
+  }
+}
+
+void caffe_cpu_gemm_s8(const int M, const int N, const int K,
+    const int8_t* A, const uint8_t* B, int32_t* C) {
+  const int lda = int8_gemm_k(K);
+  // B holds b + 128, so each row of C is over by 128 times the row sum of A.
+  vector<int32_t> comp(M, 0);
+  for (int m = 0; m < M; ++m) {
+    for (int k = 0; k < K; ++k) {
+      comp[m] += 128 * A[m * lda + k];
+    }
+  }
+  int n_begin = 0;
+  switch (caffe_cpu_gemm_s8_kernel()) {
+#ifdef USE_X86_INT8
+  case INT8_GEMM_VNNI:
+    gemm_s8_vnni(M, N, K, A, B, &comp[0], C);
+    return;
+  case INT8_GEMM_AVX2:
+    n_begin = gemm_s8_avx2(M, N, K, A, B, &comp[0], C);
+    break;
+#endif
+  default:
+    break;
+  }
+  gemm_s8_scalar(M, N, K, A, B, &comp[0], n_begin, C);
+}
+
+template <typename Dtype>
+void caffe_cpu_dequantize(const int M, const int N, const int32_t* C,
+    const Dtype scale, const Dtype* row_scales, const Dtype* col_scales,
+    Dtype* y) {
+  for (int i = 0; i < M; ++i) {
+    const Dtype row_scale = row_scales ? scale * row_scales[i] : scale;
+    const int32_t* c = C + i * N;
+    Dtype* y_row = y + i * N;
+    if (col_scales) {
+      for (int j = 0; j < N; ++j) {
+        y_row[j] = c[j] * row_scale * col_scales[j];
+      }
+    } else {
+      for (int j = 0; j < N; ++j) {
+        y_row[j] = c[j] * row_scale;
+      }
+    }
+  }
+}
+
+template void caffe_cpu_dequantize<float>(const int M, const int N,
+    const int32_t* C, const float scale, const float* row_scales,
+    const float* col_scales, float* y);
+template void caffe_cpu_dequantize<double>(const int M, const int N,
+    const int32_t* C, const double scale, const double* row_scales,
+    const double* col_scales, double* y);
+
+void ApplyQuantizationTable(const QuantizationTable& table,
+    NetParameter* param) {
+  std::map<string, int> layer_ids;
+  for (int i = 0; i < param->layer_size(); ++i) {
+    layer_ids[param->layer(i).name()] = i;
+  }
+  for (int i = 0; i < table.layer_size(); ++i) {
+    const string& name = table.layer(i).name();
+    std::map<string, int>::const_iterator it = layer_ids.find(name);
+    CHECK(it != layer_ids.end())
+        << "Unknown layer " << name << " in the quantization table.";
+    param->mutable_layer(it->second)->mutable_quantization_param()->CopyFrom(
+        table.layer(i).quantization_param());
+  }
+}
+
+void ApplyQuantizationTableOrDie(const string& filename, NetParameter* param) {
+  QuantizationTable table;
+  ReadProtoFromTextFileOrDie(filename, &table);
+  ApplyQuantizationTable(table, param);
+}
+
+}  // namespace caffe
@@ -0,0 +1,485 @@
+#include "caffe/util/simd_math.hpp"
+
+#ifdef USE_SSE_MATH
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+
+namespace caffe {
+
+// The range of x over which the exp polynomial gives a normal result.
+static const float kExpMin = -87.3365447f;
+static const float kExpMax = 88.3762626647949f;
+
+#ifdef USE_SSE_MATH
+static bool cpu_has_avx512f() {
+  static const bool has_avx512f = __builtin_cpu_supports("avx512f");
+  return has_avx512f;
+}
+
+static bool cpu_has_avx2() {
+  static const bool has_avx2 = __builtin_cpu_supports("avx2") &&
+      __builtin_cpu_supports("fma");
+  return has_avx2;
+}
+
+// The polynomials of caffe_sse_exp and caffe_sse_log, 8 and 16 values at a
+// time, with fused multiply-adds.
+
+__attribute__((target("avx2,fma")))
+static inline __m256 exp_avx2(__m256 x) {
+  x = _mm256_min_ps(x, _mm256_set1_ps(kExpMax));
+  x = _mm256_max_ps(x, _mm256_set1_ps(kExpMin));
+  const __m256 n = _mm256_round_ps(
+      _mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f)),
+      _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  x = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+  x = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), x);
+  const __m256 z = _mm256_mul_ps(x, x);
+  __m256 y = _mm256_set1_ps(1.9875691500e-4f);
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.3981999507e-3f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(8.3334519073e-3f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(4.1665795894e-2f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.6666665459e-1f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(5.0000001201e-1f));
+  y = _mm256_add_ps(_mm256_fmadd_ps(y, z, x), _mm256_set1_ps(1.f));
+  const __m256i pow2n = _mm256_slli_epi32(_mm256_add_epi32(
+      _mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+  return _mm256_mul_ps(y, _mm256_castsi256_ps(pow2n));
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256 log_parts_avx2(const __m256 x, __m256* e, __m256* r,
+    __m256* z) {
+  const __m256 one = _mm256_set1_ps(1.f);
+  const __m256i bits = _mm256_castps_si256(x);
+  *e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23),
+      _mm256_set1_epi32(126)));
+  const __m256 m = _mm256_or_ps(_mm256_castsi256_ps(_mm256_and_si256(bits,
+      _mm256_set1_epi32(0x007fffff))), _mm256_set1_ps(0.5f));
+  const __m256 small = _mm256_cmp_ps(m,
+      _mm256_set1_ps(0.707106781186547524f), _CMP_LT_OQ);
+  *e = _mm256_sub_ps(*e, _mm256_and_ps(one, small));
+  *r = _mm256_add_ps(_mm256_sub_ps(m, one), _mm256_and_ps(m, small));
+  *z = _mm256_mul_ps(*r, *r);
+  __m256 y = _mm256_set1_ps(7.0376836292e-2f);
+  y = _mm256_fmadd_ps(y, *r, _mm256_set1_ps(-1.1514610310e-1f));
+  y = _mm256_fmadd_ps(y, *r, _mm256_set1_ps(1.1676998740e-1f));
+  y = _mm256_fmadd_ps(y, *r, _mm256_set1_ps(-1.2420140846e-1f));
+  y = _mm256_fmadd_ps(y, *r, _mm256_set1_ps(1.4249322787e-1f));
+  y = _mm256_fmadd_ps(y, *r, _mm256_set1_ps(-1.6668057665e-1f));
+  y = _mm256_fmadd_ps(y, *r, _mm256_set1_ps(2.0000714765e-1f));
+  y = _mm256_fmadd_ps(y, *r, _mm256_set1_ps(-2.4999993993e-1f));
+  y = _mm256_fmadd_ps(y, *r, _mm256_set1_ps(3.3333331174e-1f));
+  return _mm256_mul_ps(_mm256_mul_ps(y, *r), *z);
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256 log_avx2(const __m256 x) {
+  __m256 e, r, z;
+  __m256 y = log_parts_avx2(x, &e, &r, &z);
+  y = _mm256_fmadd_ps(e, _mm256_set1_ps(-2.12194440e-4f), y);
+  y = _mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), y);
+  return _mm256_fmadd_ps(e, _mm256_set1_ps(0.693359375f),
+      _mm256_add_ps(r, y));
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256 pow2_avx2(const __m256i n) {
+  return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(n,
+      _mm256_set1_epi32(127)), 23));
+}
+
+// As caffe_sse_pow, with the product p e split exactly by a fused
+// multiply-add.
+__attribute__((target("avx2,fma")))
+static inline __m256 pow_avx2(const __m256 x, const float p) {
+  const __m256 p_v = _mm256_set1_ps(p);
+  __m256 e, r, z;
+  const __m256 y = log_parts_avx2(x, &e, &r, &z);
+  const __m256 log_m = _mm256_add_ps(r,
+      _mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), y));
+  const __m256 pe = _mm256_mul_ps(e, p_v);
+  const __m256 n = _mm256_round_ps(pe,
+      _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  const __m256 f = _mm256_add_ps(_mm256_sub_ps(pe, n),
+      _mm256_fmsub_ps(e, p_v, pe));
+  const __m256 u = _mm256_fmadd_ps(f, _mm256_set1_ps(0.693147180559945f),
+      _mm256_mul_ps(log_m, p_v));
+  const __m256i n_i = _mm256_cvtps_epi32(n);
+  const __m256i n_half = _mm256_srai_epi32(n_i, 1);
+  return _mm256_mul_ps(_mm256_mul_ps(exp_avx2(u), pow2_avx2(n_half)),
+      pow2_avx2(_mm256_sub_epi32(n_i, n_half)));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512 exp_avx512(__m512 x) {
+  x = _mm512_min_ps(x, _mm512_set1_ps(kExpMax));
+  x = _mm512_max_ps(x, _mm512_set1_ps(kExpMin));
+  const __m512 n = _mm512_roundscale_ps(
+      _mm512_mul_ps(x, _mm512_set1_ps(1.44269504088896341f)),
+      _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  x = _mm512_fnmadd_ps(n, _mm512_set1_ps(0.693359375f), x);
+  x = _mm512_fnmadd_ps(n, _mm512_set1_ps(-2.12194440e-4f), x);
+  const __m512 z = _mm512_mul_ps(x, x);
+  __m512 y = _mm512_set1_ps(1.9875691500e-4f);
+  y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(1.3981999507e-3f));
+  y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(8.3334519073e-3f));
+  y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(4.1665795894e-2f));
+  y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(1.6666665459e-1f));
+  y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(5.0000001201e-1f));
+  y = _mm512_add_ps(_mm512_fmadd_ps(y, z, x), _mm512_set1_ps(1.f));
+  const __m512i pow2n = _mm512_slli_epi32(_mm512_add_epi32(
+      _mm512_cvtps_epi32(n), _mm512_set1_epi32(127)), 23);
+  return _mm512_mul_ps(y, _mm512_castsi512_ps(pow2n));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512 log_parts_avx512(const __m512 x, __m512* e, __m512* r,
+    __m512* z) {
+  const __m512 one = _mm512_set1_ps(1.f);
+  const __m512i bits = _mm512_castps_si512(x);
+  *e = _mm512_cvtepi32_ps(_mm512_sub_epi32(_mm512_srli_epi32(bits, 23),
+      _mm512_set1_epi32(126)));
+  // The mantissa, with the exponent of 0.5.
+  const __m512 m = _mm512_castsi512_ps(_mm512_or_epi32(_mm512_and_epi32(bits,
+      _mm512_set1_epi32(0x007fffff)), _mm512_set1_epi32(0x3f000000)));
+  const __mmask16 small = _mm512_cmp_ps_mask(m,
+      _mm512_set1_ps(0.707106781186547524f), _CMP_LT_OQ);
+  *e = _mm512_mask_sub_ps(*e, small, *e, one);
+  *r = _mm512_sub_ps(m, one);
+  *r = _mm512_mask_add_ps(*r, small, *r, m);
+  *z = _mm512_mul_ps(*r, *r);
+  __m512 y = _mm512_set1_ps(7.0376836292e-2f);
+  y = _mm512_fmadd_ps(y, *r, _mm512_set1_ps(-1.1514610310e-1f));
+  y = _mm512_fmadd_ps(y, *r, _mm512_set1_ps(1.1676998740e-1f));
+  y = _mm512_fmadd_ps(y, *r, _mm512_set1_ps(-1.2420140846e-1f));
+  y = _mm512_fmadd_ps(y, *r, _mm512_set1_ps(1.4249322787e-1f));
+  y = _mm512_fmadd_ps(y, *r, _mm512_set1_ps(-1.6668057665e-1f));
+  y = _mm512_fmadd_ps(y, *r, _mm512_set1_ps(2.0000714765e-1f));
+  y = _mm512_fmadd_ps(y, *r, _mm512_set1_ps(-2.4999993993e-1f));
+  y = _mm512_fmadd_ps(y, *r, _mm512_set1_ps(3.3333331174e-1f));
+  return _mm512_mul_ps(_mm512_mul_ps(y, *r), *z);
+}
+
+__attribute__((target("avx512f")))
+static inline __m512 log_avx512(const __m512 x) {
+  __m512 e, r, z;
+  __m512 y = log_parts_avx512(x, &e, &r, &z);
+  y = _mm512_fmadd_ps(e, _mm512_set1_ps(-2.12194440e-4f), y);
+  y = _mm512_fnmadd_ps(z, _mm512_set1_ps(0.5f), y);
+  return _mm512_fmadd_ps(e, _mm512_set1_ps(0.693359375f),
+      _mm512_add_ps(r, y));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512 pow_avx512(const __m512 x, const float p) {
+  const __m512 p_v = _mm512_set1_ps(p);
+  __m512 e, r, z;
+  const __m512 y = log_parts_avx512(x, &e, &r, &z);
+  const __m512 log_m = _mm512_add_ps(r,
+      _mm512_fnmadd_ps(z, _mm512_set1_ps(0.5f), y));
+  const __m512 pe = _mm512_mul_ps(e, p_v);
+  const __m512 n = _mm512_roundscale_ps(pe,
+      _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  const __m512 f = _mm512_add_ps(_mm512_sub_ps(pe, n),
+      _mm512_fmsub_ps(e, p_v, pe));
+  const __m512 u = _mm512_fmadd_ps(f, _mm512_set1_ps(0.693147180559945f),
+      _mm512_mul_ps(log_m, p_v));
+  return _mm512_scalef_ps(exp_avx512(u), n);
+}
+
+// tanh follows Cephes tanhf: an odd polynomial below |x| = 0.625, and
+// 1 - 2 / (exp(2|x|) + 1), with the sign of x, above.
+
+static inline __m128 tanh_sse(const __m128 x) {
+  const __m128 sign = _mm_set1_ps(-0.f);
+  const __m128 one = _mm_set1_ps(1.f);
+  const __m128 abs_x = _mm_andnot_ps(sign, x);
+  const __m128 z = _mm_mul_ps(x, x);
+  __m128 p = _mm_set1_ps(-5.70498872745e-3f);
+  p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(2.06390887954e-2f));
+  p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(-5.37397155531e-2f));
+  p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(1.33314422036e-1f));
+  p = _mm_add_ps(_mm_mul_ps(p, z), _mm_set1_ps(-3.33332819422e-1f));
+  const __m128 small = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(p, z), x), x);
+  __m128 large = _mm_sub_ps(one, _mm_div_ps(_mm_set1_ps(2.f),
+      _mm_add_ps(caffe_sse_exp(_mm_add_ps(abs_x, abs_x)), one)));
+  large = _mm_or_ps(large, _mm_and_ps(x, sign));
+  const __m128 is_small = _mm_cmplt_ps(abs_x, _mm_set1_ps(0.625f));
+  return _mm_or_ps(_mm_and_ps(is_small, small),
+      _mm_andnot_ps(is_small, large));
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256 tanh_avx2(const __m256 x) {
+  const __m256 sign = _mm256_set1_ps(-0.f);
+  const __m256 one = _mm256_set1_ps(1.f);
+  const __m256 abs_x = _mm256_andnot_ps(sign, x);
+  const __m256 z = _mm256_mul_ps(x, x);
+  __m256 p = _mm256_set1_ps(-5.70498872745e-3f);
+  p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(2.06390887954e-2f));
+  p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(-5.37397155531e-2f));
+  p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(1.33314422036e-1f));
+  p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(-3.33332819422e-1f));
+  const __m256 small = _mm256_fmadd_ps(_mm256_mul_ps(p, z), x, x);
+  __m256 large = _mm256_sub_ps(one, _mm256_div_ps(_mm256_set1_ps(2.f),
+      _mm256_add_ps(exp_avx2(_mm256_add_ps(abs_x, abs_x)), one)));
+  large = _mm256_or_ps(large, _mm256_and_ps(x, sign));
+  return _mm256_blendv_ps(large, small,
+      _mm256_cmp_ps(abs_x, _mm256_set1_ps(0.625f), _CMP_LT_OQ));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512 tanh_avx512(const __m512 x) {
+  const __m512 one = _mm512_set1_ps(1.f);
+  const __m512 abs_x = _mm512_abs_ps(x);
+  const __m512 z = _mm512_mul_ps(x, x);
+  __m512 p = _mm512_set1_ps(-5.70498872745e-3f);
+  p = _mm512_fmadd_ps(p, z, _mm512_set1_ps(2.06390887954e-2f));
+  p = _mm512_fmadd_ps(p, z, _mm512_set1_ps(-5.37397155531e-2f));
+  p = _mm512_fmadd_ps(p, z, _mm512_set1_ps(1.33314422036e-1f));
+  p = _mm512_fmadd_ps(p, z, _mm512_set1_ps(-3.33332819422e-1f));
+  const __m512 small = _mm512_fmadd_ps(_mm512_mul_ps(p, z), x, x);
+  const __m512 large = _mm512_sub_ps(one, _mm512_div_ps(_mm512_set1_ps(2.f),
+      _mm512_add_ps(exp_avx512(_mm512_add_ps(abs_x, abs_x)), one)));
+  const __m512i sign_bit = _mm512_and_epi32(_mm512_castps_si512(x),
+      _mm512_set1_epi32(0x80000000));
+  const __m512 signed_large = _mm512_castsi512_ps(_mm512_or_epi32(
+      _mm512_castps_si512(large), sign_bit));
+  return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(abs_x,
+      _mm512_set1_ps(0.625f), _CMP_LT_OQ), signed_large, small);
+}
+#endif  // USE_SSE_MATH
+
+// The functions, each as a scalar over libm and as vectors of every width.
+// The vector forms may assume x lies in the domain map checks for.
+
+struct ExpOp {
+  float scalar(const float x) const { return std::exp(x); }
+#ifdef USE_SSE_MATH
+  __m128 sse(const __m128 x) const { return caffe_sse_exp(x); }
+  __attribute__((target("avx2,fma")))
+  __m256 avx2(const __m256 x) const { return exp_avx2(x); }
+  __attribute__((target("avx512f")))
+  __m512 avx512(const __m512 x) const { return exp_avx512(x); }
+#endif
+};
+
+struct LogOp {
+  float scalar(const float x) const { return std::log(x); }
+#ifdef USE_SSE_MATH
+  __m128 sse(const __m128 x) const { return caffe_sse_log(x); }
+  __attribute__((target("avx2,fma")))
+  __m256 avx2(const __m256 x) const { return log_avx2(x); }
+  __attribute__((target("avx512f")))
+  __m512 avx512(const __m512 x) const { return log_avx512(x); }
+#endif
+};
+
+struct PowOp {
+  explicit PowOp(const float p) : p(p) {}
+  float scalar(const float x) const { return std::pow(x, p); }
+#ifdef USE_SSE_MATH
+  __m128 sse(const __m128 x) const { return caffe_sse_pow(x, p); }
+  __attribute__((target("avx2,fma")))
+  __m256 avx2(const __m256 x) const { return pow_avx2(x, p); }
+  __attribute__((target("avx512f")))
+  __m512 avx512(const __m512 x) const { return pow_avx512(x, p); }
+#endif
+  const float p;
+};
+
+struct SqrtOp {
+  float scalar(const float x) const { return std::sqrt(x); }
+#ifdef USE_SSE_MATH
+  __m128 sse(const __m128 x) const { return _mm_sqrt_ps(x); }
+  __attribute__((target("avx2,fma")))
+  __m256 avx2(const __m256 x) const { return _mm256_sqrt_ps(x); }
+  __attribute__((target("avx512f")))
+  __m512 avx512(const __m512 x) const { return _mm512_sqrt_ps(x); }
+#endif
+};
+
+struct TanhOp {
+  float scalar(const float x) const { return std::tanh(x); }
+#ifdef USE_SSE_MATH
+  __m128 sse(const __m128 x) const { return tanh_sse(x); }
+  __attribute__((target("avx2,fma")))
+  __m256 avx2(const __m256 x) const { return tanh_avx2(x); }
+  __attribute__((target("avx512f")))
+  __m512 avx512(const __m512 x) const { return tanh_avx512(x); }
+#endif
+};
+
+struct SigmoidOp {
+  float scalar(const float x) const { return 1.f / (1.f + std::exp(-x)); }
+#ifdef USE_SSE_MATH
+  __m128 sse(const __m128 x) const {
+    const __m128 one = _mm_set1_ps(1.f);
+    return _mm_div_ps(one, _mm_add_ps(one,
+        caffe_sse_exp(_mm_sub_ps(_mm_setzero_ps(), x))));
+  }
+  __attribute__((target("avx2,fma")))
+  __m256 avx2(const __m256 x) const {
+    const __m256 one = _mm256_set1_ps(1.f);
+    return _mm256_div_ps(one, _mm256_add_ps(one,
+        exp_avx2(_mm256_sub_ps(_mm256_setzero_ps(), x))));
+  }
+  __attribute__((target("avx512f")))
+  __m512 avx512(const __m512 x) const {
+    const __m512 one = _mm512_set1_ps(1.f);
+    return _mm512_div_ps(one, _mm512_add_ps(one,
+        exp_avx512(_mm512_sub_ps(_mm512_setzero_ps(), x))));
+  }
+#endif
+};
+
+template <typename Op>
+static void map_scalar(const Op& op, const int n, const float* x, float* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = op.scalar(x[i]);
+  }
+}
+
+#ifdef USE_SSE_MATH
+template <typename Op>
+static void map_sse(const Op& op, const int n, const float* x,
+    const float lo, const float hi, float* y) {
+  const __m128 lo_v = _mm_set1_ps(lo);
+  const __m128 hi_v = _mm_set1_ps(hi);
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128 v = _mm_loadu_ps(x + i);
+    const __m128 in = _mm_and_ps(_mm_cmpge_ps(v, lo_v),
+        _mm_cmple_ps(v, hi_v));
+    if (_mm_movemask_ps(in) == 0xF) {
+      _mm_storeu_ps(y + i, op.sse(v));
+    } else {
+      map_scalar(op, 4, x + i, y + i);
+    }
+  }
+  map_scalar(op, n - i, x + i, y + i);
+}
+
+template <typename Op>
+__attribute__((target("avx2,fma")))
+static void map_avx2(const Op& op, const int n, const float* x,
+    const float lo, const float hi, float* y) {
+  const __m256 lo_v = _mm256_set1_ps(lo);
+  const __m256 hi_v = _mm256_set1_ps(hi);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 v = _mm256_loadu_ps(x + i);
+    const __m256 in = _mm256_and_ps(_mm256_cmp_ps(v, lo_v, _CMP_GE_OQ),
+        _mm256_cmp_ps(v, hi_v, _CMP_LE_OQ));
+    if (_mm256_movemask_ps(in) == 0xFF) {
+      _mm256_storeu_ps(y + i, op.avx2(v));
+    } else {
+      map_scalar(op, 8, x + i, y + i);
+    }
+  }
+  map_scalar(op, n - i, x + i, y + i);
+}
+
+// Runs the tail as a masked vector too.
+template <typename Op>
+__attribute__((target("avx512f")))
+static void map_avx512(const Op& op, const int n, const float* x,
+    const float lo, const float hi, float* y) {
+  const __m512 lo_v = _mm512_set1_ps(lo);
+  const __m512 hi_v = _mm512_set1_ps(hi);
+  for (int i = 0; i < n; i += 16) {
+    const __mmask16 mask = n - i >= 16 ? 0xFFFF : (1 << (n - i)) - 1;
+    const __m512 v = _mm512_maskz_loadu_ps(mask, x + i);
+    const __mmask16 in = _mm512_cmp_ps_mask(v, lo_v, _CMP_GE_OQ) &
+        _mm512_cmp_ps_mask(v, hi_v, _CMP_LE_OQ);
+    if ((in & mask) == mask) {
+      _mm512_mask_storeu_ps(y + i, mask, op.avx512(v));
+    } else {
+      map_scalar(op, std::min(16, n - i), x + i, y + i);
+    }
+  }
+}
+#endif  // USE_SSE_MATH
+
+// Applies op to x, in vectors where all the values lie in [lo, hi], and
+// with libm elsewhere.
+template <typename Op>
+static void map(const Op& op, const int n, const float* x, const float lo,
+    const float hi, float* y) {
+#ifdef USE_SSE_MATH
+  if (cpu_has_avx512f()) {
+    map_avx512(op, n, x, lo, hi, y);
+  } else if (cpu_has_avx2()) {
+    map_avx2(op, n, x, lo, hi, y);
+  } else {
+    map_sse(op, n, x, lo, hi, y);
+  }
+#else
+  map_scalar(op, n, x, y);
+#endif
+}
+
+void caffe_simd_exp(const int n, const float* x, float* y) {
+  map(ExpOp(), n, x, kExpMin, kExpMax, y);
+}
+
+void caffe_simd_log(const int n, const float* x, float* y) {
+  map(LogOp(), n, x, FLT_MIN, FLT_MAX, y);
+}
+
+void caffe_simd_powx(const int n, const float* x, const float p, float* y) {
+  const float inf = std::numeric_limits<float>::infinity();
+  if (p == 1) {
+    if (x != y) {
+      std::copy(x, x + n, y);
+    }
+  } else if (p == 2) {
+    for (int i = 0; i < n; ++i) {
+      y[i] = x[i] * x[i];
+    }
+  } else if (p == 0.5f) {
+    map(SqrtOp(), n, x, -inf, inf, y);
+  } else if (p == 0) {
+    std::fill(y, y + n, 1.f);
+  } else if (std::fabs(p) > 64) {
+    map_scalar(PowOp(p), n, x, y);
+  } else {
+    // Keep p * log(x) inside the range of exp, with a margin, so that the
+    // result stays normal and finite.
+    const double min_log = (p > 0 ? -87. : -88.) / std::fabs(p);
+    const double max_log = (p > 0 ? 88. : 87.) / std::fabs(p);
+    const float lo = std::max(static_cast<double>(FLT_MIN), std::exp(min_log));
+    const float hi = std::min(static_cast<double>(FLT_MAX), std::exp(max_log));
+    map(PowOp(p), n, x, lo, hi, y);
+  }
+}
+
+void caffe_simd_tanh(const int n, const float* x, float* y) {
+  const float inf = std::numeric_limits<float>::infinity();
+  map(TanhOp(), n, x, -inf, inf, y);
+}
+
+void caffe_simd_sigmoid(const int n, const float* x, float* y) {
+  map(SigmoidOp(), n, x, kExpMin, std::numeric_limits<float>::infinity(), y);
+}
+
+const char* caffe_simd_math_isa() {
+#ifdef USE_SSE_MATH
+  if (cpu_has_avx512f()) {
+    return "avx512f";
+  } else if (cpu_has_avx2()) {
+    return "avx2";
+  }
+  return "sse2";
+#else
+  return "scalar";
+#endif
+}
+
+}  // namespace caffe
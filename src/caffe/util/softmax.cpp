@@ -0,0 +1,223 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "boost/bind.hpp"
+
+#include "caffe/common.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/softmax.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+// The values exponentiated at once: a whole slice up to this size, which
+// then stays in cache, and otherwise this much of one row at a time.
+static const int kSoftmaxChunk = 4096;
+
+// Returns the width of the block of columns starting at column, as many as
+// [column, end) holds in one outer_num slice, and its slice i and inner
+// index k. The passes over a block each stream through its rows.
+static inline int softmax_block(const int column, const int end,
+    const int inner_num, int* i, int* k) {
+  *i = column / inner_num;
+  *k = column % inner_num;
+  return std::min(inner_num - *k, end - column);
+}
+
+template <typename Dtype>
+static void softmax_columns(const int channels, const int inner_num,
+    const Dtype* x, Dtype* y, Dtype* log_norm, const int begin,
+    const int end) {
+  const int dim = channels * inner_num;
+  vector<Dtype> max(std::min(end - begin, inner_num));
+  vector<Dtype> sum(max.size());
+  for (int column = begin; column < end; ) {
+    int i, k;
+    const int width = softmax_block(column, end, inner_num, &i, &k);
+    const Dtype* x_block = x + i * dim + k;
+    Dtype* y_block = y + i * dim + k;
+    std::copy(x_block, x_block + width, max.begin());
+    for (int c = 1; c < channels; ++c) {
+      const Dtype* x_row = x_block + c * inner_num;
+      for (int w = 0; w < width; ++w) {
+        max[w] = std::max(max[w], x_row[w]);
+      }
+    }
+    // Subtract the max to avoid overflow, exponentiate and sum, a chunk at
+    // a time.
+    std::fill(sum.begin(), sum.begin() + width, Dtype(0));
+    if (width == inner_num && dim <= kSoftmaxChunk) {
+      for (int c = 0; c < channels; ++c) {
+        for (int w = 0; w < width; ++w) {
+          y_block[c * inner_num + w] = x_block[c * inner_num + w] - max[w];
+        }
+      }
+      caffe_exp<Dtype>(dim, y_block, y_block);
+      for (int c = 0; c < channels; ++c) {
+        for (int w = 0; w < width; ++w) {
+          sum[w] += y_block[c * inner_num + w];
+        }
+      }
+    } else {
+      for (int c = 0; c < channels; ++c) {
+        for (int w0 = 0; w0 < width; w0 += kSoftmaxChunk) {
+          const int n = std::min(kSoftmaxChunk, width - w0);
+          const Dtype* x_chunk = x_block + c * inner_num + w0;
+          Dtype* y_chunk = y_block + c * inner_num + w0;
+          for (int w = 0; w < n; ++w) {
+            y_chunk[w] = x_chunk[w] - max[w0 + w];
+          }
+          caffe_exp<Dtype>(n, y_chunk, y_chunk);
+          for (int w = 0; w < n; ++w) {
+            sum[w0 + w] += y_chunk[w];
+          }
+        }
+      }
+    }
+    if (log_norm) {
+      for (int w = 0; w < width; ++w) {
+        log_norm[i * inner_num + k + w] = max[w] + std::log(sum[w]);
+      }
+    }
+    for (int w = 0; w < width; ++w) {
+      sum[w] = 1 / sum[w];
+    }
+    for (int c = 0; c < channels; ++c) {
+      Dtype* y_row = y_block + c * inner_num;
+      for (int w = 0; w < width; ++w) {
+        y_row[w] *= sum[w];
+      }
+    }
+    column += width;
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_softmax(const int outer_num, const int channels,
+    const int inner_num, const Dtype* x, Dtype* y, Dtype* log_norm) {
+  parallel_for(outer_num * inner_num, parallel_grain(4 * channels),
+      boost::bind(&softmax_columns<Dtype>, channels, inner_num, x, y,
+          log_norm, _1, _2));
+}
+
+template <typename Dtype>
+static void softmax_backward_columns(const int channels, const int inner_num,
+    const Dtype* y, const Dtype* dy, Dtype* dx, const int begin,
+    const int end) {
+  const int dim = channels * inner_num;
+  vector<Dtype> dot(std::min(end - begin, inner_num));
+  for (int column = begin; column < end; ) {
+    int i, k;
+    const int width = softmax_block(column, end, inner_num, &i, &k);
+    const int offset = i * dim + k;
+    std::fill(dot.begin(), dot.begin() + width, Dtype(0));
+    for (int c = 0; c < channels; ++c) {
+      const Dtype* y_row = y + offset + c * inner_num;
+      const Dtype* dy_row = dy + offset + c * inner_num;
+      for (int w = 0; w < width; ++w) {
+        dot[w] += dy_row[w] * y_row[w];
+      }
+    }
+    for (int c = 0; c < channels; ++c) {
+      const Dtype* y_row = y + offset + c * inner_num;
+      const Dtype* dy_row = dy + offset + c * inner_num;
+      Dtype* dx_row = dx + offset + c * inner_num;
+      for (int w = 0; w < width; ++w) {
+        dx_row[w] = y_row[w] * (dy_row[w] - dot[w]);
+      }
+    }
+    column += width;
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_softmax_backward(const int outer_num, const int channels,
+    const int inner_num, const Dtype* y, const Dtype* dy, Dtype* dx) {
+  parallel_for(outer_num * inner_num, parallel_grain(3 * channels),
+      boost::bind(&softmax_backward_columns<Dtype>, channels, inner_num, y,
+          dy, dx, _1, _2));
+}
+
+// The arguments of caffe_cpu_softmax_loss_diff, more than boost::bind takes.
+template <typename Dtype>
+struct SoftmaxLossDiff {
+  int channels;
+  int inner_num;
+  const Dtype* prob;
+  const Dtype* label;
+  bool has_ignore_label;
+  int ignore_label;
+  Dtype scale;
+  Dtype* diff;
+
+  void Columns(const int begin, const int end) const {
+    const int dim = channels * inner_num;
+    for (int column = begin; column < end; ) {
+      int i, k;
+      const int width = softmax_block(column, end, inner_num, &i, &k);
+      const int offset = i * dim + k;
+      for (int c = 0; c < channels; ++c) {
+        const Dtype* prob_row = prob + offset + c * inner_num;
+        Dtype* diff_row = diff + offset + c * inner_num;
+        for (int w = 0; w < width; ++w) {
+          diff_row[w] = scale * prob_row[w];
+        }
+      }
+      for (int w = 0; w < width; ++w) {
+        const int label_value = static_cast<int>(label[column + w]);
+        if (has_ignore_label && label_value == ignore_label) {
+          for (int c = 0; c < channels; ++c) {
+            diff[offset + c * inner_num + w] = 0;
+          }
+        } else {
+          DCHECK_GE(label_value, 0);
+          DCHECK_LT(label_value, channels);
+          diff[offset + label_value * inner_num + w] -= scale;
+        }
+      }
+      column += width;
+    }
+  }
+};
+
+template <typename Dtype>
+void caffe_cpu_softmax_loss_diff(const int outer_num, const int channels,
+    const int inner_num, const Dtype* prob, const Dtype* label,
+    const bool has_ignore_label, const int ignore_label, const Dtype scale,
+    Dtype* diff) {
+  SoftmaxLossDiff<Dtype> loss_diff;
+  loss_diff.channels = channels;
+  loss_diff.inner_num = inner_num;
+  loss_diff.prob = prob;
+  loss_diff.label = label;
+  loss_diff.has_ignore_label = has_ignore_label;
+  loss_diff.ignore_label = ignore_label;
+  loss_diff.scale = scale;
+  loss_diff.diff = diff;
+  parallel_for(outer_num * inner_num, parallel_grain(channels),
+      boost::bind(&SoftmaxLossDiff<Dtype>::Columns, &loss_diff, _1, _2));
+}
+
+template void caffe_cpu_softmax<float>(const int outer_num,
+    const int channels, const int inner_num, const float* x, float* y,
+    float* log_norm);
+template void caffe_cpu_softmax<double>(const int outer_num,
+    const int channels, const int inner_num, const double* x, double* y,
+    double* log_norm);
+template void caffe_cpu_softmax_backward<float>(const int outer_num,
+    const int channels, const int inner_num, const float* y, const float* dy,
+    float* dx);
+template void caffe_cpu_softmax_backward<double>(const int outer_num,
+    const int channels, const int inner_num, const double* y,
+    const double* dy, double* dx);
+template void caffe_cpu_softmax_loss_diff<float>(const int outer_num,
+    const int channels, const int inner_num, const float* prob,
+    const float* label, const bool has_ignore_label, const int ignore_label,
+    const float scale, float* diff);
+template void caffe_cpu_softmax_loss_diff<double>(const int outer_num,
+    const int channels, const int inner_num, const double* prob,
+    const double* label, const bool has_ignore_label, const int ignore_label,
+    const double scale, double* diff);
+
+}  // namespace caffe
@@ -0,0 +1,322 @@
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "boost/date_time/posix_time/posix_time.hpp"
+#include "boost/scoped_array.hpp"
+#include "caffe/common.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+#ifdef USE_MKL
+#include <mkl.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef USE_OPENBLAS
+extern "C" void openblas_set_num_threads(int num_threads);
+#endif
+
+namespace caffe {
+
+namespace {
+
+// The cores this process may run on.
+vector<int> AllowedCpus() {
+  vector<int> cpus;
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set)) {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+#endif
+  if (cpus.empty()) {
+    const int hardware_threads = boost::thread::hardware_concurrency();
+    for (int cpu = 0; cpu < std::max(1, hardware_threads); ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+void PinToCpu(const int cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  sched_setaffinity(0, sizeof(set), &set);
+#endif
+}
+
+void SetBlasNumThreads(const int num_threads) {
+#ifdef USE_OPENBLAS
+  openblas_set_num_threads(num_threads);
+#endif
+#ifdef USE_MKL
+  mkl_set_num_threads(num_threads);
+#endif
+#ifdef _OPENMP
+  omp_set_num_threads(num_threads);
+#endif
+}
+
+double SecondsSince(const boost::posix_time::ptime& start) {
+  return (boost::posix_time::microsec_clock::universal_time() - start).
+      total_microseconds() / 1e6;
+}
+
+// One parallel loop. Each thread owns a slot, the range of indices it has
+// left, which other threads may steal from.
+struct Loop {
+  struct Slot {
+    boost::mutex mutex;
+    int begin;
+    int end;
+    // Keeps the slots of different threads on different cache lines.
+    char padding[64];
+  };
+
+  Loop(const RangeFunction& body, const int n, const int grain,
+      const int num_slots)
+      : body(body), grain(grain), num_slots(num_slots),
+        slots(new Slot[num_slots]), remaining(n), workers(0) {
+    for (int i = 0; i < num_slots; ++i) {
+      slots[i].begin = static_cast<int64_t>(n) * i / num_slots;
+      slots[i].end = static_cast<int64_t>(n) * (i + 1) / num_slots;
+    }
+  }
+
+  const RangeFunction& body;
+  const int grain;
+  const int num_slots;
+  boost::scoped_array<Slot> slots;
+  // The indices left to run, and the workers in the loop.
+  boost::mutex mutex;
+  boost::condition_variable done;
+  int remaining;
+  int workers;
+};
+
+class Pool {
+ public:
+  explicit Pool(const int num_threads)
+      : num_threads_(num_threads), loop_(NULL), generation_(0),
+        stop_(false) {}
+
+  ~Pool() {
+    boost::mutex::scoped_lock run_lock(run_mutex_);
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    workers_.join_all();
+  }
+
+  int num_threads() const { return num_threads_; }
+
+  void Run(const int n, const int grain, const RangeFunction& body) {
+    if (n <= grain || num_threads_ == 1 || !run_mutex_.try_lock()) {
+      body(0, n);
+      boost::mutex::scoped_lock lock(stats_mutex_);
+      ++stats_.inline_loops;
+      return;
+    }
+    boost::mutex::scoped_lock run_lock(run_mutex_, boost::adopt_lock);
+    if (workers_.size() == 0) {
+      const vector<int> cpus = AllowedCpus();
+      const bool pin = num_threads_ <= cpus.size();
+      for (int slot = 1; slot < num_threads_; ++slot) {
+        workers_.create_thread(boost::bind(&Pool::WorkerLoop, this, slot,
+            pin ? cpus[slot] : -1));
+      }
+    }
+    const boost::posix_time::ptime start =
+        boost::posix_time::microsec_clock::universal_time();
+    Loop loop(body, n, std::max(1, grain), num_threads_);
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      loop_ = &loop;
+      ++generation_;
+    }
+    wake_.notify_all();
+    Work(&loop, 0);
+    {
+      // No more workers join once the loop is withdrawn; wait for the
+      // ranges that others still run, and for them to leave the loop.
+      boost::mutex::scoped_lock lock(mutex_);
+      loop_ = NULL;
+    }
+    boost::mutex::scoped_lock lock(loop.mutex);
+    while (loop.remaining > 0 || loop.workers > 0) {
+      loop.done.wait(lock);
+    }
+    boost::mutex::scoped_lock stats_lock(stats_mutex_);
+    ++stats_.parallel_loops;
+    stats_.capacity_seconds += SecondsSince(start) * num_threads_;
+  }
+
+  ThreadPool::Stats stats() {
+    boost::mutex::scoped_lock lock(stats_mutex_);
+    return stats_;
+  }
+
+  void ResetStats() {
+    boost::mutex::scoped_lock lock(stats_mutex_);
+    stats_ = ThreadPool::Stats();
+  }
+
+ private:
+  void WorkerLoop(const int slot, const int cpu) {
+    if (cpu >= 0) {
+      PinToCpu(cpu);
+    }
+    uint64_t seen = 0;
+    for (;;) {
+      Loop* loop;
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+        while (!stop_ && (loop_ == NULL || generation_ == seen)) {
+          wake_.wait(lock);
+        }
+        if (stop_) { return; }
+        seen = generation_;
+        loop = loop_;
+        boost::mutex::scoped_lock loop_lock(loop->mutex);
+        ++loop->workers;
+      }
+      Work(loop, slot);
+      boost::mutex::scoped_lock loop_lock(loop->mutex);
+      --loop->workers;
+      loop->done.notify_all();
+    }
+  }
+
+  // Runs ranges of the loop until none are left to run or steal.
+  void Work(Loop* loop, const int slot) {
+    ThreadPool::Stats stats;
+    int begin, end;
+    while (NextRange(loop, slot, &begin, &end, &stats)) {
+      const boost::posix_time::ptime start =
+          boost::posix_time::microsec_clock::universal_time();
+      loop->body(begin, end);
+      stats.busy_seconds += SecondsSince(start);
+      ++stats.ranges;
+      boost::mutex::scoped_lock lock(loop->mutex);
+      loop->remaining -= end - begin;
+      if (loop->remaining == 0) {
+        loop->done.notify_all();
+      }
+    }
+    boost::mutex::scoped_lock lock(stats_mutex_);
+    stats_.ranges += stats.ranges;
+    stats_.steals += stats.steals;
+    stats_.busy_seconds += stats.busy_seconds;
+  }
+
+  // Takes the next grain of the thread's own range; once that is empty,
+  // steals the back half of another thread's range and keeps what it does
+  // not run at once as its own.
+  bool NextRange(Loop* loop, const int slot, int* begin, int* end,
+      ThreadPool::Stats* stats) {
+    Loop::Slot& own = loop->slots[slot];
+    {
+      boost::mutex::scoped_lock lock(own.mutex);
+      if (own.begin < own.end) {
+        *begin = own.begin;
+        *end = std::min(own.end, own.begin + loop->grain);
+        own.begin = *end;
+        return true;
+      }
+    }
+    for (int i = 1; i < loop->num_slots; ++i) {
+      Loop::Slot& victim = loop->slots[(slot + i) % loop->num_slots];
+      int stolen_begin, stolen_end;
+      {
+        boost::mutex::scoped_lock lock(victim.mutex);
+        const int left = victim.end - victim.begin;
+        if (left <= 0) { continue; }
+        const int take = left > loop->grain ? (left + 1) / 2 : left;
+        stolen_end = victim.end;
+        stolen_begin = stolen_end - take;
+        victim.end = stolen_begin;
+      }
+      ++stats->steals;
+      *begin = stolen_begin;
+      *end = std::min(stolen_end, stolen_begin + loop->grain);
+      boost::mutex::scoped_lock lock(own.mutex);
+      own.begin = *end;
+      own.end = stolen_end;
+      return true;
+    }
+    return false;
+  }
+
+  const int num_threads_;
+  boost::thread_group workers_;
+  // Held by the thread whose loop the pool runs.
+  boost::mutex run_mutex_;
+  // Guards the loop the workers are woken for.
+  boost::mutex mutex_;
+  boost::condition_variable wake_;
+  Loop* loop_;
+  uint64_t generation_;
+  bool stop_;
+  boost::mutex stats_mutex_;
+  ThreadPool::Stats stats_;
+};
+
+boost::mutex g_pool_mutex;
+shared_ptr<Pool> g_pool;
+
+shared_ptr<Pool> GetPool() {
+  boost::mutex::scoped_lock lock(g_pool_mutex);
+  if (!g_pool) {
+    g_pool.reset(new Pool(AllowedCpus().size()));
+  }
+  return g_pool;
+}
+
+}  // namespace
+
+void parallel_for(const int n, const int grain, const RangeFunction& body) {
+  if (n <= 0) { return; }
+  if (n <= grain) {
+    body(0, n);
+    return;
+  }
+  GetPool()->Run(n, grain, body);
+}
+
+int ThreadPool::num_threads() {
+  return GetPool()->num_threads();
+}
+
+void ThreadPool::set_num_threads(const int num_threads) {
+  CHECK_GE(num_threads, 0);
+  const int threads = num_threads > 0 ? num_threads : AllowedCpus().size();
+  boost::mutex::scoped_lock lock(g_pool_mutex);
+  // The old pool joins its workers once the last loop on it returns.
+  g_pool.reset(new Pool(threads));
+  SetBlasNumThreads(threads);
+}
+
+ThreadPool::Stats ThreadPool::stats() {
+  return GetPool()->stats();
+}
+
+void ThreadPool::ResetStats() {
+  GetPool()->ResetStats();
+}
+
+}  // namespace caffe
@@ -0,0 +1,514 @@
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define USE_AVX512_WINOGRAD
+#endif
+
+#include <algorithm>
+
+#include "caffe/common.hpp"
+#include "caffe/util/winograd.hpp"
+
+namespace caffe {
+
+// The transform matrices of F(m x m, 3 x 3): B^T for the input tiles, G for
+// the filters and A^T for the output tiles.
+template <int M> struct Winograd;
+
+template <> struct Winograd<2> {
+  static const int kAlpha = 4;
+  static const float BT[4][4];
+  static const float G[4][3];
+  static const float AT[2][4];
+};
+
+const float Winograd<2>::BT[4][4] = {
+  {1,  0, -1,  0},
+  {0,  1,  1,  0},
+  {0, -1,  1,  0},
+  {0,  1,  0, -1},
+};
+const float Winograd<2>::G[4][3] = {
+  {1,     0,   0},
+  {0.5,  0.5, 0.5},
+  {0.5, -0.5, 0.5},
+  {0,     0,   1},
+};
+const float Winograd<2>::AT[2][4] = {
+  {1, 1,  1,  0},
+  {0, 1, -1, -1},
+};
+
+template <> struct Winograd<4> {
+  static const int kAlpha = 6;
+  static const float BT[6][6];
+  static const float G[6][3];
+  static const float AT[4][6];
+};
+
+const float Winograd<4>::BT[6][6] = {
+  {4,  0, -5,  0, 1, 0},
+  {0, -4, -4,  1, 1, 0},
+  {0,  4, -4, -1, 1, 0},
+  {0, -2, -1,  2, 1, 0},
+  {0,  2, -1, -2, 1, 0},
+  {0,  4,  0, -5, 0, 1},
+};
+const float Winograd<4>::G[6][3] = {
+  { 1.f / 4,        0,       0},
+  {-1.f / 6, -1.f / 6, -1.f / 6},
+  {-1.f / 6,  1.f / 6, -1.f / 6},
+  { 1.f / 24, 1.f / 12, 1.f / 6},
+  { 1.f / 24, -1.f / 12, 1.f / 6},
+  {       0,        0,       1},
+};
+const float Winograd<4>::AT[4][6] = {
+  {1, 1,  1, 1,  1, 0},
+  {0, 1, -1, 2, -2, 0},
+  {0, 1,  1, 4,  4, 0},
+  {0, 1, -1, 8, -8, 1},
+};
+
+// Where tile t of the batch lies: the offset of its image, and the first
+// row and column of its output tile.
+struct TilePosition {
+  int image, y, x;
+};
+
+static inline TilePosition tile_position(const int t, const int tile,
+    const int tiles_h, const int tiles_w) {
+  const int tiles = tiles_h * tiles_w;
+  TilePosition position;
+  position.image = t / tiles;
+  position.y = (t % tiles) / tiles_w * tile;
+  position.x = (t % tiles) % tiles_w * tile;
+  return position;
+}
+
+template <int M, typename Dtype>
+static void filter_transform(const int K, const int C, const Dtype* weights,
+    Dtype* U) {
+  const int A = Winograd<M>::kAlpha;
+  for (int k = 0; k < K; ++k) {
+    for (int c = 0; c < C; ++c) {
+      const Dtype* g = weights + (k * C + c) * 9;
+      // U = G g G^T
+      Dtype Gg[A][3];
+      for (int i = 0; i < A; ++i) {
+        for (int j = 0; j < 3; ++j) {
+          Gg[i][j] = 0;
+          for (int l = 0; l < 3; ++l) {
+            Gg[i][j] += Winograd<M>::G[i][l] * g[l * 3 + j];
+          }
+        }
+      }
+      for (int i = 0; i < A; ++i) {
+        for (int j = 0; j < A; ++j) {
+          Dtype u = 0;
+          for (int l = 0; l < 3; ++l) {
+            u += Gg[i][l] * Winograd<M>::G[j][l];
+          }
+          U[((i * A + j) * K + k) * C + c] = u;
+        }
+      }
+    }
+  }
+}
+
+template <int M, typename Dtype>
+static void input_transform(const Dtype* data, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    const int tiles_h, const int tiles_w, const int first_tile,
+    const int num_tiles, Dtype* V) {
+  const int A = Winograd<M>::kAlpha;
+  for (int p = 0; p < num_tiles; ++p) {
+    const TilePosition position =
+        tile_position(first_tile + p, M, tiles_h, tiles_w);
+    for (int c = 0; c < channels; ++c) {
+      const Dtype* channel =
+          data + (position.image * channels + c) * height * width;
+      Dtype d[A][A];
+      for (int i = 0; i < A; ++i) {
+        const int y = position.y - pad_h + i;
+        for (int j = 0; j < A; ++j) {
+          const int x = position.x - pad_w + j;
+          d[i][j] = y >= 0 && y < height && x >= 0 && x < width ?
+              channel[y * width + x] : Dtype(0);
+        }
+      }
+      // V = B^T d B
+      Dtype BTd[A][A];
+      for (int i = 0; i < A; ++i) {
+        for (int j = 0; j < A; ++j) {
+          BTd[i][j] = 0;
+          for (int l = 0; l < A; ++l) {
+            BTd[i][j] += Winograd<M>::BT[i][l] * d[l][j];
+          }
+        }
+      }
+      for (int i = 0; i < A; ++i) {
+        for (int j = 0; j < A; ++j) {
+          Dtype v = 0;
+          for (int l = 0; l < A; ++l) {
+            v += BTd[i][l] * Winograd<M>::BT[j][l];
+          }
+          V[((i * A + j) * channels + c) * num_tiles + p] = v;
+        }
+      }
+    }
+  }
+}
+
+template <int M, typename Dtype>
+static void output_transform(const Dtype* M_data, const int channels,
+    const int height, const int width, const int tiles_h, const int tiles_w,
+    const int first_tile, const int num_tiles, Dtype* output) {
+  const int A = Winograd<M>::kAlpha;
+  for (int p = 0; p < num_tiles; ++p) {
+    const TilePosition position =
+        tile_position(first_tile + p, M, tiles_h, tiles_w);
+    for (int c = 0; c < channels; ++c) {
+      Dtype* channel =
+          output + (position.image * channels + c) * height * width;
+      // Y = A^T m A
+      Dtype ATm[M][A];
+      for (int i = 0; i < M; ++i) {
+        for (int j = 0; j < A; ++j) {
+          ATm[i][j] = 0;
+          for (int l = 0; l < A; ++l) {
+            ATm[i][j] += Winograd<M>::AT[i][l] *
+                M_data[((l * A + j) * channels + c) * num_tiles + p];
+          }
+        }
+      }
+      for (int i = 0; i < M && position.y + i < height; ++i) {
+        for (int j = 0; j < M && position.x + j < width; ++j) {
+          Dtype y = 0;
+          for (int l = 0; l < A; ++l) {
+            y += ATm[i][l] * Winograd<M>::AT[j][l];
+          }
+          channel[(position.y + i) * width + position.x + j] = y;
+        }
+      }
+    }
+  }
+}
+
+#ifdef USE_AVX512_WINOGRAD
+static bool cpu_has_avx512f() {
+  static const bool has_avx512f = __builtin_cpu_supports("avx512f");
+  return has_avx512f;
+}
+
+// The SIMD transforms handle 16 tiles at a time, one per lane, gathering the
+// input tiles and scattering the output tiles.
+const int kLanes = 16;
+
+// Loads the positions of up to 16 tiles, from t on, into vectors; the
+// lanes past num_tiles repeat the last tile and are masked off.
+__attribute__((target("avx512f")))
+static __mmask16 load_tile_positions(const int t, const int num_tiles,
+    const int tile, const int tiles_h, const int tiles_w, __m512i* image,
+    __m512i* y, __m512i* x) {
+  const int lanes = std::min(kLanes, num_tiles);
+  int image_data[kLanes], y_data[kLanes], x_data[kLanes];
+  for (int l = 0; l < kLanes; ++l) {
+    const TilePosition position = tile_position(
+        t + std::min(l, lanes - 1), tile, tiles_h, tiles_w);
+    image_data[l] = position.image;
+    y_data[l] = position.y;
+    x_data[l] = position.x;
+  }
+  *image = _mm512_loadu_si512(image_data);
+  *y = _mm512_loadu_si512(y_data);
+  *x = _mm512_loadu_si512(x_data);
+  return lanes == kLanes ? 0xFFFF : (1 << lanes) - 1;
+}
+
+template <int M>
+__attribute__((target("avx512f")))
+static void input_transform_avx512(const float* data, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    const int tiles_h, const int tiles_w, const int first_tile,
+    const int num_tiles, float* V) {
+  const int A = Winograd<M>::kAlpha;
+  const __m512i zero = _mm512_setzero_si512();
+  const __m512i height_v = _mm512_set1_epi32(height);
+  const __m512i width_v = _mm512_set1_epi32(width);
+  for (int p = 0; p < num_tiles; p += kLanes) {
+    __m512i image, y0, x0;
+    const __mmask16 valid = load_tile_positions(first_tile + p,
+        num_tiles - p, M, tiles_h, tiles_w, &image, &y0, &x0);
+    // Which values of each tile lie inside the image, and their offsets from
+    // the first channel of the tile's image.
+    const __m512i image_offset = _mm512_mullo_epi32(image,
+        _mm512_set1_epi32(channels * height * width));
+    __mmask16 inside[A][A];
+    __m512i offset[A][A];
+    for (int i = 0; i < A; ++i) {
+      const __m512i y = _mm512_add_epi32(y0, _mm512_set1_epi32(i - pad_h));
+      const __mmask16 row_inside = _mm512_mask_cmpge_epi32_mask(valid, y,
+          zero) & _mm512_cmplt_epi32_mask(y, height_v);
+      const __m512i row_offset = _mm512_add_epi32(image_offset,
+          _mm512_mullo_epi32(y, width_v));
+      for (int j = 0; j < A; ++j) {
+        const __m512i x = _mm512_add_epi32(x0, _mm512_set1_epi32(j - pad_w));
+        inside[i][j] = _mm512_mask_cmpge_epi32_mask(row_inside, x, zero) &
+            _mm512_cmplt_epi32_mask(x, width_v);
+        offset[i][j] = _mm512_add_epi32(row_offset, x);
+      }
+    }
+    for (int c = 0; c < channels; ++c) {
+      const float* channel = data + c * height * width;
+      __m512 d[A][A];
+      for (int i = 0; i < A; ++i) {
+        for (int j = 0; j < A; ++j) {
+          d[i][j] = _mm512_mask_i32gather_ps(_mm512_setzero_ps(),
+              inside[i][j], offset[i][j], channel, 4);
+        }
+      }
+      // V = B^T d B
+      __m512 BTd[A][A];
+      for (int i = 0; i < A; ++i) {
+        for (int j = 0; j < A; ++j) {
+          BTd[i][j] = _mm512_setzero_ps();
+          for (int l = 0; l < A; ++l) {
+            if (Winograd<M>::BT[i][l] != 0) {
+              BTd[i][j] = _mm512_fmadd_ps(
+                  _mm512_set1_ps(Winograd<M>::BT[i][l]), d[l][j], BTd[i][j]);
+            }
+          }
+        }
+      }
+      for (int i = 0; i < A; ++i) {
+        for (int j = 0; j < A; ++j) {
+          __m512 v = _mm512_setzero_ps();
+          for (int l = 0; l < A; ++l) {
+            if (Winograd<M>::BT[j][l] != 0) {
+              v = _mm512_fmadd_ps(_mm512_set1_ps(Winograd<M>::BT[j][l]),
+                  BTd[i][l], v);
+            }
+          }
+          _mm512_mask_storeu_ps(V + ((i * A + j) * channels + c) * num_tiles +
+              p, valid, v);
+        }
+      }
+    }
+  }
+}
+
+template <int M>
+__attribute__((target("avx512f")))
+static void output_transform_avx512(const float* M_data, const int channels,
+    const int height, const int width, const int tiles_h, const int tiles_w,
+    const int first_tile, const int num_tiles, float* output) {
+  const int A = Winograd<M>::kAlpha;
+  const __m512i height_v = _mm512_set1_epi32(height);
+  const __m512i width_v = _mm512_set1_epi32(width);
+  for (int p = 0; p < num_tiles; p += kLanes) {
+    __m512i image, y0, x0;
+    const __mmask16 valid = load_tile_positions(first_tile + p,
+        num_tiles - p, M, tiles_h, tiles_w, &image, &y0, &x0);
+    const __m512i image_offset = _mm512_mullo_epi32(image,
+        _mm512_set1_epi32(channels * height * width));
+    __mmask16 inside[M][M];
+    __m512i offset[M][M];
+    for (int i = 0; i < M; ++i) {
+      const __m512i y = _mm512_add_epi32(y0, _mm512_set1_epi32(i));
+      const __mmask16 row_inside =
+          _mm512_mask_cmplt_epi32_mask(valid, y, height_v);
+      const __m512i row_offset = _mm512_add_epi32(image_offset,
+          _mm512_mullo_epi32(y, width_v));
+      for (int j = 0; j < M; ++j) {
+        const __m512i x = _mm512_add_epi32(x0, _mm512_set1_epi32(j));
+        inside[i][j] = _mm512_mask_cmplt_epi32_mask(row_inside, x, width_v);
+        offset[i][j] = _mm512_add_epi32(row_offset, x);
+      }
+    }
+    for (int c = 0; c < channels; ++c) {
+      float* channel = output + c * height * width;
+      // Y = A^T m A
+      __m512 ATm[M][A];
+      for (int i = 0; i < M; ++i) {
+        for (int j = 0; j < A; ++j) {
+          ATm[i][j] = _mm512_setzero_ps();
+        }
+      }
+      for (int l = 0; l < A; ++l) {
+        for (int j = 0; j < A; ++j) {
+          const __m512 m = _mm512_maskz_loadu_ps(valid,
+              M_data + ((l * A + j) * channels + c) * num_tiles + p);
+          for (int i = 0; i < M; ++i) {
+            if (Winograd<M>::AT[i][l] != 0) {
+              ATm[i][j] = _mm512_fmadd_ps(
+                  _mm512_set1_ps(Winograd<M>::AT[i][l]), m, ATm[i][j]);
+            }
+          }
+        }
+      }
+      for (int i = 0; i < M; ++i) {
+        for (int j = 0; j < M; ++j) {
+          __m512 y = _mm512_setzero_ps();
+          for (int l = 0; l < A; ++l) {
+            if (Winograd<M>::AT[j][l] != 0) {
+              y = _mm512_fmadd_ps(_mm512_set1_ps(Winograd<M>::AT[j][l]),
+                  ATm[i][l], y);
+            }
+          }
+          _mm512_mask_i32scatter_ps(channel, inside[i][j], offset[i][j], y,
+              4);
+        }
+      }
+    }
+  }
+}
+#endif  // USE_AVX512_WINOGRAD
+
+// Only float has SIMD transforms; these return false when there is none for
+// the Dtype or the CPU.
+template <int M, typename Dtype>
+static bool input_transform_simd(const Dtype* data, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    const int tiles_h, const int tiles_w, const int first_tile,
+    const int num_tiles, Dtype* V) {
+  return false;
+}
+
+template <int M>
+static bool input_transform_simd(const float* data, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    const int tiles_h, const int tiles_w, const int first_tile,
+    const int num_tiles, float* V) {
+#ifdef USE_AVX512_WINOGRAD
+  if (cpu_has_avx512f()) {
+    input_transform_avx512<M>(data, channels, height, width, pad_h, pad_w,
+        tiles_h, tiles_w, first_tile, num_tiles, V);
+    return true;
+  }
+#endif
+  return false;
+}
+
+template <int M, typename Dtype>
+static bool output_transform_simd(const Dtype* M_data, const int channels,
+    const int height, const int width, const int tiles_h, const int tiles_w,
+    const int first_tile, const int num_tiles, Dtype* output) {
+  return false;
+}
+
+template <int M>
+static bool output_transform_simd(const float* M_data, const int channels,
+    const int height, const int width, const int tiles_h, const int tiles_w,
+    const int first_tile, const int num_tiles, float* output) {
+#ifdef USE_AVX512_WINOGRAD
+  if (cpu_has_avx512f()) {
+    output_transform_avx512<M>(M_data, channels, height, width, tiles_h,
+        tiles_w, first_tile, num_tiles, output);
+    return true;
+  }
+#endif
+  return false;
+}
+
+template <>
+bool caffe_cpu_winograd_supported<float>() {
+#ifdef USE_AVX512_WINOGRAD
+  return cpu_has_avx512f();
+#else
+  return false;
+#endif
+}
+
+template <>
+bool caffe_cpu_winograd_supported<double>() {
+  return false;
+}
+
+template <typename Dtype>
+void winograd_filter_transform_cpu(const int tile, const int K, const int C,
+    const Dtype* weights, Dtype* U) {
+  switch (tile) {
+  case 2:
+    filter_transform<2>(K, C, weights, U);
+    break;
+  case 4:
+    filter_transform<4>(K, C, weights, U);
+    break;
+  default:
+    LOG(FATAL) << "Unsupported Winograd tile size " << tile;
+  }
+}
+
+template void winograd_filter_transform_cpu<float>(const int tile,
+    const int K, const int C, const float* weights, float* U);
+template void winograd_filter_transform_cpu<double>(const int tile,
+    const int K, const int C, const double* weights, double* U);
+
+template <typename Dtype>
+void winograd_input_transform_cpu(const Dtype* data, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    const int tile, const int tiles_h, const int tiles_w,
+    const int first_tile, const int num_tiles, Dtype* V) {
+  switch (tile) {
+  case 2:
+    if (!input_transform_simd<2>(data, channels, height, width, pad_h,
+        pad_w, tiles_h, tiles_w, first_tile, num_tiles, V)) {
+      input_transform<2>(data, channels, height, width, pad_h, pad_w,
+          tiles_h, tiles_w, first_tile, num_tiles, V);
+    }
+    break;
+  case 4:
+    if (!input_transform_simd<4>(data, channels, height, width, pad_h,
+        pad_w, tiles_h, tiles_w, first_tile, num_tiles, V)) {
+      input_transform<4>(data, channels, height, width, pad_h, pad_w,
+          tiles_h, tiles_w, first_tile, num_tiles, V);
+    }
+    break;
+  default:
+    LOG(FATAL) << "Unsupported Winograd tile size " << tile;
+  }
+}
+
+template void winograd_input_transform_cpu<float>(const float* data,
+    const int channels, const int height, const int width, const int pad_h,
+    const int pad_w, const int tile, const int tiles_h, const int tiles_w,
+    const int first_tile, const int num_tiles, float* V);
+template void winograd_input_transform_cpu<double>(const double* data,
+    const int channels, const int height, const int width, const int pad_h,
+    const int pad_w, const int tile, const int tiles_h, const int tiles_w,
+    const int first_tile, const int num_tiles, double* V);
+
+template <typename Dtype>
+void winograd_output_transform_cpu(const Dtype* M, const int channels,
+    const int height, const int width, const int tile, const int tiles_h,
+    const int tiles_w, const int first_tile, const int num_tiles,
+    Dtype* output) {
+  switch (tile) {
+  case 2:
+    if (!output_transform_simd<2>(M, channels, height, width, tiles_h,
+        tiles_w, first_tile, num_tiles, output)) {
+      output_transform<2>(M, channels, height, width, tiles_h, tiles_w,
+          first_tile, num_tiles, output);
+    }
+    break;
+  case 4:
+    if (!output_transform_simd<4>(M, channels, height, width, tiles_h,
+        tiles_w, first_tile, num_tiles, output)) {
+      output_transform<4>(M, channels, height, width, tiles_h, tiles_w,
+          first_tile, num_tiles, output);
+    }
+    break;
+  default:
+    LOG(FATAL) << "Unsupported Winograd tile size " << tile;
+  }
+}
+
+template void winograd_output_transform_cpu<float>(const float* M,
+    const int channels, const int height, const int width, const int tile,
+    const int tiles_h, const int tiles_w, const int first_tile,
+    const int num_tiles, float* output);
+template void winograd_output_transform_cpu<double>(const double* M,
+    const int channels, const int height, const int width, const int tile,
+    const int tiles_h, const int tiles_w, const int first_tile,
+    const int num_tiles, double* output);
+
+}  // namespace caffe
@@ -0,0 +1,168 @@
+// This program benchmarks the vectorized float math behind caffe_exp,
+// caffe_log, caffe_powx, caffe_tanh and caffe_sigmoid against the scalar
+// loops over libm they replace and, in MKL builds, against MKL's vector
+// math. For each function it reports the time per value and the largest
+// error, in ulp, against the result computed in double precision.
+// Usage:
+//    benchmark_math [FLAGS]
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/simd_math.hpp"
+
+#ifdef USE_MKL
+#include <mkl.h>
+#endif
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_int32(count, 4096,
+    "The number of values per call; the default keeps them in L1 cache.");
+DEFINE_int32(iterations, 2000, "The number of calls to time.");
+
+// The power the pow benchmark raises to, as LRN does.
+static const float kPower = -0.75f;
+
+typedef void (*VectorFunction)(const int n, const float* x, float* y);
+
+static void libm_exp(const int n, const float* x, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = std::exp(x[i]); }
+}
+static void libm_log(const int n, const float* x, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = std::log(x[i]); }
+}
+static void libm_pow(const int n, const float* x, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = std::pow(x[i], kPower); }
+}
+static void libm_tanh(const int n, const float* x, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = std::tanh(x[i]); }
+}
+static void libm_sigmoid(const int n, const float* x, float* y) {
+  for (int i = 0; i < n; ++i) { y[i] = 1.f / (1.f + std::exp(-x[i])); }
+}
+
+static void simd_pow(const int n, const float* x, float* y) {
+  caffe_simd_powx(n, x, kPower, y);
+}
+
+#ifdef USE_MKL
+static void mkl_exp(const int n, const float* x, float* y) {
+  vsExp(n, x, y);
+}
+static void mkl_log(const int n, const float* x, float* y) {
+  vsLn(n, x, y);
+}
+static void mkl_pow(const int n, const float* x, float* y) {
+  vsPowx(n, x, kPower, y);
+}
+static void mkl_tanh(const int n, const float* x, float* y) {
+  vsTanh(n, x, y);
+}
+#endif
+
+static double ref_exp(const double x) { return std::exp(x); }
+static double ref_log(const double x) { return std::log(x); }
+static double ref_pow(const double x) { return std::pow(x, kPower); }
+static double ref_tanh(const double x) { return std::tanh(x); }
+static double ref_sigmoid(const double x) { return 1 / (1 + std::exp(-x)); }
+
+struct Benchmark {
+  const char* name;
+  // The range the inputs are drawn from.
+  float lo;
+  float hi;
+  double (*reference)(const double x);
+  VectorFunction libm;
+  VectorFunction simd;
+  // NULL where MKL has no such function.
+  VectorFunction mkl;
+};
+
+// Returns the largest error of y in ulp.
+static double MaxUlp(const Benchmark& benchmark, const vector<float>& x,
+    const vector<float>& y) {
+  double max_ulp = 0;
+  for (int i = 0; i < x.size(); ++i) {
+    const double ref = benchmark.reference(x[i]);
+    const double ulp = std::ldexp(1.,
+        std::max(std::ilogb(std::max(std::fabs(ref), 1e-30)), -126) - 23);
+    max_ulp = std::max(max_ulp, std::fabs(y[i] - ref) / ulp);
+  }
+  return max_ulp;
+}
+
+// Logs the time per value of function, and its error.
+static void Run(const Benchmark& benchmark, const char* label,
+    const VectorFunction function, const vector<float>& x) {
+  vector<float> y(x.size());
+  function(x.size(), &x[0], &y[0]);
+  CPUTimer timer;
+  timer.Start();
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    function(x.size(), &x[0], &y[0]);
+  }
+  timer.Stop();
+  const double ns = timer.MicroSeconds() * 1e3 / FLAGS_iterations / x.size();
+  LOG(INFO) << benchmark.name << "\t" << label << "\t" << ns
+            << " ns per value, max error " << MaxUlp(benchmark, x, y)
+            << " ulp";
+}
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Benchmark the vectorized float math functions\n"
+        "Usage:\n"
+        "    benchmark_math [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_GT(FLAGS_count, 0);
+  CHECK_GT(FLAGS_iterations, 0);
+
+#ifdef USE_MKL
+  const VectorFunction mkl[] = {mkl_exp, mkl_log, mkl_pow, mkl_tanh, NULL};
+#else
+  const VectorFunction mkl[] = {NULL, NULL, NULL, NULL, NULL};
+#endif
+  const Benchmark benchmarks[] = {
+    {"exp", -80, 80, ref_exp, libm_exp, caffe_simd_exp, mkl[0]},
+    {"log", 1e-30f, 1e30f, ref_log, libm_log, caffe_simd_log, mkl[1]},
+    {"pow", 1e-3f, 1e3f, ref_pow, libm_pow, simd_pow, mkl[2]},
+    {"tanh", -10, 10, ref_tanh, libm_tanh, caffe_simd_tanh, mkl[3]},
+    {"sigmoid", -20, 20, ref_sigmoid, libm_sigmoid, caffe_simd_sigmoid,
+        mkl[4]},
+  };
+  LOG(INFO) << "Vectorized math runs with " << caffe_simd_math_isa() << ".";
+  vector<float> x(FLAGS_count);
+  for (int b = 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]); ++b) {
+    const Benchmark& benchmark = benchmarks[b];
+    // Draw the log uniformly for log and pow, so that all exponents show up.
+    if (benchmark.lo > 0) {
+      caffe_rng_uniform<float>(x.size(), std::log(benchmark.lo),
+          std::log(benchmark.hi), &x[0]);
+      for (int i = 0; i < x.size(); ++i) {
+        x[i] = std::exp(x[i]);
+      }
+    } else {
+      caffe_rng_uniform<float>(x.size(), benchmark.lo, benchmark.hi, &x[0]);
+    }
+    Run(benchmark, "libm", benchmark.libm, x);
+    Run(benchmark, "simd", benchmark.simd, x);
+    if (benchmark.mkl) {
+      Run(benchmark, "mkl", benchmark.mkl, x);
+    }
+  }
+  return 0;
+}
@@ -6,17 +6,23 @@ namespace bp = boost::python;
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <algorithm>
 #include <cstring>
 #include <map>
 #include <string>
 #include <vector>
 
 #include "boost/algorithm/string.hpp"
+#include "boost/bind.hpp"
+#include "boost/thread.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/util/quantize.hpp"
 #include "caffe/util/signal_handler.h"
+#include "caffe/util/thread_pool.hpp"
 
 using caffe::Blob;
 using caffe::Caffe;
+using caffe::CPUTimer;
 using caffe::Net;
 using caffe::Layer;
 using caffe::Solver;
@@ -48,6 +54,15 @@ DEFINE_string(weights, "",
     "separated by ','. Cannot be set simultaneously with snapshot.");
 DEFINE_int32(iterations, 50,
     "The number of iterations to run.");
+DEFINE_int32(max_workers, 0,
+    "Optional; the largest number of concurrent workers to benchmark. "
+    "Defaults to the number of hardware threads. Only used for 'throughput'.");
+DEFINE_int32(threads, 0,
+    "Optional; the number of CPU threads for parallel layers and BLAS. "
+    "Defaults to the number of cores the process may run on.");
+DEFINE_string(quantization, "",
+    "Optional; the int8 quantization table to apply to the model, as written "
+    "by calibrate_int8. Only used for 'test' and 'throughput'.");
 DEFINE_string(sigint_effect, "stop",
              "Optional; action to take when a SIGINT signal is received: "
               "snapshot, stop or none.");
@@ -127,6 +142,23 @@ vector<string> get_stages_from_flags() {
   return stages;
 }
 
+// Read the model definition for the given phase, with the level and stages
+// from flags, and the quantization table, if any, applied.
+caffe::NetParameter get_net_param_from_flags(caffe::Phase phase) {
+  caffe::NetParameter param;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &param);
+  param.mutable_state()->set_phase(phase);
+  vector<string> stages = get_stages_from_flags();
+  for (int i = 0; i < stages.size(); i++) {
+    param.mutable_state()->add_stage(stages[i]);
+  }
+  param.mutable_state()->set_level(FLAGS_level);
+  if (FLAGS_quantization.size()) {
+    caffe::ApplyQuantizationTableOrDie(FLAGS_quantization, &param);
+  }
+  return param;
+}
+
 // caffe commands to call by
 //     caffe <command> <args>
 //
@@ -261,7 +293,6 @@ RegisterBrewFunction(train);
 int test() {
   CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to score.";
   CHECK_GT(FLAGS_weights.size(), 0) << "Need model weights to score.";
-  vector<string> stages = get_stages_from_flags();
 
   // Set device id and mode
   vector<int> gpus;
@@ -280,7 +311,7 @@ int test() {
     Caffe::set_mode(Caffe::CPU);
   }
   // Instantiate the caffe net.
-  Net<float> caffe_net(FLAGS_model, caffe::TEST, FLAGS_level, &stages);
+  Net<float> caffe_net(get_net_param_from_flags(caffe::TEST));
   caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
   LOG(INFO) << "Running for " << FLAGS_iterations << " iterations.";
 
@@ -369,6 +400,7 @@ int time() {
       caffe_net.bottom_need_backward();
   LOG(INFO) << "*** Benchmark begins ***";
   LOG(INFO) << "Testing for " << FLAGS_iterations << " iterations.";
+  caffe::ThreadPool::ResetStats();
   Timer total_timer;
   total_timer.Start();
   Timer forward_timer;
@@ -417,11 +449,87 @@ int time() {
   LOG(INFO) << "Average Forward-Backward: " << total_timer.MilliSeconds() /
     FLAGS_iterations << " ms.";
   LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
+  const caffe::ThreadPool::Stats pool_stats = caffe::ThreadPool::stats();
+  LOG(INFO) << "Thread pool: " << caffe::ThreadPool::num_threads()
+      << " threads, " << pool_stats.parallel_loops << " parallel loops, "
+      << pool_stats.inline_loops << " run inline, " << pool_stats.steals
+      << " steals, utilization " << pool_stats.utilization() * 100 << "%.";
   LOG(INFO) << "*** Benchmark ends ***";
   return 0;
 }
 RegisterBrewFunction(time);
 
+// Runs the Forward passes of one throughput worker.
+static void throughput_worker(Net<float>* net, Caffe::Brew mode, int device) {
+  // The Caffe mode and device are per thread.
+  if (mode == Caffe::GPU) {
+    Caffe::SetDevice(device);
+  }
+  Caffe::set_mode(mode);
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    net->Forward();
+  }
+}
+
+// Throughput: benchmark concurrent inference on replicas of a model that
+// share its weights, scaling the number of workers.
+int throughput() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to benchmark.";
+
+  // Set device id and mode
+  vector<int> gpus;
+  get_gpus(&gpus);
+  if (gpus.size() != 0) {
+    LOG(INFO) << "Use GPU with device ID " << gpus[0];
+    Caffe::SetDevice(gpus[0]);
+    Caffe::set_mode(Caffe::GPU);
+  } else {
+    LOG(INFO) << "Use CPU.";
+    Caffe::set_mode(Caffe::CPU);
+  }
+  // Instantiate the caffe net, and one replica per worker.
+  Net<float> caffe_net(get_net_param_from_flags(caffe::TEST));
+  if (FLAGS_weights.size()) {
+    caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+  }
+  const int max_workers = std::max(FLAGS_max_workers > 0 ? FLAGS_max_workers :
+      static_cast<int>(boost::thread::hardware_concurrency()), 1);
+  vector<shared_ptr<Net<float> > > replicas;
+  for (int i = 0; i < max_workers; ++i) {
+    replicas.push_back(caffe_net.CreateReplica());
+    // As for 'time', do a clean forward pass so that memory allocation is
+    // done; the model is assumed not to take any input blobs.
+    replicas[i]->Forward();
+  }
+
+  LOG(INFO) << "*** Benchmark begins ***";
+  LOG(INFO) << "Testing for " << FLAGS_iterations
+            << " iterations per worker, up to " << max_workers << " workers.";
+  double single_worker_rate = 0;
+  for (int workers = 1; ; workers = std::min(2 * workers, max_workers)) {
+    CPUTimer timer;
+    timer.Start();
+    boost::thread_group threads;
+    for (int i = 0; i < workers; ++i) {
+      threads.create_thread(boost::bind(&throughput_worker, replicas[i].get(),
+          Caffe::mode(), gpus.size() ? gpus[0] : 0));
+    }
+    threads.join_all();
+    const double rate = workers * FLAGS_iterations / timer.Seconds();
+    if (workers == 1) {
+      single_worker_rate = rate;
+    }
+    LOG(INFO) << "Workers: " << workers << "\tforward passes/s: " << rate
+              << "\tspeedup: " << rate / single_worker_rate;
+    if (workers == max_workers) {
+      break;
+    }
+  }
+  LOG(INFO) << "*** Benchmark ends ***";
+  return 0;
+}
+RegisterBrewFunction(throughput);
+
 int main(int argc, char** argv) {
   // Print output to stderr (while still logging).
   FLAGS_alsologtostderr = 1;
@@ -434,9 +542,14 @@ int main(int argc, char** argv) {
       "  train           train or finetune a model\n"
       "  test            score a model\n"
       "  device_query    show GPU diagnostic information\n"
-      "  time            benchmark model execution time");
+      "  time            benchmark model execution time\n"
+      "  throughput      benchmark concurrent inference on weight-shared "
+      "replicas");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+  if (FLAGS_threads > 0) {
+    caffe::ThreadPool::set_num_threads(FLAGS_threads);
+  }
   if (argc == 2) {
 #ifdef WITH_PYTHON_LAYER
     try {
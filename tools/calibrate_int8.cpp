@@ -0,0 +1,136 @@
+// This program calibrates a trained net for int8 inference: it runs the net
+// over sample data, records the largest input magnitude of each
+// Convolution, DepthwiseConvolution and InnerProduct layer, and writes them
+// as a quantization table (see QuantizationParameter). It then compares the
+// scores of the net with and without quantization over the same number of
+// batches.
+// Usage:
+//    calibrate_int8 [FLAGS] NET_PROTOTXT WEIGHTS OUT_TABLE
+// The table is applied with the --quantization flag of the caffe tool.
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/quantize.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_int32(iterations, 50,
+    "The number of batches to calibrate on, and to compare the scores of the "
+    "two nets on.");
+DEFINE_double(max_score_change, 0.01,
+    "The largest change allowed in any output score of the net, e.g. its "
+    "accuracy, once quantized; 0 skips the comparison.");
+
+// Whether layers of this type can run in int8.
+static bool IsQuantizable(const string& type) {
+  return type == "Convolution" || type == "DepthwiseConvolution" ||
+      type == "InnerProduct";
+}
+
+// Returns the mean of each output of net over the given number of batches.
+static vector<float> MeanScores(Net<float>* net, int iterations) {
+  vector<float> scores(net->num_outputs(), 0);
+  for (int i = 0; i < iterations; ++i) {
+    const vector<Blob<float>*>& result = net->Forward();
+    for (int j = 0; j < result.size(); ++j) {
+      const float* result_data = result[j]->cpu_data();
+      for (int k = 0; k < result[j]->count(); ++k) {
+        scores[j] += result_data[k] / result[j]->count() / iterations;
+      }
+    }
+  }
+  return scores;
+}
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Calibrate a trained net for int8 inference\n"
+        "Usage:\n"
+        "    calibrate_int8 [FLAGS] NET_PROTOTXT WEIGHTS OUT_TABLE\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 4) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/calibrate_int8");
+    return 1;
+  }
+  CHECK_GT(FLAGS_iterations, 0);
+
+  Caffe::set_mode(Caffe::CPU);
+  NetParameter param;
+  ReadNetParamsFromTextFileOrDie(argv[1], &param);
+  param.mutable_state()->set_phase(caffe::TEST);
+  Net<float> net(param);
+  net.CopyTrainedLayersFrom(argv[2]);
+
+  // Run the net layer by layer, to see each input before any layer running
+  // in place can change it.
+  const vector<shared_ptr<Layer<float> > >& layers = net.layers();
+  vector<float> input_max(layers.size(), 0);
+  LOG(INFO) << "Calibrating on " << FLAGS_iterations << " batches.";
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    for (int j = 0; j < layers.size(); ++j) {
+      if (IsQuantizable(layers[j]->type())) {
+        const Blob<float>& input = *net.bottom_vecs()[j][0];
+        input_max[j] = std::max(input_max[j],
+            caffe_cpu_amax(input.count(), input.cpu_data()));
+      }
+      net.ForwardFromTo(j, j);
+    }
+  }
+
+  QuantizationTable table;
+  for (int j = 0; j < layers.size(); ++j) {
+    if (!IsQuantizable(layers[j]->type())) { continue; }
+    QuantizationTable::LayerQuantization* layer = table.add_layer();
+    layer->set_name(net.layer_names()[j]);
+    layer->mutable_quantization_param()->set_input_max(input_max[j]);
+    LOG(INFO) << "Layer " << net.layer_names()[j] << ": input max "
+              << input_max[j];
+  }
+  WriteProtoToTextFile(table, argv[3]);
+  LOG(INFO) << "Wrote the quantization table of " << table.layer_size()
+            << " layers to " << argv[3];
+
+  if (FLAGS_max_score_change <= 0 || net.num_outputs() == 0) {
+    return 0;
+  }
+  // Score both nets from the start of the data.
+  Net<float> fp32_net(param);
+  fp32_net.ShareTrainedLayersWith(&net);
+  NetParameter int8_param(param);
+  ApplyQuantizationTable(table, &int8_param);
+  Net<float> int8_net(int8_param);
+  int8_net.ShareTrainedLayersWith(&net);
+  const vector<float> fp32_scores = MeanScores(&fp32_net, FLAGS_iterations);
+  const vector<float> int8_scores = MeanScores(&int8_net, FLAGS_iterations);
+  bool within_budget = true;
+  for (int i = 0; i < fp32_scores.size(); ++i) {
+    const string& name =
+        fp32_net.blob_names()[fp32_net.output_blob_indices()[i]];
+    const float change = std::fabs(int8_scores[i] - fp32_scores[i]);
+    LOG(INFO) << name << ": fp32 " << fp32_scores[i] << ", int8 "
+              << int8_scores[i] << " (change " << change << ")";
+    within_budget &= change <= FLAGS_max_score_change;
+  }
+  if (!within_budget) {
+    LOG(ERROR) << "A score changed by more than " << FLAGS_max_score_change
+               << " once quantized to int8.";
+    return 1;
+  }
+  return 0;
+}
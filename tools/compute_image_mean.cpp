@@ -1,9 +1,11 @@
 #include <stdint.h>
 #include <algorithm>
+#include <cmath>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "boost/bind.hpp"
 #include "boost/scoped_ptr.hpp"
 #include "gflags/gflags.h"
 #include "glog/logging.h"
@@ -11,6 +13,7 @@
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 using namespace caffe;  // NOLINT(build/namespaces)
 
@@ -20,6 +23,88 @@ using boost::scoped_ptr;
 
 DEFINE_string(backend, "lmdb",
         "The backend {leveldb, lmdb} containing the images");
+DEFINE_int32(threads, 0,
+    "The number of threads decoding and summing the images; "
+    "0 uses every core");
+DEFINE_bool(std, false,
+    "When this option is on, also compute the standard deviation of each "
+    "channel");
+
+// The datums read from the db at once, per thread.
+const int kDatumsPerShard = 64;
+
+// The sums of the datums of a shard, pixel by pixel, and of their squares,
+// channel by channel. Bytes add up exactly in integers.
+struct ImageSums {
+  ImageSums(const int size, const int channels)
+      : count(0), byte_sums(size, 0), float_sums(size, 0.),
+        square_sums(channels, 0.) {}
+
+  int count;
+  std::vector<uint64_t> byte_sums;
+  std::vector<double> float_sums;
+  std::vector<double> square_sums;
+};
+
+// Parses, decodes and sums the datums of values [begin, end) into sums.
+void AddDatums(const std::vector<std::string>& values, const int begin,
+    const int end, ImageSums* sums) {
+  const int channels = sums->square_sums.size();
+  const int data_size = sums->byte_sums.size();
+  const int dim = data_size / channels;
+  Datum datum;
+  for (int j = begin; j < end; ++j) {
+    datum.ParseFromString(values[j]);
+    DecodeDatumNative(&datum);
+
+    const std::string& data = datum.data();
+    const int size_in_datum = std::max<int>(datum.data().size(),
+        datum.float_data_size());
+    CHECK_EQ(size_in_datum, data_size) << "Incorrect data field size " <<
+        size_in_datum;
+    if (data.size() != 0) {
+      CHECK_EQ(data.size(), size_in_datum);
+      const uint8_t* pixels = reinterpret_cast<const uint8_t*>(data.data());
+      uint64_t* byte_sums = &sums->byte_sums[0];
+      for (int i = 0; i < size_in_datum; ++i) {
+        byte_sums[i] += pixels[i];
+      }
+      for (int c = 0; c < channels; ++c) {
+        uint64_t squares = 0;
+        for (int i = c * dim; i < (c + 1) * dim; ++i) {
+          squares += pixels[i] * pixels[i];
+        }
+        sums->square_sums[c] += squares;
+      }
+    } else {
+      CHECK_EQ(datum.float_data_size(), size_in_datum);
+      const float* floats = datum.float_data().data();
+      double* float_sums = &sums->float_sums[0];
+      for (int i = 0; i < size_in_datum; ++i) {
+        float_sums[i] += floats[i];
+      }
+      for (int c = 0; c < channels; ++c) {
+        double squares = 0;
+        for (int i = c * dim; i < (c + 1) * dim; ++i) {
+          squares += static_cast<double>(floats[i]) * floats[i];
+        }
+        sums->square_sums[c] += squares;
+      }
+    }
+    ++sums->count;
+  }
+}
+
+// Sums shard of the values into shard_sums[shard].
+void AddShard(const std::vector<std::string>* values,
+    std::vector<ImageSums>* shard_sums, int begin, int end) {
+  const int num_shards = shard_sums->size();
+  const int num = values->size();
+  for (int shard = begin; shard < end; ++shard) {
+    AddDatums(*values, num * shard / num_shards,
+        num * (shard + 1) / num_shards, &(*shard_sums)[shard]);
+  }
+}
 
 int main(int argc, char** argv) {
   ::google::InitGoogleLogging(argv[0]);
@@ -60,54 +145,54 @@ int main(int argc, char** argv) {
   sum_blob.set_height(datum.height());
   sum_blob.set_width(datum.width());
   const int data_size = datum.channels() * datum.height() * datum.width();
-  int size_in_datum = std::max<int>(datum.data().size(),
-                                    datum.float_data_size());
-  for (int i = 0; i < size_in_datum; ++i) {
-    sum_blob.add_data(0.);
-  }
+  const int channels = sum_blob.channels();
+  const int dim = sum_blob.height() * sum_blob.width();
+
+  // The cursor reads the datums in batches, which the threads decode and
+  // sum in shards of their own.
+  const int num_shards =
+      FLAGS_threads > 0 ? FLAGS_threads : ThreadPool::num_threads();
+  ThreadPool::set_num_threads(num_shards);
+  std::vector<ImageSums> shard_sums(num_shards,
+      ImageSums(data_size, channels));
+  std::vector<std::string> values;
   LOG(INFO) << "Starting Iteration";
   while (cursor->valid()) {
-    Datum datum;
-    datum.ParseFromString(cursor->value());
-    DecodeDatumNative(&datum);
-
-    const std::string& data = datum.data();
-    size_in_datum = std::max<int>(datum.data().size(),
-        datum.float_data_size());
-    CHECK_EQ(size_in_datum, data_size) << "Incorrect data field size " <<
-        size_in_datum;
-    if (data.size() != 0) {
-      CHECK_EQ(data.size(), size_in_datum);
-      for (int i = 0; i < size_in_datum; ++i) {
-        sum_blob.set_data(i, sum_blob.data(i) + (uint8_t)data[i]);
-      }
-    } else {
-      CHECK_EQ(datum.float_data_size(), size_in_datum);
-      for (int i = 0; i < size_in_datum; ++i) {
-        sum_blob.set_data(i, sum_blob.data(i) +
-            static_cast<float>(datum.float_data(i)));
-      }
+    values.clear();
+    while (cursor->valid() && values.size() < kDatumsPerShard * num_shards) {
+      values.push_back(cursor->value());
+      cursor->Next();
     }
-    ++count;
-    if (count % 10000 == 0) {
+    parallel_for(num_shards, 1,
+        boost::bind(&AddShard, &values, &shard_sums, _1, _2));
+    const int last_count = count;
+    count += values.size();
+    if (count / 10000 != last_count / 10000) {
       LOG(INFO) << "Processed " << count << " files.";
     }
-    cursor->Next();
   }
 
   if (count % 10000 != 0) {
     LOG(INFO) << "Processed " << count << " files.";
   }
-  for (int i = 0; i < sum_blob.data_size(); ++i) {
-    sum_blob.set_data(i, sum_blob.data(i) / count);
+  std::vector<double> square_sums(channels, 0.);
+  for (int i = 0; i < data_size; ++i) {
+    double sum = 0;
+    for (int shard = 0; shard < num_shards; ++shard) {
+      sum += shard_sums[shard].byte_sums[i] + shard_sums[shard].float_sums[i];
+    }
+    sum_blob.add_data(sum / count);
+  }
+  for (int shard = 0; shard < num_shards; ++shard) {
+    for (int c = 0; c < channels; ++c) {
+      square_sums[c] += shard_sums[shard].square_sums[c];
+    }
   }
   // Write to disk
   if (argc == 3) {
     LOG(INFO) << "Write to " << argv[2];
     WriteProtoToBinaryFile(sum_blob, argv[2]);
   }
-  const int channels = sum_blob.channels();
-  const int dim = sum_blob.height() * sum_blob.width();
   std::vector<float> mean_values(channels, 0.0);
   LOG(INFO) << "Number of channels: " << channels;
   for (int c = 0; c < channels; ++c) {
@@ -115,6 +200,13 @@ int main(int argc, char** argv) {
       mean_values[c] += sum_blob.data(dim * c + i);
     }
     LOG(INFO) << "mean_value channel [" << c << "]:" << mean_values[c] / dim;
+    if (FLAGS_std) {
+      const double mean = mean_values[c] / dim;
+      const double variance =
+          square_sums[c] / (static_cast<double>(count) * dim) - mean * mean;
+      LOG(INFO) << "std_value channel [" << c << "]:"
+          << std::sqrt(std::max(0., variance));
+    }
   }
 #else
   LOG(FATAL) << "This tool requires OpenCV; compile with USE_OPENCV.";
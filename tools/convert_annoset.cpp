@@ -27,9 +27,11 @@
 
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
+#include "caffe/util/db_writer.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 using namespace caffe;  // NOLINT(build/namespaces)
 using std::pair;
@@ -39,6 +41,8 @@ DEFINE_bool(gray, false,
     "When this option is on, treat images as grayscale ones");
 DEFINE_bool(shuffle, false,
     "Randomly shuffle the order of images and their labels");
+DEFINE_int32(shuffle_seed, 1701,
+    "The seed of the --shuffle order, so that runs write the same db");
 DEFINE_string(backend, "lmdb",
     "The backend {lmdb, leveldb} for storing the result");
 DEFINE_string(anno_type, "classification",
@@ -61,6 +65,75 @@ DEFINE_bool(encoded, false,
     "When this option is on, the encoded image will be save in datum");
 DEFINE_string(encode_type, "",
     "Optional: What type should we encode the image as ('png','jpg',...).");
+DEFINE_int32(threads, 0,
+    "The number of threads reading, resizing and encoding images; "
+    "0 uses every core");
+DEFINE_int32(commit_mb, 64,
+    "The megabytes of records written to the db per transaction");
+
+#ifdef USE_OPENCV
+typedef std::vector<std::pair<std::string, boost::variant<int, std::string> > >
+    AnnoLines;
+
+// Makes the AnnotatedDatum record of a line of the list, on the
+// db::WriteRecords workers.
+struct AnnoRecordMaker {
+  bool operator()(int line_id, string* key, string* value) const {
+    bool status = true;
+    std::string enc = encode_type;
+    if (encoded && !enc.size()) {
+      // Guess the encoding type from the file name
+      string fn = (*lines)[line_id].first;
+      size_t p = fn.rfind('.');
+      if ( p == fn.npos )
+        LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
+      enc = fn.substr(p);
+      std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
+    }
+    AnnotatedDatum anno_datum;
+    Datum* datum = anno_datum.mutable_datum();
+    const std::string filename = root_folder + (*lines)[line_id].first;
+    if (anno_type == "classification") {
+      const int label = boost::get<int>((*lines)[line_id].second);
+      status = ReadImageToDatum(filename, label, resize_height, resize_width,
+          min_dim, max_dim, is_color, enc, datum);
+    } else if (anno_type == "detection") {
+      const std::string labelname =
+          root_folder + boost::get<std::string>((*lines)[line_id].second);
+      status = ReadRichImageToAnnotatedDatum(filename, labelname, resize_height,
+          resize_width, min_dim, max_dim, is_color, enc, type, label_type,
+          *name_to_label, &anno_datum);
+      anno_datum.set_type(AnnotatedDatum_AnnotationType_BBOX);
+    }
+    if (status == false) {
+      LOG(WARNING) << "Failed to read " << (*lines)[line_id].first;
+      return false;
+    }
+    if (size_check) {
+      size_check->Check(*datum);
+    }
+    // sequential
+    *key = caffe::format_int(line_id, 8) + "_" + (*lines)[line_id].first;
+    CHECK(anno_datum.SerializeToString(value));
+    return true;
+  }
+
+  const AnnoLines* lines;
+  const std::map<std::string, int>* name_to_label;
+  std::string root_folder;
+  std::string anno_type;
+  AnnotatedDatum_AnnotationType type;
+  std::string label_type;
+  int min_dim;
+  int max_dim;
+  int resize_height;
+  int resize_width;
+  bool is_color;
+  bool encoded;
+  std::string encode_type;
+  db::SizeCheck* size_check;
+};
+#endif  // USE_OPENCV
 
 int main(int argc, char** argv) {
 #ifdef USE_OPENCV
@@ -88,14 +161,14 @@ int main(int argc, char** argv) {
   const bool encoded = FLAGS_encoded;
   const string encode_type = FLAGS_encode_type;
   const string anno_type = FLAGS_anno_type;
-  AnnotatedDatum_AnnotationType type;
+  AnnotatedDatum_AnnotationType type = AnnotatedDatum_AnnotationType_BBOX;
   const string label_type = FLAGS_label_type;
   const string label_map_file = FLAGS_label_map_file;
   const bool check_label = FLAGS_check_label;
   std::map<std::string, int> name_to_label;
 
   std::ifstream infile(argv[2]);
-  std::vector<std::pair<std::string, boost::variant<int, std::string> > > lines;
+  AnnoLines lines;
   std::string filename;
   int label;
   std::string labelname;
@@ -117,6 +190,7 @@ int main(int argc, char** argv) {
   if (FLAGS_shuffle) {
     // randomly shuffle data
     LOG(INFO) << "Shuffling data";
+    Caffe::set_random_seed(FLAGS_shuffle_seed);
     shuffle(lines.begin(), lines.end());
   }
   LOG(INFO) << "A total of " << lines.size() << " images.";
@@ -132,74 +206,29 @@ int main(int argc, char** argv) {
   // Create new DB
   scoped_ptr<db::DB> db(db::GetDB(FLAGS_backend));
   db->Open(argv[3], db::NEW);
-  scoped_ptr<db::Transaction> txn(db->NewTransaction());
 
-  // Storing to db
-  std::string root_folder(argv[1]);
-  AnnotatedDatum anno_datum;
-  Datum* datum = anno_datum.mutable_datum();
-  int count = 0;
-  int data_size = 0;
-  bool data_size_initialized = false;
-
-  for (int line_id = 0; line_id < lines.size(); ++line_id) {
-    bool status = true;
-    std::string enc = encode_type;
-    if (encoded && !enc.size()) {
-      // Guess the encoding type from the file name
-      string fn = lines[line_id].first;
-      size_t p = fn.rfind('.');
-      if ( p == fn.npos )
-        LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
-      enc = fn.substr(p);
-      std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
-    }
-    filename = root_folder + lines[line_id].first;
-    if (anno_type == "classification") {
-      label = boost::get<int>(lines[line_id].second);
-      status = ReadImageToDatum(filename, label, resize_height, resize_width,
-          min_dim, max_dim, is_color, enc, datum);
-    } else if (anno_type == "detection") {
-      labelname = root_folder + boost::get<std::string>(lines[line_id].second);
-      status = ReadRichImageToAnnotatedDatum(filename, labelname, resize_height,
-          resize_width, min_dim, max_dim, is_color, enc, type, label_type,
-          name_to_label, &anno_datum);
-      anno_datum.set_type(AnnotatedDatum_AnnotationType_BBOX);
-    }
-    if (status == false) {
-      LOG(WARNING) << "Failed to read " << lines[line_id].first;
-      continue;
-    }
-    if (check_size) {
-      if (!data_size_initialized) {
-        data_size = datum->channels() * datum->height() * datum->width();
-        data_size_initialized = true;
-      } else {
-        const std::string& data = datum->data();
-        CHECK_EQ(data.size(), data_size) << "Incorrect data field size "
-            << data.size();
-      }
-    }
-    // sequential
-    string key_str = caffe::format_int(line_id, 8) + "_" + lines[line_id].first;
-
-    // Put in db
-    string out;
-    CHECK(anno_datum.SerializeToString(&out));
-    txn->Put(key_str, out);
-
-    if (++count % 1000 == 0) {
-      // Commit db
-      txn->Commit();
-      txn.reset(db->NewTransaction());
-      LOG(INFO) << "Processed " << count << " files.";
-    }
-  }
-  // write the last batch
-  if (count % 1000 != 0) {
-    txn->Commit();
-    LOG(INFO) << "Processed " << count << " files.";
-  }
+  // Storing to db, in the order of the list, while the images are read,
+  // resized and encoded on the workers.
+  db::SizeCheck size_check;
+  AnnoRecordMaker make_record;
+  make_record.lines = &lines;
+  make_record.name_to_label = &name_to_label;
+  make_record.root_folder = argv[1];
+  make_record.anno_type = anno_type;
+  make_record.type = type;
+  make_record.label_type = label_type;
+  make_record.min_dim = min_dim;
+  make_record.max_dim = max_dim;
+  make_record.resize_height = resize_height;
+  make_record.resize_width = resize_width;
+  make_record.is_color = is_color;
+  make_record.encoded = encoded;
+  make_record.encode_type = encode_type;
+  make_record.size_check = check_size ? &size_check : NULL;
+  const int num_threads =
+      FLAGS_threads > 0 ? FLAGS_threads : ThreadPool::num_threads();
+  db::WriteRecords(db.get(), lines.size(), make_record, num_threads,
+      static_cast<int64_t>(FLAGS_commit_mb) << 20);
 #else
   LOG(FATAL) << "This tool requires OpenCV; compile with USE_OPENCV.";
 #endif  // USE_OPENCV
@@ -20,9 +20,11 @@
 
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
+#include "caffe/util/db_writer.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 using namespace caffe;  // NOLINT(build/namespaces)
 using std::pair;
@@ -32,6 +34,8 @@ DEFINE_bool(gray, false,
     "When this option is on, treat images as grayscale ones");
 DEFINE_bool(shuffle, false,
     "Randomly shuffle the order of images and their labels");
+DEFINE_int32(shuffle_seed, 1701,
+    "The seed of the --shuffle order, so that runs write the same db");
 DEFINE_string(backend, "lmdb",
         "The backend {lmdb, leveldb} for storing the result");
 DEFINE_int32(resize_width, 0, "Width images are resized to");
@@ -42,6 +46,51 @@ DEFINE_bool(encoded, false,
     "When this option is on, the encoded image will be save in datum");
 DEFINE_string(encode_type, "",
     "Optional: What type should we encode the image as ('png','jpg',...).");
+DEFINE_int32(threads, 0,
+    "The number of threads reading, resizing and encoding images; "
+    "0 uses every core");
+DEFINE_int32(commit_mb, 64,
+    "The megabytes of records written to the db per transaction");
+
+#ifdef USE_OPENCV
+// Makes the Datum record of a line of the list, on the db::WriteRecords
+// workers.
+struct ImageRecordMaker {
+  bool operator()(int line_id, string* key, string* value) const {
+    std::string enc = encode_type;
+    if (encoded && !enc.size()) {
+      // Guess the encoding type from the file name
+      string fn = (*lines)[line_id].first;
+      size_t p = fn.rfind('.');
+      if ( p == fn.npos )
+        LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
+      enc = fn.substr(p);
+      std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
+    }
+    Datum datum;
+    bool status = ReadImageToDatum(root_folder + (*lines)[line_id].first,
+        (*lines)[line_id].second, resize_height, resize_width, is_color,
+        enc, &datum);
+    if (status == false) return false;
+    if (size_check) {
+      size_check->Check(datum);
+    }
+    // sequential
+    *key = caffe::format_int(line_id, 8) + "_" + (*lines)[line_id].first;
+    CHECK(datum.SerializeToString(value));
+    return true;
+  }
+
+  const std::vector<std::pair<std::string, int> >* lines;
+  std::string root_folder;
+  int resize_height;
+  int resize_width;
+  bool is_color;
+  bool encoded;
+  std::string encode_type;
+  db::SizeCheck* size_check;
+};
+#endif  // USE_OPENCV
 
 int main(int argc, char** argv) {
 #ifdef USE_OPENCV
@@ -84,6 +133,7 @@ int main(int argc, char** argv) {
   if (FLAGS_shuffle) {
     // randomly shuffle data
     LOG(INFO) << "Shuffling data";
+    Caffe::set_random_seed(FLAGS_shuffle_seed);
     shuffle(lines.begin(), lines.end());
   }
   LOG(INFO) << "A total of " << lines.size() << " images.";
@@ -97,61 +147,23 @@ int main(int argc, char** argv) {
   // Create new DB
   scoped_ptr<db::DB> db(db::GetDB(FLAGS_backend));
   db->Open(argv[3], db::NEW);
-  scoped_ptr<db::Transaction> txn(db->NewTransaction());
 
-  // Storing to db
-  std::string root_folder(argv[1]);
-  Datum datum;
-  int count = 0;
-  int data_size = 0;
-  bool data_size_initialized = false;
-
-  for (int line_id = 0; line_id < lines.size(); ++line_id) {
-    bool status;
-    std::string enc = encode_type;
-    if (encoded && !enc.size()) {
-      // Guess the encoding type from the file name
-      string fn = lines[line_id].first;
-      size_t p = fn.rfind('.');
-      if ( p == fn.npos )
-        LOG(WARNING) << "Failed to guess the encoding of '" << fn << "'";
-      enc = fn.substr(p);
-      std::transform(enc.begin(), enc.end(), enc.begin(), ::tolower);
-    }
-    status = ReadImageToDatum(root_folder + lines[line_id].first,
-        lines[line_id].second, resize_height, resize_width, is_color,
-        enc, &datum);
-    if (status == false) continue;
-    if (check_size) {
-      if (!data_size_initialized) {
-        data_size = datum.channels() * datum.height() * datum.width();
-        data_size_initialized = true;
-      } else {
-        const std::string& data = datum.data();
-        CHECK_EQ(data.size(), data_size) << "Incorrect data field size "
-            << data.size();
-      }
-    }
-    // sequential
-    string key_str = caffe::format_int(line_id, 8) + "_" + lines[line_id].first;
-
-    // Put in db
-    string out;
-    CHECK(datum.SerializeToString(&out));
-    txn->Put(key_str, out);
-
-    if (++count % 1000 == 0) {
-      // Commit db
-      txn->Commit();
-      txn.reset(db->NewTransaction());
-      LOG(INFO) << "Processed " << count << " files.";
-    }
-  }
-  // write the last batch
-  if (count % 1000 != 0) {
-    txn->Commit();
-    LOG(INFO) << "Processed " << count << " files.";
-  }
+  // Storing to db, in the order of the list, while the images are read,
+  // resized and encoded on the workers.
+  db::SizeCheck size_check;
+  ImageRecordMaker make_record;
+  make_record.lines = &lines;
+  make_record.root_folder = argv[1];
+  make_record.resize_height = resize_height;
+  make_record.resize_width = resize_width;
+  make_record.is_color = is_color;
+  make_record.encoded = encoded;
+  make_record.encode_type = encode_type;
+  make_record.size_check = check_size ? &size_check : NULL;
+  const int num_threads =
+      FLAGS_threads > 0 ? FLAGS_threads : ThreadPool::num_threads();
+  db::WriteRecords(db.get(), lines.size(), make_record, num_threads,
+      static_cast<int64_t>(FLAGS_commit_mb) << 20);
 #else
   LOG(FATAL) << "This tool requires OpenCV; compile with USE_OPENCV.";
 #endif  // USE_OPENCV
@@ -0,0 +1,60 @@
+// This program converts trained weights (.caffemodel or .h5) to a mapped
+// weight file, which Net::CopyTrainedLayersFrom maps into memory instead of
+// parsing and copying.
+// Usage:
+//    convert_to_mapped_weights [FLAGS] WEIGHTS_IN MAPPED_WEIGHTS_OUT
+// Converting HDF5 weights also needs the net definition, given by --model.
+
+#include <string>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/mapped_weights.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_string(model, "",
+    "The model definition protocol buffer text file, needed for .h5 weights.");
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Convert trained weights to a mapped weight file\n"
+        "Usage:\n"
+        "    convert_to_mapped_weights [FLAGS] WEIGHTS_IN MAPPED_WEIGHTS_OUT\n"
+        "WEIGHTS_IN is a .caffemodel, or a .h5 file together with --model.\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 3) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0],
+        "tools/convert_to_mapped_weights");
+    return 1;
+  }
+
+  const string input_filename(argv[1]);
+  NetParameter net_param;
+  if (input_filename.size() >= 3 &&
+      input_filename.compare(input_filename.size() - 3, 3, ".h5") == 0) {
+    CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to convert "
+        << input_filename;
+    Caffe::set_mode(Caffe::CPU);
+    Net<float> net(FLAGS_model, caffe::TEST);
+    net.CopyTrainedLayersFrom(input_filename);
+    net.ToProto(&net_param);
+  } else {
+    ReadNetParamsFromBinaryFileOrDie(input_filename, &net_param);
+  }
+
+  WriteMappedWeights(net_param, argv[2]);
+  LOG(INFO) << "Wrote mapped weights to " << argv[2];
+  return 0;
+}
@@ -1,24 +1,200 @@
+#include <algorithm>
+#include <cstdio>
 #include <string>
 #include <vector>
 
 #include "boost/algorithm/string.hpp"
+#include "boost/bind.hpp"
+#include "boost/thread.hpp"
 #include "google/protobuf/text_format.h"
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
 #include "caffe/util/db.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
 
 using caffe::Blob;
+using caffe::BlockingQueue;
 using caffe::Caffe;
 using caffe::Datum;
 using caffe::Net;
 using std::string;
 namespace db = caffe::db;
 
+// Writes the features of one feature blob, a row per item of the batch.
+template<typename Dtype>
+class FeatureWriter {
+ public:
+  virtual ~FeatureWriter() {}
+  virtual void Write(const Blob<Dtype>& features) = 0;
+  virtual void Close() = 0;
+};
+
+// Writes each row as a Datum of float_data into a LMDB or LevelDB, keyed by
+// its row index.
+template<typename Dtype>
+class DBFeatureWriter : public FeatureWriter<Dtype> {
+ public:
+  DBFeatureWriter(const string& db_type, const string& source,
+      const string& blob_name)
+      : db_(db::GetDB(db_type)), blob_name_(blob_name), num_rows_(0) {
+    db_->Open(source, db::NEW);
+    txn_.reset(db_->NewTransaction());
+  }
+
+  virtual void Write(const Blob<Dtype>& features) {
+    const int batch_size = features.num();
+    const int dim_features = features.count() / batch_size;
+    Datum datum;
+    datum.set_channels(features.channels());
+    datum.set_height(features.height());
+    datum.set_width(features.width());
+    datum.mutable_float_data()->Resize(dim_features, 0);
+    string out;
+    for (int n = 0; n < batch_size; ++n) {
+      const Dtype* feature_data = features.cpu_data() + features.offset(n);
+      std::copy(feature_data, feature_data + dim_features,
+          datum.mutable_float_data()->mutable_data());
+      CHECK(datum.SerializeToString(&out));
+      txn_->Put(caffe::format_int(num_rows_, 10), out);
+      if (++num_rows_ % 1000 == 0) {
+        txn_->Commit();
+        txn_.reset(db_->NewTransaction());
+        LOG(ERROR)<< "Extracted features of " << num_rows_ <<
+            " query images for feature blob " << blob_name_;
+      }
+    }
+  }
+
+  virtual void Close() {
+    // write the last batch
+    if (num_rows_ % 1000 != 0) {
+      txn_->Commit();
+    }
+    LOG(ERROR)<< "Extracted features of " << num_rows_ <<
+        " query images for feature blob " << blob_name_;
+    txn_.reset();
+    db_->Close();
+  }
+
+ private:
+  boost::shared_ptr<db::DB> db_;
+  boost::shared_ptr<db::Transaction> txn_;
+  const string blob_name_;
+  int num_rows_;
+};
+
+// Writes the rows as one row-major float32 matrix: headerless for "raw", or
+// as a .npy file for "npy", which numpy.load(..., mmap_mode='r') maps
+// without reading it in.
+template<typename Dtype>
+class MatrixFeatureWriter : public FeatureWriter<Dtype> {
+ public:
+  MatrixFeatureWriter(const string& source, const string& blob_name,
+      const bool npy)
+      : source_(source), blob_name_(blob_name), npy_(npy), num_rows_(0),
+        dim_features_(-1) {
+    file_ = fopen(source.c_str(), "wb");
+    CHECK(file_) << "Failed to open " << source;
+    if (npy_) {
+      // Hold the place of the header, which needs the final number of rows.
+      WriteNpyHeader();
+    }
+  }
+
+  virtual void Write(const Blob<Dtype>& features) {
+    const int batch_size = features.num();
+    const int dim_features = features.count() / batch_size;
+    if (dim_features_ < 0) {
+      dim_features_ = dim_features;
+    }
+    CHECK_EQ(dim_features_, dim_features) << "The features of blob "
+        << blob_name_ << " changed size.";
+    buffer_.assign(features.cpu_data(), features.cpu_data() + features.count());
+    CHECK_EQ(fwrite(&buffer_[0], sizeof(float), buffer_.size(), file_),
+        buffer_.size()) << "Failed to write " << source_;
+    num_rows_ += batch_size;
+    if (num_rows_ / 1000 != (num_rows_ - batch_size) / 1000) {
+      LOG(ERROR)<< "Extracted features of " << num_rows_ <<
+          " query images for feature blob " << blob_name_;
+    }
+  }
+
+  virtual void Close() {
+    if (npy_) {
+      CHECK_EQ(fseek(file_, 0, SEEK_SET), 0);
+      WriteNpyHeader();
+    }
+    CHECK_EQ(fclose(file_), 0) << "Failed to write " << source_;
+    LOG(ERROR)<< "Extracted features of " << num_rows_ <<
+        " query images for feature blob " << blob_name_ << " as a "
+        << num_rows_ << " x " << std::max(dim_features_, 0)
+        << " float matrix";
+  }
+
+ private:
+  // Writes a version 1.0 .npy header of a fixed kNpyHeaderSize bytes, so
+  // that it can be rewritten in place once the shape is known.
+  void WriteNpyHeader() {
+    static const int kNpyHeaderSize = 128;
+    string dict = "{'descr': '<f4', 'fortran_order': False, 'shape': (" +
+        caffe::format_int(num_rows_) + ", " +
+        caffe::format_int(std::max(dim_features_, 0)) + "), }";
+    const int dict_size = kNpyHeaderSize - 10;
+    CHECK_LT(dict.size(), dict_size);
+    dict.resize(dict_size - 1, ' ');
+    dict += '\n';
+    string header("\x93NUMPY\x01\x00", 8);
+    header += static_cast<char>(dict_size & 0xff);
+    header += static_cast<char>(dict_size >> 8);
+    header += dict;
+    CHECK_EQ(fwrite(header.data(), 1, header.size(), file_), header.size())
+        << "Failed to write " << source_;
+  }
+
+  const string source_;
+  const string blob_name_;
+  const bool npy_;
+  FILE* file_;
+  int num_rows_;
+  int dim_features_;
+  std::vector<float> buffer_;
+};
+
+template<typename Dtype>
+FeatureWriter<Dtype>* GetFeatureWriter(const string& db_type,
+    const string& source, const string& blob_name) {
+  if (db_type == "raw" || db_type == "npy") {
+    return new MatrixFeatureWriter<Dtype>(source, blob_name,
+        db_type == "npy");
+  }
+  return new DBFeatureWriter<Dtype>(db_type, source, blob_name);
+}
+
+// Takes the copies of the feature blobs, a batch at a time, off the full
+// queue and writes them, then hands them back on the free queue. A NULL
+// in place of the first feature of a batch ends it.
+template<typename Dtype>
+void WriteFeatures(BlockingQueue<Blob<Dtype>*>* full,
+    BlockingQueue<Blob<Dtype>*>* free_blobs,
+    const std::vector<boost::shared_ptr<FeatureWriter<Dtype> > >* writers) {
+  while (true) {
+    for (size_t i = 0; i < writers->size(); ++i) {
+      Blob<Dtype>* features = full->pop();
+      if (!features) {
+        return;
+      }
+      writers->at(i)->Write(*features);
+      free_blobs->push(features);
+    }
+  }
+}
+
 template<typename Dtype>
 int feature_extraction_pipeline(int argc, char** argv);
 
@@ -39,6 +215,8 @@ int feature_extraction_pipeline(int argc, char** argv) {
     "  feature_extraction_proto_file  extract_feature_blob_name1[,name2,...]"
     "  save_feature_dataset_name1[,name2,...]  num_mini_batches  db_type"
     "  [CPU/GPU] [DEVICE_ID=0]\n"
+    "db_type is lmdb or leveldb for a db of a Datum per image, or raw or npy"
+    " for a float32 matrix of a row per image, headerless or in .npy format.\n"
     "Note: you can extract multiple features in one pass by specifying"
     " multiple feature blob names and dataset names separated by ','."
     " The names cannot contain white space characters and the number of blobs"
@@ -118,64 +296,43 @@ int feature_extraction_pipeline(int argc, char** argv) {
 
   int num_mini_batches = atoi(argv[++arg_pos]);
 
-  std::vector<boost::shared_ptr<db::DB> > feature_dbs;
-  std::vector<boost::shared_ptr<db::Transaction> > txns;
+  std::vector<boost::shared_ptr<FeatureWriter<Dtype> > > writers;
   const char* db_type = argv[++arg_pos];
   for (size_t i = 0; i < num_features; ++i) {
     LOG(INFO)<< "Opening dataset " << dataset_names[i];
-    boost::shared_ptr<db::DB> db(db::GetDB(db_type));
-    db->Open(dataset_names.at(i), db::NEW);
-    feature_dbs.push_back(db);
-    boost::shared_ptr<db::Transaction> txn(db->NewTransaction());
-    txns.push_back(txn);
+    writers.push_back(boost::shared_ptr<FeatureWriter<Dtype> >(
+        GetFeatureWriter<Dtype>(db_type, dataset_names[i], blob_names[i])));
   }
 
   LOG(ERROR)<< "Extracting Features";
 
-  Datum datum;
-  std::vector<int> image_indices(num_features, 0);
+  // The features of a batch are copied out to free blobs and written by the
+  // writer thread while the net runs forward on the next batch. Two blobs per
+  // feature double-buffer them.
+  BlockingQueue<Blob<Dtype>*> full_blobs, free_blobs;
+  std::vector<boost::shared_ptr<Blob<Dtype> > > blobs(2 * num_features);
+  for (size_t i = 0; i < blobs.size(); ++i) {
+    blobs[i].reset(new Blob<Dtype>());
+    free_blobs.push(blobs[i].get());
+  }
+  boost::thread writer(boost::bind(&WriteFeatures<Dtype>, &full_blobs,
+      &free_blobs, &writers));
   for (int batch_index = 0; batch_index < num_mini_batches; ++batch_index) {
     feature_extraction_net->Forward();
     for (int i = 0; i < num_features; ++i) {
       const boost::shared_ptr<Blob<Dtype> > feature_blob =
         feature_extraction_net->blob_by_name(blob_names[i]);
-      int batch_size = feature_blob->num();
-      int dim_features = feature_blob->count() / batch_size;
-      const Dtype* feature_blob_data;
-      for (int n = 0; n < batch_size; ++n) {
-        datum.set_height(feature_blob->height());
-        datum.set_width(feature_blob->width());
-        datum.set_channels(feature_blob->channels());
-        datum.clear_data();
-        datum.clear_float_data();
-        feature_blob_data = feature_blob->cpu_data() +
-            feature_blob->offset(n);
-        for (int d = 0; d < dim_features; ++d) {
-          datum.add_float_data(feature_blob_data[d]);
-        }
-        string key_str = caffe::format_int(image_indices[i], 10);
-
-        string out;
-        CHECK(datum.SerializeToString(&out));
-        txns.at(i)->Put(key_str, out);
-        ++image_indices[i];
-        if (image_indices[i] % 1000 == 0) {
-          txns.at(i)->Commit();
-          txns.at(i).reset(feature_dbs.at(i)->NewTransaction());
-          LOG(ERROR)<< "Extracted features of " << image_indices[i] <<
-              " query images for feature blob " << blob_names[i];
-        }
-      }  // for (int n = 0; n < batch_size; ++n)
+      Blob<Dtype>* features = free_blobs.pop();
+      features->ReshapeLike(*feature_blob);
+      caffe::caffe_copy(feature_blob->count(), feature_blob->cpu_data(),
+          features->mutable_cpu_data());
+      full_blobs.push(features);
     }  // for (int i = 0; i < num_features; ++i)
   }  // for (int batch_index = 0; batch_index < num_mini_batches; ++batch_index)
-  // write the last batch
+  full_blobs.push(NULL);
+  writer.join();
   for (int i = 0; i < num_features; ++i) {
-    if (image_indices[i] % 1000 != 0) {
-      txns.at(i)->Commit();
-    }
-    LOG(ERROR)<< "Extracted features of " << image_indices[i] <<
-        " query images for feature blob " << blob_names[i];
-    feature_dbs.at(i)->Close();
+    writers[i]->Close();
   }
 
   LOG(ERROR)<< "Successfully extracted the features!";
@@ -0,0 +1,125 @@
+// This program rewrites a trained net for faster inference, folding
+// BatchNorm, Scale and Bias layers into the preceding Convolution or
+// InnerProduct layer and fusing ReLU and PReLU layers into its output (see
+// caffe/util/optimize_net.hpp), then checks that the rewritten net computes
+// the same outputs.
+// Usage:
+//    optimize_net [FLAGS] NET_PROTOTXT WEIGHTS OUT_PROTOTXT OUT_WEIGHTS
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/optimize_net.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+DEFINE_bool(verify, true,
+    "Check that the optimized net computes the same outputs on random inputs.");
+DEFINE_double(tolerance, 1e-4,
+    "The largest difference allowed between the outputs of the two nets, "
+    "relative to the largest output.");
+
+// Feeds both nets the same random inputs and returns the largest difference
+// between their outputs, relative to the largest output.
+static float OutputDifference(Net<float>* net, Net<float>* optimized_net) {
+  FillerParameter filler_param;
+  GaussianFiller<float> filler(filler_param);
+  CHECK_EQ(net->num_inputs(), optimized_net->num_inputs());
+  for (int i = 0; i < net->num_inputs(); ++i) {
+    filler.Fill(net->input_blobs()[i]);
+    optimized_net->input_blobs()[i]->CopyFrom(*net->input_blobs()[i]);
+  }
+  net->Forward();
+  optimized_net->Forward();
+  float max_difference = 0, max_output = 0;
+  for (int i = 0; i < net->num_outputs(); ++i) {
+    const string& name = net->blob_names()[net->output_blob_indices()[i]];
+    CHECK(optimized_net->has_blob(name)) << "Missing output " << name;
+    const Blob<float>& output = *net->output_blobs()[i];
+    const Blob<float>& optimized_output = *optimized_net->blob_by_name(name);
+    CHECK(output.shape() == optimized_output.shape())
+        << "Shape mismatch for output " << name;
+    for (int j = 0; j < output.count(); ++j) {
+      max_difference = std::max(max_difference,
+          std::fabs(output.cpu_data()[j] - optimized_output.cpu_data()[j]));
+      max_output = std::max(max_output, std::fabs(output.cpu_data()[j]));
+    }
+  }
+  return max_output > 0 ? max_difference / max_output : max_difference;
+}
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Optimize a trained net for inference\n"
+        "Usage:\n"
+        "    optimize_net [FLAGS] NET_PROTOTXT WEIGHTS OUT_PROTOTXT "
+        "OUT_WEIGHTS\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 5) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/optimize_net");
+    return 1;
+  }
+
+  Caffe::set_mode(Caffe::CPU);
+  Net<float> net(argv[1], caffe::TEST);
+  net.CopyTrainedLayersFrom(argv[2]);
+
+  // Attach the trained weights to the TEST phase layer definitions.
+  NetParameter param, filtered_param;
+  ReadNetParamsFromTextFileOrDie(argv[1], &param);
+  param.mutable_state()->set_phase(caffe::TEST);
+  Net<float>::FilterNet(param, &filtered_param);
+  for (int i = 0; i < filtered_param.layer_size(); ++i) {
+    LayerParameter* layer_param = filtered_param.mutable_layer(i);
+    const vector<shared_ptr<Blob<float> > >& blobs =
+        net.layer_by_name(layer_param->name())->blobs();
+    layer_param->clear_blobs();
+    for (int j = 0; j < blobs.size(); ++j) {
+      blobs[j]->ToProto(layer_param->add_blobs());
+    }
+  }
+
+  NetParameter optimized_param;
+  vector<string> removed_layers;
+  OptimizeNetForInference(filtered_param, &optimized_param, &removed_layers);
+  for (int i = 0; i < removed_layers.size(); ++i) {
+    LOG(INFO) << "Removed layer " << removed_layers[i];
+  }
+  LOG(INFO) << "Removed " << removed_layers.size() << " of "
+            << filtered_param.layer_size() << " layers.";
+
+  if (FLAGS_verify) {
+    if (net.num_inputs() == 0) {
+      LOG(WARNING) << "Not verifying the optimized net, as it has no inputs.";
+    } else {
+      Net<float> optimized_net(optimized_param);
+      const float difference = OutputDifference(&net, &optimized_net);
+      LOG(INFO) << "Largest relative output difference: " << difference;
+      CHECK_LE(difference, FLAGS_tolerance)
+          << "The optimized net doesn't compute the same outputs.";
+    }
+  }
+
+  WriteProtoToBinaryFile(optimized_param, argv[4]);
+  for (int i = 0; i < optimized_param.layer_size(); ++i) {
+    optimized_param.mutable_layer(i)->clear_blobs();
+  }
+  WriteProtoToTextFile(optimized_param, argv[3]);
+  LOG(INFO) << "Wrote the optimized net to " << argv[3] << " and " << argv[4];
+  return 0;
+}